@@ -0,0 +1,231 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CBufferPool.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// blocks of the small classes are carved from slabs
+static const size_t SMALL_CLASS_LIMIT = 1 << 20;
+static const size_t BLOCKS_PER_SLAB = 16;
+static const size_t MIN_CLASS_SIZE = 4096;
+
+///////////////////////////////////////////////////////////////////////////////
+// CBufferPool
+
+CBufferPool& CBufferPool::GetSingleton()
+{
+	static CBufferPool s_Instance;
+	return s_Instance;
+}
+
+CBufferPool::CBufferPool()
+	: m_CurrentBytes(0), m_PeakBytes(0), m_DeviceBytes(0), m_Hits(0), m_Misses(0)
+{
+}
+
+CBufferPool::~CBufferPool()
+{
+	// the contexts are released by the assignments before, nothing left to free
+}
+
+bool CBufferPool::SPoolKey::operator<(const SPoolKey& Other) const
+{
+	if(Context != Other.Context)
+		return Context < Other.Context;
+	if(Flags != Other.Flags)
+		return Flags < Other.Flags;
+	return ClassSize < Other.ClassSize;
+}
+
+size_t CBufferPool::GetClassSize(size_t Size) const
+{
+	size_t classSize = MIN_CLASS_SIZE;
+	while(classSize < Size)
+		classSize <<= 1;
+	return classSize;
+}
+
+CBufferPool::SContextInfo& CBufferPool::GetContextInfo(cl_context Context)
+{
+	map<cl_context, SContextInfo>::iterator it = m_Contexts.find(Context);
+	if(it != m_Contexts.end())
+		return it->second;
+
+	// sub-buffer origins have to be aligned for all devices of the context
+	SContextInfo info;
+	info.Alignment = MIN_CLASS_SIZE;
+	info.DeviceBytes = 0;
+
+	size_t devicesSize = 0;
+	clGetContextInfo(Context, CL_CONTEXT_DEVICES, 0, NULL, &devicesSize);
+	vector<cl_device_id> devices(devicesSize / sizeof(cl_device_id));
+	if(!devices.empty() && clGetContextInfo(Context, CL_CONTEXT_DEVICES, devicesSize, &devices[0], NULL) == CL_SUCCESS)
+	{
+		for(size_t i = 0; i < devices.size(); i++)
+		{
+			cl_uint alignBits = 0;
+			if(clGetDeviceInfo(devices[i], CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(alignBits), &alignBits, NULL) == CL_SUCCESS)
+				info.Alignment = max<size_t>(info.Alignment, alignBits / 8);
+		}
+	}
+
+	return m_Contexts[Context] = info;
+}
+
+cl_mem CBufferPool::AllocateBlock(const SPoolKey& Key, cl_int* Error)
+{
+	cl_int clError;
+	SContextInfo& info = GetContextInfo(Key.Context);
+
+	if(Key.ClassSize > SMALL_CLASS_LIMIT || Key.ClassSize % info.Alignment != 0)
+	{
+		cl_mem buffer = clCreateBuffer(Key.Context, Key.Flags, Key.ClassSize, NULL, &clError);
+		if(Error)
+			*Error = clError;
+		if(clError != CL_SUCCESS)
+			return NULL;
+		info.DeviceBytes += Key.ClassSize;
+		m_DeviceBytes += Key.ClassSize;
+		return buffer;
+	}
+
+	cl_mem slab = clCreateBuffer(Key.Context, Key.Flags, Key.ClassSize * BLOCKS_PER_SLAB, NULL, &clError);
+	if(Error)
+		*Error = clError;
+	if(clError != CL_SUCCESS)
+		return NULL;
+	info.Slabs.push_back(slab);
+	info.DeviceBytes += Key.ClassSize * BLOCKS_PER_SLAB;
+	m_DeviceBytes += Key.ClassSize * BLOCKS_PER_SLAB;
+
+	// the blocks inherit the flags of the slab
+	vector<cl_mem>& freeBlocks = m_FreeBlocks[Key];
+	cl_mem first = NULL;
+	for(size_t i = 0; i < BLOCKS_PER_SLAB; i++)
+	{
+		cl_buffer_region region = {i * Key.ClassSize, Key.ClassSize};
+		cl_mem block = clCreateSubBuffer(slab, 0, CL_BUFFER_CREATE_TYPE_REGION, &region, &clError);
+		if(clError != CL_SUCCESS)
+			break;
+		if(first == NULL)
+			first = block;
+		else
+			freeBlocks.push_back(block);
+	}
+
+	if(Error)
+		*Error = first ? CL_SUCCESS : clError;
+	return first;
+}
+
+cl_mem CBufferPool::Acquire(cl_context Context, cl_mem_flags Flags, size_t Size, cl_int* Error)
+{
+	// buffers backed by host memory are tied to their host pointer
+	if(Flags & (CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR))
+	{
+		if(Error)
+			*Error = CL_INVALID_VALUE;
+		return NULL;
+	}
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	SPoolKey key = {Context, Flags, GetClassSize(max<size_t>(Size, 1))};
+
+	cl_mem buffer = NULL;
+	vector<cl_mem>& freeBlocks = m_FreeBlocks[key];
+	if(!freeBlocks.empty())
+	{
+		buffer = freeBlocks.back();
+		freeBlocks.pop_back();
+		m_Hits++;
+		if(Error)
+			*Error = CL_SUCCESS;
+	}
+	else
+	{
+		buffer = AllocateBlock(key, Error);
+		if(buffer == NULL)
+			return NULL;
+		m_Misses++;
+	}
+
+	m_UsedBlocks[buffer] = key;
+	m_CurrentBytes += key.ClassSize;
+	m_PeakBytes = max(m_PeakBytes, m_CurrentBytes);
+	return buffer;
+}
+
+void CBufferPool::Release(cl_mem Buffer)
+{
+	if(Buffer == NULL)
+		return;
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	map<cl_mem, SPoolKey>::iterator it = m_UsedBlocks.find(Buffer);
+	if(it == m_UsedBlocks.end())
+	{
+		clReleaseMemObject(Buffer);
+		return;
+	}
+
+	SPoolKey key = it->second;
+	m_UsedBlocks.erase(it);
+	m_CurrentBytes -= key.ClassSize;
+
+	if(m_Contexts.find(key.Context) == m_Contexts.end())
+	{
+		// the context was cleared while the buffer was in use
+		clReleaseMemObject(Buffer);
+		return;
+	}
+	m_FreeBlocks[key].push_back(Buffer);
+}
+
+void CBufferPool::Clear(cl_context Context)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	for(map<SPoolKey, vector<cl_mem> >::iterator it = m_FreeBlocks.begin(); it != m_FreeBlocks.end(); )
+	{
+		if(it->first.Context != Context)
+		{
+			++it;
+			continue;
+		}
+
+		for(size_t i = 0; i < it->second.size(); i++)
+			clReleaseMemObject(it->second[i]);
+		m_FreeBlocks.erase(it++);
+	}
+
+	// sub-buffers keep their slab alive, so the slab handles can go now
+	map<cl_context, SContextInfo>::iterator info = m_Contexts.find(Context);
+	if(info != m_Contexts.end())
+	{
+		for(size_t i = 0; i < info->second.Slabs.size(); i++)
+			clReleaseMemObject(info->second.Slabs[i]);
+		m_DeviceBytes -= info->second.DeviceBytes;
+		m_Contexts.erase(info);
+	}
+}
+
+void CBufferPool::PrintStats() const
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	if(m_Hits + m_Misses == 0)
+		return;
+
+	cout << "Buffer pool: " << m_Hits << " reused, " << m_Misses << " allocated, peak " << m_PeakBytes / 1024 << " KB in use, "
+		<< m_DeviceBytes / 1024 << " KB on the device" << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
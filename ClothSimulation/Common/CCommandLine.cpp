@@ -0,0 +1,89 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CCommandLine.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CCommandLine
+
+void CCommandLine::Parse(int argc, char** argv)
+{
+	m_Options.clear();
+
+	for(int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if(arg.compare(0, 2, "--") != 0)
+		{
+			cerr << "Warning: ignoring unknown command line argument '" << arg << "'." << endl;
+			continue;
+		}
+
+		arg = arg.substr(2);
+		size_t separator = arg.find('=');
+		if(separator != string::npos)
+			m_Options[arg.substr(0, separator)] = arg.substr(separator + 1);
+		else if(i + 1 < argc && string(argv[i + 1]).compare(0, 2, "--") != 0)
+			m_Options[arg] = argv[++i];
+		else
+			m_Options[arg] = "";
+	}
+}
+
+bool CCommandLine::Lookup(const std::string& Name, const char* EnvName, std::string& Value) const
+{
+	auto it = m_Options.find(Name);
+	if(it != m_Options.end())
+	{
+		Value = it->second;
+		return true;
+	}
+
+	const char* env = EnvName ? getenv(EnvName) : nullptr;
+	if(env)
+	{
+		Value = env;
+		return true;
+	}
+
+	return false;
+}
+
+bool CCommandLine::HasOption(const std::string& Name, const char* EnvName) const
+{
+	string value;
+	return Lookup(Name, EnvName, value);
+}
+
+std::string CCommandLine::GetString(const std::string& Name, const std::string& Default, const char* EnvName) const
+{
+	string value;
+	if(!Lookup(Name, EnvName, value) || value.empty())
+		return Default;
+	return value;
+}
+
+int CCommandLine::GetInt(const std::string& Name, int Default, const char* EnvName) const
+{
+	string value;
+	if(!Lookup(Name, EnvName, value) || value.empty())
+		return Default;
+	return atoi(value.c_str());
+}
+
+double CCommandLine::GetDouble(const std::string& Name, double Default, const char* EnvName) const
+{
+	string value;
+	if(!Lookup(Name, EnvName, value) || value.empty())
+		return Default;
+	return atof(value.c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -34,6 +34,37 @@
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <functional>
+
+//! Distribution of one device-side interval over a series of kernel launches (in milliseconds)
+/*!
+	The mean is taken without outliers, see CStatistics::GetRobustMean().
+*/
+struct SProfileInterval
+{
+	double Min;
+	double Median;
+	double P95;
+	double P99;
+	double Max;
+	double Mean;
+};
+
+//! Per-launch device timestamps of a kernel, summarized by CLUtil::ProfileKernelEvents()
+/*!
+	QueuedToSubmit and SubmitToStart together make up the launch latency,
+	StartToEnd is the actual execution time of the kernel on the device.
+	If HostTimed is set, the queue had no profiling support: StartToEnd then holds the average
+	of the batch measured on the host (including the launch overhead) and the latencies are zero.
+*/
+struct SKernelProfile
+{
+	SProfileInterval QueuedToSubmit;
+	SProfileInterval SubmitToStart;
+	SProfileInterval StartToEnd;
+	int NIterations;
+	bool HostTimed;
+};
 
 //! Utility class for frequently-needed OpenCL tasks
 // TO DO: replace this with a nicer OpenCL wrapper
@@ -43,6 +74,9 @@ public:
 	//! Determines the OpenCL global work size given the number of data elements and threads per workgroup
 	static size_t GetGlobalWorkSize(size_t DataElemCount, size_t LocalWorkSize);
 
+	//! The smallest power of two not less than Value, e.g. the local size of a last pass over Value elements
+	static size_t GetNextPowerOfTwo(size_t Value);
+
 	//! Loads a program source to memory as a string
 	static bool LoadProgramSourceToMemory(const std::string& Path, std::string& SourceCode);
 
@@ -51,14 +85,64 @@ public:
 
 	static void PrintBuildLog(cl_program Program, cl_device_id Device);
 
+	//! Enables or disables the on-disk cache of program binaries used by BuildCLProgramFromMemory()
+	/*!
+		The cache is enabled by default and can also be disabled by setting the environment variable GPU_CL_CACHE=0.
+		Binaries are keyed by a hash of the source code, the compile options, the platform and device name and the
+		driver version, so a driver update or a changed kernel never picks up a stale binary.
+	*/
+	static void SetProgramCacheEnabled(bool Enabled);
+
+	//! Sets the directory of the program binary cache (default: $GPU_CL_CACHE_DIR, or "clcache" in the working directory)
+	static void SetProgramCacheDirectory(const std::string& Directory);
+
+	static unsigned int GetProgramCacheHits();
+	static unsigned int GetProgramCacheMisses();
+
+	//! Prints the hit/miss counters of the program binary cache (if it was used at all)
+	static void PrintProgramCacheStats();
+
 	//! Measures the execution time of a kernel by executing it N times and returning the average time in milliseconds.
 	/*!
 		The scheduling cost of the kernel can be amortized if we enqueue
 		the kernel multiple times. If your kernel is simple and fast, use a high number of iterations!		
+		One untimed launch comes first, so the average does not contain the first-launch costs.
+		There is no confidence interval, use ProfileKernelEvents() for per-launch samples.
 	*/
 	static double ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, 
 		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations);
 
+	//! Measures a kernel N times using the device timestamps of a cl_event attached to each launch.
+	/*!
+		Requires a command queue created with CL_QUEUE_PROFILING_ENABLE. In contrast to ProfileKernel()
+		the results do not contain host-side enqueue overhead, and the launch latency is reported separately
+		from the kernel execution time. Without profiling support the batch is timed on the host instead
+		(see SKernelProfile::HostTimed). Returns false if a launch failed.
+	*/
+	static bool ProfileKernelEvents(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions,
+		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations, SKernelProfile& Profile);
+
+	//! Enqueues an arbitrary command N times and profiles it like ProfileKernelEvents()
+	/*!
+		Enqueue is called once per iteration and has to attach the given event to the
+		command it enqueues (e.g. a buffer transfer), it returns the OpenCL error code.
+		If a trace is recorded, each command appears as TraceName on the track of the queue (see CTracer).
+	*/
+	static bool ProfileCommandEvents(cl_command_queue CommandQueue, const std::function<cl_int(cl_event* Event)>& Enqueue,
+		int NIterations, SKernelProfile& Profile, const std::string& TraceName = "Command");
+
+	//! Prints the interval distributions of a kernel profile, one line per interval
+	static void PrintKernelProfile(const std::string& KernelName, const SKernelProfile& Profile);
+
+	//! Returns true if the command queue was created with CL_QUEUE_PROFILING_ENABLE
+	static bool IsProfilingEnabled(cl_command_queue CommandQueue);
+
+	//! Returns true if the device lists the extension (e.g. "cl_khr_fp64") in CL_DEVICE_EXTENSIONS
+	static bool HasDeviceExtension(cl_device_id Device, const std::string& Extension);
+
+	//! The CL_DEVICE_OPENCL_C_VERSION of the device as major * 100 + minor * 10 (e.g. 120, 200), 0 on errors
+	static unsigned int GetDeviceCVersion(cl_device_id Device);
+
 	static const char* GetCLErrorString(cl_int CLErrorCode);
 };
 
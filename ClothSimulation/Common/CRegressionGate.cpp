@@ -0,0 +1,315 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CRegressionGate.h"
+#include "CResultsSink.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CRegressionGate
+
+// Reads the flat objects written by CResultsSink::WriteJSON(), arrays are kept as text
+static bool ParseJSONFields(const string& Line, map<string, string>& Fields)
+{
+	size_t pos = Line.find('{');
+	if(pos == string::npos)
+		return false;
+	pos++;
+
+	while(pos < Line.size())
+	{
+		size_t keyBegin = Line.find('"', pos);
+		if(keyBegin == string::npos)
+			break;
+		size_t keyEnd = Line.find('"', keyBegin + 1);
+		size_t colon = keyEnd == string::npos ? string::npos : Line.find(':', keyEnd);
+		if(colon == string::npos)
+			return false;
+		string key = Line.substr(keyBegin + 1, keyEnd - keyBegin - 1);
+
+		pos = Line.find_first_not_of(" \t", colon + 1);
+		if(pos == string::npos)
+			return false;
+
+		string value;
+		if(Line[pos] == '"')
+		{
+			for(pos++; pos < Line.size() && Line[pos] != '"'; pos++)
+			{
+				if(Line[pos] == '\\' && pos + 1 < Line.size())
+					pos++;
+				value += Line[pos];
+			}
+			pos++;
+		}
+		else
+		{
+			size_t end = Line[pos] == '[' ? Line.find(']', pos) + 1 : Line.find_first_of(",}", pos);
+			if(end == string::npos || end == 0)
+				return false;
+			value = Line.substr(pos, end - pos);
+			pos = end;
+		}
+		Fields[key] = value;
+
+		pos = Line.find_first_of(",}", pos);
+		if(pos == string::npos || Line[pos] == '}')
+			break;
+		pos++;
+	}
+	return true;
+}
+
+// Splits a line written by CResultsSink::WriteCSV(), quoted fields may contain commas and "" for quotes
+static vector<string> ParseCSVFields(const string& Line)
+{
+	vector<string> fields(1);
+	bool quoted = false;
+	for(size_t i = 0; i < Line.size(); i++)
+	{
+		char c = Line[i];
+		if(quoted)
+		{
+			if(c == '"' && i + 1 < Line.size() && Line[i + 1] == '"')
+				fields.back() += Line[++i];
+			else if(c == '"')
+				quoted = false;
+			else
+				fields.back() += c;
+		}
+		else if(c == '"')
+			quoted = true;
+		else if(c == ',')
+			fields.push_back(string());
+		else if(c != '\r')
+			fields.back() += c;
+	}
+	return fields;
+}
+
+// The local work size as it appears in the comparison, e.g. "256x1x1"
+static string FormatLocalWorkSize(size_t X, size_t Y, size_t Z)
+{
+	stringstream s;
+	s << X << "x" << Y << "x" << Z;
+	return s.str();
+}
+
+CRegressionGate& CRegressionGate::GetSingleton()
+{
+	static CRegressionGate s_Instance;
+	return s_Instance;
+}
+
+CRegressionGate::CRegressionGate()
+	: m_Enabled(false), m_ThresholdPercent(5.0), m_Alpha(0.01)
+{
+}
+
+bool CRegressionGate::LoadBaseline(const std::string& Path, const std::string& DeviceName)
+{
+	m_Enabled = false;
+	m_Path = Path;
+	m_Baseline.clear();
+	m_Current.clear();
+	m_InvalidTasks.clear();
+
+	ifstream file(Path.c_str());
+	if(!file.good())
+	{
+		cerr << "Error: cannot open the baseline file '" << Path << "'." << endl;
+		return false;
+	}
+
+	vector<string> header;
+	size_t nSamples = 0;
+	string line;
+	while(getline(file, line))
+	{
+		size_t first = line.find_first_not_of(" \t\r");
+		if(first == string::npos)
+			continue;
+
+		map<string, string> fields;
+		if(line[first] == '{')
+		{
+			if(!ParseJSONFields(line, fields))
+				continue;
+		}
+		else
+		{
+			vector<string> values = ParseCSVFields(line);
+			// every file starts with a header, but appended files may repeat it
+			if(!values.empty() && values[0] == "timestamp")
+			{
+				header = values;
+				continue;
+			}
+			for(size_t i = 0; i < header.size() && i < values.size(); i++)
+				fields[header[i]] = values[i];
+		}
+
+		if(AddBaselineSample(fields, DeviceName))
+			nSamples++;
+	}
+
+	if(nSamples == 0)
+	{
+		cerr << "Error: the baseline file '" << Path << "' contains no valid results of the device '" << DeviceName << "'." << endl;
+		return false;
+	}
+
+	cout << "Regression baseline: " << nSamples << " samples of " << m_Baseline.size() << " results from '" << Path << "'" << endl;
+	m_Enabled = true;
+	return true;
+}
+
+bool CRegressionGate::AddBaselineSample(const std::map<std::string, std::string>& Fields, const std::string& DeviceName)
+{
+	const char* required[] = { "task", "variant", "device", "problem_size", "mean_ms", "valid" };
+	for(size_t i = 0; i < sizeof(required) / sizeof(required[0]); i++)
+	{
+		if(Fields.find(required[i]) == Fields.end())
+			return false;
+	}
+
+	const string& valid = Fields.at("valid");
+	double meanMs = atof(Fields.at("mean_ms").c_str());
+	if(Fields.at("device") != DeviceName || (valid != "true" && valid != "1") || meanMs <= 0.0)
+		return false;
+
+	// JSON Lines keep the local work size as "[x,y,z]", CSV files have a column per dimension
+	size_t local[3] = { 0, 0, 0 };
+	auto json = Fields.find("local_work_size");
+	if(json != Fields.end())
+	{
+		stringstream s(json->second);
+		char separator;
+		s >> separator >> local[0] >> separator >> local[1] >> separator >> local[2];
+	}
+	else if(Fields.count("lws_x") && Fields.count("lws_y") && Fields.count("lws_z"))
+	{
+		local[0] = (size_t)strtoull(Fields.at("lws_x").c_str(), NULL, 10);
+		local[1] = (size_t)strtoull(Fields.at("lws_y").c_str(), NULL, 10);
+		local[2] = (size_t)strtoull(Fields.at("lws_z").c_str(), NULL, 10);
+	}
+
+	ResultKey key(Fields.at("task"), Fields.at("variant"), (size_t)strtoull(Fields.at("problem_size").c_str(), NULL, 10),
+		FormatLocalWorkSize(local[0], local[1], local[2]));
+	m_Baseline[key].Add(meanMs);
+	return true;
+}
+
+void CRegressionGate::SetThreshold(double Percent, double Alpha)
+{
+	m_ThresholdPercent = max(Percent, 0.0);
+	m_Alpha = min(max(Alpha, 1.0e-6), 0.5);
+}
+
+void CRegressionGate::AddResults(const std::string& TaskName, const std::vector<SBenchmarkResult>& Results, bool Valid)
+{
+	if(!m_Enabled)
+		return;
+
+	if(!Valid)
+	{
+		m_InvalidTasks.insert(TaskName);
+		return;
+	}
+
+	for(size_t i = 0; i < Results.size(); i++)
+	{
+		if(Results[i].MeanMs > 0.0)
+		{
+			const size_t* local = Results[i].LocalWorkSize;
+			m_Current[ResultKey(TaskName, Results[i].Variant, Results[i].ProblemSize,
+				FormatLocalWorkSize(local[0], local[1], local[2]))].Add(Results[i].MeanMs);
+		}
+	}
+}
+
+bool CRegressionGate::Evaluate() const
+{
+	if(!m_Enabled)
+		return true;
+
+	ios::fmtflags flags = cout.flags();
+	streamsize precision = cout.precision();
+	cout << endl << "########################################" << endl;
+	cout << "Regression check against '" << m_Path << "' (threshold " << m_ThresholdPercent << "%, "
+		<< 100.0 * (1.0 - m_Alpha) << "% confidence):" << endl;
+
+	size_t nRegressions = 0, nCompared = 0;
+	for(auto it = m_Current.begin(); it != m_Current.end(); ++it)
+	{
+		const CStatistics& current = it->second;
+		cout << "  " << get<0>(it->first) << " / " << get<1>(it->first) << " / " << get<2>(it->first) << " / local " << get<3>(it->first) << ": ";
+
+		auto base = m_Baseline.find(it->first);
+		if(base == m_Baseline.end())
+		{
+			cout << "no baseline" << endl;
+			continue;
+		}
+		const CStatistics& baseline = base->second;
+		nCompared++;
+
+		// Welch's t-test, the variance of a side with a single sample is taken from the other one
+		double varBase = baseline.GetCount() > 1 ? baseline.GetVariance() : current.GetVariance();
+		double varCurrent = current.GetCount() > 1 ? current.GetVariance() : baseline.GetVariance();
+		double seBase = varBase / double(baseline.GetCount());
+		double seCurrent = varCurrent / double(current.GetCount());
+		double se = sqrt(seBase + seCurrent);
+		double diff = current.GetMean() - baseline.GetMean();
+		double slowdown = 100.0 * diff / baseline.GetMean();
+
+		bool tested = baseline.GetCount() + current.GetCount() > 2 && se > 0.0;
+		double pValue = diff > 0.0 ? 0.0 : 1.0;
+		double margin = 0.0;
+		if(tested)
+		{
+			// Welch-Satterthwaite approximation of the degrees of freedom
+			double dofBase = baseline.GetCount() > 1 ? double(baseline.GetCount() - 1) : double(current.GetCount() - 1);
+			double dofCurrent = current.GetCount() > 1 ? double(current.GetCount() - 1) : double(baseline.GetCount() - 1);
+			double dof = (seBase + seCurrent) * (seBase + seCurrent) / (seBase * seBase / dofBase + seCurrent * seCurrent / dofCurrent);
+
+			pValue = 1.0 - CStatistics::GetStudentTCDF(diff / se, dof);
+			margin = 100.0 * CStatistics::GetStudentTQuantile(1.0 - 0.5 * m_Alpha, dof) * se / baseline.GetMean();
+		}
+
+		bool regression = slowdown > m_ThresholdPercent && pValue < m_Alpha;
+		if(regression)
+			nRegressions++;
+
+		cout << fixed << setprecision(4) << baseline.GetMean() << " -> " << current.GetMean() << " ms ("
+			<< showpos << setprecision(1) << slowdown << "%";
+		if(tested)
+			cout << ", CI [" << slowdown - margin << "%, " << slowdown + margin << "%]" << noshowpos << setprecision(4) << ", p = " << pValue;
+		else
+			cout << noshowpos << ", untested";
+		cout << ", n = " << baseline.GetCount() << "/" << current.GetCount() << ")" << (regression ? " REGRESSION" : "") << endl;
+		cout.flags(flags);
+		cout.precision(precision);
+	}
+
+	for(auto it = m_InvalidTasks.begin(); it != m_InvalidTasks.end(); ++it)
+		cout << "  " << *it << ": INVALID RESULTS" << endl;
+
+	bool passed = nRegressions == 0 && m_InvalidTasks.empty();
+	cout << (passed ? "PASSED" : "FAILED") << ": " << nCompared << " results compared, " << nRegressions << " regression(s), "
+		<< m_InvalidTasks.size() << " invalid task(s)" << endl;
+	return passed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,27 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+// Kernel table compiled with -mavx2 (/arch:AVX2), see CMakeLists.txt
+
+#include "CSimdKernels.h"
+
+#ifdef SIMD_HAS_AVX2
+
+const SSimdKernels* GetSimdKernelsAVX2()
+{
+	static const SSimdKernels s_Kernels = MakeSimdKernels<SAVX2Traits>(SIMD_AVX2);
+	return &s_Kernels;
+}
+
+#else
+
+const SSimdKernels* GetSimdKernelsAVX2()
+{
+	return NULL;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,33 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+// Kernel table compiled with -mavx512f (/arch:AVX512), see CMakeLists.txt
+
+// GCC 12 warns about the uninitialized placeholders inside of its own AVX-512 intrinsics
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic ignored "-Wuninitialized"
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#include "CSimdKernels.h"
+
+#ifdef SIMD_HAS_AVX512
+
+const SSimdKernels* GetSimdKernelsAVX512()
+{
+	static const SSimdKernels s_Kernels = MakeSimdKernels<SAVX512Traits>(SIMD_AVX512);
+	return &s_Kernels;
+}
+
+#else
+
+const SSimdKernels* GetSimdKernelsAVX512()
+{
+	return NULL;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,449 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CSIMD_KERNELS_H
+#define _CSIMD_KERNELS_H
+
+// Implementation of the kernel tables of CSimd.h. This header is only included by the
+// CSimd<Level>.cpp files, which are compiled with the compiler flags of their instruction set.
+// Everything is in an unnamed namespace: if the linker merged an inline function of the AVX2
+// file into the scalar one, the scalar code would crash on hosts without AVX2.
+
+#include "CSimd.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SIMD_HAS_SSE2
+	#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+	#define SIMD_HAS_AVX2
+	#include <immintrin.h>
+#endif
+#if defined(__AVX512F__)
+	#define SIMD_HAS_AVX512
+	#include <immintrin.h>
+#endif
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+// Traits: vector types and operations of one instruction set
+//
+// W:				number of lanes
+// F / I:			float / unsigned int vector
+// PrefixI():		inclusive prefix sum inside of one vector
+// RotateBlock():	rotates a RotateW x RotateW block clockwise
+
+struct SScalarTraits
+{
+	enum { W = 1, RotateW = 1 };
+	typedef float F;
+	typedef unsigned int I;
+
+	static F LoadF(const float* P) { return *P; }
+	static void StoreF(float* P, F V) { *P = V; }
+	static F SetF(float V) { return V; }
+	static F ZeroF() { return 0.0f; }
+	static F AddF(F A, F B) { return A + B; }
+	static F MulF(F A, F B) { return A * B; }
+	static F MinF(F A, F B) { return B < A ? B : A; }
+	static F MaxF(F A, F B) { return A < B ? B : A; }
+
+	static I LoadI(const unsigned int* P) { return *P; }
+	static void StoreI(unsigned int* P, I V) { *P = V; }
+	static I SetI(unsigned int V) { return V; }
+	static I ZeroI() { return 0; }
+	static I AddI(I A, I B) { return A + B; }
+	static I AndI(I A, I B) { return A & B; }
+	static I ShiftRight16I(I V) { return V >> 16; }
+	static I PrefixI(I V) { return V; }
+	static I BroadcastLastI(I V) { return V; }
+	static unsigned int HSumI(I V) { return V; }
+	static I TruncI(F V) { return (unsigned int)(int)V; }
+
+	static void RotateBlock(const float* Src, size_t SrcStride, float* Dst, size_t DstStride)
+	{
+		(void)SrcStride; (void)DstStride;
+		*Dst = *Src;
+	}
+};
+
+#ifdef SIMD_HAS_SSE2
+struct SSSE2Traits
+{
+	enum { W = 4, RotateW = 4 };
+	typedef __m128 F;
+	typedef __m128i I;
+
+	static F LoadF(const float* P) { return _mm_loadu_ps(P); }
+	static void StoreF(float* P, F V) { _mm_storeu_ps(P, V); }
+	static F SetF(float V) { return _mm_set1_ps(V); }
+	static F ZeroF() { return _mm_setzero_ps(); }
+	static F AddF(F A, F B) { return _mm_add_ps(A, B); }
+	static F MulF(F A, F B) { return _mm_mul_ps(A, B); }
+	static F MinF(F A, F B) { return _mm_min_ps(A, B); }
+	static F MaxF(F A, F B) { return _mm_max_ps(A, B); }
+
+	static I LoadI(const unsigned int* P) { return _mm_loadu_si128((const __m128i*)P); }
+	static void StoreI(unsigned int* P, I V) { _mm_storeu_si128((__m128i*)P, V); }
+	static I SetI(unsigned int V) { return _mm_set1_epi32((int)V); }
+	static I ZeroI() { return _mm_setzero_si128(); }
+	static I AddI(I A, I B) { return _mm_add_epi32(A, B); }
+	static I AndI(I A, I B) { return _mm_and_si128(A, B); }
+	static I ShiftRight16I(I V) { return _mm_srli_epi32(V, 16); }
+	static I PrefixI(I V)
+	{
+		V = _mm_add_epi32(V, _mm_slli_si128(V, 4));
+		return _mm_add_epi32(V, _mm_slli_si128(V, 8));
+	}
+	static I BroadcastLastI(I V) { return _mm_shuffle_epi32(V, _MM_SHUFFLE(3, 3, 3, 3)); }
+	static unsigned int HSumI(I V)
+	{
+		V = _mm_add_epi32(V, _mm_shuffle_epi32(V, _MM_SHUFFLE(1, 0, 3, 2)));
+		V = _mm_add_epi32(V, _mm_shuffle_epi32(V, _MM_SHUFFLE(2, 3, 0, 1)));
+		return (unsigned int)_mm_cvtsi128_si32(V);
+	}
+	static I TruncI(F V) { return _mm_cvttps_epi32(V); }
+
+	static void RotateBlock(const float* Src, size_t SrcStride, float* Dst, size_t DstStride)
+	{
+		__m128 r0 = _mm_loadu_ps(Src);
+		__m128 r1 = _mm_loadu_ps(Src + SrcStride);
+		__m128 r2 = _mm_loadu_ps(Src + 2 * SrcStride);
+		__m128 r3 = _mm_loadu_ps(Src + 3 * SrcStride);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		// the rows of the rotated block are the reversed columns
+		_mm_storeu_ps(Dst, _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(0, 1, 2, 3)));
+		_mm_storeu_ps(Dst + DstStride, _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(0, 1, 2, 3)));
+		_mm_storeu_ps(Dst + 2 * DstStride, _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(0, 1, 2, 3)));
+		_mm_storeu_ps(Dst + 3 * DstStride, _mm_shuffle_ps(r3, r3, _MM_SHUFFLE(0, 1, 2, 3)));
+	}
+};
+#endif // SIMD_HAS_SSE2
+
+#ifdef SIMD_HAS_AVX2
+struct SAVX2Traits
+{
+	enum { W = 8, RotateW = 8 };
+	typedef __m256 F;
+	typedef __m256i I;
+
+	static F LoadF(const float* P) { return _mm256_loadu_ps(P); }
+	static void StoreF(float* P, F V) { _mm256_storeu_ps(P, V); }
+	static F SetF(float V) { return _mm256_set1_ps(V); }
+	static F ZeroF() { return _mm256_setzero_ps(); }
+	static F AddF(F A, F B) { return _mm256_add_ps(A, B); }
+	static F MulF(F A, F B) { return _mm256_mul_ps(A, B); }
+	static F MinF(F A, F B) { return _mm256_min_ps(A, B); }
+	static F MaxF(F A, F B) { return _mm256_max_ps(A, B); }
+
+	static I LoadI(const unsigned int* P) { return _mm256_loadu_si256((const __m256i*)P); }
+	static void StoreI(unsigned int* P, I V) { _mm256_storeu_si256((__m256i*)P, V); }
+	static I SetI(unsigned int V) { return _mm256_set1_epi32((int)V); }
+	static I ZeroI() { return _mm256_setzero_si256(); }
+	static I AddI(I A, I B) { return _mm256_add_epi32(A, B); }
+	static I AndI(I A, I B) { return _mm256_and_si256(A, B); }
+	static I ShiftRight16I(I V) { return _mm256_srli_epi32(V, 16); }
+	static I PrefixI(I V)
+	{
+		// prefix sums of both 128 bit lanes, then the total of the lower lane is added to the upper one
+		V = _mm256_add_epi32(V, _mm256_slli_si256(V, 4));
+		V = _mm256_add_epi32(V, _mm256_slli_si256(V, 8));
+		__m256i lowerTotal = _mm256_shuffle_epi32(_mm256_permute2x128_si256(V, V, 0x08), _MM_SHUFFLE(3, 3, 3, 3));
+		return _mm256_add_epi32(V, lowerTotal);
+	}
+	static I BroadcastLastI(I V) { return _mm256_permutevar8x32_epi32(V, _mm256_set1_epi32(7)); }
+	static unsigned int HSumI(I V)
+	{
+		__m128i s = _mm_add_epi32(_mm256_castsi256_si128(V), _mm256_extracti128_si256(V, 1));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+		return (unsigned int)_mm_cvtsi128_si32(s);
+	}
+	static I TruncI(F V) { return _mm256_cvttps_epi32(V); }
+
+	static void RotateBlock(const float* Src, size_t SrcStride, float* Dst, size_t DstStride)
+	{
+		__m256 r[8], t[8];
+		for(int i = 0; i < 8; i++)
+			r[i] = _mm256_loadu_ps(Src + i * SrcStride);
+
+		// 8x8 transpose: interleave pairs, then quads, then exchange the 128 bit lanes
+		for(int i = 0; i < 8; i += 2)
+		{
+			t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+			t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+		}
+		for(int i = 0; i < 8; i += 4)
+		{
+			r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+			r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+			r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+			r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+		}
+		for(int i = 0; i < 4; i++)
+		{
+			t[i] = _mm256_permute2f128_ps(r[i], r[i + 4], 0x20);
+			t[i + 4] = _mm256_permute2f128_ps(r[i], r[i + 4], 0x31);
+		}
+
+		// the rows of the rotated block are the reversed columns
+		const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+		for(int i = 0; i < 8; i++)
+			_mm256_storeu_ps(Dst + i * DstStride, _mm256_permutevar8x32_ps(t[i], reverse));
+	}
+};
+#endif // SIMD_HAS_AVX2
+
+#ifdef SIMD_HAS_AVX512
+struct SAVX512Traits
+{
+	// the rotation uses the 8x8 blocks of AVX2, a 16x16 transpose needs too many registers to pay off
+	enum { W = 16, RotateW = 8 };
+	typedef __m512 F;
+	typedef __m512i I;
+
+	static F LoadF(const float* P) { return _mm512_loadu_ps(P); }
+	static void StoreF(float* P, F V) { _mm512_storeu_ps(P, V); }
+	static F SetF(float V) { return _mm512_set1_ps(V); }
+	static F ZeroF() { return _mm512_setzero_ps(); }
+	static F AddF(F A, F B) { return _mm512_add_ps(A, B); }
+	static F MulF(F A, F B) { return _mm512_mul_ps(A, B); }
+	static F MinF(F A, F B) { return _mm512_min_ps(A, B); }
+	static F MaxF(F A, F B) { return _mm512_max_ps(A, B); }
+
+	static I LoadI(const unsigned int* P) { return _mm512_loadu_si512((const void*)P); }
+	static void StoreI(unsigned int* P, I V) { _mm512_storeu_si512((void*)P, V); }
+	static I SetI(unsigned int V) { return _mm512_set1_epi32((int)V); }
+	static I ZeroI() { return _mm512_setzero_si512(); }
+	static I AddI(I A, I B) { return _mm512_add_epi32(A, B); }
+	static I AndI(I A, I B) { return _mm512_and_si512(A, B); }
+	static I ShiftRight16I(I V) { return _mm512_srli_epi32(V, 16); }
+	static I PrefixI(I V)
+	{
+		// alignr with a zero vector shifts the elements up by 1, 2, 4 and 8 lanes
+		const __m512i zero = _mm512_setzero_si512();
+		V = _mm512_add_epi32(V, _mm512_alignr_epi32(V, zero, 15));
+		V = _mm512_add_epi32(V, _mm512_alignr_epi32(V, zero, 14));
+		V = _mm512_add_epi32(V, _mm512_alignr_epi32(V, zero, 12));
+		return _mm512_add_epi32(V, _mm512_alignr_epi32(V, zero, 8));
+	}
+	static I BroadcastLastI(I V) { return _mm512_permutexvar_epi32(_mm512_set1_epi32(15), V); }
+	static unsigned int HSumI(I V) { return (unsigned int)_mm512_reduce_add_epi32(V); }
+	static I TruncI(F V) { return _mm512_cvttps_epi32(V); }
+
+	static void RotateBlock(const float* Src, size_t SrcStride, float* Dst, size_t DstStride)
+	{
+		SAVX2Traits::RotateBlock(Src, SrcStride, Dst, DstStride);
+	}
+};
+#endif // SIMD_HAS_AVX512
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels, written once for all traits
+
+template<class T>
+unsigned int SimdSumU32(const unsigned int* Data, size_t N)
+{
+	// two accumulators hide the latency of the additions
+	typename T::I acc0 = T::ZeroI(), acc1 = T::ZeroI();
+	size_t i = 0;
+	for(; i + 2 * T::W <= N; i += 2 * T::W)
+	{
+		acc0 = T::AddI(acc0, T::LoadI(Data + i));
+		acc1 = T::AddI(acc1, T::LoadI(Data + i + T::W));
+	}
+
+	unsigned int sum = T::HSumI(T::AddI(acc0, acc1));
+	for(; i < N; i++)
+		sum += Data[i];
+	return sum;
+}
+
+template<class T>
+unsigned long long SimdSumU64(const unsigned int* Data, size_t N)
+{
+	// the lower and upper 16 bits are summed in separate 32 bit lanes. Blocks of 65536 values
+	// overflow neither the lanes nor their horizontal sum, so only the block sums need 64 bit.
+	const size_t BlockSize = 65536;
+	typename T::I mask = T::SetI(0xFFFF);
+	unsigned long long sum = 0;
+	size_t i = 0;
+	while(i + T::W <= N)
+	{
+		size_t blockEnd = (N - i > BlockSize) ? i + BlockSize : N;
+		typename T::I lower = T::ZeroI(), upper = T::ZeroI();
+		for(; i + T::W <= blockEnd; i += T::W)
+		{
+			typename T::I v = T::LoadI(Data + i);
+			lower = T::AddI(lower, T::AndI(v, mask));
+			upper = T::AddI(upper, T::ShiftRight16I(v));
+		}
+		sum += (unsigned long long)T::HSumI(lower) + ((unsigned long long)T::HSumI(upper) << 16);
+	}
+
+	for(; i < N; i++)
+		sum += Data[i];
+	return sum;
+}
+
+template<class T>
+unsigned int SimdInclusiveScanU32(const unsigned int* In, unsigned int* Out, size_t N, unsigned int Carry)
+{
+	typename T::I carry = T::SetI(Carry);
+	size_t i = 0;
+	for(; i + T::W <= N; i += T::W)
+	{
+		typename T::I v = T::AddI(T::PrefixI(T::LoadI(In + i)), carry);
+		T::StoreI(Out + i, v);
+		carry = T::BroadcastLastI(v);
+	}
+
+	unsigned int sum = (i > 0) ? Out[i - 1] : Carry;
+	for(; i < N; i++)
+	{
+		sum += In[i];
+		Out[i] = sum;
+	}
+	return sum;
+}
+
+// scalar version with bounds checks for the borders of the row
+inline void ConvolveRowAddScalar(const float* Src, float* Dst, int XBegin, int XEnd, int Width, const float* Kernel, int Radius)
+{
+	for(int x = XBegin; x < XEnd; x++)
+	{
+		float value = 0;
+		for(int k = -Radius; k <= Radius; k++)
+		{
+			int sx = x + k;
+			if(sx >= 0 && sx < Width)
+				value += Src[sx] * Kernel[Radius - k];
+		}
+		Dst[x] += value;
+	}
+}
+
+template<class T>
+void SimdConvolveRowAdd(const float* Src, float* Dst, int Width, const float* Kernel, int Radius)
+{
+	// only the borders need bounds checks, the interior runs without branches
+	int interiorBegin = (Radius < Width) ? Radius : Width;
+	int interiorEnd = (Width - Radius > interiorBegin) ? Width - Radius : interiorBegin;
+
+	ConvolveRowAddScalar(Src, Dst, 0, interiorBegin, Width, Kernel, Radius);
+
+	int x = interiorBegin;
+	for(; x + T::W <= interiorEnd; x += T::W)
+	{
+		typename T::F value = T::ZeroF();
+		for(int k = -Radius; k <= Radius; k++)
+			value = T::AddF(value, T::MulF(T::LoadF(Src + x + k), T::SetF(Kernel[Radius - k])));
+		T::StoreF(Dst + x, T::AddF(T::LoadF(Dst + x), value));
+	}
+
+	ConvolveRowAddScalar(Src, Dst, x, Width, Width, Kernel, Radius);
+}
+
+template<class T>
+void SimdAxpyRow(const float* Src, float* Dst, int Width, float Weight)
+{
+	typename T::F weight = T::SetF(Weight);
+	int x = 0;
+	for(; x + T::W <= Width; x += T::W)
+		T::StoreF(Dst + x, T::AddF(T::LoadF(Dst + x), T::MulF(T::LoadF(Src + x), weight)));
+	for(; x < Width; x++)
+		Dst[x] += Src[x] * Weight;
+}
+
+template<class T>
+void SimdScaleOffsetRow(float* Dst, int Width, float Scale, float Offset)
+{
+	typename T::F scale = T::SetF(Scale), offset = T::SetF(Offset);
+	int x = 0;
+	for(; x + T::W <= Width; x += T::W)
+		T::StoreF(Dst + x, T::AddF(T::MulF(T::LoadF(Dst + x), scale), offset));
+	for(; x < Width; x++)
+		Dst[x] = Dst[x] * Scale + Offset;
+}
+
+template<class T>
+void SimdHistogramRow(const float* Src, int Width, int NBins, unsigned int* Bins)
+{
+	// the bin indices are computed in vectors, only the increments are scalar.
+	// Clamping before the truncation gives the same bins as clamping the integer.
+	typename T::F bins = T::SetF(float(NBins)), lowest = T::ZeroF(), highest = T::SetF(float(NBins - 1));
+	unsigned int index[T::W];
+	int x = 0;
+	for(; x + T::W <= Width; x += T::W)
+	{
+		typename T::F p = T::MulF(T::LoadF(Src + x), bins);
+		T::StoreI(index, T::TruncI(T::MinF(T::MaxF(p, lowest), highest)));
+		for(int i = 0; i < T::W; i++)
+			Bins[index[i]]++;
+	}
+	for(; x < Width; x++)
+	{
+		int h = int(Src[x] * float(NBins));
+		h = (h < 0) ? 0 : ((h > NBins - 1) ? NBins - 1 : h);
+		Bins[h]++;
+	}
+}
+
+template<class T>
+void SimdRotateClockwise(const float* M, float* MR, size_t SizeX, size_t SizeY, size_t XBegin, size_t XEnd)
+{
+	const size_t B = T::RotateW;
+
+	// full blocks, the remaining rows and columns are copied element by element
+	size_t x = XBegin;
+	for(; x + B <= XEnd; x += B)
+	{
+		size_t y = 0;
+		for(; y + B <= SizeY; y += B)
+			T::RotateBlock(M + y * SizeX + x, SizeX, MR + x * SizeY + (SizeY - y - B), SizeY);
+		for(; y < SizeY; y++)
+			for(size_t i = 0; i < B; i++)
+				MR[(x + i) * SizeY + (SizeY - y - 1)] = M[y * SizeX + x + i];
+	}
+	for(; x < XEnd; x++)
+		for(size_t y = 0; y < SizeY; y++)
+			MR[x * SizeY + (SizeY - y - 1)] = M[y * SizeX + x];
+}
+
+template<class T>
+SSimdKernels MakeSimdKernels(ESimdLevel Level)
+{
+	SSimdKernels kernels;
+	kernels.Level = Level;
+	kernels.SumU32 = &SimdSumU32<T>;
+	kernels.SumU64 = &SimdSumU64<T>;
+	kernels.InclusiveScanU32 = &SimdInclusiveScanU32<T>;
+	kernels.ConvolveRowAdd = &SimdConvolveRowAdd<T>;
+	kernels.AxpyRow = &SimdAxpyRow<T>;
+	kernels.ScaleOffsetRow = &SimdScaleOffsetRow<T>;
+	kernels.HistogramRow = &SimdHistogramRow<T>;
+	kernels.RotateClockwise = &SimdRotateClockwise<T>;
+	return kernels;
+}
+
+} // namespace
+
+#endif // _CSIMD_KERNELS_H
@@ -0,0 +1,27 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+// Kernel table compiled with SSE2 (default on x86-64)
+
+#include "CSimdKernels.h"
+
+#ifdef SIMD_HAS_SSE2
+
+const SSimdKernels* GetSimdKernelsSSE2()
+{
+	static const SSimdKernels s_Kernels = MakeSimdKernels<SSSE2Traits>(SIMD_SSE2);
+	return &s_Kernels;
+}
+
+#else
+
+const SSimdKernels* GetSimdKernelsSSE2()
+{
+	return NULL;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
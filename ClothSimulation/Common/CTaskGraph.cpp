@@ -0,0 +1,136 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CTaskGraph.h"
+#include "CTracer.h"
+
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CTaskGraph
+
+CTaskGraph::CTaskGraph()
+	: m_NFinished(0)
+{
+}
+
+CTaskGraph::NodeId CTaskGraph::AddHostNode(const std::string& Name, const HostFunc& Function, const std::vector<NodeId>& Dependencies)
+{
+	SNode node;
+	node.Name = Name;
+	node.Device = false;
+	node.Host = Function;
+	return AddNode(node, Dependencies);
+}
+
+CTaskGraph::NodeId CTaskGraph::AddDeviceNode(const std::string& Name, const DeviceFunc& Function, const std::vector<NodeId>& Dependencies)
+{
+	SNode node;
+	node.Name = Name;
+	node.Device = true;
+	node.DeviceFunction = Function;
+	return AddNode(node, Dependencies);
+}
+
+CTaskGraph::NodeId CTaskGraph::AddNode(SNode& Node, const std::vector<NodeId>& Dependencies)
+{
+	NodeId id = m_Nodes.size();
+	Node.NDependencies = 0;
+	for(size_t i = 0; i < Dependencies.size(); i++)
+	{
+		// only earlier nodes, this keeps the graph acyclic
+		if(Dependencies[i] >= id)
+		{
+			cerr << "Warning: node '" << Node.Name << "' ignores the dependency on a later node." << endl;
+			continue;
+		}
+		m_Nodes[Dependencies[i]].Dependents.push_back(id);
+		Node.NDependencies++;
+	}
+	m_Nodes.push_back(Node);
+	return id;
+}
+
+void CTaskGraph::Clear()
+{
+	m_Nodes.clear();
+}
+
+bool CTaskGraph::Run(const std::vector<cl_command_queue>& CommandQueues)
+{
+	m_Remaining.resize(m_Nodes.size());
+	m_ReadyHost.clear();
+	m_ReadyDevice.clear();
+	m_NFinished = 0;
+
+	bool hasDeviceNodes = false;
+	for(NodeId i = 0; i < m_Nodes.size(); i++)
+	{
+		hasDeviceNodes |= m_Nodes[i].Device;
+		m_Remaining[i] = m_Nodes[i].NDependencies;
+		if(m_Remaining[i] == 0)
+			(m_Nodes[i].Device ? m_ReadyDevice : m_ReadyHost).insert(i);
+	}
+	if(hasDeviceNodes && CommandQueues.empty())
+	{
+		cerr << "Error: the task graph has device nodes, but no command queue." << endl;
+		return false;
+	}
+
+	vector<thread> lanes;
+	for(size_t i = 0; i < CommandQueues.size() && hasDeviceNodes; i++)
+		lanes.push_back(thread(&CTaskGraph::RunLoop, this, true, CommandQueues[i]));
+
+	RunLoop(false, NULL);
+
+	for(size_t i = 0; i < lanes.size(); i++)
+		lanes[i].join();
+
+	return true;
+}
+
+void CTaskGraph::RunLoop(bool Device, cl_command_queue CommandQueue)
+{
+	set<NodeId>& ready = Device ? m_ReadyDevice : m_ReadyHost;
+
+	for(;;)
+	{
+		NodeId id;
+		{
+			unique_lock<mutex> lock(m_Mutex);
+			m_Changed.wait(lock, [&]() { return !ready.empty() || m_NFinished == m_Nodes.size(); });
+			if(ready.empty())
+				return;
+			id = *ready.begin();
+			ready.erase(ready.begin());
+		}
+
+		{
+			const SNode& node = m_Nodes[id];
+			CTraceZone zone(node.Name);
+			if(node.Device)
+				node.DeviceFunction(CommandQueue);
+			else
+				node.Host();
+		}
+
+		{
+			lock_guard<mutex> lock(m_Mutex);
+			m_NFinished++;
+			const vector<NodeId>& dependents = m_Nodes[id].Dependents;
+			for(size_t i = 0; i < dependents.size(); i++)
+			{
+				if(--m_Remaining[dependents[i]] == 0)
+					(m_Nodes[dependents[i]].Device ? m_ReadyDevice : m_ReadyHost).insert(dependents[i]);
+			}
+		}
+		m_Changed.notify_all();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
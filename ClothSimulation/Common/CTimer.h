@@ -24,31 +24,29 @@
 //using the built-in precision timer of the OS
 
 // We reverted from std::chrono, because that timer implementation seems to be very imprecise
-// (at least under windows)
+// (at least under windows). On the other systems the raw monotonic clock is used, which is
+// not slewed by NTP like the wall clock of gettimeofday().
 
 #ifdef _WIN32
 
 #include <Windows.h>
 
-#elif defined (__APPLE__) || defined(MACOSX)
-
-#include <sys/time.h>
-
 #else
 
-#include <sys/time.h>
 #include <time.h>
 
 #endif
 
+class CStatistics;
+
 //! Simple wrapper class for the measurement of time intervals
 /*!
 	Use this timer to measure elapsed time on the HOST side.
 	Not suitable for measuring the execution of DEVICE code
 	without synchronization with the HOST.
 
-	NOTE: This class is not thread-safe (like most other classes in these
-	examples), but we are not doing CPU multithreading in the praktikum...
+	NOTE: A timer object must not be shared between threads, but each
+	thread can use its own timers.
 */
 class CTimer
 {
@@ -67,13 +65,28 @@ public:
 
 protected:
 
-#ifdef WIN32
+#ifdef _WIN32
 	LARGE_INTEGER		m_StartTime;
 	LARGE_INTEGER		m_EndTime;
 #else
-	struct timeval		m_StartTime;
-	struct timeval		m_EndTime;
+	struct timespec		m_StartTime;
+	struct timespec		m_EndTime;
 #endif
 };
 
+//! Measures the lifetime of the object and stores it in ms, or adds it as a sample to statistics
+class CScopedTimer
+{
+public:
+	CScopedTimer(double& ElapsedMilliseconds);
+	CScopedTimer(CStatistics& Statistics);
+
+	~CScopedTimer();
+
+protected:
+	CTimer			m_Timer;
+	double*			m_pElapsedMilliseconds;
+	CStatistics*	m_pStatistics;
+};
+
 #endif // _CTIMER_H
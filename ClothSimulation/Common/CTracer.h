@@ -0,0 +1,109 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTRACER_H
+#define _CTRACER_H
+
+#include "CLUtil.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+//! Timeline of host zones and device commands, written as Chrome trace JSON
+/*!
+	Host zones are opened with CTraceZone (one track per host thread), device commands
+	are added with their event profiling timestamps (one track per command queue).
+	The device clock is mapped to the host clock with Calibrate(): the host time taken
+	right before a command is enqueued corresponds to its CL_PROFILING_COMMAND_QUEUED
+	timestamp.
+
+	Open the file in chrome://tracing or https://ui.perfetto.dev. Nothing is recorded
+	unless a file was opened (--trace <file>, see CAssignmentBase).
+*/
+class CTracer
+{
+public:
+	static CTracer& GetSingleton();
+
+	bool Open(const std::string& Path);
+
+	//! Writes the trace and closes the file
+	void Close();
+
+	bool IsEnabled() const { return m_Enabled; }
+
+	//! Host time in microseconds since the trace was opened
+	double Now() const;
+
+	void AddZone(const std::string& Name, double BeginUs, double EndUs);
+
+	//! Maps the device clock to the host clock, HostUs is Now() right before the command of Event was enqueued
+	void Calibrate(cl_event Event, double HostUs);
+
+	//! Adds a finished command with the device timestamps of its event (requires a profiling queue)
+	void AddDeviceCommand(const std::string& Name, cl_command_queue CommandQueue, cl_event Event);
+
+protected:
+	CTracer();
+	~CTracer();
+
+	struct STraceEvent
+	{
+		std::string		Name;
+		int				Pid;
+		int				Tid;
+		double			BeginUs;
+		double			DurationUs;
+	};
+
+	int GetThreadTrack(std::thread::id Thread);
+	int GetQueueTrack(cl_command_queue CommandQueue);
+
+	std::string										m_Path;
+	// read without m_Mutex by the zones of all threads
+	std::atomic<bool>								m_Enabled;
+	std::chrono::steady_clock::time_point			m_Start;
+	//host time of device time zero, in us
+	double											m_DeviceOffsetUs;
+
+	std::vector<STraceEvent>						m_Events;
+	std::map<std::thread::id, int>					m_ThreadTracks;
+	std::map<cl_command_queue, int>					m_QueueTracks;
+
+	std::mutex										m_Mutex;
+};
+
+//! Records the lifetime of the object as a host zone of the trace
+class CTraceZone
+{
+public:
+	CTraceZone(const std::string& Name);
+	~CTraceZone();
+
+protected:
+	std::string		m_Name;
+	double			m_BeginUs;
+};
+
+#endif // _CTRACER_H
@@ -10,10 +10,15 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include <iostream>
 #include <string>
+#include <algorithm>
 
 #include "GLCommon.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CTracer.h"
+#include "../Common/CStatistics.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CRegressionGate.h"
 #include <CL/cl_gl.h>
 
 #ifdef __linux__
@@ -77,10 +82,22 @@ CAssignment4::~CAssignment4()
 
 bool CAssignment4::EnterMainLoop(int argc, char** argv)
 {
+	m_CommandLine.Parse(argc, argv);
+	OpenTrace();
+
+	if(m_CommandLine.GetInt("headless", 0, "GPU_HEADLESS") != 0)
+	{
+		bool success = RunHeadless();
+		ReleaseCLContext();
+		CTracer::GetSingleton().Close();
+		return success;
+	}
 
 	// create CL context with GL context sharing
 	if(InitGL(argc, argv) && InitCLContext())
 	{
+		ConfigureLaunchPlans();
+
 		if(m_pCurrentTask)
 			m_pCurrentTask->InitResources(m_CLDevice, m_CLContext);
 
@@ -104,76 +121,89 @@ bool CAssignment4::EnterMainLoop(int argc, char** argv)
 
 	ReleaseCLContext();
 	CleanupGL();
+	CTracer::GetSingleton().Close();
 
 	return true;
 }
 
-bool CAssignment4::DoCompute()
+bool CAssignment4::RunHeadless()
 {
-	if(m_pCurrentTask)
-		m_pCurrentTask->ComputeGPU(m_CLContext, m_CLCommandQueue, m_LocalWorkSize);
-
-	return true;
-}
+	int nFrames = max(m_CommandLine.GetInt("frames", 1000, "GPU_FRAMES"), 1);
+	float timeStep = (float)m_CommandLine.GetDouble("time-step", 0.003, "GPU_TIME_STEP");
 
-#define PRINT_INFO(title, buffer, bufferSize, maxBufferSize, expr) { expr; buffer[bufferSize] = '\0'; std::cout << title << ": " << buffer << std::endl; }
+	OpenResultsSink();
 
-bool CAssignment4::InitCLContext()
-{
-	// 1. get all platform IDs
+	// no GL context to share, so the context of the other assignments is used
+	if(!m_pCurrentTask || !CAssignmentBase::InitCLContext())
+		return false;
+	ConfigureLaunchPlans();
+	if(!OpenRegressionGate())
+		return false;
 
-	std::vector<cl_platform_id> platformIds;
-	const cl_uint c_MaxPlatforms = 16;
-	platformIds.resize(c_MaxPlatforms);
+	char deviceName[256] = {0};
+	clGetDeviceInfo(m_CLDevice, CL_DEVICE_NAME, sizeof(deviceName) - 1, deviceName, NULL);
+	CResultsSink& results = CResultsSink::GetSingleton();
+	results.BeginTask(m_pCurrentTask->GetName(), deviceName, m_LocalWorkSize);
 
-	cl_uint countPlatforms;
-	V_RETURN_FALSE_CL(clGetPlatformIDs(c_MaxPlatforms, &platformIds[0], &countPlatforms), "Failed to get CL platform ID");
-	platformIds.resize(countPlatforms);
+	m_pCurrentTask->SetHeadless(true);
+	bool valid = false;
+	{
+		CTraceZone zone("InitResources");
+		valid = m_pCurrentTask->InitResources(m_CLDevice, m_CLContext);
+	}
+	if(valid)
+	{
+		cout << "Simulating " << nFrames << " frames with a time step of " << timeStep << " s..." << endl;
 
-	// 2. find all available GPU devices
-	std::vector<cl_device_id> deviceIds;
-	const int maxDevices = 16;
-	deviceIds.resize(maxDevices);
-	int countAllDevices = 0;
+		// each frame ends with clFinish(), so the host time of a frame is the time of a simulation step
+		CStatistics frameTimes(2);
+		CTimer timer;
+		double simulationTime = 0.0;
+		for(int i = 0; i < nFrames; i++)
+		{
+			CTraceZone zone("Frame");
+			timer.Start();
+			m_pCurrentTask->OnIdle(simulationTime, timeStep);
+			m_pCurrentTask->ComputeGPU(m_CLContext, m_CLCommandQueue, m_LocalWorkSize);
+			timer.Stop();
+
+			frameTimes.Add(timer.GetElapsedMilliseconds());
+			simulationTime += timeStep;
+		}
 
+		// the problem size is the number of particles or cloth vertices, so runs with other --frames stay comparable
+		SBenchmarkResult steps("Step", m_pCurrentTask->GetProblemSize(), frameTimes);
+		steps.Iterations = nFrames;
+		cout << "  Average step time: " << steps.MeanMs << " ms, " << 1000.0 / steps.MeanMs << " steps/s" << endl;
+		results.Add(steps);
 
-	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+		m_pCurrentTask->ProfileKernels(m_CLCommandQueue, m_LocalWorkSize, 100);
 
-	for (size_t i = 0; i < platformIds.size(); i++)
-	{
-		// Getting the available devices.
-		cl_uint countDevices;
-		clGetDeviceIDs(platformIds[i], deviceType, 1, &deviceIds[countAllDevices], &countDevices);
-		countAllDevices += countDevices;
+		valid = m_pCurrentTask->ValidateState(m_CLCommandQueue);
+		cout << (valid ? "SIMULATION STATE IS FINITE" : "SIMULATION DIVERGED!") << endl;
 	}
-	deviceIds.resize(countAllDevices);
+	results.EndTask(valid);
+	CRegressionGate::GetSingleton().AddResults(m_pCurrentTask->GetName(), results.GetLastTaskResults(), valid);
 
-	if (countAllDevices == 0)
-	{
-		std::cout << "No device of the selected type with OpenCL support was found.";
+	m_pCurrentTask->ReleaseResources();
+
+	return CRegressionGate::GetSingleton().Evaluate() && valid;
+}
+
+bool CAssignment4::DoCompute()
+{
+	if(m_pCurrentTask)
+		m_pCurrentTask->ComputeGPU(m_CLContext, m_CLCommandQueue, m_LocalWorkSize);
+
+	return true;
+}
+
+bool CAssignment4::InitCLContext()
+{
+	// Same device selection as the other assignments. Note that the selected
+	// device has to be able to share the GL context (--cl-device-type etc.).
+	if(!SelectCLDevice())
 		return false;
-	}
-	// Choosing the first available device.
-	m_CLDevice = deviceIds[0];
-	clGetDeviceInfo(m_CLDevice, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &m_CLPlatform, NULL);
-
-	// Printing platform and device data.
-	const int maxBufferSize = 1024;
-	char buffer[maxBufferSize];
-	size_t bufferSize;
-	std::cout << "OpenCL platform:" << std::endl << std::endl;
-	PRINT_INFO("Name", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_NAME, maxBufferSize, (void*)buffer, &bufferSize));
-	PRINT_INFO("Vendor", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_VENDOR, maxBufferSize, (void*)buffer, &bufferSize));
-	PRINT_INFO("Version", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_VERSION, maxBufferSize, (void*)buffer, &bufferSize));
-	PRINT_INFO("Profile", buffer, bufferSize, maxBufferSize, clGetPlatformInfo(m_CLPlatform, CL_PLATFORM_PROFILE, maxBufferSize, (void*)buffer, &bufferSize));
-	std::cout << std::endl << "Device:" << std::endl << std::endl;
-	PRINT_INFO("Name", buffer, bufferSize, maxBufferSize, clGetDeviceInfo(m_CLDevice, CL_DEVICE_NAME, maxBufferSize, (void*)buffer, &bufferSize));
-	PRINT_INFO("Vendor", buffer, bufferSize, maxBufferSize, clGetDeviceInfo(m_CLDevice, CL_DEVICE_VENDOR, maxBufferSize, (void*)buffer, &bufferSize));
-	PRINT_INFO("Driver version", buffer, bufferSize, maxBufferSize, clGetDeviceInfo(m_CLDevice, CL_DRIVER_VERSION, maxBufferSize, (void*)buffer, &bufferSize));
-	cl_ulong localMemorySize;
-	clGetDeviceInfo(m_CLDevice, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemorySize, &bufferSize);
-	std::cout << "Local memory size: " << localMemorySize << " Byte" << std::endl;
-	std::cout << std::endl << "******************************" << std::endl << std::endl;
 
 	cl_int clError;
 
@@ -215,7 +245,7 @@ bool CAssignment4::InitCLContext()
 	// from the CPU into this queue. This way the host program can continue the execution until some results
 	// from that device are needed.
 
-	m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, 0, &clError);
+	m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, CL_QUEUE_PROFILING_ENABLE, &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create the command queue in the context");
 
 	return true;
@@ -283,6 +313,7 @@ void CAssignment4::CleanupGL()
 
 void CAssignment4::Render()
 {
+	CTraceZone zone("Render");
 	if(m_pCurrentTask)
 		m_pCurrentTask->Render();
 
@@ -291,6 +322,7 @@ void CAssignment4::Render()
 
 void CAssignment4::OnIdle()
 {
+	CTraceZone zone("OnIdle");
 	if(m_PrevTime < 0)
 	{
 		m_FrameTimer.Start();
@@ -6,6 +6,10 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CClothSimulationTask.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CTracer.h"
+#include "../Common/CKernelLibrary.h"
+#include "../Common/CLaunchPlan.h"
+#include "../Common/CResultsSink.h"
 
 #ifdef min // these macros are defined under windows, but collide with our math utility
 #	undef min
@@ -17,6 +21,8 @@ GPU Computing / GPGPU Praktikum source code.
 #include "HLSLEx.h"
 
 #include <string>
+#include <vector>
+#include <cmath>
 
 #include "CL/cl_gl.h"
 
@@ -52,6 +58,85 @@ bool CClothSimulationTask::InitResources(cl_device_id Device, cl_context Context
 		cout<<"Failed to create cloth."<<endl;
 		return false;
 	}
+	if(!m_Headless && !InitGLResources())
+		return false;
+
+	/////////////////////////////////////////////////////////////
+	// OpenCL resources
+
+	cl_int clError, clError2;
+
+	if(m_Headless)
+	{
+		// there are no OpenGL buffers to share, the simulation starts from the vertices of the plane
+		std::vector<hlsl::float4> positions, normals;
+		m_pClothModel->GetVertexData(positions, normals);
+		m_clPosArray = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, positions.size() * sizeof(hlsl::float4), positions.data(), &clError);
+		m_clNormalArray = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, normals.size() * sizeof(hlsl::float4), normals.data(), &clError2);
+	}
+	else
+	{
+		m_clPosArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetVertexBuffer(), &clError);
+		m_clNormalArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetNormalBuffer(), &clError2);
+	}
+	clError |= clError2;
+
+	m_clPosArrayAux = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2);
+	clError |= clError2;
+	m_clPosArrayOld = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2);
+	clError |= clError2;
+
+	V_RETURN_FALSE_CL(clError, "Error allocating device arrays.");
+
+	m_ClothSimProgram = CKernelLibrary::GetSingleton().Build(Device, Context, "clothsim.cl");
+	if(m_ClothSimProgram == nullptr)
+		return false;
+
+
+	m_IntegrateKernel = clCreateKernel(m_ClothSimProgram, "Integrate", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create Integrate kernel.");
+	m_NormalKernel = clCreateKernel(m_ClothSimProgram, "ComputeNormals", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create Normal kernel.");
+	m_ConstraintKernel = clCreateKernel(m_ClothSimProgram, "SatisfyConstraints", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create Constraint kernel.");
+	m_CollisionsKernel = clCreateKernel(m_ClothSimProgram, "CheckCollisions", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create Collision kernel.");
+
+	// Compute the rest distance between two particles.
+	// We scale the distance by 0.9 to get a nicer look for the cloth (more folds).
+	float restDistance = 1.f / ((float)m_ClothResX)*0.9f;
+
+	////////////////////////////////////////////////////////////////////////
+	// Specify the arguments for each kernel
+	clError  = clSetKernelArg(m_IntegrateKernel, 0, sizeof(unsigned int), &m_ClothResX);
+	clError |= clSetKernelArg(m_IntegrateKernel, 1, sizeof(unsigned int), &m_ClothResY);
+	clError |= clSetKernelArg(m_IntegrateKernel, 2, sizeof(cl_mem), (void*) &m_clPosArray);
+	clError |= clSetKernelArg(m_IntegrateKernel, 3, sizeof(cl_mem), (void*) &m_clPosArrayOld);
+	V_RETURN_FALSE_CL(clError, "Failed to set integration kernel params");
+
+	clError  = clSetKernelArg(m_ConstraintKernel, 0, sizeof(unsigned int), &m_ClothResX);
+	clError |= clSetKernelArg(m_ConstraintKernel, 1, sizeof(unsigned int), &m_ClothResY);
+	clError |= clSetKernelArg(m_ConstraintKernel, 2, sizeof(float), &restDistance);
+	// The rest of parameters is set before kernel launch (ping-ponging)
+	V_RETURN_FALSE_CL(clError, "Failed to set constraint kernel params");
+
+	clError  = clSetKernelArg(m_NormalKernel, 0, sizeof(unsigned int), &m_ClothResX);
+    clError |= clSetKernelArg(m_NormalKernel, 1, sizeof(unsigned int), &m_ClothResY);
+	clError |= clSetKernelArg(m_NormalKernel, 2, sizeof(cl_mem), (void*) &m_clPosArray);
+    clError |= clSetKernelArg(m_NormalKernel, 3, sizeof(cl_mem), (void*) &m_clNormalArray);
+	V_RETURN_FALSE_CL(clError, "Failed to set normal computation kernel params");
+
+	clError  = clSetKernelArg(m_CollisionsKernel, 0, sizeof(unsigned int), &m_ClothResX);
+    clError |= clSetKernelArg(m_CollisionsKernel, 1, sizeof(unsigned int), &m_ClothResY);
+	clError |= clSetKernelArg(m_CollisionsKernel, 2, sizeof(cl_mem), (void*) &m_clPosArray);
+	// Dynamic sphere parameters are updated before kernel launch
+	V_RETURN_FALSE_CL(clError, "Failed to set collision kernel params");
+
+	return true;
+}
+
+bool CClothSimulationTask::InitGLResources()
+{
 	if(!m_pClothModel->CreateGLResources())
 	{
 		cout<<"Failed to create cloth OpenGL resources"<<endl;
@@ -130,68 +215,6 @@ bool CClothSimulationTask::InitResources(cl_device_id Device, cl_context Context
     glRotatef(m_RotateY, 0.0, 1.0, 0.0);
     glRotatef(m_RotateX, 1.0, 0.0, 0.0);
 
-	/////////////////////////////////////////////////////////////
-	// OpenCL resources
-
-	cl_int clError, clError2;
-
-	m_clPosArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetVertexBuffer(), &clError);
-	m_clNormalArray = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_pClothModel->GetNormalBuffer(), &clError2);
-	clError |= clError2;
-
-	m_clPosArrayAux = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2);
-	clError |= clError2;
-	m_clPosArrayOld = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_ClothResX * m_ClothResY * sizeof(hlsl::float4), 0, &clError2);
-	clError |= clError2;
-
-	V_RETURN_FALSE_CL(clError, "Error allocating device arrays.");
-
-	string programCode;
-	CLUtil::LoadProgramSourceToMemory("clothsim.cl", programCode);
-	m_ClothSimProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
-	if(m_ClothSimProgram == nullptr)
-		return false;
-
-
-	m_IntegrateKernel = clCreateKernel(m_ClothSimProgram, "Integrate", &clError);
-	V_RETURN_FALSE_CL(clError, "Failed to create Integrate kernel.");
-	m_NormalKernel = clCreateKernel(m_ClothSimProgram, "ComputeNormals", &clError);
-	V_RETURN_FALSE_CL(clError, "Failed to create Normal kernel.");
-	m_ConstraintKernel = clCreateKernel(m_ClothSimProgram, "SatisfyConstraints", &clError);
-	V_RETURN_FALSE_CL(clError, "Failed to create Constraint kernel.");
-	m_CollisionsKernel = clCreateKernel(m_ClothSimProgram, "CheckCollisions", &clError);
-	V_RETURN_FALSE_CL(clError, "Failed to create Collision kernel.");
-
-	// Compute the rest distance between two particles.
-	// We scale the distance by 0.9 to get a nicer look for the cloth (more folds).
-	float restDistance = 1.f / ((float)m_ClothResX)*0.9f;
-
-	////////////////////////////////////////////////////////////////////////
-	// Specify the arguments for each kernel
-	clError  = clSetKernelArg(m_IntegrateKernel, 0, sizeof(unsigned int), &m_ClothResX);
-	clError |= clSetKernelArg(m_IntegrateKernel, 1, sizeof(unsigned int), &m_ClothResY);
-	clError |= clSetKernelArg(m_IntegrateKernel, 2, sizeof(cl_mem), (void*) &m_clPosArray);
-	clError |= clSetKernelArg(m_IntegrateKernel, 3, sizeof(cl_mem), (void*) &m_clPosArrayOld);
-	V_RETURN_FALSE_CL(clError, "Failed to set integration kernel params");
-
-	clError  = clSetKernelArg(m_ConstraintKernel, 0, sizeof(unsigned int), &m_ClothResX);
-	clError |= clSetKernelArg(m_ConstraintKernel, 1, sizeof(unsigned int), &m_ClothResY);
-	clError |= clSetKernelArg(m_ConstraintKernel, 2, sizeof(float), &restDistance);
-	// The rest of parameters is set before kernel launch (ping-ponging)
-	V_RETURN_FALSE_CL(clError, "Failed to set constraint kernel params");
-
-	clError  = clSetKernelArg(m_NormalKernel, 0, sizeof(unsigned int), &m_ClothResX);
-    clError |= clSetKernelArg(m_NormalKernel, 1, sizeof(unsigned int), &m_ClothResY);
-	clError |= clSetKernelArg(m_NormalKernel, 2, sizeof(cl_mem), (void*) &m_clPosArray);
-    clError |= clSetKernelArg(m_NormalKernel, 3, sizeof(cl_mem), (void*) &m_clNormalArray);
-	V_RETURN_FALSE_CL(clError, "Failed to set normal computation kernel params");
-
-	clError  = clSetKernelArg(m_CollisionsKernel, 0, sizeof(unsigned int), &m_ClothResX);
-    clError |= clSetKernelArg(m_CollisionsKernel, 1, sizeof(unsigned int), &m_ClothResY);
-	clError |= clSetKernelArg(m_CollisionsKernel, 2, sizeof(cl_mem), (void*) &m_clPosArray);
-	// Dynamic sphere parameters are updated before kernel launch
-	V_RETURN_FALSE_CL(clError, "Failed to set collision kernel params");
-
 	return true;
 }
 
@@ -215,6 +238,9 @@ void CClothSimulationTask::ReleaseResources()
 		m_pSphere = 0;
 	}
 
+	// the recorded plan references the buffers and kernels
+	m_RelaxationPlan.Clear();
+
 	SAFE_RELEASE_MEMOBJECT(m_clPosArrayAux);
 	SAFE_RELEASE_MEMOBJECT(m_clPosArrayOld);
 	SAFE_RELEASE_MEMOBJECT(m_clNormalArray);
@@ -245,9 +271,12 @@ void CClothSimulationTask::ComputeGPU(cl_context , cl_command_queue CommandQueue
 	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_ClothResX, LocalWorkSize[0]);
 	globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_ClothResY, LocalWorkSize[1]);
 
-	glFinish();
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL),  "Error acquiring OpenGL vertex buffer.");
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error acquiring OpenGL normal buffer.");
+	if(!m_Headless)
+	{
+		glFinish();
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL),  "Error acquiring OpenGL vertex buffer.");
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error acquiring OpenGL normal buffer.");
+	}
 
 	clErr  = clSetKernelArg(m_IntegrateKernel, 0, sizeof(unsigned int), &m_ClothResX);
 	clErr |= clSetKernelArg(m_IntegrateKernel, 1, sizeof(unsigned int), &m_ClothResY);
@@ -267,50 +296,98 @@ void CClothSimulationTask::ComputeGPU(cl_context , cl_command_queue CommandQueue
 
 	// Check for collisions
 
-	// Constraint relaxation: use the ping-pong technique and perform the relaxation in several iterations
-	for (unsigned int i = 0; i < 2.0 * m_ClothResX; i++) {
-		// Execute the constraint relaxation kernel
-		clErr = clSetKernelArg(m_ConstraintKernel, 3, sizeof(cl_mem), (void*) &m_clPosArrayAux);
-		clErr |= clSetKernelArg(m_ConstraintKernel, 4, sizeof(cl_mem), (void*) &m_clPosArray);
-		V_RETURN_CL(clErr, "Failed to set m_ConstraintKernel params");
+	// The relaxation passes only depend on the cloth size and the sphere, so they are planned once
+	// and replayed each frame (OnMouseMove() drops the plan when the sphere moves)
+	if(m_RelaxationPlan.IsEmpty())
+	{
+		// Constraint relaxation: use the ping-pong technique and perform the relaxation in several iterations
+		for (unsigned int i = 0; i < 2.0 * m_ClothResX; i++) {
+			// Execute the constraint relaxation kernel
+			m_RelaxationPlan.Launch(m_ConstraintKernel, 2, globalWorkSize, LocalWorkSize)
+				.Arg(3, m_clPosArrayAux)
+				.Arg(4, m_clPosArray);
+
+			// Occasionally check for collisions
+			if(i % 3 == 0) {
+				m_RelaxationPlan.Launch(m_CollisionsKernel, 2, globalWorkSize, LocalWorkSize)
+					.Arg(3, sizeof(cl_float4), &m_SpherePos)
+					.Arg(4, m_SphereRadius);
+			}
+
+			// Swap the ping pong buffers
+			m_RelaxationPlan.Swap(m_clPosArray, m_clPosArrayAux);
+		}
 
-		clErr = clEnqueueNDRangeKernel(CommandQueue, m_ConstraintKernel, 2, NULL, globalWorkSize, LocalWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(clErr, "Error executing m_ConstraintKernel!");
+		// You can check for collisions here again, to make sure there is no intersection with the cloth in the end
+		m_RelaxationPlan.Launch(m_CollisionsKernel, 2, globalWorkSize, LocalWorkSize)
+			.Arg(3, sizeof(cl_float4), &m_SpherePos)
+			.Arg(4, m_SphereRadius);
 
-		// Occasionally check for collisions
-		if(i % 3 == 0) {
-			clErr = clSetKernelArg(m_CollisionsKernel, 3, sizeof(cl_float4), &m_SpherePos);
-			clErr |= clSetKernelArg(m_CollisionsKernel, 4, sizeof(cl_float), &m_SphereRadius);
-			V_RETURN_CL(clErr, "Failed to set m_CollisionsKernel params");
+		//compute correct normals
+		m_RelaxationPlan.Launch(m_NormalKernel, 2, globalWorkSize, LocalWorkSize);
+	}
+	V_RETURN_CL(m_RelaxationPlan.Replay(CommandQueue), "Error executing the constraint relaxation!");
 
-			clErr |= clEnqueueNDRangeKernel(CommandQueue, m_CollisionsKernel, 2, NULL, globalWorkSize, LocalWorkSize, 0, NULL, NULL);
-			V_RETURN_CL(clErr, "Error executing m_CollisionsKernel!");
-		}
 
-		// Swap the ping pong buffers
-		swap(m_clPosArray, m_clPosArrayAux);
+	if(!m_Headless)
+	{
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL),  "Error releasing OpenGL vertex buffer.");
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error releasing OpenGL normal buffer.");
 	}
 
-	// You can check for collisions here again, to make sure there is no intersection with the cloth in the end
-	clErr = clSetKernelArg(m_CollisionsKernel, 3, sizeof(cl_float4), &m_SpherePos);
-	clErr |= clSetKernelArg(m_CollisionsKernel, 4, sizeof(cl_float), &m_SphereRadius);
-	V_RETURN_CL(clErr, "Failed to set m_CollisionsKernel params");
+	// the frame waits here for the simulation kernels
+	{
+		CTraceZone zone("clFinish");
+		clFinish(CommandQueue);
+	}
+	m_FrameCounter++;
+	m_PrevElapsedTime = m_ElapsedTime;
+	m_ElapsedTime = 0;
+}
 
-	clErr |= clEnqueueNDRangeKernel(CommandQueue, m_CollisionsKernel, 2, NULL, globalWorkSize, LocalWorkSize, 0, NULL, NULL);
-	V_RETURN_CL(clErr, "Error executing m_CollisionsKernel!");
+void CClothSimulationTask::ProfileKernels(cl_command_queue CommandQueue, size_t LocalWorkSize[3], int NIterations)
+{
+	size_t globalWorkSize[2];
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_ClothResX, LocalWorkSize[0]);
+	globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_ClothResY, LocalWorkSize[1]);
 
-	//compute correct normals
-	clErr = clEnqueueNDRangeKernel(CommandQueue, m_NormalKernel, 2, 0, globalWorkSize, LocalWorkSize, 0, 0, 0);
-	V_RETURN_CL(clErr, "Error executing normal computation kernel");
+	// the relaxation plan sets the ping-pong arguments at each launch, so they are set here as in the last frame
+	cl_int clErr;
+	clErr  = clSetKernelArg(m_IntegrateKernel, 4, sizeof(cl_float), (void*)&m_PrevElapsedTime);
+	clErr |= clSetKernelArg(m_ConstraintKernel, 3, sizeof(cl_mem), (void*)&m_clPosArrayAux);
+	clErr |= clSetKernelArg(m_ConstraintKernel, 4, sizeof(cl_mem), (void*)&m_clPosArray);
+	clErr |= clSetKernelArg(m_CollisionsKernel, 3, sizeof(cl_float4), (void*)&m_SpherePos);
+	clErr |= clSetKernelArg(m_CollisionsKernel, 4, sizeof(cl_float), (void*)&m_SphereRadius);
+	V_RETURN_CL(clErr, "Failed to set the kernel params for profiling");
+
+	const char* kernelNames[] = { "Integrate", "SatisfyConstraints", "CheckCollisions", "ComputeNormals" };
+	cl_kernel kernels[] = { m_IntegrateKernel, m_ConstraintKernel, m_CollisionsKernel, m_NormalKernel };
+	for(size_t i = 0; i < ARRAYLEN(kernels); i++)
+	{
+		SKernelProfile profile;
+		if(!CLUtil::ProfileKernelEvents(CommandQueue, kernels[i], 2, globalWorkSize, LocalWorkSize, NIterations, profile))
+			continue;
 
+		CLUtil::PrintKernelProfile(kernelNames[i], profile);
+		CResultsSink::GetSingleton().Add(SBenchmarkResult(kernelNames[i], size_t(m_ClothResX) * m_ClothResY, profile));
+	}
+}
 
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosArray, 0, NULL, NULL),  "Error releasing OpenGL vertex buffer.");
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clNormalArray, 0, NULL, NULL), "Error releasing OpenGL normal buffer.");
+bool CClothSimulationTask::ValidateState(cl_command_queue CommandQueue)
+{
+	std::vector<hlsl::float4> positions(size_t(m_ClothResX) * m_ClothResY);
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_clPosArray, CL_TRUE, 0, positions.size() * sizeof(hlsl::float4), positions.data(), 0, NULL, NULL),
+		"Error reading the cloth positions.");
 
-	clFinish(CommandQueue);
-	m_FrameCounter++;
-	m_PrevElapsedTime = m_ElapsedTime;
-	m_ElapsedTime = 0;
+	for(size_t i = 0; i < positions.size(); i++)
+	{
+		if(!std::isfinite(positions[i].x) || !std::isfinite(positions[i].y) || !std::isfinite(positions[i].z))
+		{
+			cout<<"Cloth particle "<<i<<" has left the finite range."<<endl;
+			return false;
+		}
+	}
+	return true;
 }
 
 void CClothSimulationTask::Render()
@@ -419,6 +496,7 @@ void CClothSimulationTask::OnMouseMove(int X, int Y)
 	if(m_Buttons & 4)
 	{
 		m_SpherePos.z += dy * 0.002f;
+		m_RelaxationPlan.Clear();
 	}
 	m_PrevX = X;
 	m_PrevY = Y;
@@ -445,6 +523,9 @@ void CClothSimulationTask::OnIdle(double , float ElapsedTime)
 	m_ElapsedTime += ElapsedTime;
 	m_simulationTime += ElapsedTime;
 
+	if(m_Headless)
+		return;
+
 	//set the modelview matrix
 	glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
@@ -6,6 +6,9 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CParticleSystemTask.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CTracer.h"
+#include "../Common/CKernelLibrary.h"
+#include "../Common/CResultsSink.h"
 
 #ifdef min // these macros are defined under windows, but collide with our math utility
 #	undef min
@@ -17,7 +20,9 @@ GPU Computing / GPGPU Praktikum source code.
 #include "HLSLEx.h"
 
 #include <string>
+#include <vector>
 #include <algorithm>
+#include <cmath>
 #include <string.h>
 
 #include "CL/cl_gl.h"
@@ -52,6 +57,12 @@ CParticleSystemTask::CParticleSystemTask(
 
 	for(unsigned int i = 0; i < 3; i++)
 		m_LocalWorkSize[i] = LocalWorkSize[i];
+
+	for(unsigned int i = 0; i < 2; i++)
+	{
+		m_clPosLife[i] = m_clVelMass[i] = nullptr;
+		m_glPosLife[i] = m_glVelMass[i] = m_glTexVelMass[i] = 0;
+	}
 	
 	// compute the number of levels that we need for the work-efficient algorithm
 	m_nLevels = 1;
@@ -92,7 +103,7 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context)
 		cout<<"Failed to load mesh."<<endl;
 		return false;
 	}
-	if(!m_pMesh->CreateGLResources())
+	if(!m_Headless && !m_pMesh->CreateGLResources())
 	{
 		cout<<"Failed to create mesh OpenGL resources"<<endl;
 		return false;
@@ -120,70 +131,39 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context)
 		pVelMass[i].s[3] = (1.f + float(rand()) / float(RAND_MAX)) * 1.5f;
 	}
 
-	// Device resources
-	glGenBuffers(2, m_glPosLife);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[0]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[1]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
-    CHECK_FOR_OGL_ERROR();
-
-	glGenBuffers(2, m_glVelMass);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[0]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[1]);
-	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
-    CHECK_FOR_OGL_ERROR();
-
-	//create a texture for the TBO
-	glGenTextures(2, m_glTexVelMass);
-
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[0]);
-	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[0]);
-	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
-    CHECK_FOR_OGL_ERROR();
-
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[1]);
-	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[1]);
-	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
-	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
-    CHECK_FOR_OGL_ERROR();
-
-
-	//scatter force field sampling points
-	float* pForceSamples = new float[NUM_FORCE_LINES * 2 * 4];
-	for(int i = 0; i < NUM_FORCE_LINES; i++)
+	if(!m_Headless && !InitGLResources(pPosLife, pVelMass))
 	{
-		pForceSamples[8 * i] = float(rand()) / float(RAND_MAX);
-		pForceSamples[8 * i + 1] = float(rand()) / float(RAND_MAX);
-		pForceSamples[8 * i + 2] = float(rand()) / float(RAND_MAX);
-		pForceSamples[8 * i + 3] = 0.0f; 
-
-		pForceSamples[8 * i + 4] = pForceSamples[8 * i];
-		pForceSamples[8 * i + 5] = pForceSamples[8 * i +1];
-		pForceSamples[8 * i + 6] = pForceSamples[8 * i + 2];
-		pForceSamples[8 * i + 7] = 1.0f;
+		SAFE_DELETE_ARRAY(pPosLife);
+		SAFE_DELETE_ARRAY(pVelMass);
+		return false;
 	}
 
-	glGenBuffers(1, &m_glForceLines);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glForceLines);
-	glBufferData(GL_ARRAY_BUFFER, NUM_FORCE_LINES * 2 * 4 * sizeof(float), pForceSamples, GL_DYNAMIC_DRAW);
-    CHECK_FOR_OGL_ERROR();
-
-	delete [] pForceSamples;
-
 	cl_int clError, clError2;
 
 	// Particle arrrays
-	m_clPosLife[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[0], &clError2);
-	clError = clError2;
-	m_clPosLife[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[1], &clError2);
-	clError |= clError2;
-	m_clVelMass[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[0], &clError2);
-	clError |= clError2;
-	m_clVelMass[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[1], &clError2);
-	clError |= clError2;
+	if(m_Headless)
+	{
+		// plain buffers with the same size and initial contents as the OpenGL buffers
+		clError = CL_SUCCESS;
+		for(int i = 0; i < 2; i++)
+		{
+			m_clPosLife[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, m_nParticles * sizeof(cl_float4) * 2, pPosLife, &clError2);
+			clError |= clError2;
+			m_clVelMass[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, m_nParticles * sizeof(cl_float4) * 2, pVelMass, &clError2);
+			clError |= clError2;
+		}
+	}
+	else
+	{
+		m_clPosLife[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[0], &clError2);
+		clError = clError2;
+		m_clPosLife[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glPosLife[1], &clError2);
+		clError |= clError2;
+		m_clVelMass[0] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[0], &clError2);
+		clError |= clError2;
+		m_clVelMass[1] = clCreateFromGLBuffer(Context, CL_MEM_READ_WRITE, m_glVelMass[1], &clError2);
+		clError |= clError2;
+	}
 	m_clAlive = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_nParticles * sizeof(cl_uint) * 2, NULL, &clError2);
 	clError |= clError2;
 
@@ -214,67 +194,8 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context)
 
 
 
-	//shader programs
-
-	m_VSMesh = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
-	m_PSMesh = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
-
-	if(!CreateShaderFromFile("mesh.vert", m_VSMesh))
-		return false;
-
-	if(!CreateShaderFromFile("mesh.frag", m_PSMesh))
-		return false;
-
-	m_ProgRenderMesh = glCreateProgramObjectARB();
-	glAttachObjectARB(m_ProgRenderMesh, m_VSMesh);
-	glAttachObjectARB(m_ProgRenderMesh, m_PSMesh);
-	if(!LinkGLSLProgram(m_ProgRenderMesh))
-		return false;
-
-	m_VSParticles = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
-	m_PSParticles = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
-
-	if(!CreateShaderFromFile("particles.vert", m_VSParticles))
-		return false;
-	
-	if(!CreateShaderFromFile("particles.frag", m_PSParticles))
-		return false;
-
-	m_ProgRenderParticles = glCreateProgramObjectARB();
-	glAttachObjectARB(m_ProgRenderParticles, m_VSParticles);
-	glAttachObjectARB(m_ProgRenderParticles, m_PSParticles);
-	if(!LinkGLSLProgram(m_ProgRenderParticles))
-		return false;
-
-	GLint tboSampler = glGetUniformLocationARB(m_ProgRenderParticles, "tboSampler");
-	glUseProgramObjectARB(m_ProgRenderParticles);
-	glUniform1i(tboSampler, 0);
-
-	m_VSForceField = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
-	m_PSForceField = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
-
-	if(!CreateShaderFromFile("forcefield.vert", m_VSForceField))
-		return false;
-
-	if(!CreateShaderFromFile("forcefield.frag", m_PSForceField))
-		return false;
-
-    CHECK_FOR_OGL_ERROR();
-	m_ProgRenderForceField = glCreateProgramObjectARB();
-	glAttachObjectARB(m_ProgRenderForceField, m_VSForceField);
-	glAttachObjectARB(m_ProgRenderForceField, m_PSForceField);
-	if(!LinkGLSLProgram(m_ProgRenderForceField))
-		return false;
-    CHECK_FOR_OGL_ERROR();
-
-	GLint texForceField = glGetUniformLocationARB(m_ProgRenderForceField, "texForceField");
-	glUseProgramObjectARB(m_ProgRenderForceField);
-	glUniform1i(texForceField, 0);
-
 	// Particle kernels
-	string programCode;
-	CLUtil::LoadProgramSourceToMemory("ParticleSystem.cl", programCode);
-	m_PSystemProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_PSystemProgram = CKernelLibrary::GetSingleton().Build(Device, Context, "ParticleSystem.cl");
 	if(!m_PSystemProgram)
 		return false;
 
@@ -286,8 +207,7 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context)
 	V_RETURN_FALSE_CL(clError, "Failed to create Reorganize kernel.");
 
 	// Scan kernels
-	CLUtil::LoadProgramSourceToMemory("Scan.cl", programCode);
-	m_ScanProgram = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_ScanProgram = CKernelLibrary::GetSingleton().Build(Device, Context, "Scan.cl");
 	if(!m_ScanProgram)
 		return false;
 
@@ -328,33 +248,36 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context)
 	}
 	fclose(fin);
 
-	// Create OpenGL texture
-	
-    CHECK_FOR_OGL_ERROR();
-	glEnable(GL_TEXTURE_3D);
-    CHECK_FOR_OGL_ERROR();
-	glGenTextures(1, &m_glVolTex3D);
-    CHECK_FOR_OGL_ERROR();
-    glBindTexture(GL_TEXTURE_3D, m_glVolTex3D);
-    CHECK_FOR_OGL_ERROR();
-	//if(!glIsEnabled(GL_TEXTURE_3D))
-	//	cout<<"3D textures are not supported."<<endl;
+	if(!m_Headless)
+	{
+		// Create OpenGL texture
 
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		CHECK_FOR_OGL_ERROR();
+		glEnable(GL_TEXTURE_3D);
+		CHECK_FOR_OGL_ERROR();
+		glGenTextures(1, &m_glVolTex3D);
+		CHECK_FOR_OGL_ERROR();
+		glBindTexture(GL_TEXTURE_3D, m_glVolTex3D);
+		CHECK_FOR_OGL_ERROR();
+		//if(!glIsEnabled(GL_TEXTURE_3D))
+		//	cout<<"3D textures are not supported."<<endl;
 
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    CHECK_FOR_OGL_ERROR();
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		CHECK_FOR_OGL_ERROR();
+
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F_ARB, 
+						m_volumeRes[0], m_volumeRes[1], m_volumeRes[2],
+						0, GL_RGBA, GL_FLOAT, pVolume);
+		CHECK_FOR_OGL_ERROR();
+	}
 
-	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F_ARB, 
-					m_volumeRes[0], m_volumeRes[1], m_volumeRes[2],
-					0, GL_RGBA, GL_FLOAT, pVolume);
-    CHECK_FOR_OGL_ERROR();
-    
 	cl_image_format volume_format;
     volume_format.image_channel_order = CL_RGBA;
 	volume_format.image_channel_data_type = CL_FLOAT;
@@ -380,6 +303,121 @@ bool CParticleSystemTask::InitResources(cl_device_id Device, cl_context Context)
 	clError  = clSetKernelArg(m_ReorganizeKernel, 0, sizeof(cl_mem), (void*)&m_clAlive);
 	V_RETURN_FALSE_CL(clError, "Failed to set args for m_ReorganizeKernel");
 
+	return true;
+}
+
+bool CParticleSystemTask::InitGLResources(const cl_float4* pPosLife, const cl_float4* pVelMass)
+{
+	// Device resources
+	glGenBuffers(2, m_glPosLife);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[0]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glPosLife[1]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pPosLife, GL_DYNAMIC_DRAW);
+    CHECK_FOR_OGL_ERROR();
+
+	glGenBuffers(2, m_glVelMass);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[0]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVelMass[1]);
+	glBufferData(GL_ARRAY_BUFFER, m_nParticles * sizeof(cl_float4) * 2, pVelMass, GL_DYNAMIC_DRAW);
+    CHECK_FOR_OGL_ERROR();
+
+	//create a texture for the TBO
+	glGenTextures(2, m_glTexVelMass);
+
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[0]);
+	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[0]);
+	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
+    CHECK_FOR_OGL_ERROR();
+
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, m_glTexVelMass[1]);
+	glTexBufferEXT(GL_TEXTURE_BUFFER_EXT, GL_RGBA32F_ARB, m_glVelMass[1]);
+	glBindBuffer(GL_TEXTURE_BUFFER_EXT, 0);
+	glBindTexture(GL_TEXTURE_BUFFER_EXT, 0);
+    CHECK_FOR_OGL_ERROR();
+
+
+	//scatter force field sampling points
+	float* pForceSamples = new float[NUM_FORCE_LINES * 2 * 4];
+	for(int i = 0; i < NUM_FORCE_LINES; i++)
+	{
+		pForceSamples[8 * i] = float(rand()) / float(RAND_MAX);
+		pForceSamples[8 * i + 1] = float(rand()) / float(RAND_MAX);
+		pForceSamples[8 * i + 2] = float(rand()) / float(RAND_MAX);
+		pForceSamples[8 * i + 3] = 0.0f; 
+
+		pForceSamples[8 * i + 4] = pForceSamples[8 * i];
+		pForceSamples[8 * i + 5] = pForceSamples[8 * i +1];
+		pForceSamples[8 * i + 6] = pForceSamples[8 * i + 2];
+		pForceSamples[8 * i + 7] = 1.0f;
+	}
+
+	glGenBuffers(1, &m_glForceLines);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glForceLines);
+	glBufferData(GL_ARRAY_BUFFER, NUM_FORCE_LINES * 2 * 4 * sizeof(float), pForceSamples, GL_DYNAMIC_DRAW);
+    CHECK_FOR_OGL_ERROR();
+
+	delete [] pForceSamples;
+
+	//shader programs
+
+	m_VSMesh = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+	m_PSMesh = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+
+	if(!CreateShaderFromFile("mesh.vert", m_VSMesh))
+		return false;
+
+	if(!CreateShaderFromFile("mesh.frag", m_PSMesh))
+		return false;
+
+	m_ProgRenderMesh = glCreateProgramObjectARB();
+	glAttachObjectARB(m_ProgRenderMesh, m_VSMesh);
+	glAttachObjectARB(m_ProgRenderMesh, m_PSMesh);
+	if(!LinkGLSLProgram(m_ProgRenderMesh))
+		return false;
+
+	m_VSParticles = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+	m_PSParticles = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+
+	if(!CreateShaderFromFile("particles.vert", m_VSParticles))
+		return false;
+	
+	if(!CreateShaderFromFile("particles.frag", m_PSParticles))
+		return false;
+
+	m_ProgRenderParticles = glCreateProgramObjectARB();
+	glAttachObjectARB(m_ProgRenderParticles, m_VSParticles);
+	glAttachObjectARB(m_ProgRenderParticles, m_PSParticles);
+	if(!LinkGLSLProgram(m_ProgRenderParticles))
+		return false;
+
+	GLint tboSampler = glGetUniformLocationARB(m_ProgRenderParticles, "tboSampler");
+	glUseProgramObjectARB(m_ProgRenderParticles);
+	glUniform1i(tboSampler, 0);
+
+	m_VSForceField = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+	m_PSForceField = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+
+	if(!CreateShaderFromFile("forcefield.vert", m_VSForceField))
+		return false;
+
+	if(!CreateShaderFromFile("forcefield.frag", m_PSForceField))
+		return false;
+
+    CHECK_FOR_OGL_ERROR();
+	m_ProgRenderForceField = glCreateProgramObjectARB();
+	glAttachObjectARB(m_ProgRenderForceField, m_VSForceField);
+	glAttachObjectARB(m_ProgRenderForceField, m_PSForceField);
+	if(!LinkGLSLProgram(m_ProgRenderForceField))
+		return false;
+    CHECK_FOR_OGL_ERROR();
+
+	GLint texForceField = glGetUniformLocationARB(m_ProgRenderForceField, "texForceField");
+	glUseProgramObjectARB(m_ProgRenderForceField);
+	glUniform1i(texForceField, 0);
+
 	//set the modelview matrix
 	glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
@@ -395,7 +433,8 @@ void CParticleSystemTask::ReleaseResources()
 {
 	if(m_pMesh)
 	{
-		m_pMesh->ReleaseGLResources();
+		if(!m_Headless)
+			m_pMesh->ReleaseGLResources();
 		delete m_pMesh;
 		m_pMesh = NULL;
 	}
@@ -429,6 +468,10 @@ void CParticleSystemTask::ReleaseResources()
 	SAFE_RELEASE_KERNEL(m_ReorganizeKernel);
 	SAFE_RELEASE_PROGRAM(m_PSystemProgram);	
 
+	// there are no OpenGL resources (and maybe no OpenGL context) in headless mode
+	if(m_Headless)
+		return;
+
 	SAFE_RELEASE_GL_BUFFER(m_glForceLines);
 	SAFE_RELEASE_GL_BUFFER(m_glPosLife[0]);
 	SAFE_RELEASE_GL_BUFFER(m_glPosLife[1]);
@@ -452,14 +495,17 @@ void CParticleSystemTask::ReleaseResources()
 
 void CParticleSystemTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	glFinish();
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
-	V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+	if(!m_Headless)
+	{
+		glFinish();
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error acquiring OpenGL buffer.");
+		V_RETURN_CL(clEnqueueAcquireGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error acquiring OpenGL buffer.");
+	}
 
 	// Integration with a fixed timestep
-	Integrate(Context, CommandQueue, LocalWorkSize, 0.003f);
+	Integrate(Context, CommandQueue, LocalWorkSize, m_TimeStep);
 
 
 	//********************************************************
@@ -474,15 +520,50 @@ void CParticleSystemTask::ComputeGPU(cl_context Context, cl_command_queue Comman
 	//Reorganize(Context, CommandQueue, LocalWorkSize);
 
 
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error releasing OpenGL buffer.");
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
-	V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+	if(!m_Headless)
+	{
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[0], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[0], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clPosLife[1], 0, NULL, NULL),  "Error releasing OpenGL buffer.");
+		V_RETURN_CL(clEnqueueReleaseGLObjects(CommandQueue, 1, &m_clVelMass[1], 0, NULL, NULL), "Error releasing OpenGL buffer.");
+	}
 
+	// the frame waits here for the simulation kernels
+	CTraceZone zone("clFinish");
 	clFinish(CommandQueue);
 
 }
 
+void CParticleSystemTask::ProfileKernels(cl_command_queue CommandQueue, size_t LocalWorkSize[3], int NIterations)
+{
+	// the arguments of the last frame are still set, the stream compaction kernels are not used yet
+	size_t globalWorkSize[1] = { CLUtil::GetGlobalWorkSize(m_nParticles, LocalWorkSize[0]) };
+
+	SKernelProfile profile;
+	if(!CLUtil::ProfileKernelEvents(CommandQueue, m_IntegrateKernel, 1, globalWorkSize, LocalWorkSize, NIterations, profile))
+		return;
+
+	CLUtil::PrintKernelProfile("Integrate", profile);
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("Integrate", m_nParticles, profile));
+}
+
+bool CParticleSystemTask::ValidateState(cl_command_queue CommandQueue)
+{
+	std::vector<cl_float4> posLife(m_nParticles);
+	V_RETURN_FALSE_CL(clEnqueueReadBuffer(CommandQueue, m_clPosLife[0], CL_TRUE, 0, posLife.size() * sizeof(cl_float4), posLife.data(), 0, NULL, NULL),
+		"Error reading the particle positions.");
+
+	for(size_t i = 0; i < posLife.size(); i++)
+	{
+		if(!std::isfinite(posLife[i].s[0]) || !std::isfinite(posLife[i].s[1]) || !std::isfinite(posLife[i].s[2]))
+		{
+			cout<<"Particle "<<i<<" has left the finite range."<<endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 void CParticleSystemTask::Render()
 {
 	glCullFace(GL_BACK);
@@ -626,6 +707,13 @@ void CParticleSystemTask::OnMouseMove(int X, int Y)
 
 void CParticleSystemTask::OnIdle(double , float ElapsedTime)
 {
+	// the headless runner chooses the time step, the interactive one is fixed
+	if(m_Headless)
+	{
+		m_TimeStep = ElapsedTime;
+		return;
+	}
+
 	//move camera?
 	if(m_KeyboardMask[GLFW_KEY_W])
 		m_TranslateZ += 2.f * ElapsedTime;
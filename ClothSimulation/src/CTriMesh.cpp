@@ -275,25 +275,23 @@ bool CTriMesh::CreateGLResources()
 	//{
 	//	pVertices[iVert] = m_Vertices[iVert];
 	//}
-	float4* pVertices = new float4[m_Vertices.size()];
-	float4* pNormals = new float4[m_Vertices.size()];
+	std::vector<float4> vertices, normals;
+	GetVertexData(vertices, normals);
 	float2* pTexCoords = new float2[m_Vertices.size()];
 
 	for(size_t iVert = 0; iVert < m_Vertices.size(); iVert++)
 	{
-		pVertices[iVert] = float4(m_Vertices[iVert].Pos, 1.0f);
-		pNormals[iVert] = float4(m_Vertices[iVert].Norm, 0.0f);
 		pTexCoords[iVert] = m_Vertices[iVert].Tex;
 	}
 
 	glGenBuffers(1, &m_glVertexBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, m_glVertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float4) * m_Vertices.size(), pVertices, GL_DYNAMIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float4) * m_Vertices.size(), vertices.data(), GL_DYNAMIC_DRAW);
 	V_RETURN_OGL_ERROR();
 	
 	glGenBuffers(1, &m_glNormalBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, m_glNormalBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float4) * m_Vertices.size(), pNormals, GL_DYNAMIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float4) * m_Vertices.size(), normals.data(), GL_DYNAMIC_DRAW);
 	V_RETURN_OGL_ERROR();
 
 	glGenBuffers(1, &m_glTexCoordBuffer);
@@ -301,8 +299,6 @@ bool CTriMesh::CreateGLResources()
 	glBufferData(GL_ARRAY_BUFFER, sizeof(float2) * m_Vertices.size(), pTexCoords, GL_DYNAMIC_DRAW);
 	V_RETURN_OGL_ERROR();
 
-	delete [] pVertices;
-	delete [] pNormals;
 	delete [] pTexCoords;
 	
 	glGenBuffers(1, &m_glIndexBuffer);
@@ -328,6 +324,10 @@ bool CTriMesh::CreateGLResources()
 
 void CTriMesh::ReleaseGLResources()
 {
+	// meshes that are only used on the CPU (headless mode) must not make any OpenGL calls
+	if(!m_glVertexBuffer && !m_glNormalBuffer && !m_glTexCoordBuffer && !m_glIndexBuffer)
+		return;
+
 	SAFE_RELEASE_GL_BUFFER(m_glVertexBuffer);
 	CHECK_FOR_OGL_ERROR();
 	SAFE_RELEASE_GL_BUFFER(m_glNormalBuffer);
@@ -381,6 +381,18 @@ GLuint CTriMesh::GetNormalBuffer() const
 	return m_glNormalBuffer;
 }
 
+void CTriMesh::GetVertexData(std::vector<float4>& Positions, std::vector<float4>& Normals) const
+{
+	Positions.resize(m_Vertices.size());
+	Normals.resize(m_Vertices.size());
+
+	for(size_t iVert = 0; iVert < m_Vertices.size(); iVert++)
+	{
+		Positions[iVert] = float4(m_Vertices[iVert].Pos, 1.0f);
+		Normals[iVert] = float4(m_Vertices[iVert].Norm, 0.0f);
+	}
+}
+
 //void CTriMesh::SetTransform(const float4x4& Matrix)
 //{
 //	m_ModelMatrix = Matrix;
@@ -13,10 +13,11 @@ using namespace std;
 int main(int argc, char** argv)
 {
 	CAssignment4* pAssignment = CAssignment4::GetSingleton();
+	bool success = false;
 
 	if(pAssignment)
 	{
-		pAssignment->EnterMainLoop(argc, argv);
+		success = pAssignment->EnterMainLoop(argc, argv);
 		delete pAssignment;
 	}
 	
@@ -25,6 +26,7 @@ int main(int argc, char** argv)
 	cin.get();
 #endif
 
+	return success ? 0 : 1;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
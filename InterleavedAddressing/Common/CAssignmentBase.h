@@ -21,9 +21,31 @@
 #define _CASSIGNMENT_BASE_H
 
 #include "IComputeTask.h"
+#include "CCommandLine.h"
+#include "CBenchmarkSweep.h"
+#include "CAutoTuner.h"
+#include "CHostBuffer.h"
+#include "CResultsSink.h"
 
 #include "CommonDefs.h"
 
+#include <vector>
+
+//! One task of RunComputeTasks(), the task is owned by the caller
+struct SComputeTaskRun
+{
+	SComputeTaskRun();
+
+	IComputeTask*					pTask;
+	size_t							LocalWorkSize[3];
+	//! Printed before the task starts, e.g. the sweep configuration
+	std::string						Label;
+
+	// filled when the task is finished
+	bool							Valid;
+	std::vector<SBenchmarkResult>	Results;
+};
+
 //! Base class for all assignments
 /*! 
 	Inherit a new class for each specific assignment.
@@ -34,6 +56,60 @@
 
 	Internally the assignment class should initialize the context,
 	run one or more compute tasks and then release the context.
+
+	The OpenCL device can be chosen on the command line (or with the
+	corresponding environment variables):
+		--cl-device-type gpu|cpu|accelerator|all	(GPU_CL_DEVICE_TYPE, default: gpu, falls back to any type)
+		--cl-platform <substring>					(GPU_CL_PLATFORM)
+		--cl-device <substring>						(GPU_CL_DEVICE)
+		--cl-device-index <n>						(GPU_CL_DEVICE_INDEX, index in the printed device table)
+		--cl-select memory|fastest|first			(GPU_CL_SELECT, default: memory)
+
+	The measurements of all tasks can be written to a file:
+		--results <file>							(GPU_RESULTS)
+		--results-format jsonl|csv					(GPU_RESULTS_FORMAT, default: from the file extension)
+
+	A timeline of the host zones and device commands can be recorded (see CTracer):
+		--trace <file>								(GPU_TRACE, Chrome trace JSON for chrome://tracing or Perfetto)
+
+	The CPU reference implementations run on a thread pool (see CThreadPool):
+		--cpu-threads <n>							(GPU_CPU_THREADS, default: 0 = all hardware threads)
+		--cpu-deterministic 0|1						(GPU_CPU_DETERMINISTIC, default: 1, bit-exact results for any thread count)
+		--cpu-simd auto|scalar|sse2|avx2|avx512		(GPU_CPU_SIMD, instruction set of the "CPU-SIMD" baselines, see CSimd)
+
+	The local work sizes can be tuned per device and stored in a database (see CAutoTuner):
+		--autotune [retune]							(GPU_AUTOTUNE, measure missing entries, "retune" measures all again)
+		--autotune-db <file>						(GPU_AUTOTUNE_DB, default: autotune.db, entries are used even without --autotune)
+		--autotune-iterations <n>					(GPU_AUTOTUNE_ITERATIONS, default: 10 launches per candidate)
+
+	The host arrays of the tasks are transferred by copies or mapped in place (see CMirroredBuffer):
+		--buffer-mode auto|pageable|pinned|zerocopy	(GPU_BUFFER_MODE, default: auto = zerocopy on CPU and unified memory devices)
+
+	Large inputs can be streamed in slices that overlap transfers and kernels (see CStreamPipeline):
+		--cl-queues <n>								(GPU_CL_QUEUES, default: 3 = upload, compute and download queue, 1 serializes)
+
+	Multi-pass kernels are replayed from launch plans (see CLaunchPlan):
+		--cl-command-buffers 0|1					(GPU_CL_COMMAND_BUFFERS, default: 1 = record cl_khr_command_buffer if supported)
+
+	The kernel results are related to the peak bandwidth and FLOP rate of the device (see CRoofline):
+		--roofline 0|1								(GPU_ROOFLINE, default: 1 = measure the peaks once per device and report per kernel)
+
+	All tasks can be run several times, e.g. to record a baseline with --results:
+		--repetitions <n>							(GPU_REPETITIONS, default: 1, or 5 with --baseline)
+
+	The results can be checked for slowdowns against a baseline results file (see CRegressionGate),
+	EnterMainLoop() then fails if a kernel is significantly slower or invalid:
+		--baseline <file>							(GPU_BASELINE, results file of --results, only the current device is used)
+		--regression-threshold <percent>			(GPU_REGRESSION_THRESHOLD, default: 5)
+		--regression-alpha <p>						(GPU_REGRESSION_ALPHA, default: 0.01, significance level of the t-test)
+
+	The tasks of a sweep can overlap, the CPU reference of a task then runs while the device
+	computes the previous ones (see CTaskGraph):
+		--task-graph 0|1							(GPU_TASK_GRAPH, default: 0, the overlap perturbs the CPU timings)
+		--task-graph-queues <n>						(GPU_TASK_GRAPH_QUEUES, default: 1, queues for concurrent GPU phases)
+		--task-graph-window <n>						(GPU_TASK_GRAPH_WINDOW, default: 2, tasks with allocated resources)
+
+	The problem sizes, local sizes etc. of the tasks are given as sweeps, see CBenchmarkSweep.
 */
 class CAssignmentBase
 {
@@ -51,14 +127,67 @@ public:
 protected:	
 	virtual bool InitCLContext();
 
+	//! Selects m_CLPlatform and m_CLDevice according to the command line / environment
+	bool SelectCLDevice();
+
+	//! Opens the results file if requested on the command line
+	void OpenResultsSink();
+
+	//! Starts recording a trace if requested on the command line
+	void OpenTrace();
+
+	//! Sets the number of threads and the instruction set of the CPU implementations
+	void ConfigureCPUBaseline();
+
+	//! Loads the tuning database and enables tuning if requested on the command line
+	void OpenAutoTuner();
+
+	//! Selects the host memory mode of the task arrays, requires the command queue
+	void ConfigureBufferMode();
+
+	//! Creates the additional command queues of CStreamPipeline, requires the command queue
+	void CreatePipelineQueues();
+
+	//! Enables the command buffers of CLaunchPlan if requested and supported by the device
+	void ConfigureLaunchPlans();
+
+	//! Measures the roofline peaks of the device unless disabled on the command line
+	void MeasureRoofline();
+
+	//! Loads the baseline of the current device if requested on the command line
+	bool OpenRegressionGate();
+
+	//! Enables the task graph of RunComputeTasks() and creates its command queues if requested
+	void ConfigureTaskGraph();
+
 	virtual void ReleaseCLContext();
 
 	virtual bool RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3]);
 
+	//! Runs several tasks, with --task-graph the phases of different tasks overlap (see CTaskGraph)
+	bool RunComputeTasks(std::vector<SComputeTaskRun>& Runs);
+
+	// The phases of RunComputeTask(), the results of the task are bound with CResultsSink::BindTask()
+	bool InitComputeTask(IComputeTask& Task, size_t LocalWorkSize[3], unsigned int& ResultsId);
+	void ComputeTaskCPU(IComputeTask& Task);
+	void ComputeTaskGPU(IComputeTask& Task, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	bool FinishComputeTask(IComputeTask& Task, unsigned int ResultsId);
+
+	//! Runs all configurations of a sweep (as configured on the command line) in the current context
+	bool RunSweep(CBenchmarkSweep& Sweep, const CBenchmarkSweep::TaskFactory& Factory);
+
 	cl_platform_id		m_CLPlatform;
 	cl_device_id		m_CLDevice;
 	cl_context			m_CLContext;
 	cl_command_queue	m_CLCommandQueue;
+	//! Additional queues of CStreamPipeline, m_CLCommandQueue is the first pipeline queue
+	std::vector<cl_command_queue>	m_CLPipelineQueues;
+	//! Queues of the GPU phases in the task graph, m_CLCommandQueue is the first one
+	std::vector<cl_command_queue>	m_CLTaskGraphQueues;
+	bool							m_TaskGraph;
+	int								m_TaskGraphWindow;
+
+	CCommandLine		m_CommandLine;
 };
 
 #endif // _CASSIGNMENT_BASE_H
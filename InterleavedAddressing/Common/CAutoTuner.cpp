@@ -0,0 +1,325 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CAutoTuner.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// STuningSpace
+
+STuningSpace::STuningSpace(cl_uint Dimensions, size_t SizeX, size_t SizeY, size_t SizeZ)
+	: Dimensions(Dimensions), LocalMemPerWorkItem(0), LocalMemArgument(-1), PowerOfTwo(false)
+{
+	ProblemSize[0] = SizeX;
+	ProblemSize[1] = SizeY;
+	ProblemSize[2] = SizeZ;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CAutoTuner
+
+static size_t NextPowerOfTwo(size_t Value)
+{
+	size_t p = 1;
+	while(p < Value)
+		p *= 2;
+	return p;
+}
+
+static string FormatLocalWorkSize(const size_t LocalWorkSize[3], cl_uint Dimensions)
+{
+	stringstream s;
+	for(cl_uint d = 0; d < Dimensions; d++)
+		s << (d > 0 ? "x" : "") << LocalWorkSize[d];
+	return s.str();
+}
+
+CAutoTuner& CAutoTuner::GetSingleton()
+{
+	static CAutoTuner s_Instance;
+	return s_Instance;
+}
+
+CAutoTuner::CAutoTuner()
+	: m_TuningEnabled(false), m_Retune(false), m_Suspended(false), m_NIterations(10)
+{
+}
+
+bool CAutoTuner::Open(const std::string& Path, bool TuningEnabled, bool Retune, int NIterations)
+{
+	m_Path = Path;
+	m_TuningEnabled = TuningEnabled;
+	m_Retune = Retune;
+	m_NIterations = max(NIterations, 1);
+
+	return Load();
+}
+
+std::string CAutoTuner::GetDeviceName(cl_device_id Device)
+{
+	char name[256] = {0};
+	clGetDeviceInfo(Device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+	return name;
+}
+
+std::string CAutoTuner::GetKey(const std::string& DeviceName, const std::string& KernelName, const STuningSpace& Space)
+{
+	// the bucket is the problem size rounded up to a power of two per dimension
+	size_t bucket[3] = {1, 1, 1};
+	for(cl_uint d = 0; d < Space.Dimensions; d++)
+		bucket[d] = NextPowerOfTwo(Space.ProblemSize[d]);
+
+	return DeviceName + "\t" + KernelName + "\t" + FormatLocalWorkSize(bucket, Space.Dimensions);
+}
+
+bool CAutoTuner::Load()
+{
+	lock_guard<mutex> lock(m_Mutex);
+	m_Entries.clear();
+
+	ifstream file(m_Path.c_str());
+	if(!file.is_open())
+		return true; // a missing database is not an error, it is created by the first tuning run
+
+	// device, kernel, bucket, local_x, local_y, local_z, ms (tab separated)
+	string line;
+	while(getline(file, line))
+	{
+		if(!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		vector<string> fields;
+		stringstream s(line);
+		string field;
+		while(getline(s, field, '\t'))
+			fields.push_back(field);
+		if(fields.size() != 7)
+		{
+			cerr << "Warning: ignoring invalid line in tuning database " << m_Path << ": " << line << endl;
+			continue;
+		}
+
+		STuningResult entry;
+		for(int d = 0; d < 3; d++)
+			entry.LocalWorkSize[d] = (size_t)strtoul(fields[3 + d].c_str(), NULL, 10);
+		entry.TimeMs = atof(fields[6].c_str());
+		m_Entries[fields[0] + "\t" + fields[1] + "\t" + fields[2]] = entry;
+	}
+
+	cout << "Loaded " << m_Entries.size() << " entries from tuning database " << m_Path << "." << endl;
+	return true;
+}
+
+bool CAutoTuner::Save() const
+{
+	ofstream file(m_Path.c_str(), ios::out | ios::trunc);
+	if(!file.is_open())
+	{
+		cerr << "Error: could not write tuning database " << m_Path << endl;
+		return false;
+	}
+
+	file << "# device\tkernel\tbucket\tlocal_x\tlocal_y\tlocal_z\tms" << endl;
+	for(map<string, STuningResult>::const_iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+	{
+		const STuningResult& entry = it->second;
+		file << it->first << "\t" << entry.LocalWorkSize[0] << "\t" << entry.LocalWorkSize[1] << "\t"
+			<< entry.LocalWorkSize[2] << "\t" << entry.TimeMs << endl;
+	}
+	return true;
+}
+
+bool CAutoTuner::Lookup(cl_device_id Device, const std::string& KernelName, const STuningSpace& Space, size_t LocalWorkSize[3]) const
+{
+	lock_guard<mutex> lock(m_Mutex);
+	map<string, STuningResult>::const_iterator it = m_Entries.find(GetKey(GetDeviceName(Device), KernelName, Space));
+	if(it == m_Entries.end())
+		return false;
+
+	for(int d = 0; d < 3; d++)
+		LocalWorkSize[d] = it->second.LocalWorkSize[d];
+	return true;
+}
+
+bool CAutoTuner::GetCandidates(cl_device_id Device, cl_kernel Kernel, const STuningSpace& Space, std::vector<STuningResult>& Candidates) const
+{
+	Candidates.clear();
+
+	size_t kernelWorkGroupSize = 0;
+	size_t maxWorkItemSizes[3] = {1, 1, 1};
+	cl_ulong deviceLocalMem = 0, kernelLocalMem = 0;
+	V_RETURN_FALSE_CL(clGetKernelWorkGroupInfo(Kernel, Device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelWorkGroupSize, NULL),
+		"Error querying the kernel work group size.");
+	V_RETURN_FALSE_CL(clGetKernelWorkGroupInfo(Kernel, Device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong), &kernelLocalMem, NULL),
+		"Error querying the kernel local memory size.");
+	V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(maxWorkItemSizes), maxWorkItemSizes, NULL),
+		"Error querying the maximum work item sizes.");
+	V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &deviceLocalMem, NULL),
+		"Error querying the local memory size.");
+
+	// OpenCL 1.0 has no preferred multiple, then we do not restrict the total size
+	size_t multiple = 1;
+#ifdef CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+	if(clGetKernelWorkGroupInfo(Kernel, Device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &multiple, NULL) != CL_SUCCESS || multiple == 0)
+		multiple = 1;
+#endif
+
+	// CL_KERNEL_LOCAL_MEM_SIZE may already contain the __local arguments of the last launch, which is conservative
+	cl_ulong availableLocalMem = deviceLocalMem > kernelLocalMem ? deviceLocalMem - kernelLocalMem : 0;
+
+	// sizes per dimension: powers of two, plus multiples of the preferred multiple for the first dimension
+	vector<size_t> sizes[3];
+	for(cl_uint d = 0; d < 3; d++)
+	{
+		size_t maxSize = 1;
+		if(d < Space.Dimensions)
+			maxSize = min(min(maxWorkItemSizes[d], kernelWorkGroupSize), NextPowerOfTwo(Space.ProblemSize[d]));
+
+		for(size_t s = 1; s <= maxSize; s *= 2)
+			sizes[d].push_back(s);
+		if(d == 0 && !Space.PowerOfTwo && multiple > 1)
+		{
+			for(size_t s = multiple; s <= maxSize; s += multiple)
+				sizes[d].push_back(s);
+			sort(sizes[d].begin(), sizes[d].end());
+			sizes[d].erase(unique(sizes[d].begin(), sizes[d].end()), sizes[d].end());
+		}
+	}
+
+	vector<STuningResult> unaligned;
+	for(size_t x = 0; x < sizes[0].size(); x++)
+		for(size_t y = 0; y < sizes[1].size(); y++)
+			for(size_t z = 0; z < sizes[2].size(); z++)
+			{
+				STuningResult candidate;
+				candidate.LocalWorkSize[0] = sizes[0][x];
+				candidate.LocalWorkSize[1] = sizes[1][y];
+				candidate.LocalWorkSize[2] = sizes[2][z];
+				candidate.TimeMs = -1.0;
+
+				size_t total = candidate.LocalWorkSize[0] * candidate.LocalWorkSize[1] * candidate.LocalWorkSize[2];
+				if(total > kernelWorkGroupSize || total * Space.LocalMemPerWorkItem > availableLocalMem)
+					continue;
+
+				if(total % multiple == 0)
+					Candidates.push_back(candidate);
+				else
+					unaligned.push_back(candidate);
+			}
+
+	// small problems may not allow a single multiple of the preferred size
+	if(Candidates.empty())
+		Candidates.swap(unaligned);
+
+	return !Candidates.empty();
+}
+
+bool CAutoTuner::Tune(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+	const STuningSpace& Space, const MeasureFunc& Measure, size_t LocalWorkSize[3])
+{
+	if(m_Suspended)
+		return false;
+
+	cl_device_id device = NULL;
+	V_RETURN_FALSE_CL(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL),
+		"Error querying the device of the command queue.");
+
+	if(!m_Retune && Lookup(device, KernelName, Space, LocalWorkSize))
+	{
+		cout << "Using tuned local work size " << FormatLocalWorkSize(LocalWorkSize, Space.Dimensions) << " for " << KernelName << "." << endl;
+		return true;
+	}
+
+	if(!m_TuningEnabled)
+		return false;
+
+	vector<STuningResult> candidates;
+	if(!GetCandidates(device, Kernel, Space, candidates))
+	{
+		cerr << "Error: no valid local work size to tune " << KernelName << "." << endl;
+		return false;
+	}
+
+	cout << "Autotuning " << KernelName << " (" << candidates.size() << " candidates)..." << endl;
+
+	const STuningResult* best = NULL;
+	double defaultMs = -1.0;
+	for(size_t i = 0; i < candidates.size(); i++)
+	{
+		STuningResult& candidate = candidates[i];
+		candidate.TimeMs = Measure(candidate.LocalWorkSize);
+		if(candidate.TimeMs < 0.0)
+			continue;
+
+		if(equal(candidate.LocalWorkSize, candidate.LocalWorkSize + Space.Dimensions, LocalWorkSize))
+			defaultMs = candidate.TimeMs;
+		if(best == NULL || candidate.TimeMs < best->TimeMs)
+			best = &candidate;
+	}
+
+	if(best == NULL)
+	{
+		cerr << "Error: all candidates failed while tuning " << KernelName << "." << endl;
+		return false;
+	}
+
+	cout << "  best local work size " << FormatLocalWorkSize(best->LocalWorkSize, Space.Dimensions) << ": " << best->TimeMs << " ms";
+	if(defaultMs >= 0.0)
+		cout << " (" << FormatLocalWorkSize(LocalWorkSize, Space.Dimensions) << ": " << defaultMs << " ms)";
+	cout << endl;
+
+	for(int d = 0; d < 3; d++)
+		LocalWorkSize[d] = best->LocalWorkSize[d];
+
+	lock_guard<mutex> lock(m_Mutex);
+	m_Entries[GetKey(GetDeviceName(device), KernelName, Space)] = *best;
+	Save();
+
+	return true;
+}
+
+bool CAutoTuner::Tune(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+	const STuningSpace& Space, size_t LocalWorkSize[3])
+{
+	int nIterations = m_NIterations;
+	auto measure = [&](const size_t Local[3]) -> double {
+		size_t global[3] = {1, 1, 1};
+		for(cl_uint d = 0; d < Space.Dimensions; d++)
+			global[d] = CLUtil::GetGlobalWorkSize(Space.ProblemSize[d], Local[d]);
+
+		if(Space.LocalMemArgument >= 0)
+		{
+			size_t localMem = Local[0] * Local[1] * Local[2] * Space.LocalMemPerWorkItem;
+			if(clSetKernelArg(Kernel, Space.LocalMemArgument, localMem, NULL) != CL_SUCCESS)
+				return -1.0;
+		}
+
+		// one launch to check that the configuration is valid, this also warms up the caches
+		if(clEnqueueNDRangeKernel(CommandQueue, Kernel, Space.Dimensions, NULL, global, Local, 0, NULL, NULL) != CL_SUCCESS ||
+			clFinish(CommandQueue) != CL_SUCCESS)
+			return -1.0;
+
+		// the median is less sensitive to outliers than the mean
+		SKernelProfile profile;
+		if(CLUtil::IsProfilingEnabled(CommandQueue) &&
+			CLUtil::ProfileKernelEvents(CommandQueue, Kernel, Space.Dimensions, global, Local, nIterations, profile))
+			return profile.StartToEnd.Median;
+
+		return CLUtil::ProfileKernel(CommandQueue, Kernel, Space.Dimensions, global, Local, nIterations);
+	};
+
+	return Tune(CommandQueue, Kernel, KernelName, Space, measure, LocalWorkSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////
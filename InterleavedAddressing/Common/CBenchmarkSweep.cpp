@@ -0,0 +1,290 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CBenchmarkSweep.h"
+
+#include "CLUtil.h"
+#include "CResultsSink.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CBenchmarkSweep
+
+CBenchmarkSweep::CBenchmarkSweep(const std::string& Name, const std::string& Sizes, const std::string& LocalSizes,
+	const std::string& Variants, const std::string& Iterations)
+	: m_Name(Name), m_SizesSpec(Sizes), m_LocalSizesSpec(LocalSizes), m_VariantsSpec(Variants), m_IterationsSpec(Iterations),
+	m_LocalSizesOverridden(false)
+{
+}
+
+bool CBenchmarkSweep::ParseCommandLine(const CCommandLine& CommandLine)
+{
+	m_LocalSizesOverridden = CommandLine.HasOption(m_Name + "-local");
+	m_SizesSpec = CommandLine.GetString(m_Name + "-sizes", m_SizesSpec);
+	m_LocalSizesSpec = CommandLine.GetString(m_Name + "-local", m_LocalSizesSpec);
+	m_VariantsSpec = CommandLine.GetString(m_Name + "-variants", m_VariantsSpec);
+	m_IterationsSpec = CommandLine.GetString(m_Name + "-iterations", m_IterationsSpec);
+
+	// check the syntax before anything is executed
+	vector<SExtent> extents;
+	return ParseExtents(m_SizesSpec, extents) && ParseExtents(m_LocalSizesSpec, extents) && ParseExtents(m_IterationsSpec, extents);
+}
+
+bool CBenchmarkSweep::IsLocalSizeTunable() const
+{
+	vector<SExtent> extents;
+	return !m_LocalSizesOverridden && ParseExtents(m_LocalSizesSpec, extents) && extents.size() == 1;
+}
+
+bool CBenchmarkSweep::IsSelected(const CCommandLine& CommandLine) const
+{
+	if(!CommandLine.HasOption("sweeps"))
+		return true;
+
+	vector<string> selected;
+	ParseStrings(CommandLine.GetString("sweeps"), selected);
+	for(size_t i = 0; i < selected.size(); i++)
+		if(selected[i] == m_Name)
+			return true;
+	return false;
+}
+
+bool CBenchmarkSweep::ParseExtents(const std::string& Spec, std::vector<SExtent>& Extents)
+{
+	Extents.clear();
+
+	vector<string> items;
+	ParseStrings(Spec, items);
+	for(size_t i = 0; i < items.size(); i++)
+	{
+		const string& item = items[i];
+		size_t firstColon = item.find(':');
+		if(firstColon != string::npos)
+		{
+			// range lo:hi:step, lo:hi:*factor or lo:hi:?count
+			size_t secondColon = item.find(':', firstColon + 1);
+			if(secondColon == string::npos)
+			{
+				cerr << "Error: invalid range '" << item << "', expected lo:hi:step, lo:hi:*factor or lo:hi:?count." << endl;
+				return false;
+			}
+			size_t lo = strtoul(item.substr(0, firstColon).c_str(), NULL, 10);
+			size_t hi = strtoul(item.substr(firstColon + 1, secondColon - firstColon - 1).c_str(), NULL, 10);
+			string stepSpec = item.substr(secondColon + 1);
+			bool multiplicative = !stepSpec.empty() && stepSpec[0] == '*';
+			bool random = !stepSpec.empty() && stepSpec[0] == '?';
+			size_t step = strtoul(stepSpec.c_str() + (multiplicative || random ? 1 : 0), NULL, 10);
+			if(lo == 0 || step == 0 || (multiplicative && step < 2) || (random && hi < lo))
+			{
+				cerr << "Error: invalid range '" << item << "'." << endl;
+				return false;
+			}
+
+			if(random)
+			{
+				// the generator is seeded with the range, so the spec is parsed to the same sizes every time
+				// (mt19937_64 gives the same sequence on all platforms, unlike the standard distributions)
+				mt19937_64 generator(hi * 1000003 + lo * 1009 + step);
+				vector<size_t> values(step);
+				for(size_t v = 0; v < step; v++)
+					values[v] = lo + size_t(generator() % (hi - lo + 1));
+				sort(values.begin(), values.end());
+
+				for(size_t v = 0; v < step; v++)
+				{
+					SExtent extent = { { values[v], 1, 1 } };
+					Extents.push_back(extent);
+				}
+				continue;
+			}
+
+			for(size_t value = lo; value <= hi; value = multiplicative ? value * step : value + step)
+			{
+				SExtent extent = { { value, 1, 1 } };
+				Extents.push_back(extent);
+			}
+		}
+		else
+		{
+			// N, NxM or NxMxK
+			SExtent extent = { { 1, 1, 1 } };
+			stringstream stream(item);
+			string component;
+			int dim = 0;
+			while(getline(stream, component, 'x'))
+			{
+				if(dim >= 3 || component.empty())
+				{
+					cerr << "Error: invalid extent '" << item << "'." << endl;
+					return false;
+				}
+				extent.Value[dim++] = strtoul(component.c_str(), NULL, 10);
+			}
+			Extents.push_back(extent);
+		}
+	}
+
+	return true;
+}
+
+void CBenchmarkSweep::ParseStrings(const std::string& Spec, std::vector<std::string>& Strings)
+{
+	Strings.clear();
+
+	stringstream stream(Spec);
+	string item;
+	while(getline(stream, item, ','))
+	{
+		size_t first = item.find_first_not_of(" \t");
+		size_t last = item.find_last_not_of(" \t");
+		if(first != string::npos)
+			Strings.push_back(item.substr(first, last - first + 1));
+	}
+}
+
+bool CBenchmarkSweep::Run(const TaskFactory& Factory, const TaskRunner& Runner)
+{
+	vector<SSweepConfig> configs;
+	if(!GetConfigurations(configs))
+		return false;
+
+	m_Best.clear();
+
+	bool success = true;
+	for(size_t c = 0; c < configs.size(); c++)
+	{
+		SSweepConfig& config = configs[c];
+		cout << endl << DescribeConfiguration(config) << endl;
+
+		IComputeTask* pTask = Factory(config);
+		if(!pTask)
+		{
+			success = false;
+			continue;
+		}
+
+		success &= Runner(*pTask, config.LocalWorkSize);
+		SAFE_DELETE(pTask);
+
+		const CResultsSink& results = CResultsSink::GetSingleton();
+		UpdateBest(config, results.GetLastTaskResults(), results.WasLastTaskValid());
+	}
+
+	return success;
+}
+
+bool CBenchmarkSweep::GetConfigurations(std::vector<SSweepConfig>& Configs) const
+{
+	vector<SExtent> sizes, localSizes, iterations;
+	vector<string> variants;
+	if(!ParseExtents(m_SizesSpec, sizes) || !ParseExtents(m_LocalSizesSpec, localSizes) || !ParseExtents(m_IterationsSpec, iterations))
+		return false;
+	ParseStrings(m_VariantsSpec, variants);
+	if(variants.empty())
+		variants.push_back("");
+
+	for(size_t s = 0; s < sizes.size(); s++)
+		for(size_t l = 0; l < localSizes.size(); l++)
+			for(size_t v = 0; v < variants.size(); v++)
+				for(size_t i = 0; i < iterations.size(); i++)
+				{
+					SSweepConfig config;
+					for(int d = 0; d < 3; d++)
+					{
+						config.ProblemSize[d] = sizes[s].Value[d];
+						config.LocalWorkSize[d] = localSizes[l].Value[d];
+					}
+					config.Variant = variants[v];
+					config.Iterations = int(iterations[i].Value[0]);
+					Configs.push_back(config);
+				}
+
+	return true;
+}
+
+std::string CBenchmarkSweep::DescribeConfiguration(const SSweepConfig& Config) const
+{
+	stringstream out;
+	out << "[" << m_Name << "] size " << Config.ProblemSize[0];
+	if(Config.ProblemSize[1] > 1)
+		out << "x" << Config.ProblemSize[1];
+	out << ", local " << Config.LocalWorkSize[0] << "x" << Config.LocalWorkSize[1] << "x" << Config.LocalWorkSize[2];
+	if(!Config.Variant.empty())
+		out << ", variant " << Config.Variant;
+	out << ", " << Config.Iterations << " iterations";
+	return out.str();
+}
+
+void CBenchmarkSweep::UpdateBest(const SSweepConfig& Config, const std::vector<SBenchmarkResult>& Results, bool Valid)
+{
+	if(!Valid)
+		return;
+
+	const vector<SBenchmarkResult>& measurements = Results;
+	for(size_t i = 0; i < measurements.size(); i++)
+	{
+		const SBenchmarkResult& measurement = measurements[i];
+		if(measurement.MeanMs <= 0.0)
+			continue;
+
+		SBestConfig* pBest = nullptr;
+		for(size_t b = 0; b < m_Best.size(); b++)
+		{
+			if(m_Best[b].ProblemSize.Value[0] == Config.ProblemSize[0] && m_Best[b].ProblemSize.Value[1] == Config.ProblemSize[1]
+				&& m_Best[b].ProblemSize.Value[2] == Config.ProblemSize[2])
+				pBest = &m_Best[b];
+		}
+
+		if(!pBest)
+		{
+			m_Best.push_back(SBestConfig());
+			pBest = &m_Best.back();
+			for(int d = 0; d < 3; d++)
+				pBest->ProblemSize.Value[d] = Config.ProblemSize[d];
+		}
+		else if(pBest->TimeMs <= measurement.MeanMs)
+		{
+			continue;
+		}
+
+		pBest->Config = Config;
+		// the task may have used its own local size for this measurement
+		for(int d = 0; d < 3; d++)
+			pBest->Config.LocalWorkSize[d] = measurement.LocalWorkSize[d];
+		pBest->Variant = measurement.Variant;
+		pBest->TimeMs = measurement.MeanMs;
+		pBest->BytesMoved = measurement.BytesMoved;
+	}
+}
+
+void CBenchmarkSweep::PrintBestConfigurations() const
+{
+	if(m_Best.empty())
+		return;
+
+	cout << endl << "Best configurations of sweep '" << m_Name << "':" << endl;
+	for(size_t b = 0; b < m_Best.size(); b++)
+	{
+		const SBestConfig& best = m_Best[b];
+		cout << "  size " << best.ProblemSize.Value[0];
+		if(best.ProblemSize.Value[1] > 1)
+			cout << "x" << best.ProblemSize.Value[1];
+		cout << ": " << (best.Variant.empty() ? "default" : best.Variant)
+			<< ", local " << best.Config.LocalWorkSize[0] << "x" << best.Config.LocalWorkSize[1] << "x" << best.Config.LocalWorkSize[2]
+			<< ", " << best.TimeMs << " ms";
+		if(best.BytesMoved > 0.0)
+			cout << " (" << 1.0e-6 * best.BytesMoved / best.TimeMs << " GB/s)";
+		cout << endl;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
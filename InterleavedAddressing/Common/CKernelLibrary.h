@@ -0,0 +1,113 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CKERNEL_LIBRARY_H
+#define _CKERNEL_LIBRARY_H
+
+#include "CLUtil.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+
+//! Specialization constants of a program, passed to the compiler as -D options
+class CKernelDefines
+{
+public:
+	CKernelDefines& Set(const std::string& Name, int Value);
+	CKernelDefines& Set(const std::string& Name, unsigned int Value);
+	CKernelDefines& Set(const std::string& Name, size_t Value);
+	CKernelDefines& Set(const std::string& Name, float Value);
+	CKernelDefines& Set(const std::string& Name, bool Value);
+	//! Defines the macro as the given token, e.g. a type name
+	CKernelDefines& SetToken(const std::string& Name, const std::string& Token);
+	//! Defines the macro without a value
+	CKernelDefines& Set(const std::string& Name);
+
+	bool IsEmpty() const { return m_Values.empty(); }
+
+	//! The -D options, ordered by name so equal defines give equal options
+	std::string GetOptions() const;
+
+protected:
+	std::map<std::string, std::string>	m_Values;
+};
+
+//! Loads kernel sources with #include support and builds each specialization only once per context
+/*!
+	#include "File.cl" is resolved against the directory of the including file first,
+	then against the search paths (the working directory and ../Common/CL, which
+	holds the kernels shared by the assignments). Each file is inserted only once
+	per program, so shared headers need no include guards.
+
+	Build() memoizes the programs per context, device, source and options. Tasks
+	with the same specialization share one program; the returned program is retained
+	for the caller, who releases it as usual (SAFE_RELEASE_PROGRAM). The library
+	drops its references in ReleasePrograms(), which CAssignmentBase calls before it
+	releases the context.
+*/
+class CKernelLibrary
+{
+public:
+	static CKernelLibrary& GetSingleton();
+
+	void AddSearchPath(const std::string& Path);
+
+	//! Reads a kernel file and inserts all files it includes
+	bool LoadSource(const std::string& FileName, std::string& SourceCode);
+
+	//! Loads and builds a program, or returns the one built before with the same source and options
+	cl_program Build(cl_device_id Device, cl_context Context, const std::string& FileName,
+		const CKernelDefines& Defines = CKernelDefines(), const std::string& CompileOptions = "");
+
+	//! Releases the memoized programs of the context
+	void ReleasePrograms(cl_context Context);
+
+	void PrintStats() const;
+
+protected:
+	CKernelLibrary();
+
+	struct SProgramKey
+	{
+		cl_context		Context;
+		cl_device_id	Device;
+		std::string		SourceCode;
+		std::string		CompileOptions;
+
+		bool operator<(const SProgramKey& Other) const;
+	};
+
+	bool Preprocess(const std::string& Path, std::set<std::string>& Included, std::vector<std::string>& Stack, std::string& Output);
+
+	//! Finds an included file, returns an empty string if it does not exist
+	std::string ResolveInclude(const std::string& Name, const std::string& IncludingPath) const;
+
+	std::vector<std::string>			m_SearchPaths;
+	std::map<SProgramKey, cl_program>	m_Programs;
+
+	size_t								m_Hits;
+	size_t								m_Misses;
+
+	mutable std::mutex					m_Mutex;
+};
+
+#endif // _CKERNEL_LIBRARY_H
@@ -0,0 +1,36 @@
+// Micro-benchmarks for the peaks of the roofline model, see CRoofline
+
+// Peak memory bandwidth: every work-item copies float4s in a grid-stride loop
+__kernel void Roofline_Copy(const __global float4* in, __global float4* out, uint n)
+{
+	for (uint i = get_global_id(0); i < n; i += get_global_size(0))
+		out[i] = in[i];
+}
+
+#define FMA_ITERATIONS 256
+
+// Peak arithmetic rate: four independent multiply-add chains of float4 in registers,
+// FMA_ITERATIONS * 4 * 4 * 2 = 8192 floating point operations per work-item.
+// mad() maps to the fastest multiply-add of the device, fma() has to be correctly rounded
+// and is emulated in software on devices without FMA units.
+__kernel void Roofline_FMA(__global float* out, float a, float b)
+{
+	float4 va = (float4)(a);
+	float4 vb = (float4)(b);
+	float4 x0 = (float4)(get_global_id(0) * 1.0e-6f);
+	float4 x1 = x0 + 0.25f;
+	float4 x2 = x0 + 0.5f;
+	float4 x3 = x0 + 0.75f;
+
+	for (int i = 0; i < FMA_ITERATIONS; i++)
+	{
+		x0 = mad(x0, va, vb);
+		x1 = mad(x1, va, vb);
+		x2 = mad(x2, va, vb);
+		x3 = mad(x3, va, vb);
+	}
+
+	// the write keeps the compiler from removing the loop
+	float4 sum = x0 + x1 + x2 + x3;
+	out[get_global_id(0)] = sum.x + sum.y + sum.z + sum.w;
+}
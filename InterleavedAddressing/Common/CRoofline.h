@@ -0,0 +1,80 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CROOFLINE_H
+#define _CROOFLINE_H
+
+#include "CLUtil.h"
+#include "CResultsSink.h"
+
+#include <string>
+#include <map>
+
+//! Peak rates of a device, measured by micro-benchmarks
+struct SRooflinePeaks
+{
+	std::string		DeviceName;
+	//! Bandwidth of a device-to-device copy kernel in GB/s
+	double			BandwidthGBs;
+	//! Rate of a register-only FMA kernel in GFLOP/s (single precision, one FMA = 2 FLOP)
+	double			GFlops;
+
+	//! Arithmetic intensity (FLOP/byte) at which a kernel stops being memory bound
+	double GetRidgePoint() const { return BandwidthGBs > 0.0 ? GFlops / BandwidthGBs : 0.0; }
+};
+
+//! Relates the measured kernel times to the hardware limits of the device (roofline model)
+/*!
+	The tasks declare the bytes read and written and the arithmetic operations of one
+	iteration in their SBenchmarkResult (BytesMoved, Flops). These are the minimal
+	amounts of the problem, not of a particular variant, so the extra traffic or work
+	of a naive variant shows up as a lower percentage.
+
+	The attainable rate of a kernel with arithmetic intensity I = Flops / BytesMoved is
+	min(GFlops, I * BandwidthGBs). Report() prints the achieved GB/s and GFLOP/s and
+	their fraction of this roofline; kernels without arithmetic are compared to the
+	bandwidth alone.
+
+	The peaks are measured once per device by Measure(), which CAssignmentBase calls
+	after creating the context (--roofline 0 skips it).
+*/
+class CRoofline
+{
+public:
+	static CRoofline& GetSingleton();
+
+	//! Measures the peaks of the device unless it was measured before, returns false on errors
+	bool Measure(cl_device_id Device, cl_context Context, cl_command_queue CommandQueue);
+
+	//! Selects the peaks of a measured device for Report(), NULL disables the report
+	void SetDevice(cl_device_id Device);
+
+	const SRooflinePeaks* GetPeaks() const { return m_Current; }
+
+	//! Prints the achieved rates of a result and fills its RooflinePercent
+	void Report(SBenchmarkResult& Result) const;
+
+protected:
+	CRoofline();
+
+	std::map<cl_device_id, SRooflinePeaks>	m_Peaks;
+	const SRooflinePeaks*					m_Current;
+};
+
+#endif // _CROOFLINE_H
@@ -0,0 +1,89 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTASK_GRAPH_H
+#define _CTASK_GRAPH_H
+
+#include "CLUtil.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+//! Runs a graph of host and device work, each node as soon as its dependencies are finished
+/*!
+	Host nodes run one after another on the thread that calls Run(), the CPU work inside
+	a node is parallelized with CThreadPool as usual. Device nodes run on one thread per
+	command queue, so device nodes without a dependency between them run concurrently on
+	different queues, and host nodes run while the device is busy.
+
+	A node can only depend on nodes that were added before it, so the graph is acyclic.
+	If several nodes are ready, the one that was added first runs first.
+*/
+class CTaskGraph
+{
+public:
+	typedef size_t NodeId;
+	typedef std::function<void()> HostFunc;
+	typedef std::function<void(cl_command_queue CommandQueue)> DeviceFunc;
+
+	CTaskGraph();
+
+	NodeId AddHostNode(const std::string& Name, const HostFunc& Function, const std::vector<NodeId>& Dependencies = std::vector<NodeId>());
+
+	NodeId AddDeviceNode(const std::string& Name, const DeviceFunc& Function, const std::vector<NodeId>& Dependencies = std::vector<NodeId>());
+
+	//! Runs all nodes and returns when they are finished, needs at least one queue if there are device nodes
+	bool Run(const std::vector<cl_command_queue>& CommandQueues);
+
+	void Clear();
+
+	size_t GetNodeCount() const { return m_Nodes.size(); }
+
+protected:
+	struct SNode
+	{
+		std::string				Name;
+		bool					Device;
+		HostFunc				Host;
+		DeviceFunc				DeviceFunction;
+		size_t					NDependencies;
+		std::vector<NodeId>		Dependents;
+	};
+
+	NodeId AddNode(SNode& Node, const std::vector<NodeId>& Dependencies);
+
+	//! Runs the ready nodes of one kind until all nodes are finished
+	void RunLoop(bool Device, cl_command_queue CommandQueue);
+
+	std::vector<SNode>			m_Nodes;
+
+	// state of Run()
+	std::mutex					m_Mutex;
+	std::condition_variable		m_Changed;
+	std::vector<size_t>			m_Remaining;
+	std::set<NodeId>			m_ReadyHost;
+	std::set<NodeId>			m_ReadyDevice;
+	size_t						m_NFinished;
+};
+
+#endif // _CTASK_GRAPH_H
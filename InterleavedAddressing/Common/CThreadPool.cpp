@@ -0,0 +1,187 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CThreadPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// index of the queue of the current worker thread, -1 for threads that do not belong to the pool
+static thread_local int t_WorkerIndex = -1;
+
+///////////////////////////////////////////////////////////////////////////////
+// CThreadPool
+
+CThreadPool& CThreadPool::GetSingleton()
+{
+	static CThreadPool s_Instance;
+	return s_Instance;
+}
+
+CThreadPool::CThreadPool()
+	: m_Pending(0), m_Stop(false), m_NThreads(1), m_Deterministic(true)
+{
+	SetThreadCount(0);
+}
+
+CThreadPool::~CThreadPool()
+{
+	Stop();
+}
+
+void CThreadPool::SetThreadCount(unsigned int NThreads)
+{
+	Stop();
+
+	if(NThreads == 0)
+		NThreads = thread::hardware_concurrency();
+	m_NThreads = max(NThreads, 1u);
+}
+
+void CThreadPool::Start()
+{
+	// the calling thread is the last one, it does not need a queue of its own
+	unsigned int nWorkers = m_NThreads - 1;
+	for(unsigned int i = 0; i < nWorkers; i++)
+		m_Queues.push_back(unique_ptr<SWorkerQueue>(new SWorkerQueue()));
+	for(unsigned int i = 0; i < nWorkers; i++)
+		m_Threads.push_back(thread(&CThreadPool::WorkerLoop, this, i));
+}
+
+void CThreadPool::Stop()
+{
+	{
+		lock_guard<mutex> lock(m_WakeMutex);
+		m_Stop = true;
+	}
+	m_Wake.notify_all();
+
+	for(size_t i = 0; i < m_Threads.size(); i++)
+		m_Threads[i].join();
+
+	m_Threads.clear();
+	m_Queues.clear();
+	m_Stop = false;
+}
+
+void CThreadPool::WorkerLoop(unsigned int Index)
+{
+	t_WorkerIndex = int(Index);
+
+	for(;;)
+	{
+		if(RunOneTask(t_WorkerIndex))
+			continue;
+
+		unique_lock<mutex> lock(m_WakeMutex);
+		m_Wake.wait(lock, [this]() { return m_Stop || m_Pending > 0; });
+		if(m_Stop)
+			return;
+	}
+}
+
+bool CThreadPool::RunOneTask(int OwnQueue)
+{
+	function<void()> task;
+	size_t nQueues = m_Queues.size();
+
+	// newest task of the own queue first, it is most likely still in the cache
+	if(OwnQueue >= 0)
+	{
+		SWorkerQueue& queue = *m_Queues[OwnQueue];
+		lock_guard<mutex> lock(queue.Mutex);
+		if(!queue.Tasks.empty())
+		{
+			task = move(queue.Tasks.back());
+			queue.Tasks.pop_back();
+		}
+	}
+
+	// steal the oldest task of another queue
+	for(size_t i = 1; !task && i <= nQueues; i++)
+	{
+		SWorkerQueue& queue = *m_Queues[(size_t(OwnQueue + 1) + i - 1) % nQueues];
+		lock_guard<mutex> lock(queue.Mutex);
+		if(!queue.Tasks.empty())
+		{
+			task = move(queue.Tasks.front());
+			queue.Tasks.pop_front();
+		}
+	}
+
+	if(!task)
+		return false;
+
+	m_Pending--;
+	task();
+	return true;
+}
+
+void CThreadPool::GetChunks(size_t Begin, size_t End, size_t Grain, std::vector<size_t>& Bounds) const
+{
+	Bounds.clear();
+	Bounds.push_back(Begin);
+	if(End <= Begin)
+		return;
+
+	// a fixed number of chunks keeps the boundaries independent of the thread count,
+	// otherwise a few chunks per thread are enough for the load balancing
+	size_t nChunks = m_Deterministic ? 256 : size_t(m_NThreads) * 8;
+	size_t chunkSize = max(max(Grain, size_t(1)), (End - Begin + nChunks - 1) / nChunks);
+
+	for(size_t b = Begin + chunkSize; b < End; b += chunkSize)
+		Bounds.push_back(b);
+	Bounds.push_back(End);
+}
+
+void CThreadPool::ParallelFor(size_t Begin, size_t End, const RangeFunc& Body, size_t Grain)
+{
+	vector<size_t> bounds;
+	GetChunks(Begin, End, Grain, bounds);
+	size_t nChunks = bounds.size() - 1;
+
+	if(m_NThreads <= 1 || nChunks <= 1)
+	{
+		for(size_t i = 0; i < nChunks; i++)
+			Body(bounds[i], bounds[i + 1]);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_StartMutex);
+		if(m_Threads.empty())
+			Start();
+	}
+
+	// count the tasks before they are visible, so m_Pending never drops below zero
+	m_Pending += nChunks;
+
+	atomic<size_t> remaining(nChunks);
+	for(size_t i = 0; i < nChunks; i++)
+	{
+		SWorkerQueue& queue = *m_Queues[i % m_Queues.size()];
+		lock_guard<mutex> lock(queue.Mutex);
+		queue.Tasks.push_back([&, i]() {
+			Body(bounds[i], bounds[i + 1]);
+			remaining--;
+		});
+	}
+
+	// the lock makes sure that no worker misses the notification between its check and the wait
+	{
+		lock_guard<mutex> lock(m_WakeMutex);
+	}
+	m_Wake.notify_all();
+
+	// help until all chunks are done, this also makes nested calls from a worker safe
+	while(remaining > 0)
+	{
+		if(!RunOneTask(t_WorkerIndex))
+			this_thread::yield();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -4,6 +4,16 @@ GPU Computing / GPGPU Praktikum source code.
 ******************************************************************************/
 
 #include "CTimer.h"
+#include "CStatistics.h"
+
+// the raw clock is not adjusted by NTP, but it is not available everywhere
+#if !defined(_WIN32)
+	#ifdef CLOCK_MONOTONIC_RAW
+		#define TIMER_CLOCK CLOCK_MONOTONIC_RAW
+	#else
+		#define TIMER_CLOCK CLOCK_MONOTONIC
+	#endif
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // CTimer
@@ -13,7 +23,7 @@ void CTimer::Start()
 #ifdef _WIN32
 	QueryPerformanceCounter(&m_StartTime);
 #else
-	gettimeofday(&m_StartTime, NULL);
+	clock_gettime(TIMER_CLOCK, &m_StartTime);
 #endif
 }
 
@@ -22,7 +32,7 @@ void CTimer::Stop()
 #ifdef _WIN32
 	QueryPerformanceCounter(&m_EndTime);
 #else
-	gettimeofday(&m_EndTime, NULL);
+	clock_gettime(TIMER_CLOCK, &m_EndTime);
 #endif
 }
 
@@ -39,10 +49,35 @@ double CTimer::GetElapsedMilliseconds()
 		return -1;
 	}
 #else
-	double delta = ((double)m_EndTime.tv_sec + 1.0e-6 * (double)m_EndTime.tv_usec) - 
-		((double)m_StartTime.tv_sec + 1.0e-6 * (double)m_StartTime.tv_usec);
+	// the difference of the seconds is exact, only the result is converted
+	double delta = double(m_EndTime.tv_sec - m_StartTime.tv_sec) + 1.0e-9 * double(m_EndTime.tv_nsec - m_StartTime.tv_nsec);
 	return 1000.0 * delta;
 #endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+// CScopedTimer
+
+CScopedTimer::CScopedTimer(double& ElapsedMilliseconds)
+	: m_pElapsedMilliseconds(&ElapsedMilliseconds), m_pStatistics(NULL)
+{
+	m_Timer.Start();
+}
+
+CScopedTimer::CScopedTimer(CStatistics& Statistics)
+	: m_pElapsedMilliseconds(NULL), m_pStatistics(&Statistics)
+{
+	m_Timer.Start();
+}
+
+CScopedTimer::~CScopedTimer()
+{
+	m_Timer.Stop();
+	double ms = m_Timer.GetElapsedMilliseconds();
+	if(m_pElapsedMilliseconds)
+		*m_pElapsedMilliseconds = ms;
+	if(m_pStatistics)
+		m_pStatistics->Add(ms);
+}
+
+///////////////////////////////////////////////////////////////////////////////
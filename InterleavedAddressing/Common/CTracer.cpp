@@ -0,0 +1,198 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CTracer.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+// process ids of the two groups of tracks
+static const int HOST_PID = 1;
+static const int DEVICE_PID = 2;
+
+// event names may come from the command line (e.g. variants), so quotes and control characters are escaped
+static string EscapeJSON(const string& Text)
+{
+	ostringstream s;
+	for(size_t i = 0; i < Text.size(); i++)
+	{
+		unsigned char c = (unsigned char)Text[i];
+		if(c == '"' || c == '\\')
+			s << '\\' << c;
+		else if(c < 0x20)
+			s << "\\u" << hex << setw(4) << setfill('0') << int(c) << dec;
+		else
+			s << c;
+	}
+	return s.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CTracer
+
+CTracer& CTracer::GetSingleton()
+{
+	static CTracer s_Instance;
+	return s_Instance;
+}
+
+CTracer::CTracer()
+	: m_Enabled(false), m_Start(chrono::steady_clock::now()), m_DeviceOffsetUs(0.0)
+{
+}
+
+CTracer::~CTracer()
+{
+	Close();
+}
+
+bool CTracer::Open(const std::string& Path)
+{
+	Close();
+
+	// fail early instead of losing the trace at the end
+	ofstream file(Path.c_str());
+	if(!file.is_open())
+	{
+		cerr << "Error: could not open the trace file " << Path << endl;
+		return false;
+	}
+
+	lock_guard<mutex> lock(m_Mutex);
+	m_Path = Path;
+	m_Start = chrono::steady_clock::now();
+	m_Enabled = true;
+	return true;
+}
+
+void CTracer::Close()
+{
+	lock_guard<mutex> lock(m_Mutex);
+	if(!m_Enabled)
+		return;
+	m_Enabled = false;
+
+	ofstream file(m_Path.c_str());
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+
+	// track names
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << HOST_PID << ",\"args\":{\"name\":\"Host\"}}," << endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << DEVICE_PID << ",\"args\":{\"name\":\"Device\"}}";
+	for(map<thread::id, int>::const_iterator it = m_ThreadTracks.begin(); it != m_ThreadTracks.end(); ++it)
+		file << "," << endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << HOST_PID << ",\"tid\":" << it->second
+			<< ",\"args\":{\"name\":\"Thread " << it->second << "\"}}";
+	for(map<cl_command_queue, int>::const_iterator it = m_QueueTracks.begin(); it != m_QueueTracks.end(); ++it)
+		file << "," << endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << DEVICE_PID << ",\"tid\":" << it->second
+			<< ",\"args\":{\"name\":\"Queue " << it->second << "\"}}";
+
+	// complete events
+	file << fixed << setprecision(3);
+	for(size_t i = 0; i < m_Events.size(); i++)
+	{
+		const STraceEvent& e = m_Events[i];
+		file << "," << endl << "{\"name\":\"" << EscapeJSON(e.Name) << "\",\"ph\":\"X\",\"pid\":" << e.Pid << ",\"tid\":" << e.Tid
+			<< ",\"ts\":" << e.BeginUs << ",\"dur\":" << e.DurationUs << "}";
+	}
+	file << endl << "]}" << endl;
+
+	cout << "Trace with " << m_Events.size() << " events written to " << m_Path << endl;
+
+	m_Events.clear();
+	m_ThreadTracks.clear();
+	m_QueueTracks.clear();
+}
+
+double CTracer::Now() const
+{
+	return chrono::duration<double, micro>(chrono::steady_clock::now() - m_Start).count();
+}
+
+int CTracer::GetThreadTrack(std::thread::id Thread)
+{
+	map<thread::id, int>::iterator it = m_ThreadTracks.find(Thread);
+	if(it != m_ThreadTracks.end())
+		return it->second;
+	int track = (int)m_ThreadTracks.size();
+	m_ThreadTracks[Thread] = track;
+	return track;
+}
+
+int CTracer::GetQueueTrack(cl_command_queue CommandQueue)
+{
+	map<cl_command_queue, int>::iterator it = m_QueueTracks.find(CommandQueue);
+	if(it != m_QueueTracks.end())
+		return it->second;
+	int track = (int)m_QueueTracks.size();
+	m_QueueTracks[CommandQueue] = track;
+	return track;
+}
+
+void CTracer::AddZone(const std::string& Name, double BeginUs, double EndUs)
+{
+	lock_guard<mutex> lock(m_Mutex);
+	if(!m_Enabled)
+		return;
+
+	STraceEvent e = {Name, HOST_PID, GetThreadTrack(this_thread::get_id()), BeginUs, EndUs - BeginUs};
+	m_Events.push_back(e);
+}
+
+void CTracer::Calibrate(cl_event Event, double HostUs)
+{
+	if(!m_Enabled || Event == NULL)
+		return;
+
+	cl_ulong queued = 0;
+	if(clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, NULL) != CL_SUCCESS)
+		return;
+
+	lock_guard<mutex> lock(m_Mutex);
+	m_DeviceOffsetUs = HostUs - queued * 1e-3;
+}
+
+void CTracer::AddDeviceCommand(const std::string& Name, cl_command_queue CommandQueue, cl_event Event)
+{
+	if(!m_Enabled || Event == NULL)
+		return;
+
+	cl_ulong start = 0, end = 0;
+	if(clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) != CL_SUCCESS ||
+		clGetEventProfilingInfo(Event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) != CL_SUCCESS)
+		return;
+
+	lock_guard<mutex> lock(m_Mutex);
+	if(!m_Enabled)
+		return;
+
+	STraceEvent e = {Name, DEVICE_PID, GetQueueTrack(CommandQueue), m_DeviceOffsetUs + start * 1e-3,
+		end > start ? (end - start) * 1e-3 : 0.0};
+	m_Events.push_back(e);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CTraceZone
+
+CTraceZone::CTraceZone(const std::string& Name)
+	: m_BeginUs(-1.0)
+{
+	// the name is only copied if it is recorded
+	if(CTracer::GetSingleton().IsEnabled())
+	{
+		m_Name = Name;
+		m_BeginUs = CTracer::GetSingleton().Now();
+	}
+}
+
+CTraceZone::~CTraceZone()
+{
+	if(m_BeginUs >= 0.0)
+		CTracer::GetSingleton().AddZone(m_Name, m_BeginUs, CTracer::GetSingleton().Now());
+}
+
+///////////////////////////////////////////////////////////////////////////////
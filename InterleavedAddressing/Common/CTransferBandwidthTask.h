@@ -0,0 +1,85 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTRANSFER_BANDWIDTH_TASK_H
+#define _CTRANSFER_BANDWIDTH_TASK_H
+
+#include "IComputeTask.h"
+#include "CHostBuffer.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+//! Measures host-to-device, device-to-host and device-to-device transfers of one size
+/*!
+	For every host memory mode of CHostBuffer (or only the one given as variant) the
+	H2D and D2H copies are profiled, the D2D copy between two device buffers once per
+	task. Each transfer is reported as its own variant ("H2D-pinned", "D2D", ...), the
+	median time of a small transfer is its latency.
+
+	Validation checks that the data survives the round trip host -> device -> device -> host
+	in every mode. The CPU part measures memcpy() of the same size as a baseline.
+*/
+class CTransferBandwidthTask : public IComputeTask
+{
+public:
+	//! Size is given in bytes
+	CTransferBandwidthTask(size_t Size, const std::string& Variant = "", unsigned int NIterations = 100);
+
+	virtual ~CTransferBandwidthTask();
+
+	// IComputeTask
+
+	virtual bool InitResources(cl_device_id Device, cl_context Context);
+
+	virtual void ReleaseResources();
+
+	virtual void ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+
+	virtual void ComputeCPU();
+
+	virtual bool ValidateResults();
+
+	virtual std::string GetName() const { return "TransferBandwidth"; }
+
+protected:
+	typedef std::function<cl_int(cl_event* Event)> EnqueueFunc;
+
+	bool IsModeEnabled(EHostMemoryMode Mode) const;
+
+	//! Measures the transfers of one host memory mode, returns false if the data did not survive the round trip
+	bool MeasureMode(cl_context Context, cl_command_queue CommandQueue, EHostMemoryMode Mode);
+
+	//! Profiles a transfer, prints and reports its time. BytesMoved are the bytes read and written by one transfer.
+	bool Measure(cl_command_queue CommandQueue, const std::string& Variant, double BytesMoved, const EnqueueFunc& Enqueue);
+
+	size_t						m_Size;
+	std::string					m_Variant;
+	unsigned int				m_NIterations;
+
+	std::vector<unsigned char>	m_hPattern;
+
+	cl_mem						m_dBuffer = nullptr;
+	cl_mem						m_dBufferCopy = nullptr;
+
+	bool						m_Valid = true;
+};
+
+#endif // _CTRANSFER_BANDWIDTH_TASK_H
@@ -9,96 +9,71 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CScanTask.h"
 
 #include <iostream>
+#include <sstream>
 
 using namespace std;
 
+static vector<string> SplitList(const string& List)
+{
+	vector<string> items;
+	stringstream stream(List);
+	string item;
+	while(getline(stream, item, ','))
+	{
+		if(!item.empty())
+			items.push_back(item);
+	}
+	return items;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // CAssignment2
 
 bool CAssignment2::DoCompute()
 {
+	bool success = true;
+
 	// Task 1: parallel reduction
+	// Use --reduction-sizes 1048576:16777216:*2 --reduction-local 64:1024:*2 to reproduce the full evaluation sweep.
 	cout<<"########################################"<<endl;
 	cout<<"Running parallel reduction task..."<<endl<<endl;
-	{
-		size_t LocalWorkSize[3] = {256, 1, 1};
-		CReductionTask reduction(1024 * 1024 * 16);
-		RunComputeTask(reduction, LocalWorkSize);
-
-		// cout << "######################################   64   ######################################\n";
-		// LocalWorkSize[0] = 64;
-		// reduction = CReductionTask(1024 * 1024 * 1);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 2);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 4);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 8);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 16);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// cout << "######################################  128   ######################################\n";
-		// LocalWorkSize[0] = 128;
-		// reduction = CReductionTask(1024 * 1024 * 1);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 2);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 4);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 8);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 16);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// cout << "######################################  256   ######################################\n";
-		// LocalWorkSize[0] = 256;
-		// reduction = CReductionTask(1024 * 1024 * 1);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 2);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 4);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 8);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 16);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// cout << "######################################  512   ######################################\n";
-		// LocalWorkSize[0] = 512;
-		// reduction = CReductionTask(1024 * 1024 * 1);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 2);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 4);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 8);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 16);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// cout << "######################################  1024  ######################################\n";
-		// LocalWorkSize[0] = 1024;
-		// reduction = CReductionTask(1024 * 1024 * 1);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 2);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 4);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 8);
-		// RunComputeTask(reduction, LocalWorkSize);
-		// reduction = CReductionTask(1024 * 1024 * 16);
-		// RunComputeTask(reduction, LocalWorkSize);
+	CBenchmarkSweep reduction("reduction", "16777216", "256", "", "100");
+	// validation of arbitrary sizes: below one work-group, primes and random ones, none of them padded
+	CBenchmarkSweep reductionRandom("reduction-random", "1,3,255,257,4099,65537,1:4194304:?8", "256", "", "10");
+	vector<string> types = SplitList(m_CommandLine.GetString("reduction-types", "uint", "GPU_REDUCTION_TYPES"));
+	vector<string> operators = SplitList(m_CommandLine.GetString("reduction-ops", "sum", "GPU_REDUCTION_OPS"));
+	for(size_t t = 0; t < types.size(); t++)
+		for(size_t o = 0; o < operators.size(); o++)
+		{
+			const string& type = types[t];
+			const string& op = operators[o];
+			if(!CReductionTask::IsSupported(type, op))
+			{
+				cerr << "Error: there is no " << op << " reduction of " << type << "." << endl;
+				success = false;
+				continue;
+			}
 
-	}
+			cout << endl << "Reduction: " << op << " of " << type << endl;
+			auto factory = [&](const SSweepConfig& Config) -> IComputeTask* {
+				return CReductionTask::Create(type, op, Config.ProblemSize[0], Config.Variant, Config.Iterations);
+			};
+			success &= RunSweep(reduction, factory);
+			success &= RunSweep(reductionRandom, factory);
+		}
 
 	// Task 2: parallel prefix sum
 	cout << "########################################"<<endl;
 	cout<<"Running parallel prefix sum task..."<<endl<<endl;
-	{
-		size_t LocalWorkSize[3] = {256, 1, 1};
-		CScanTask scan(1024*1024*16 , LocalWorkSize[0]);
-		RunComputeTask(scan, LocalWorkSize);
-	}
-
+	CBenchmarkSweep scan("scan", "16777216", "256", "", "100");
+	CBenchmarkSweep scanRandom("scan-random", "1,3,255,257,4099,65537,1:4194304:?8", "256", "", "10");
+	auto scanFactory = [](const SSweepConfig& Config) -> IComputeTask* {
+		return CScanTask::Create(Config.ProblemSize[0], Config.LocalWorkSize[0], Config.Variant, Config.Iterations);
+	};
+	success &= RunSweep(scan, scanFactory);
+	success &= RunSweep(scanRandom, scanFactory);
 
-	return true;
+	return success;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
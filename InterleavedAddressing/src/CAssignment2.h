@@ -23,6 +23,14 @@
 #include "../Common/CAssignmentBase.h"
 
 //! Assignment2 solution
+/*!
+	The reduction runs for each combination of element type and operator (see CReductionTask):
+		--reduction-types <list>					(GPU_REDUCTION_TYPES, default: uint, of int,uint,uint64,float,double)
+		--reduction-ops <list>						(GPU_REDUCTION_OPS, default: sum, of sum,kahan,min,max,argmin,argmax)
+
+	The sweeps "reduction-random" and "scan-random" validate sizes that are not a power of two,
+	e.g. --reduction-random-sizes 1:16777216:?32 draws 32 random sizes (see CBenchmarkSweep).
+*/
 class CAssignment2 : public CAssignmentBase
 {
 public:
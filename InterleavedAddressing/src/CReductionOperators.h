@@ -0,0 +1,367 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CREDUCTION_OPERATORS_H
+#define _CREDUCTION_OPERATORS_H
+
+#include "../Common/CLUtil.h"
+#include "../Common/CKernelLibrary.h"
+#include "../Common/CSimd.h"
+#include "../Common/CThreadPool.h"
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <type_traits>
+
+// Element types and associative operators of the typed reduction (see CTypedReductionTask).
+// Each operator defines the same Identity(), Load() and Combine() as the specialization of
+// Reduction.cl it selects with GetDefines(), so host and device accumulators have the same layout.
+
+///////////////////////////////////////////////////////////////////////////////
+// Element types
+
+//! Names, limits and test data of an element type, Sum is the accumulator of its sums
+template<typename T> struct SReductionType;
+
+template<> struct SReductionType<cl_int>
+{
+	typedef cl_long Sum;
+	static const char* GetName() { return "int"; }
+	static const char* GetCLName() { return "int"; }
+	static const char* GetCLSumName() { return "long"; }
+	static const char* GetCLMax() { return "INT_MAX"; }
+	static const char* GetCLLowest() { return "INT_MIN"; }
+	static cl_int Random() { return (rand() & 31) - 16; }
+};
+
+template<> struct SReductionType<cl_uint>
+{
+	typedef cl_ulong Sum;
+	static const char* GetName() { return "uint"; }
+	static const char* GetCLName() { return "uint"; }
+	static const char* GetCLSumName() { return "ulong"; }
+	static const char* GetCLMax() { return "UINT_MAX"; }
+	static const char* GetCLLowest() { return "0u"; }
+	static cl_uint Random() { return rand() & 15; }
+};
+
+template<> struct SReductionType<cl_ulong>
+{
+	typedef cl_ulong Sum;
+	static const char* GetName() { return "uint64"; }
+	static const char* GetCLName() { return "ulong"; }
+	static const char* GetCLSumName() { return "ulong"; }
+	static const char* GetCLMax() { return "ULONG_MAX"; }
+	static const char* GetCLLowest() { return "0ul"; }
+	// counters beyond 32 bit, 2^24 of them still sum up without overflow
+	static cl_ulong Random() { return (cl_ulong(rand() & 0x7fff) << 24) | cl_ulong(rand() & 0xffffff); }
+};
+
+template<> struct SReductionType<cl_float>
+{
+	typedef cl_float Sum;
+	static const char* GetName() { return "float"; }
+	static const char* GetCLName() { return "float"; }
+	static const char* GetCLSumName() { return "float"; }
+	static const char* GetCLMax() { return "INFINITY"; }
+	static const char* GetCLLowest() { return "-INFINITY"; }
+	// not negative, so the magnitude of the sum bounds its rounding error
+	static cl_float Random() { return float(rand()) / float(RAND_MAX); }
+};
+
+template<> struct SReductionType<cl_double>
+{
+	typedef cl_double Sum;
+	static const char* GetName() { return "double"; }
+	static const char* GetCLName() { return "double"; }
+	static const char* GetCLSumName() { return "double"; }
+	static const char* GetCLMax() { return "INFINITY"; }
+	static const char* GetCLLowest() { return "-INFINITY"; }
+	static cl_double Random() { return double(rand()) / double(RAND_MAX); }
+};
+
+//! Largest and lowest value of a type, infinity for floating point types
+template<typename T> T GetReductionMax() { return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(); }
+template<typename T> T GetReductionLowest() { return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(); }
+
+//! Sets the -D options of the element type, double requires cl_khr_fp64
+template<typename T> bool SetReductionElement(cl_device_id Device, CKernelDefines& Defines)
+{
+	Defines.SetToken("ELEMENT", SReductionType<T>::GetCLName());
+	if(std::is_same<T, cl_double>::value)
+	{
+		if(!CLUtil::HasDeviceExtension(Device, "cl_khr_fp64"))
+		{
+			std::cerr << "Error: the device does not support double precision (cl_khr_fp64)." << std::endl;
+			return false;
+		}
+		Defines.Set("REDUCTION_FP64");
+	}
+	return true;
+}
+
+//! Selects the atomic function of Reduction_DecompAtomics, empty for floating point accumulators or missing extensions
+template<typename A> std::string SelectReductionAtomic(cl_device_id Device, CKernelDefines& Defines, const std::string& Function, bool Extended)
+{
+	if(!std::numeric_limits<A>::is_integer)
+		return "";
+	if(sizeof(A) == 4)
+		return "atomic_" + Function;
+
+	// add is a base atomic, min and max are extended ones
+	if(!CLUtil::HasDeviceExtension(Device, Extended ? "cl_khr_int64_extended_atomics" : "cl_khr_int64_base_atomics"))
+		return "";
+	Defines.Set(Extended ? "REDUCTION_INT64_EXTENDED_ATOMICS" : "REDUCTION_INT64_ATOMICS");
+	return "atom_" + Function;
+}
+
+//! Sum of [Begin, End) with Neumaier compensation in the wider type, the reference for floating point sums
+template<typename T, typename TWide> T GetCompensatedSum(const T* pData, size_t Begin, size_t End)
+{
+	TWide sum = 0, compensation = 0;
+	for(size_t i = Begin; i < End; i++)
+	{
+		TWide x = pData[i];
+		TWide t = sum + x;
+		compensation += (std::abs(sum) >= std::abs(x)) ? (sum - t) + x : (x - t) + sum;
+		sum = t;
+	}
+	return T(sum + compensation);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Operators
+
+//! Sum, integers are accumulated with 64 bit, the reference of floating point sums is compensated
+template<typename T> struct SReduceSum
+{
+	typedef T								Element;
+	typedef typename SReductionType<T>::Sum	Accumulator;
+
+	static const char* GetName() { return "sum"; }
+	//! Suffix of the work_group_reduce_ / sub_group_reduce_ functions, empty if there is none
+	static const char* GetCollective() { return "add"; }
+
+	static std::string GetDefines(cl_device_id Device, CKernelDefines& Defines)
+	{
+		Defines.Set("REDUCE_SUM").SetToken("ACCUMULATOR", SReductionType<T>::GetCLSumName());
+		return SelectReductionAtomic<Accumulator>(Device, Defines, "add", false);
+	}
+
+	static Accumulator Identity() { return Accumulator(0); }
+	static Accumulator Load(T Value, cl_uint) { return Accumulator(Value); }
+	static Accumulator Combine(Accumulator A, Accumulator B) { return A + B; }
+
+	static Accumulator Reference(const T* pData, size_t Begin, size_t End)
+	{
+		if(!std::numeric_limits<T>::is_integer)
+			return Accumulator(GetCompensatedSum<T, long double>(pData, Begin, End));
+
+		Accumulator sum = 0;
+		for(size_t i = Begin; i < End; i++)
+			sum += pData[i];
+		return sum;
+	}
+
+	//! Integer sums are exact, the GPU rounds once per level of the reduction tree and once per
+	//! element a work-item accumulates sequentially (grid-stride), the latter grows like sqrt(N)
+	static bool IsEqual(Accumulator GPU, Accumulator CPU, size_t N)
+	{
+		if(std::numeric_limits<T>::is_integer)
+			return GPU == CPU;
+		double levels = std::ceil(std::log2(double(std::max<size_t>(N, 2))));
+		return std::abs(double(GPU) - double(CPU)) <= (std::sqrt(double(N)) + levels + 1.0) * std::numeric_limits<T>::epsilon() * std::abs(double(CPU));
+	}
+
+	static std::string ToString(Accumulator Value) { std::stringstream s; s.precision(std::numeric_limits<Accumulator>::digits10 + 2); s << Value; return s.str(); }
+
+	//! Vectorized CPU baseline, only available for some types
+	static bool ReduceSIMD(const T* pData, size_t N, Accumulator& Result) { return false; }
+};
+
+//! The partial sum and the compensation of its rounding error, same layout as float2 / double2
+template<typename T> struct SKahanSum
+{
+	T	Sum;
+	T	Compensation;
+};
+
+//! Kahan-compensated sum of floating point values
+template<typename T> struct SReduceKahan
+{
+	static_assert(!std::numeric_limits<T>::is_integer, "Kahan summation requires floating point elements");
+
+	typedef T				Element;
+	typedef SKahanSum<T>	Accumulator;
+
+	static const char* GetName() { return "kahan"; }
+	static const char* GetCollective() { return ""; }
+
+	static std::string GetDefines(cl_device_id Device, CKernelDefines& Defines)
+	{
+		Defines.Set("REDUCE_KAHAN").SetToken("ACCUMULATOR", std::string(SReductionType<T>::GetCLName()) + "2");
+		return "";
+	}
+
+	static Accumulator Identity() { Accumulator a = {0, 0}; return a; }
+	static Accumulator Load(T Value, cl_uint) { Accumulator a = {Value, 0}; return a; }
+	static Accumulator Combine(Accumulator A, Accumulator B)
+	{
+		// TwoSum: err is the exact rounding error of A.Sum + B.Sum
+		T sum = A.Sum + B.Sum;
+		T b = sum - A.Sum;
+		T err = (A.Sum - (sum - b)) + (B.Sum - b);
+		Accumulator a = {sum, A.Compensation + B.Compensation + err};
+		return a;
+	}
+
+	static Accumulator Reference(const T* pData, size_t Begin, size_t End)
+	{
+		Accumulator a = {GetCompensatedSum<T, long double>(pData, Begin, End), 0};
+		return a;
+	}
+
+	//! The compensated result is within a few units in the last place, independent of N
+	static bool IsEqual(const Accumulator& GPU, const Accumulator& CPU, size_t N)
+	{
+		double gpu = double(GPU.Sum) + double(GPU.Compensation);
+		double cpu = double(CPU.Sum) + double(CPU.Compensation);
+		return std::abs(gpu - cpu) <= 4.0 * std::numeric_limits<T>::epsilon() * std::abs(cpu);
+	}
+
+	static std::string ToString(const Accumulator& Value)
+	{
+		std::stringstream s;
+		s.precision(std::numeric_limits<T>::digits10 + 2);
+		s << Value.Sum << " (compensation " << Value.Compensation << ")";
+		return s.str();
+	}
+
+	static bool ReduceSIMD(const T* pData, size_t N, Accumulator& Result) { return false; }
+};
+
+//! Minimum (IsMax false) or maximum (IsMax true)
+template<typename T, bool IsMax> struct SReduceExtremum
+{
+	typedef T	Element;
+	typedef T	Accumulator;
+
+	static const char* GetName() { return IsMax ? "max" : "min"; }
+	static const char* GetCollective() { return GetName(); }
+
+	static std::string GetDefines(cl_device_id Device, CKernelDefines& Defines)
+	{
+		Defines.Set(IsMax ? "REDUCE_MAX" : "REDUCE_MIN")
+			.SetToken("IDENTITY_VALUE", IsMax ? SReductionType<T>::GetCLLowest() : SReductionType<T>::GetCLMax());
+		return SelectReductionAtomic<T>(Device, Defines, GetName(), true);
+	}
+
+	static T Identity() { return IsMax ? GetReductionLowest<T>() : GetReductionMax<T>(); }
+	static T Load(T Value, cl_uint) { return Value; }
+	static T Combine(T A, T B) { return (IsMax ? A < B : B < A) ? B : A; }
+
+	static T Reference(const T* pData, size_t Begin, size_t End)
+	{
+		T result = Identity();
+		for(size_t i = Begin; i < End; i++)
+			result = Combine(result, pData[i]);
+		return result;
+	}
+
+	//! No rounding, the result is one of the elements
+	static bool IsEqual(T GPU, T CPU, size_t N) { return GPU == CPU; }
+
+	static std::string ToString(T Value) { std::stringstream s; s.precision(std::numeric_limits<T>::digits10 + 2); s << Value; return s.str(); }
+
+	static bool ReduceSIMD(const T* pData, size_t N, Accumulator& Result) { return false; }
+};
+
+template<typename T> using SReduceMin = SReduceExtremum<T, false>;
+template<typename T> using SReduceMax = SReduceExtremum<T, true>;
+
+//! A value and the index of its first occurrence, same layout as ArgValue of Reduction.cl
+template<typename T> struct SArgValue
+{
+	T		Value;
+	cl_uint	Index;
+};
+
+//! Index of the minimum (IsMax false) or maximum (IsMax true), ties go to the lower index
+template<typename T, bool IsMax> struct SReduceArgExtremum
+{
+	typedef T				Element;
+	typedef SArgValue<T>	Accumulator;
+
+	static const char* GetName() { return IsMax ? "argmax" : "argmin"; }
+	static const char* GetCollective() { return ""; }
+
+	static std::string GetDefines(cl_device_id Device, CKernelDefines& Defines)
+	{
+		Defines.Set(IsMax ? "REDUCE_ARGMAX" : "REDUCE_ARGMIN")
+			.SetToken("IDENTITY_VALUE", IsMax ? SReductionType<T>::GetCLLowest() : SReductionType<T>::GetCLMax());
+		return "";
+	}
+
+	static Accumulator Identity() { Accumulator a = {IsMax ? GetReductionLowest<T>() : GetReductionMax<T>(), std::numeric_limits<cl_uint>::max()}; return a; }
+	static Accumulator Load(T Value, cl_uint Index) { Accumulator a = {Value, Index}; return a; }
+	static Accumulator Combine(const Accumulator& A, const Accumulator& B)
+	{
+		bool takeB = IsMax ? B.Value > A.Value : B.Value < A.Value;
+		return (takeB || (B.Value == A.Value && B.Index < A.Index)) ? B : A;
+	}
+
+	static Accumulator Reference(const T* pData, size_t Begin, size_t End)
+	{
+		Accumulator result = Identity();
+		for(size_t i = Begin; i < End; i++)
+			result = Combine(result, Load(pData[i], cl_uint(i)));
+		return result;
+	}
+
+	static bool IsEqual(const Accumulator& GPU, const Accumulator& CPU, size_t N) { return GPU.Index == CPU.Index && GPU.Value == CPU.Value; }
+
+	static std::string ToString(const Accumulator& Value)
+	{
+		std::stringstream s;
+		s.precision(std::numeric_limits<T>::digits10 + 2);
+		s << Value.Value << " at " << Value.Index;
+		return s.str();
+	}
+
+	static bool ReduceSIMD(const T* pData, size_t N, Accumulator& Result) { return false; }
+};
+
+template<typename T> using SReduceArgMin = SReduceArgExtremum<T, false>;
+template<typename T> using SReduceArgMax = SReduceArgExtremum<T, true>;
+
+//! The SIMD kernel and the combination of the chunks accumulate with 64 bit, like the GPU
+template<> inline bool SReduceSum<cl_uint>::ReduceSIMD(const cl_uint* pData, size_t N, cl_ulong& Result)
+{
+	const SSimdKernels& simd = CSimd::GetSingleton().GetKernels();
+	Result = CThreadPool::GetSingleton().ParallelReduce(0, N, cl_ulong(0), [&](size_t Begin, size_t End) {
+		return cl_ulong(simd.SumU64(pData + Begin, End - Begin));
+	}, [](cl_ulong A, cl_ulong B) { return A + B; });
+	return true;
+}
+
+#endif // _CREDUCTION_OPERATORS_H
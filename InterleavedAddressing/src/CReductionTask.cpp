@@ -7,26 +7,115 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "../Common/CLUtil.h"
 #include "../Common/CTimer.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CAutoTuner.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CSimd.h"
+#include "../Common/CBufferPool.h"
+#include "../Common/CTracer.h"
+#include "../Common/CStatistics.h"
+#include "../Common/CKernelLibrary.h"
+#include "../Common/CLaunchPlan.h"
+
+#include <algorithm>
 
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////////
 // CReductionTask
 
-string g_kernelNames[5] = {
+string g_kernelNames[8] = {
 	"interleavedAddressing",
 	"sequentialAddressing",
 	"kernelDecomposition",
 	"kernelDecompositionUnroll",
-	"kernelDecompositionAtomics"
+	"kernelDecompositionAtomics",
+	"singlePass",
+	"gridStride",
+	"kernelDecompositionCollective"
 };
 
-CReductionTask::CReductionTask(size_t ArraySize)
-	: m_N(ArraySize), m_hInput(NULL),
+// element types and operators of Create()
+static const char* g_typeNames[] = {"int", "uint", "uint64", "float", "double"};
+static const char* g_operatorNames[] = {"sum", "kahan", "min", "max", "argmin", "argmax"};
+
+template<template<typename> class TOperator, typename T>
+static CReductionTask* CreateTyped(size_t ArraySize, const std::string& Variant, unsigned int NIterations)
+{
+	return new CTypedReductionTask<TOperator<T> >(ArraySize, Variant, NIterations);
+}
+
+template<template<typename> class TOperator>
+static CReductionTask* CreateForType(const std::string& Type, size_t ArraySize, const std::string& Variant, unsigned int NIterations)
+{
+	if(Type == "int")
+		return CreateTyped<TOperator, cl_int>(ArraySize, Variant, NIterations);
+	if(Type == "uint")
+		return CreateTyped<TOperator, cl_uint>(ArraySize, Variant, NIterations);
+	if(Type == "uint64")
+		return CreateTyped<TOperator, cl_ulong>(ArraySize, Variant, NIterations);
+	if(Type == "float")
+		return CreateTyped<TOperator, cl_float>(ArraySize, Variant, NIterations);
+	if(Type == "double")
+		return CreateTyped<TOperator, cl_double>(ArraySize, Variant, NIterations);
+	return nullptr;
+}
+
+bool CReductionTask::IsSupported(const std::string& Type, const std::string& Operator)
+{
+	if(find(g_typeNames, g_typeNames + ARRAYLEN(g_typeNames), Type) == g_typeNames + ARRAYLEN(g_typeNames)
+		|| find(g_operatorNames, g_operatorNames + ARRAYLEN(g_operatorNames), Operator) == g_operatorNames + ARRAYLEN(g_operatorNames))
+		return false;
+
+	// compensation only makes sense for rounded sums
+	return Operator != "kahan" || Type == "float" || Type == "double";
+}
+
+CReductionTask* CReductionTask::Create(const std::string& Type, const std::string& Operator, size_t ArraySize,
+	const std::string& Variant, unsigned int NIterations)
+{
+	if(!IsSupported(Type, Operator))
+	{
+		cerr << "Error: there is no " << Operator << " reduction of " << Type << "." << endl;
+		return nullptr;
+	}
+	if(!Variant.empty() && find(g_kernelNames, g_kernelNames + ARRAYLEN(g_kernelNames), Variant) == g_kernelNames + ARRAYLEN(g_kernelNames))
+	{
+		cerr << "Error: there is no reduction variant " << Variant << "." << endl;
+		return nullptr;
+	}
+
+	if(Operator == "sum")
+		return CreateForType<SReduceSum>(Type, ArraySize, Variant, NIterations);
+	if(Operator == "min")
+		return CreateForType<SReduceMin>(Type, ArraySize, Variant, NIterations);
+	if(Operator == "max")
+		return CreateForType<SReduceMax>(Type, ArraySize, Variant, NIterations);
+	if(Operator == "argmin")
+		return CreateForType<SReduceArgMin>(Type, ArraySize, Variant, NIterations);
+	if(Operator == "argmax")
+		return CreateForType<SReduceArgMax>(Type, ArraySize, Variant, NIterations);
+	if(Type == "float")
+		return CreateTyped<SReduceKahan, cl_float>(ArraySize, Variant, NIterations);
+	return CreateTyped<SReduceKahan, cl_double>(ArraySize, Variant, NIterations);
+}
+
+const std::string& CReductionTask::GetVariantName(unsigned int Task)
+{
+	return g_kernelNames[Task];
+}
+
+CReductionTask::CReductionTask(size_t ArraySize, const std::string& Variant, unsigned int NIterations, size_t ElementSize, size_t AccumulatorSize)
+	: m_N(ArraySize), m_Variant(Variant), m_NIterations(NIterations),
+	m_ElementSize(ElementSize), m_AccumulatorSize(AccumulatorSize), m_Atomics(false), m_hInput(NULL),
 	m_dPingArray(NULL),
 	m_dPongArray(NULL),
+	m_dGroupsDone(NULL),
+	m_NComputeUnits(1),
 	m_Program(NULL),
-	m_InterleavedAddressingKernel(NULL), m_SequentialAddressingKernel(NULL), m_DecompKernel(NULL), m_DecompUnrollKernel(NULL), m_DecompAtomicsKernel(NULL)
+	m_LoadKernel(NULL), m_InterleavedAddressingKernel(NULL), m_SequentialAddressingKernel(NULL), m_DecompKernel(NULL), m_DecompUnrollKernel(NULL), m_DecompAtomicsKernel(NULL), m_SinglePassKernel(NULL),
+	m_GridStrideKernel(NULL), m_GridStrideFinalKernel(NULL), m_DecompCollectiveKernel(NULL)
 {
 }
 
@@ -37,30 +126,41 @@ CReductionTask::~CReductionTask()
 
 bool CReductionTask::InitResources(cl_device_id Device, cl_context Context)
 {
-	//CPU resources
-	m_hInput = new unsigned int[m_N];
-
-	//fill the array with some values
-	for(unsigned int i = 0; i < m_N; i++)
-		//m_hInput[i] = 1;			// Use this for debugging
-		m_hInput[i] = rand() & 15;
+	//specialize the kernels for the element type and operator
+	CKernelDefines defines;
+	if(!Specialize(Device, defines))
+		return false;
+	if(!m_Atomics && (m_Variant.empty() || m_Variant == g_kernelNames[4]))
+		cout << "Note: " << g_kernelNames[4] << " is not available for " << GetName() << " on this device." << endl;
+	if(!SelectCollectives(Device, defines) && (m_Variant.empty() || m_Variant == g_kernelNames[7]))
+		cout << "Note: " << g_kernelNames[7] << " uses local memory for " << GetName() << " on this device." << endl;
+
+	//CPU resources, in zero-copy mode the device reads the input from the host memory directly
+	if(!m_Input.Allocate(Context, m_ElementSize * m_N, CL_MEM_READ_ONLY))
+		return false;
+	m_hInput = m_Input.Get<void>();
+	FillInput();
 
 	//device resources
 	cl_int clError, clError2;
-	m_dPingArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+	m_dPingArray = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, m_AccumulatorSize * m_N, &clError2);
 	clError = clError2;
-	m_dPongArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+	m_dPongArray = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, m_AccumulatorSize * m_N, &clError2);
+	clError |= clError2;
+	cl_uint groupsDone = 0;
+	m_dGroupsDone = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint), &groupsDone, &clError2);
 	clError |= clError2;
 	V_RETURN_FALSE_CL(clError, "Error allocating device arrays");
+	V_RETURN_FALSE_CL(clGetDeviceInfo(Device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &m_NComputeUnits, NULL), "Error querying the compute units");
 
 	//load and compile kernels
-	string programCode;
-
-	CLUtil::LoadProgramSourceToMemory("Reduction.cl", programCode);
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_Program = CKernelLibrary::GetSingleton().Build(Device, Context, "Reduction.cl", defines, m_CompileOptions);
 	if(m_Program == nullptr) return false;
 
 	//create kernels
+	m_LoadKernel = clCreateKernel(m_Program, "Reduction_Load", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_Load.");
+
 	m_InterleavedAddressingKernel = clCreateKernel(m_Program, "Reduction_InterleavedAddressing", &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_InterleavedAddressing.");
 
@@ -76,111 +176,133 @@ bool CReductionTask::InitResources(cl_device_id Device, cl_context Context)
 	m_DecompAtomicsKernel = clCreateKernel(m_Program, "Reduction_DecompAtomics", &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_DecompAtomics.");
 
+	m_SinglePassKernel = clCreateKernel(m_Program, "Reduction_SinglePass", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_SinglePass.");
+
+	m_GridStrideKernel = clCreateKernel(m_Program, "Reduction_GridStride", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_GridStride.");
+
+	m_GridStrideFinalKernel = clCreateKernel(m_Program, "Reduction_GridStrideFinal", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_GridStrideFinal.");
+
+	m_DecompCollectiveKernel = clCreateKernel(m_Program, "Reduction_DecompCollective", &clError);
+	V_RETURN_FALSE_CL(clError, "Failed to create kernel: Reduction_DecompCollective.");
+
 	return true;
 }
 
 void CReductionTask::ReleaseResources()
 {
 	// host resources
-	SAFE_DELETE_ARRAY(m_hInput);
+	m_hInput = NULL;
+	m_Input.Release();
+
+	// the recorded plans reference the buffers and kernels
+	m_Plans.clear();
 
 	// device resources
-	SAFE_RELEASE_MEMOBJECT(m_dPingArray);
-	SAFE_RELEASE_MEMOBJECT(m_dPongArray);
+	SAFE_RELEASE_POOLED(m_dPingArray);
+	SAFE_RELEASE_POOLED(m_dPongArray);
+	SAFE_RELEASE_MEMOBJECT(m_dGroupsDone);
 
+	SAFE_RELEASE_KERNEL(m_LoadKernel);
 	SAFE_RELEASE_KERNEL(m_InterleavedAddressingKernel);
 	SAFE_RELEASE_KERNEL(m_SequentialAddressingKernel);
 	SAFE_RELEASE_KERNEL(m_DecompKernel);
 	SAFE_RELEASE_KERNEL(m_DecompUnrollKernel);
 	SAFE_RELEASE_KERNEL(m_DecompAtomicsKernel);
+	SAFE_RELEASE_KERNEL(m_SinglePassKernel);
+	SAFE_RELEASE_KERNEL(m_GridStrideKernel);
+	SAFE_RELEASE_KERNEL(m_GridStrideFinalKernel);
+	SAFE_RELEASE_KERNEL(m_DecompCollectiveKernel);
 
 	SAFE_RELEASE_PROGRAM(m_Program);
 }
 
-void CReductionTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+bool CReductionTask::SelectCollectives(cl_device_id Device, CKernelDefines& Defines)
 {
-	ExecuteTask(Context, CommandQueue, LocalWorkSize, 0);
-	ExecuteTask(Context, CommandQueue, LocalWorkSize, 1);
-	ExecuteTask(Context, CommandQueue, LocalWorkSize, 2);
-	//ExecuteTask(Context, CommandQueue, LocalWorkSize, 3);
-	ExecuteTask(Context, CommandQueue, LocalWorkSize, 4);
-
-	TestPerformance(Context, CommandQueue, LocalWorkSize, 0);
-	TestPerformance(Context, CommandQueue, LocalWorkSize, 1);
-	TestPerformance(Context, CommandQueue, LocalWorkSize, 2);
-	//TestPerformance(Context, CommandQueue, LocalWorkSize, 3);
-	TestPerformance(Context, CommandQueue, LocalWorkSize, 4);
-
+	// work_group_reduce_ is part of OpenCL C 2.x (optional in 3.0, where Reduction.cl checks the feature macro),
+	// sub_group_reduce_ comes with cl_khr_subgroups. Kahan sums and argmin / argmax have no collective function.
+	unsigned int version = CLUtil::GetDeviceCVersion(Device);
+	if(m_Collective.empty() || version < 200)
+		return false;
+
+	m_CompileOptions = version >= 300 ? "-cl-std=CL3.0" : "-cl-std=CL2.0";
+	Defines.SetToken("REDUCTION_COLLECTIVE", m_Collective).Set("REDUCTION_WORK_GROUP");
+	if(CLUtil::HasDeviceExtension(Device, "cl_khr_subgroups"))
+		Defines.Set("REDUCTION_SUB_GROUP");
+	return true;
 }
 
-void CReductionTask::ComputeCPU()
+bool CReductionTask::IsVariantEnabled(unsigned int Task) const
 {
-	CTimer timer;
-	timer.Start();
-
-	unsigned int nIterations = 10;
-	for(unsigned int j = 0; j < nIterations; j++) {
-		m_resultCPU = m_hInput[0];
-		for(unsigned int i = 1; i < m_N; i++) {
-			m_resultCPU += m_hInput[i];
-		}
-	}
+	// the atomics need an integer accumulator (and the 64 bit atomics extensions)
+	if (Task == 4 && !m_Atomics)
+		return false;
 
-	timer.Stop();
-
-	double ms = timer.GetElapsedMilliseconds() / double(nIterations);
-	cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" <<endl;
+	return m_Variant.empty() || m_Variant == g_kernelNames[Task];
 }
 
-bool CReductionTask::ValidateResults()
+void CReductionTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	bool success = true;
+	//the input is transferred (or unmapped) once, the runs only copy it on the device
+	V_RETURN_CL(m_Input.Upload(CommandQueue), "Error copying data from host to device!");
 
-	for(int i = 0; i < 5; i++)
-		if(m_resultGPU[i] != m_resultCPU)
-		{
-			// Skip decomposition unroll (not needed by GPGPU)
-			if (i == 3) continue;
-			cout << "Validation of reduction kernel "<<g_kernelNames[i]<<" failed. "
-					 << "Result should be " << m_resultCPU << " but is " << m_resultGPU[i] << endl;
-			success = false;
-		}
+	for (unsigned int task = 0; task < ARRAYLEN(g_kernelNames); task++)
+	{
+		if (!IsVariantEnabled(task))
+			continue;
+
+		CTraceZone zone(g_kernelNames[task]);
 
-	return success;
+		// each kernel gets its own tuned local work size
+		size_t localWorkSize[3] = {LocalWorkSize[0], LocalWorkSize[1], LocalWorkSize[2]};
+		TuneLocalWorkSize(Context, CommandQueue, localWorkSize, task);
+
+		// the local trees halve the block, so a swept (or untuned) size like 192 runs with 128
+		size_t powerOfTwo = 1;
+		while (powerOfTwo * 2 <= localWorkSize[0])
+			powerOfTwo *= 2;
+		localWorkSize[0] = powerOfTwo;
+
+		ExecuteTask(Context, CommandQueue, localWorkSize, task);
+		TestPerformance(Context, CommandQueue, localWorkSize, task);
+	}
 }
 
-void CReductionTask::Reduction_InterleavedAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CReductionTask::Reduction_InterleavedAddressing(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
 	// loop kernel calls until result is processed
 	for (unsigned int stride = 1; stride < m_N; stride = stride * 2)
 	{
-		// get local and global work size
+		// get local and global work size, one work-item per pair (the last one may be incomplete)
+		size_t nPairs = (m_N + stride * 2 - 1) / (stride * 2);
 		size_t localWorkSize = LocalWorkSize[0];
-		size_t globalWorkSize = CLUtil::GetGlobalWorkSize(m_N / (stride * 2), localWorkSize);
+		size_t globalWorkSize = CLUtil::GetGlobalWorkSize(nPairs, localWorkSize);
 		size_t nGroups = globalWorkSize / localWorkSize;
 
 		if (nGroups == 1)
 		{
-			localWorkSize = m_N / (stride * 2);
+			localWorkSize = nPairs;
 			globalWorkSize = localWorkSize;
 		}
 
-		// set kernel arguments
-		cl_int cl_error = clSetKernelArg(m_InterleavedAddressingKernel, 0, sizeof(cl_mem), (void*) &m_dPingArray);
-		cl_error = clSetKernelArg(m_InterleavedAddressingKernel, 1, sizeof(cl_uint), (void*) &stride);
-		V_RETURN_CL(cl_error, "Failed to set kernel arguments in 'Reduction_InterleavedAddressing'.");
-
-		// run kernel
-	  cl_error = clEnqueueNDRangeKernel(CommandQueue, m_InterleavedAddressingKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(cl_error, "Failed to run kernel in 'Reduction_InterleavedAddressing'.");
+		// add the pass with its kernel arguments
+		Plan.Launch(m_InterleavedAddressingKernel, 1, &globalWorkSize, &localWorkSize)
+			.Arg(0, m_dPingArray)
+			.Arg(1, stride)
+			.Arg(2, m_N);
 	}
 }
 
-void CReductionTask::Reduction_SequentialAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CReductionTask::Reduction_SequentialAddressing(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
 	// loop kernel calls until result is processed
-	for (unsigned int stride = m_N / 2; stride >= 1 ; stride = stride / 2)
+	for (unsigned int size = m_N; size > 1; )
 	{
+		// the upper half is combined with the lower half, for odd sizes the middle element stays in place
+		unsigned int stride = (size + 1) / 2;
+
 		// get local and global work size
 		size_t localWorkSize = LocalWorkSize[0];
 		size_t globalWorkSize = CLUtil::GetGlobalWorkSize(stride, localWorkSize);
@@ -192,18 +314,17 @@ void CReductionTask::Reduction_SequentialAddressing(cl_context Context, cl_comma
 			globalWorkSize = localWorkSize;
 		}
 
-		// set  kernel arguments
-		cl_int cl_error = clSetKernelArg(m_SequentialAddressingKernel, 0, sizeof(cl_mem), (void*) &m_dPingArray);
-		cl_error = clSetKernelArg(m_SequentialAddressingKernel, 1, sizeof(cl_uint), (void*) &stride);
-		V_RETURN_CL(cl_error, "Failed to set kernel arguments in 'Reduction_SequentialAddressing'.");
+		// add the pass with its kernel arguments
+		Plan.Launch(m_SequentialAddressingKernel, 1, &globalWorkSize, &localWorkSize)
+			.Arg(0, m_dPingArray)
+			.Arg(1, stride)
+			.Arg(2, size);
 
-		// run kernel
-	  cl_error = clEnqueueNDRangeKernel(CommandQueue, m_SequentialAddressingKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(cl_error, "Failed to run kernel in 'Reduction_SequentialAddressing'.");
+		size = stride;
 	}
 }
 
-void CReductionTask::Reduction_Decomp(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CReductionTask::PlanDecomposition(CLaunchPlan& Plan, size_t LocalWorkSize[3], cl_kernel Kernel, bool LocalBlock)
 {
 	size_t localWorkSize = LocalWorkSize[0];
 	size_t globalWorkSize;
@@ -212,151 +333,223 @@ void CReductionTask::Reduction_Decomp(cl_context Context, cl_command_queue Comma
 	// loop kernel calls until result is processed
 	for (unsigned int size = m_N; size > 1; )
 	{
-		// get local and global work size
-		if (localWorkSize < size)
+		// get local and global work size, the last group loads the identity beyond the end of the array
+		if (localWorkSize * 2 < size)
 		{
-			nGroups = size / localWorkSize / 2;
+			nGroups = (size + localWorkSize * 2 - 1) / (localWorkSize * 2);
 			globalWorkSize = nGroups * localWorkSize;
 		} else
 		{
+			// the local trees need a power of two
 			nGroups = 1;
-			localWorkSize = size / 2;
+			localWorkSize = min(localWorkSize, CLUtil::GetNextPowerOfTwo((size + 1) / 2));
 			globalWorkSize = localWorkSize;
 		}
 
-		size = nGroups;
-
-		// set kernel parameter and allocate local memory
-		cl_int cl_error = clSetKernelArg(m_DecompKernel, 0, sizeof(cl_mem), (void*) &m_dPingArray);
-		cl_error = clSetKernelArg(m_DecompKernel, 1, sizeof(cl_mem), (void*) &m_dPongArray);
-		cl_error = clSetKernelArg(m_DecompKernel, 2, sizeof(cl_uint), (void*) &localWorkSize);
-		cl_error = clSetKernelArg(m_DecompKernel, 3, localWorkSize * sizeof(unsigned int), NULL);
-		V_RETURN_CL(cl_error, "Failed to set kernel arguments in 'Reduction_Decomp'.");
-
-		// run kernel
-	  cl_error = clEnqueueNDRangeKernel(CommandQueue, m_DecompKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(cl_error, "Failed to run kernel in 'Reduction_Decomp'.");
+		// add the pass with its kernel parameters and local memory (one value per work-item or one per group)
+		Plan.Launch(Kernel, 1, &globalWorkSize, &localWorkSize)
+			.Arg(0, m_dPingArray)
+			.Arg(1, m_dPongArray)
+			.Arg(2, cl_uint(localWorkSize))
+			.Arg(3, size)
+			.LocalArg(4, (LocalBlock ? localWorkSize : 1) * m_AccumulatorSize);
 
-		swap(m_dPingArray, m_dPongArray);
+		Plan.Swap(m_dPingArray, m_dPongArray);
+		size = cl_uint(nGroups);
 	}
 }
 
-void CReductionTask::Reduction_DecompUnroll(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CReductionTask::Reduction_Decomp(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
-	// Not needed in GPGPU (and also no explanations in paper)
+	PlanDecomposition(Plan, LocalWorkSize, m_DecompKernel, true);
 }
 
-void CReductionTask::Reduction_DecompAtomics(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CReductionTask::Reduction_DecompUnroll(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
-	size_t localWorkSize = LocalWorkSize[0];
-	size_t globalWorkSize;
-	size_t nGroups;
-
-	// loop kernel calls until result is processed
-	for (unsigned int size = m_N; size > 1; )
-	{
-		// get local and global work size
-		if (localWorkSize < size)
-		{
-			nGroups = size / localWorkSize / 2;
-			globalWorkSize = nGroups * localWorkSize;
-		} else
-		{
-			nGroups = 1;
-			localWorkSize = size / 2;
-			globalWorkSize = localWorkSize;
-		}
-
-		size = nGroups;
-
-		// set kernel parameter and allocate local memory
-		cl_int cl_error = clSetKernelArg(m_DecompAtomicsKernel, 0, sizeof(cl_mem), (void*) &m_dPingArray);
-		cl_error = clSetKernelArg(m_DecompAtomicsKernel, 1, sizeof(cl_mem), (void*) &m_dPongArray);
-		cl_error = clSetKernelArg(m_DecompAtomicsKernel, 2, sizeof(cl_uint), (void*) &localWorkSize);
-		cl_error = clSetKernelArg(m_DecompAtomicsKernel, 3, sizeof(unsigned int), NULL);
-		V_RETURN_CL(cl_error, "Failed to set kernel arguments in 'Reduction_DecompAtomics'.");
-
-		// run kernel
-	  cl_error = clEnqueueNDRangeKernel(CommandQueue, m_DecompAtomicsKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(cl_error, "Failed to run kernel in 'Reduction_DecompAtomics'.");
-
-		swap(m_dPingArray, m_dPongArray);
-	}
+	PlanDecomposition(Plan, LocalWorkSize, m_DecompUnrollKernel, true);
 }
 
-void CReductionTask::ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+void CReductionTask::Reduction_DecompCollective(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
-	//write input data to the GPU
-	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hInput, 0, NULL, NULL), "Error copying data from host to device!");
-
-	//run selected task
-	switch (Task){
-		case 0:
-			Reduction_InterleavedAddressing(Context, CommandQueue, LocalWorkSize);
-			break;
-		case 1:
-			Reduction_SequentialAddressing(Context, CommandQueue, LocalWorkSize);
-			break;
-		case 2:
-			Reduction_Decomp(Context, CommandQueue, LocalWorkSize);
-			break;
-		case 3:
-			Reduction_DecompUnroll(Context, CommandQueue, LocalWorkSize);
-			break;
-		case 4:
-			Reduction_DecompAtomics(Context, CommandQueue, LocalWorkSize);
-			break;
-
-	}
-
-	//read back the results synchronously.
-	m_resultGPU[Task] = 0;
-	V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, 1 * sizeof(cl_uint), &m_resultGPU[Task], 0, NULL, NULL), "Error reading data from device!");
+	PlanDecomposition(Plan, LocalWorkSize, m_DecompCollectiveKernel, true);
+}
 
+void CReductionTask::Reduction_DecompAtomics(CLaunchPlan& Plan, size_t LocalWorkSize[3])
+{
+	PlanDecomposition(Plan, LocalWorkSize, m_DecompAtomicsKernel, false);
 }
 
-void CReductionTask::TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+void CReductionTask::Reduction_SinglePass(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
-	cout << "Testing performance of task " << g_kernelNames[Task] << endl;
+	size_t localWorkSize = LocalWorkSize[0];
+	size_t globalWorkSize = GetPersistentGroups(localWorkSize, 1) * localWorkSize;
+
+	// the partial results of the groups go to the pong array, the result to the first element of the ping array
+	Plan.Launch(m_SinglePassKernel, 1, &globalWorkSize, &localWorkSize)
+		.Arg(0, m_dPingArray)
+		.Arg(1, m_dPongArray)
+		.Arg(2, m_dGroupsDone)
+		.Arg(3, cl_uint(m_N))
+		.LocalArg(4, localWorkSize * m_AccumulatorSize);
+}
 
-	//write input data to the GPU
-	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hInput, 0, NULL, NULL), "Error copying data from host to device!");
-	//finish all before we start meassuring the time
-	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
+void CReductionTask::Reduction_GridStride(CLaunchPlan& Plan, size_t LocalWorkSize[3])
+{
+	// vload4 reads four elements per iteration
+	size_t localWorkSize = LocalWorkSize[0];
+	size_t nGroups = GetPersistentGroups(localWorkSize, 4);
+	size_t globalWorkSize = nGroups * localWorkSize;
+
+	// the groups read the input elements directly and write their partial results to the pong array
+	Plan.Launch(m_GridStrideKernel, 1, &globalWorkSize, &localWorkSize)
+		.Arg(0, m_Input.GetDeviceBuffer())
+		.Arg(1, m_dPongArray)
+		.Arg(2, cl_uint(m_N))
+		.LocalArg(3, localWorkSize * m_AccumulatorSize);
+
+	// one group combines the partial results into the first element of the ping array
+	Plan.Launch(m_GridStrideFinalKernel, 1, &localWorkSize, &localWorkSize)
+		.Arg(0, m_dPongArray)
+		.Arg(1, m_dPingArray)
+		.Arg(2, cl_uint(nGroups))
+		.LocalArg(3, localWorkSize * m_AccumulatorSize);
+}
 
-	CTimer timer;
-	timer.Start();
+size_t CReductionTask::GetPersistentGroups(size_t LocalWorkSize, size_t ElementsPerItem) const
+{
+	// the groups loop over the array, so a few groups per compute unit keep the device busy
+	size_t elementsPerGroup = LocalWorkSize * ElementsPerItem;
+	size_t nGroups = min<size_t>((m_N + elementsPerGroup - 1) / elementsPerGroup, 8 * size_t(m_NComputeUnits));
+	return max<size_t>(nGroups, 1);
+}
 
-	//run the kernel N times
-	unsigned int nIterations = 100;
-	for(unsigned int i = 0; i < nIterations; i++) {
-		//run selected task
+size_t CReductionTask::Reduce(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	// the passes are planned once per kernel, local size and start buffer (the decompositions swap ping and pong)
+	CLaunchPlan& plan = m_Plans[make_tuple(Task, LocalWorkSize[0], m_dPingArray)];
+	if (plan.IsEmpty())
+	{
+		//plan selected task
 		switch (Task){
 			case 0:
-				Reduction_InterleavedAddressing(Context, CommandQueue, LocalWorkSize);
+				Reduction_InterleavedAddressing(plan, LocalWorkSize);
 				break;
 			case 1:
-				Reduction_SequentialAddressing(Context, CommandQueue, LocalWorkSize);
+				Reduction_SequentialAddressing(plan, LocalWorkSize);
 				break;
 			case 2:
-				Reduction_Decomp(Context, CommandQueue, LocalWorkSize);
+				Reduction_Decomp(plan, LocalWorkSize);
 				break;
 			case 3:
-				Reduction_DecompUnroll(Context, CommandQueue, LocalWorkSize);
+				Reduction_DecompUnroll(plan, LocalWorkSize);
 				break;
 			case 4:
-				Reduction_DecompAtomics(Context, CommandQueue, LocalWorkSize);
+				Reduction_DecompAtomics(plan, LocalWorkSize);
+				break;
+			case 5:
+				Reduction_SinglePass(plan, LocalWorkSize);
+				break;
+			case 6:
+				Reduction_GridStride(plan, LocalWorkSize);
+				break;
+			case 7:
+				Reduction_DecompCollective(plan, LocalWorkSize);
 				break;
 		}
 	}
 
-	//wait until the command queue is empty again
+	V_RETURN_0_CL(plan.Replay(CommandQueue), "Failed to run the passes of the reduction.");
+	return plan.GetLaunchCount();
+}
+
+void CReductionTask::TuneLocalWorkSize(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	cl_kernel kernels[8] = {m_InterleavedAddressingKernel, m_SequentialAddressingKernel, m_DecompKernel, m_DecompUnrollKernel, m_DecompAtomicsKernel, m_SinglePassKernel, m_GridStrideKernel, m_DecompCollectiveKernel};
+
+	// the local trees halve the block, so only powers of two are valid
+	STuningSpace space(1, m_N);
+	space.PowerOfTwo = true;
+	space.LocalMemPerWorkItem = (Task == 2 || Task == 3 || Task >= 5) ? m_AccumulatorSize : 0;
+
+	// time all passes of the reduction, the input data does not matter for the timing
+	CAutoTuner& tuner = CAutoTuner::GetSingleton();
+	int nIterations = tuner.GetIterations();
+	auto measure = [&](const size_t Local[3]) -> double {
+		size_t localWorkSize[3] = {Local[0], Local[1], Local[2]};
+		if (clFinish(CommandQueue) != CL_SUCCESS)
+			return -1.0;
+
+		CTimer timer;
+		timer.Start();
+		for (int i = 0; i < nIterations; i++)
+			Reduce(Context, CommandQueue, localWorkSize, Task);
+		if (clFinish(CommandQueue) != CL_SUCCESS)
+			return -1.0;
+		timer.Stop();
+
+		return timer.GetElapsedMilliseconds() / double(nIterations);
+	};
+
+	tuner.Tune(CommandQueue, kernels[Task], g_kernelNames[Task], space, measure, LocalWorkSize);
+}
+
+cl_int CReductionTask::LoadInput(cl_command_queue CommandQueue)
+{
+	// the decompositions swap ping and pong, so the arguments are set for each run
+	cl_int clError = clSetKernelArg(m_LoadKernel, 0, sizeof(cl_mem), (void*)&m_Input.GetDeviceBuffer());
+	clError |= clSetKernelArg(m_LoadKernel, 1, sizeof(cl_mem), (void*)&m_dPingArray);
+	clError |= clSetKernelArg(m_LoadKernel, 2, sizeof(cl_uint), (void*)&m_N);
+	if (clError != CL_SUCCESS)
+		return clError;
+
+	// the runtime picks a local size the kernel supports
+	size_t globalWorkSize = m_N;
+	return clEnqueueNDRangeKernel(CommandQueue, m_LoadKernel, 1, NULL, &globalWorkSize, NULL, 0, NULL, NULL);
+}
+
+void CReductionTask::ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	//reset the ping array to the input data
+	V_RETURN_CL(LoadInput(CommandQueue), "Error loading the input data!");
+
+	Reduce(Context, CommandQueue, LocalWorkSize, Task);
+
+	//read back the results synchronously.
+	V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_AccumulatorSize, GetResultGPU(Task), 0, NULL, NULL), "Error reading data from device!");
+
+}
+
+void CReductionTask::TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	cout << "Testing performance of task " << g_kernelNames[Task] << endl;
+
+	//reset the ping array to the input data
+	V_RETURN_CL(LoadInput(CommandQueue), "Error loading the input data!");
+	//finish all before we start meassuring the time
 	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
 
-	timer.Stop();
+	//run the kernel N times (plus two warm-up runs), each run is timed on its own
+	unsigned int nIterations = m_NIterations;
+	CStatistics stats(2);
+	size_t nLaunches = 0;
+	for(unsigned int i = 0; i < nIterations + 2; i++) {
+		CScopedTimer timer(stats);
+		nLaunches = Reduce(Context, CommandQueue, LocalWorkSize, Task);
+		V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
+	}
 
-	double ms = timer.GetElapsedMilliseconds() / double(nIterations);
-	cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" <<endl;
+	size_t nOutliers = 0;
+	double ms = stats.GetRobustMean(3.0, &nOutliers);
+	cout << "  average time: " << ms << " ms (median " << stats.GetMedian() << ", p95 " << stats.GetPercentile(0.95)
+		<< ", " << nOutliers << " outliers), throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s, "
+		<< nLaunches << " launch(es)" <<endl;
+
+	// the local work size may differ from the one of the task if it was tuned
+	// (the roofline counts the minimal work: each element is read once and added once)
+	SBenchmarkResult result(g_kernelNames[Task], m_N, stats, double(m_N) * m_ElementSize, double(m_N));
+	copy(LocalWorkSize, LocalWorkSize + 3, result.LocalWorkSize);
+	CRoofline::GetSingleton().Report(result);
+	CResultsSink::GetSingleton().Add(result);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -21,12 +21,32 @@
 #define _CREDUCTION_TASK_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CHostBuffer.h"
+#include "../Common/CLaunchPlan.h"
+#include "../Common/CTimer.h"
+#include "../Common/CResultsSink.h"
+#include "CReductionOperators.h"
+
+#include <map>
+#include <tuple>
+#include <iostream>
 
 //! A2/T1: Parallel reduction
+/*!
+	The kernels are specialized for an element type, an accumulator type and an
+	associative operator with -D options of Reduction.cl. CTypedReductionTask adds
+	the host side of a specialization (test data, CPU reference and validation),
+	Create() selects it by the names of the type and the operator.
+*/
 class CReductionTask : public IComputeTask
 {
 public:
-	CReductionTask(size_t ArraySize);
+	//! Types: int, uint, uint64, float, double. Operators: sum, kahan (floating point only), min, max, argmin, argmax.
+	static bool IsSupported(const std::string& Type, const std::string& Operator);
+
+	//! Variant selects a single kernel by name (see GetVariantName()), if empty all kernels are executed. Returns nullptr for unsupported types and unknown variants.
+	static CReductionTask* Create(const std::string& Type, const std::string& Operator, size_t ArraySize,
+		const std::string& Variant = "", unsigned int NIterations = 100);
 
 	virtual ~CReductionTask();
 
@@ -38,17 +58,49 @@ public:
 
 	virtual void ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 
-	virtual void ComputeCPU();
-
-	virtual bool ValidateResults();
+	static const std::string& GetVariantName(unsigned int Task);
 
 protected:
+	CReductionTask(size_t ArraySize, const std::string& Variant, unsigned int NIterations, size_t ElementSize, size_t AccumulatorSize);
+
+	//! Sets the -D options of the specialization, m_Atomics and m_Collective, false if the device cannot run it
+	virtual bool Specialize(cl_device_id Device, CKernelDefines& Defines) = 0;
+
+	//! Enables the collective functions the device has, returns false if the kernels fall back to local memory
+	bool SelectCollectives(cl_device_id Device, CKernelDefines& Defines);
+
+	//! Fills m_hInput with test data
+	virtual void FillInput() = 0;
+
+	//! Accumulator of the GPU result of a kernel variant
+	virtual void* GetResultGPU(unsigned int Task) = 0;
+
+	//! Converts the input elements into accumulators in the ping array
+	cl_int LoadInput(cl_command_queue CommandQueue);
+
+	//! The variants add their passes to a launch plan, Reduce() replays it
+	void Reduction_InterleavedAddressing(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Reduction_SequentialAddressing(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Reduction_Decomp(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Reduction_DecompUnroll(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Reduction_DecompAtomics(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Reduction_SinglePass(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Reduction_GridStride(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Reduction_DecompCollective(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+
+	//! The passes of the decomposition kernels, LocalBlock gives each work-item a local value (otherwise one per group)
+	void PlanDecomposition(CLaunchPlan& Plan, size_t LocalWorkSize[3], cl_kernel Kernel, bool LocalBlock);
+
+	//! Number of groups of the kernels that loop over the array, a few per compute unit
+	size_t GetPersistentGroups(size_t LocalWorkSize, size_t ElementsPerItem) const;
+
+	bool IsVariantEnabled(unsigned int Task) const;
 
-	void Reduction_InterleavedAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Reduction_SequentialAddressing(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Reduction_Decomp(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Reduction_DecompUnroll(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Reduction_DecompAtomics(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	//! Enqueues all passes of the selected reduction kernel, returns the number of launches
+	size_t Reduce(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
+
+	//! Replaces LocalWorkSize with the entry of the tuning database (or tunes it, see CAutoTuner)
+	void TuneLocalWorkSize(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
 
 	void ExecuteTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int task);
 	void TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int task);
@@ -58,23 +110,161 @@ protected:
 
 	unsigned int		m_N;
 
-	// input data
-	unsigned int		*m_hInput;
-	// results
-	unsigned int		m_resultCPU;
-	unsigned int		m_resultGPU[5];
+	// selected kernel variant and number of iterations for the performance test
+	std::string			m_Variant;
+	unsigned int		m_NIterations;
+
+	// byte sizes of the specialization
+	size_t				m_ElementSize;
+	size_t				m_AccumulatorSize;
+	// true if Reduction_DecompAtomics supports the accumulator on the device
+	bool				m_Atomics;
+	// suffix of the collective reduce functions of the operator (empty if it has none)
+	std::string			m_Collective;
+	// build options, the collective functions need OpenCL C 2.0
+	std::string			m_CompileOptions;
+
+	// input data (host side of m_Input, valid until it is uploaded)
+	void				*m_hInput;
+	// the input stays on the device, every run resets the ping array with the load kernel
+	CMirroredBuffer		m_Input;
 
+	// accumulator arrays
 	cl_mem				m_dPingArray;
 	cl_mem				m_dPongArray;
+	// counter of the finished groups of the single-pass kernel
+	cl_mem				m_dGroupsDone;
+	// the single-pass and grid-stride kernels start a few groups per compute unit
+	cl_uint				m_NComputeUnits;
 
 	//OpenCL program and kernels
 	cl_program		m_Program;
+	cl_kernel			m_LoadKernel;
 	cl_kernel			m_InterleavedAddressingKernel;
 	cl_kernel			m_SequentialAddressingKernel;
 	cl_kernel			m_DecompKernel;
 	cl_kernel			m_DecompUnrollKernel;
 	cl_kernel			m_DecompAtomicsKernel;
+	cl_kernel			m_SinglePassKernel;
+	cl_kernel			m_GridStrideKernel;
+	cl_kernel			m_GridStrideFinalKernel;
+	cl_kernel			m_DecompCollectiveKernel;
+
+	// launch plans per task, local work size and start buffer
+	std::map<std::tuple<unsigned int, size_t, cl_mem>, CLaunchPlan>	m_Plans;
 
 };
 
+//! The reduction of one element type with one operator of CReductionOperators.h
+template<class TOperator>
+class CTypedReductionTask : public CReductionTask
+{
+public:
+	typedef typename TOperator::Element		Element;
+	typedef typename TOperator::Accumulator	Accumulator;
+
+	CTypedReductionTask(size_t ArraySize, const std::string& Variant, unsigned int NIterations)
+		: CReductionTask(ArraySize, Variant, NIterations, sizeof(Element), sizeof(Accumulator))
+	{
+		m_resultCPU = TOperator::Identity();
+		for(unsigned int i = 0; i < ARRAYLEN(m_resultGPU); i++)
+			m_resultGPU[i] = TOperator::Identity();
+	}
+
+	virtual void ComputeCPU();
+
+	virtual bool ValidateResults();
+
+	virtual std::string GetName() const { return std::string("Reduction ") + TOperator::GetName() + "<" + SReductionType<Element>::GetName() + ">"; }
+
+protected:
+	virtual bool Specialize(cl_device_id Device, CKernelDefines& Defines);
+
+	virtual void FillInput();
+
+	virtual void* GetResultGPU(unsigned int Task) { return &m_resultGPU[Task]; }
+
+	// results
+	Accumulator		m_resultCPU;
+	Accumulator		m_resultGPU[8];
+};
+
+template<class TOperator>
+bool CTypedReductionTask<TOperator>::Specialize(cl_device_id Device, CKernelDefines& Defines)
+{
+	if(!SetReductionElement<Element>(Device, Defines))
+		return false;
+
+	std::string atomic = TOperator::GetDefines(Device, Defines);
+	m_Atomics = !atomic.empty();
+	if(m_Atomics)
+		Defines.SetToken("REDUCTION_ATOMIC", atomic);
+	m_Collective = TOperator::GetCollective();
+
+	return true;
+}
+
+template<class TOperator>
+void CTypedReductionTask<TOperator>::FillInput()
+{
+	//fill the array with some values
+	Element* pInput = static_cast<Element*>(m_hInput);
+	for(unsigned int i = 0; i < m_N; i++)
+		pInput[i] = SReductionType<Element>::Random();
+}
+
+template<class TOperator>
+void CTypedReductionTask<TOperator>::ComputeCPU()
+{
+	CThreadPool& pool = CThreadPool::GetSingleton();
+	const Element* pInput = static_cast<const Element*>(m_hInput);
+
+	CTimer timer;
+	timer.Start();
+
+	// the chunks are combined in order, so the result does not depend on the thread count
+	unsigned int nIterations = 10;
+	for(unsigned int j = 0; j < nIterations; j++) {
+		m_resultCPU = pool.ParallelReduce(0, m_N, TOperator::Identity(), [pInput](size_t Begin, size_t End) {
+			return TOperator::Reference(pInput, Begin, End);
+		}, TOperator::Combine);
+	}
+
+	timer.Stop();
+
+	double ms = timer.GetElapsedMilliseconds() / double(nIterations);
+	std::cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s ("
+		<< pool.GetThreadCount() << " threads)" << std::endl;
+
+	// vectorized CPU baseline to compare the GPU kernels against
+	Accumulator resultSIMD;
+	timer.Start();
+	for(unsigned int j = 0; j < nIterations; j++) {
+		if(!TOperator::ReduceSIMD(pInput, m_N, resultSIMD))
+			return;
+	}
+	timer.Stop();
+
+	ms = timer.GetElapsedMilliseconds() / double(nIterations);
+	std::cout << "  CPU-SIMD (" << CSimd::GetLevelName(CSimd::GetSingleton().GetKernels().Level) << ") average time: " << ms << " ms, throughput: "
+		<< 1.0e-6 * (double)m_N / ms << " Gelem/s" << (TOperator::IsEqual(resultSIMD, m_resultCPU, m_N) ? "" : ", RESULT DIFFERS") << std::endl;
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("CPU-SIMD", m_N, nIterations, ms, double(m_N) * sizeof(Element)));
+}
+
+template<class TOperator>
+bool CTypedReductionTask<TOperator>::ValidateResults()
+{
+	bool success = true;
+
+	for(unsigned int i = 0; i < ARRAYLEN(m_resultGPU); i++)
+		if(IsVariantEnabled(i) && !TOperator::IsEqual(m_resultGPU[i], m_resultCPU, m_N))
+		{
+			std::cout << "Validation of reduction kernel " << GetVariantName(i) << " failed. "
+					 << "Result should be " << TOperator::ToString(m_resultCPU) << " but is " << TOperator::ToString(m_resultGPU[i]) << std::endl;
+			success = false;
+		}
+
+	return success;
+}
+
 #endif // _CREDUCTION_TASK_H
@@ -7,8 +7,19 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "../Common/CLUtil.h"
 #include "../Common/CTimer.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CSimd.h"
+#include "../Common/CBufferPool.h"
+#include "../Common/CTracer.h"
+#include "../Common/CStatistics.h"
+#include "../Common/CKernelLibrary.h"
+#include "../Common/CLaunchPlan.h"
 
 #include <string.h>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -26,21 +37,35 @@ const string g_kernelNames[2] =
 	"scanWorkEfficient"
 };
 
-CScanTask::CScanTask(size_t ArraySize, size_t MinLocalWorkSize)
-	: m_N(ArraySize), m_hArray(NULL), m_hResultCPU(NULL), m_hResultGPU(NULL),
-	m_dPingArray(NULL), m_dPongArray(NULL),
+CScanTask* CScanTask::Create(size_t ArraySize, size_t MinLocalWorkSize, const std::string& Variant, unsigned int NIterations)
+{
+	if(!Variant.empty() && find(g_kernelNames, g_kernelNames + ARRAYLEN(g_kernelNames), Variant) == g_kernelNames + ARRAYLEN(g_kernelNames))
+	{
+		cerr << "Error: there is no scan variant " << Variant << "." << endl;
+		return nullptr;
+	}
+	return new CScanTask(ArraySize, MinLocalWorkSize, Variant, NIterations);
+}
+
+CScanTask::CScanTask(size_t ArraySize, size_t MinLocalWorkSize, const std::string& Variant, unsigned int NIterations)
+	: m_N(ArraySize), m_Variant(Variant), m_NIterations(NIterations), m_hArray(NULL), m_hResultCPU(NULL), m_hResultGPU(NULL),
+	m_dPingArray(NULL), m_dPongArray(NULL), m_dLevelArrays(NULL),
 	m_Program(NULL),
 	m_ScanNaiveKernel(NULL), m_ScanWorkEfficientKernel(NULL), m_ScanWorkEfficientAddKernel(NULL)
 {
 	// compute the number of levels that we need for the work-efficient algorithm
 
-	m_MinLocalWorkSize = MinLocalWorkSize;
+	// the sweeps of the work-efficient scan need a power of two, e.g. 192 work-items scan blocks of 2 * 128
+	m_MinLocalWorkSize = 1;
+	while (m_MinLocalWorkSize * 2 <= MinLocalWorkSize)
+		m_MinLocalWorkSize *= 2;
 
 	m_nLevels = 2;
 	size_t N = ArraySize;
 	while (N > 2 * m_MinLocalWorkSize)
 	{
-		N /= 2 * m_MinLocalWorkSize;
+		// the last group of a level may be incomplete
+		N = (N + 2 * m_MinLocalWorkSize - 1) / (2 * m_MinLocalWorkSize);
 		m_nLevels++;
 	}
 
@@ -56,8 +81,10 @@ CScanTask::~CScanTask()
 
 bool CScanTask::InitResources(cl_device_id Device, cl_context Context)
 {
-	//CPU resources
-	m_hArray	 = new unsigned int[m_N];
+	//CPU resources, in zero-copy mode the device reads the input from the host memory directly
+	if(!m_Input.Allocate(Context, sizeof(cl_uint) * m_N, CL_MEM_READ_ONLY))
+		return false;
+	m_hArray	 = m_Input.Get<unsigned int>();
 	m_hResultCPU = new unsigned int[m_N];
 	m_hResultGPU = new unsigned int[m_N];
 
@@ -69,26 +96,23 @@ bool CScanTask::InitResources(cl_device_id Device, cl_context Context)
 	//device resources
 	// ping-pong buffers
 	cl_int clError, clError2;
-	m_dPingArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+	m_dPingArray = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, &clError2);
 	clError = clError2;
-	m_dPongArray = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, NULL, &clError2);
+	m_dPongArray = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * m_N, &clError2);
 	clError |= clError2;
 
 	// level buffer
 	m_dLevelArrays = new cl_mem[m_nLevels];
 	unsigned int N = m_N;
 	for (unsigned int i = 0; i < m_nLevels; i++) {
-		m_dLevelArrays[i] = clCreateBuffer(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * N, NULL, &clError2);
+		m_dLevelArrays[i] = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, sizeof(cl_uint) * N, &clError2);
 		clError |= clError2;
-		N = max(N / (2 * m_MinLocalWorkSize), m_MinLocalWorkSize);
+		N = (N + 2 * m_MinLocalWorkSize - 1) / (2 * m_MinLocalWorkSize);
 	}
 	V_RETURN_FALSE_CL(clError, "Error allocating device arrays");
 
-	//load and compile kernels
-	string programCode;
-
-	CLUtil::LoadProgramSourceToMemory("Scan.cl", programCode);
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	//load and compile kernels, Scan.cl includes the shared PrefixSum.cl from Common/CL
+	m_Program = CKernelLibrary::GetSingleton().Build(Device, Context, "Scan.cl");
 	if(m_Program == nullptr) return false;
 
 	//create kernels
@@ -107,18 +131,22 @@ bool CScanTask::InitResources(cl_device_id Device, cl_context Context)
 void CScanTask::ReleaseResources()
 {
 	// host resources
-	SAFE_DELETE_ARRAY(m_hArray);
+	m_hArray = NULL;
+	m_Input.Release();
 
 	SAFE_DELETE_ARRAY(m_hResultCPU);
 	SAFE_DELETE_ARRAY(m_hResultGPU);
 
+	// the recorded plans reference the buffers and kernels
+	m_Plans.clear();
+
 	// device resources
-	SAFE_RELEASE_MEMOBJECT(m_dPingArray);
-	SAFE_RELEASE_MEMOBJECT(m_dPongArray);
+	SAFE_RELEASE_POOLED(m_dPingArray);
+	SAFE_RELEASE_POOLED(m_dPongArray);
 
 	if(m_dLevelArrays)
 		for (unsigned int i = 0; i < m_nLevels; i++) {
-			SAFE_RELEASE_MEMOBJECT(m_dLevelArrays[i]);
+			SAFE_RELEASE_POOLED(m_dLevelArrays[i]);
 		}
 	SAFE_DELETE_ARRAY(m_dLevelArrays);
 
@@ -133,42 +161,116 @@ void CScanTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, si
 {
 	cout << endl;
 
-	ValidateTask(Context, CommandQueue, LocalWorkSize, 0);
-	ValidateTask(Context, CommandQueue, LocalWorkSize, 1);
+	//the input is transferred (or unmapped) once, the runs only copy it on the device
+	V_RETURN_CL(m_Input.Upload(CommandQueue), "Error copying data from host to device!");
+
+	for (unsigned int task = 0; task < ARRAYLEN(m_bValidationResults); task++)
+		if (IsVariantEnabled(task))
+		{
+			CTraceZone zone("Validate " + g_kernelNames[task]);
+			ValidateTask(Context, CommandQueue, LocalWorkSize, task);
+		}
 
 	cout << endl;
 
-	TestPerformance(Context, CommandQueue, LocalWorkSize, 0);
-	TestPerformance(Context, CommandQueue, LocalWorkSize, 1);
+	for (unsigned int task = 0; task < ARRAYLEN(m_bValidationResults); task++)
+		if (IsVariantEnabled(task))
+		{
+			CTraceZone zone(g_kernelNames[task]);
+			TestPerformance(Context, CommandQueue, LocalWorkSize, task);
+		}
 
 	cout << endl;
 }
 
 void CScanTask::ComputeCPU()
 {
+	CThreadPool& pool = CThreadPool::GetSingleton();
+
+	// the array is scanned in chunks, then the totals of the preceding chunks are added
+	vector<size_t> bounds;
+	pool.GetChunks(0, m_N, 4096, bounds);
+	size_t nChunks = bounds.size() - 1;
+	vector<unsigned int> offsets(nChunks, 0);
+
 	CTimer timer;
 	timer.Start();
 
 	unsigned int nIterations = 100;
 	for(unsigned int j = 0; j < nIterations; j++) {
-		unsigned int sum = 0;
-		for(unsigned int i = 0; i < m_N; i++) {
-			sum += m_hArray[i];
-			m_hResultCPU[i] = sum;
+		// inclusive scan of each chunk
+		pool.ParallelFor(0, nChunks, [&](size_t First, size_t Last) {
+			for(size_t c = First; c < Last; c++) {
+				unsigned int sum = 0;
+				for(size_t i = bounds[c]; i < bounds[c + 1]; i++) {
+					sum += m_hArray[i];
+					m_hResultCPU[i] = sum;
+				}
+			}
+		});
+
+		// exclusive scan of the chunk totals
+		unsigned int offset = 0;
+		for(size_t c = 0; c < nChunks; c++) {
+			offsets[c] = offset;
+			offset += m_hResultCPU[bounds[c + 1] - 1];
 		}
+
+		// the first chunk is already complete
+		pool.ParallelFor(1, nChunks, [&](size_t First, size_t Last) {
+			for(size_t c = First; c < Last; c++)
+				for(size_t i = bounds[c]; i < bounds[c + 1]; i++)
+					m_hResultCPU[i] += offsets[c];
+		});
 	}
 
 	timer.Stop();
 	double ms = timer.GetElapsedMilliseconds() / double(nIterations);
-	cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" <<endl;
+	cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s ("
+		<< pool.GetThreadCount() << " threads)" <<endl;
+
+	// vectorized CPU baseline with the same chunking, written to a separate array
+	const SSimdKernels& simd = CSimd::GetSingleton().GetKernels();
+	vector<unsigned int> resultSIMD(m_N);
+	timer.Start();
+	for(unsigned int j = 0; j < nIterations; j++) {
+		pool.ParallelFor(0, nChunks, [&](size_t First, size_t Last) {
+			for(size_t c = First; c < Last; c++)
+				simd.InclusiveScanU32(m_hArray + bounds[c], &resultSIMD[bounds[c]], bounds[c + 1] - bounds[c], 0);
+		});
+
+		unsigned int offset = 0;
+		for(size_t c = 0; c < nChunks; c++) {
+			offsets[c] = offset;
+			offset += resultSIMD[bounds[c + 1] - 1];
+		}
+
+		// adding the offset is a scan of the chunk with the offset as carry
+		pool.ParallelFor(1, nChunks, [&](size_t First, size_t Last) {
+			for(size_t c = First; c < Last; c++)
+				simd.InclusiveScanU32(m_hArray + bounds[c], &resultSIMD[bounds[c]], bounds[c + 1] - bounds[c], offsets[c]);
+		});
+	}
+	timer.Stop();
+
+	bool simdValid = m_N == 0 || memcmp(&resultSIMD[0], m_hResultCPU, m_N * sizeof(unsigned int)) == 0;
+	ms = timer.GetElapsedMilliseconds() / double(nIterations);
+	cout << "  CPU-SIMD (" << CSimd::GetLevelName(simd.Level) << ") average time: " << ms << " ms, throughput: "
+		<< 1.0e-6 * (double)m_N / ms << " Gelem/s" << (simdValid ? "" : ", RESULT DIFFERS") << endl;
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("CPU-SIMD", m_N, nIterations, ms, 2.0 * double(m_N) * sizeof(cl_uint)));
+}
+
+bool CScanTask::IsVariantEnabled(unsigned int Task) const
+{
+	return m_Variant.empty() || m_Variant == g_kernelNames[Task];
 }
 
 bool CScanTask::ValidateResults()
 {
 	bool success = true;
 
-	for(int i = 0; i < 2; i++)
-		if(!m_bValidationResults[i])
+	for(unsigned int i = 0; i < ARRAYLEN(m_bValidationResults); i++)
+		if(IsVariantEnabled(i) && !m_bValidationResults[i])
 		{
 			cout<<"Validation of reduction kernel "<<g_kernelNames[i]<<" failed." << endl;
 			success = false;
@@ -177,85 +279,84 @@ bool CScanTask::ValidateResults()
 	return success;
 }
 
-void CScanTask::Scan_Naive(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CScanTask::Scan_Naive(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
 	for (unsigned int offset = 1; offset < m_N; offset = offset * 2)
 	{
-		cl_int cl_error;
-		cl_error = clSetKernelArg(m_ScanNaiveKernel, 0, sizeof(cl_mem), (void*) &m_dPingArray);
-		cl_error = clSetKernelArg(m_ScanNaiveKernel, 1, sizeof(cl_mem), (void*) &m_dPongArray);
-		cl_error = clSetKernelArg(m_ScanNaiveKernel, 2, sizeof(cl_uint), (void*) &m_N);
-		cl_error = clSetKernelArg(m_ScanNaiveKernel, 3, sizeof(cl_uint), (void*) &offset);
-		V_RETURN_CL(cl_error, "Failed to set kernel arguments in 'Scan_Naive'.");
-
-		// get local and global work size
+		// get local and global work size, the kernel skips the work-items beyond the end of the array
 		size_t localWorkSize = LocalWorkSize[0];
-		size_t globalWorkSize = m_N;
+		size_t globalWorkSize = CLUtil::GetGlobalWorkSize(m_N, localWorkSize);
 
-		if (globalWorkSize < localWorkSize)
+		if (m_N < localWorkSize)
 		{
-			localWorkSize = globalWorkSize;
+			localWorkSize = m_N;
+			globalWorkSize = m_N;
 		}
 
-		// run kernel
-	  cl_error = clEnqueueNDRangeKernel(CommandQueue, m_ScanNaiveKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(cl_error, "Failed to run kernel in 'Scan_Naive'.");
+		// add the pass with its kernel arguments
+		Plan.Launch(m_ScanNaiveKernel, 1, &globalWorkSize, &localWorkSize)
+			.Arg(0, m_dPingArray)
+			.Arg(1, m_dPongArray)
+			.Arg(2, m_N)
+			.Arg(3, offset);
 
 		// swap ping and pong array
-		swap(m_dPingArray, m_dPongArray);
+		Plan.Swap(m_dPingArray, m_dPongArray);
 	}
 }
 
-void CScanTask::Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+void CScanTask::Scan_WorkEfficient(CLaunchPlan& Plan, size_t LocalWorkSize[3])
 {
-	// get local and global work size
-	size_t localWorkSize = LocalWorkSize[0];
-	size_t globalWorkSize = m_N / 2;
-	// loop over levels to compute decomposed pps where i+1 input for higher level
-	for (unsigned int i = 0; i < m_nLevels - 1; i++) {
-		// set kernel arguments for decomposed pps
-		cl_int cl_error;
-		cl_error = clSetKernelArg(m_ScanWorkEfficientKernel, 0, sizeof(cl_mem), (void*) &m_dLevelArrays[i]);
-		cl_error = clSetKernelArg(m_ScanWorkEfficientKernel, 1, sizeof(cl_mem), (void*) &m_dLevelArrays[i + 1]);
-		cl_error = clSetKernelArg(m_ScanWorkEfficientKernel, 2, localWorkSize * 2 * sizeof(cl_uint), NULL);
-		V_RETURN_CL(cl_error, "Failed to set kernel arguments in 'Scan_WorkEfficient'.");
-
-		// run decomposed pps kernel
-		if (globalWorkSize < localWorkSize)
-	  	cl_error = clEnqueueNDRangeKernel(CommandQueue, m_ScanWorkEfficientKernel, 1, NULL, &globalWorkSize, &globalWorkSize, 0, NULL, NULL);
-		else
-	  	cl_error = clEnqueueNDRangeKernel(CommandQueue, m_ScanWorkEfficientKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(cl_error, "Failed to run kernel in 'Scan_WorkEfficient'.");
+	// each group scans 2 * localWorkSize elements of a level and writes its sum to the next level,
+	// the last group of a level may be incomplete. The level arrays were allocated for
+	// m_MinLocalWorkSize, so the plan uses it instead of LocalWorkSize.
+	size_t localWorkSize = m_MinLocalWorkSize;
+	vector<unsigned int> sizes(1, m_N);
+	while (sizes.back() > 2 * localWorkSize)
+		sizes.push_back(cl_uint((sizes.back() + 2 * localWorkSize - 1) / (2 * localWorkSize)));
 
-		// change global work size if there is another step
-		if (i != m_nLevels - 2)
-		{
-			globalWorkSize /= 2 * localWorkSize;
-		}
+	// loop over levels to compute decomposed pps where i+1 input for higher level
+	for (unsigned int i = 0; i < sizes.size(); i++) {
+		// a single group of the next power of two if the level fits into one block
+		size_t nGroups = (sizes[i] + 2 * localWorkSize - 1) / (2 * localWorkSize);
+		size_t groupSize = nGroups > 1 ? localWorkSize : min(CLUtil::GetNextPowerOfTwo((sizes[i] + 1) / 2), localWorkSize);
+		size_t globalWorkSize = nGroups * groupSize;
+
+		// add decomposed pps pass
+		Plan.Launch(m_ScanWorkEfficientKernel, 1, &globalWorkSize, &groupSize)
+			.Arg(0, m_dLevelArrays[i])
+			.Arg(1, m_dLevelArrays[i + 1])
+			.Arg(2, sizes[i])
+			.LocalArg(3, groupSize * 2 * sizeof(cl_uint));
 	}
 
-	// multiply global work size with 2 because add kernel always needs twice as much worker
-	globalWorkSize *= 2;
-
 	// loop over levels backward to propagate results back with Scan_WorkEfficientAdd
-	for (unsigned int i = m_nLevels - 2; i > 0; i--) {
-		// change global and local work size
-		globalWorkSize *= 2 * localWorkSize;
-
-		// set kernel arguments for compose pps with add
-		cl_int cl_error;
-		cl_error = clSetKernelArg(m_ScanWorkEfficientAddKernel, 0, sizeof(cl_mem), (void*) &m_dLevelArrays[i]);
-		cl_error = clSetKernelArg(m_ScanWorkEfficientAddKernel, 1, sizeof(cl_mem), (void*) &m_dLevelArrays[i - 1]);
-		cl_error = clSetKernelArg(m_ScanWorkEfficientAddKernel, 2, localWorkSize * sizeof(cl_uint), NULL);
-		V_RETURN_CL(cl_error, "Failed to set kernel arguments in 'Scan_WorkEfficientAdd'.");
-
-		// run add kernel
-		if (globalWorkSize < localWorkSize)
-	  	cl_error = clEnqueueNDRangeKernel(CommandQueue, m_ScanWorkEfficientAddKernel, 1, NULL, &globalWorkSize, &globalWorkSize, 0, NULL, NULL);
+	for (size_t i = sizes.size() - 1; i > 0; i--) {
+		// the add kernel needs one worker per element, except for the first block which is complete
+		size_t globalWorkSize = CLUtil::GetGlobalWorkSize(sizes[i - 1] - 2 * localWorkSize, localWorkSize);
+
+		// add compose pps pass
+		Plan.Launch(m_ScanWorkEfficientAddKernel, 1, &globalWorkSize, &localWorkSize)
+			.Arg(0, m_dLevelArrays[i])
+			.Arg(1, m_dLevelArrays[i - 1])
+			.Arg(2, sizes[i - 1])
+			.LocalArg(3, localWorkSize * sizeof(cl_uint));
+	}
+}
+
+void CScanTask::Scan(cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
+{
+	// the passes are planned once per kernel, local size and start buffer (the naive scan swaps ping and pong)
+	CLaunchPlan& plan = m_Plans[make_tuple(Task, LocalWorkSize[0], m_dPingArray)];
+	if (plan.IsEmpty())
+	{
+		if (Task == 0)
+			Scan_Naive(plan, LocalWorkSize);
 		else
-	  	cl_error = clEnqueueNDRangeKernel(CommandQueue, m_ScanWorkEfficientAddKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-		V_RETURN_CL(cl_error, "Failed to run kernel in 'Scan_WorkEfficientAdd'.");
+			Scan_WorkEfficient(plan, LocalWorkSize);
 	}
+
+	V_RETURN_CL(plan.Replay(CommandQueue), "Failed to run the passes of the scan.");
 }
 
 void CScanTask::ValidateTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task)
@@ -263,13 +364,13 @@ void CScanTask::ValidateTask(cl_context Context, cl_command_queue CommandQueue,
 	//run selected task
 	switch (Task){
 		case 0:
-			V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hArray, 0, NULL, NULL), "Error copying data from host to device!");
-			Scan_Naive(Context, CommandQueue, LocalWorkSize);
+			V_RETURN_CL(clEnqueueCopyBuffer(CommandQueue, m_Input.GetDeviceBuffer(), m_dPingArray, 0, 0, m_N * sizeof(cl_uint), 0, NULL, NULL), "Error copying the input data!");
+			Scan(CommandQueue, LocalWorkSize, Task);
 			V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dPingArray, CL_TRUE, 0, m_N * sizeof(cl_uint), m_hResultGPU, 0, NULL, NULL), "Error reading data from device!");
 			break;
 		case 1:
-			V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dLevelArrays[0], CL_FALSE, 0, m_N * sizeof(cl_uint), m_hArray, 0, NULL, NULL), "Error copying data from host to device!");
-			Scan_WorkEfficient(Context, CommandQueue, LocalWorkSize);
+			V_RETURN_CL(clEnqueueCopyBuffer(CommandQueue, m_Input.GetDeviceBuffer(), m_dLevelArrays[0], 0, 0, m_N * sizeof(cl_uint), 0, NULL, NULL), "Error copying the input data!");
+			Scan(CommandQueue, LocalWorkSize, Task);
 			V_RETURN_CL(clEnqueueReadBuffer(CommandQueue, m_dLevelArrays[0], CL_TRUE, 0, m_N * sizeof(cl_uint), m_hResultGPU, 0, NULL, NULL), "Error reading data from device!");
 			break;
 	}
@@ -282,35 +383,30 @@ void CScanTask::TestPerformance(cl_context Context, cl_command_queue CommandQueu
 {
 	cout << "Testing performance of task " << g_kernelNames[Task] << endl;
 
-	//write input data to the GPU
-	V_RETURN_CL(clEnqueueWriteBuffer(CommandQueue, m_dPingArray, CL_FALSE, 0, m_N * sizeof(cl_uint), m_hArray, 0, NULL, NULL), "Error copying data from host to device!");
+	//reset the ping array to the input data
+	V_RETURN_CL(clEnqueueCopyBuffer(CommandQueue, m_Input.GetDeviceBuffer(), m_dPingArray, 0, 0, m_N * sizeof(cl_uint), 0, NULL, NULL), "Error copying the input data!");
 	//finish all before we start meassuring the time
 	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
 
-	CTimer timer;
-	timer.Start();
-
-	//run the kernel N times
-	unsigned int nIterations = 100;
-	for(unsigned int i = 0; i < nIterations; i++) {
+	//run the kernel N times (plus two warm-up runs), each run is timed on its own
+	unsigned int nIterations = m_NIterations;
+	CStatistics stats(2);
+	for(unsigned int i = 0; i < nIterations + 2; i++) {
+		CScopedTimer timer(stats);
 		//run selected task
-		switch (Task){
-			case 0:
-				Scan_Naive(Context, CommandQueue, LocalWorkSize);
-				break;
-			case 1:
-				Scan_WorkEfficient(Context, CommandQueue, LocalWorkSize);
-				break;
-		}
+		Scan(CommandQueue, LocalWorkSize, Task);
+		V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
 	}
 
-	//wait until the command queue is empty again
-	V_RETURN_CL(clFinish(CommandQueue), "Error finishing the queue!");
+	size_t nOutliers = 0;
+	double ms = stats.GetRobustMean(3.0, &nOutliers);
+	cout << "  average time: " << ms << " ms (median " << stats.GetMedian() << ", p95 " << stats.GetPercentile(0.95)
+		<< ", " << nOutliers << " outliers), throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" <<endl;
 
-	timer.Stop();
-
-	double ms = timer.GetElapsedMilliseconds() / double(nIterations);
-	cout << "  average time: " << ms << " ms, throughput: " << 1.0e-6 * (double)m_N / ms << " Gelem/s" <<endl;
+	// each element is read, added and written once
+	SBenchmarkResult result(g_kernelNames[Task], m_N, stats, 2.0 * double(m_N) * sizeof(cl_uint), double(m_N));
+	CRoofline::GetSingleton().Report(result);
+	CResultsSink::GetSingleton().Add(result);
 }
 
 
@@ -21,13 +21,23 @@
 #define _CSCAN_TASK_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CHostBuffer.h"
+#include "../Common/CLaunchPlan.h"
+
+#include <map>
+#include <tuple>
 
 //! A2 / T2 Parallel prefix sum (scan)
 class CScanTask : public IComputeTask
 {
 public:
-	//! The second parameter is necessary to pre-allocate the multi-level arrays
-	CScanTask(size_t ArraySize, size_t MinLocalWorkSize);
+	//! The second parameter is necessary to pre-allocate the multi-level arrays, the work-efficient
+	//! scan runs with it (rounded down to a power of two) regardless of the local size of ComputeGPU()
+	//! Variant selects a single kernel by name (see g_kernelNames), if empty all kernels are executed
+	CScanTask(size_t ArraySize, size_t MinLocalWorkSize, const std::string& Variant = "", unsigned int NIterations = 100);
+
+	//! Same as the constructor, but returns nullptr for unknown variants instead of running no kernel at all
+	static CScanTask* Create(size_t ArraySize, size_t MinLocalWorkSize, const std::string& Variant = "", unsigned int NIterations = 100);
 
 	virtual ~CScanTask();
 
@@ -42,18 +52,30 @@ public:
 
 	virtual bool ValidateResults();
 
+	virtual std::string GetName() const { return "Scan"; }
+
 protected:
 
-	void Scan_Naive(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
-	void Scan_WorkEfficient(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+	//! The variants add their passes to a launch plan, Scan() replays it
+	void Scan_Naive(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Scan_WorkEfficient(CLaunchPlan& Plan, size_t LocalWorkSize[3]);
+	void Scan(cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
+
+	bool IsVariantEnabled(unsigned int Task) const;
 
 	void ValidateTask(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
 	void TestPerformance(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], unsigned int Task);
 
 	unsigned int		m_N;
 
-	//float data on the CPU
+	// selected kernel variant and number of iterations for the performance test
+	std::string			m_Variant;
+	unsigned int		m_NIterations;
+
+	//float data on the CPU (m_hArray is the host side of m_Input, valid until it is uploaded)
 	unsigned int		*m_hArray;
+	// the input stays on the device, every run starts with a device-side copy of it
+	CMirroredBuffer		m_Input;
 
 	unsigned int		*m_hResultCPU;
 	unsigned int		*m_hResultGPU;
@@ -73,6 +95,9 @@ protected:
 	cl_kernel			m_ScanNaiveKernel;
 	cl_kernel			m_ScanWorkEfficientKernel;
 	cl_kernel			m_ScanWorkEfficientAddKernel;
+
+	// launch plans per task, local work size and start buffer
+	std::map<std::tuple<unsigned int, size_t, cl_mem>, CLaunchPlan>	m_Plans;
 };
 
 #endif // _CSCAN_TASK_H
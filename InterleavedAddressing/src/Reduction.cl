@@ -1,35 +1,165 @@
+// The kernels are specialized with -D options (see CReductionOperators.h):
+//	ELEMENT				type of the input array
+//	ACCUMULATOR			type of the partial results
+//	REDUCE_<OP>			the operator: SUM, KAHAN, MIN, MAX, ARGMIN or ARGMAX
+//	IDENTITY_VALUE		the neutral element value of MIN, MAX, ARGMIN and ARGMAX
+//	REDUCTION_ATOMIC	atomic function of Reduction_DecompAtomics (only for integer accumulators)
+//	REDUCTION_COLLECTIVE	suffix of the work_group_reduce_ / sub_group_reduce_ functions (add, min or max)
+//	REDUCTION_WORK_GROUP, REDUCTION_SUB_GROUP	the device has the work-group / sub-group collective functions
+// Without options the kernels sum uint.
+
+#ifdef REDUCTION_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+#ifdef REDUCTION_INT64_ATOMICS
+#pragma OPENCL EXTENSION cl_khr_int64_base_atomics : enable
+#endif
+#ifdef REDUCTION_INT64_EXTENDED_ATOMICS
+#pragma OPENCL EXTENSION cl_khr_int64_extended_atomics : enable
+#endif
+
+// work_group_reduce_ is optional in OpenCL C 3.0, sub_group_reduce_ is the next choice
+#if defined(REDUCTION_COLLECTIVE) && defined(REDUCTION_WORK_GROUP) && \
+	((__OPENCL_C_VERSION__ >= 200 && __OPENCL_C_VERSION__ < 300) || defined(__opencl_c_work_group_collective_functions))
+#define REDUCE_WORK_GROUP
+#elif defined(REDUCTION_COLLECTIVE) && defined(REDUCTION_SUB_GROUP)
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#define REDUCE_SUB_GROUP
+#endif
+
+#ifndef ELEMENT
+#define ELEMENT uint
+#endif
+
+#if !defined(REDUCE_SUM) && !defined(REDUCE_KAHAN) && !defined(REDUCE_MIN) && !defined(REDUCE_MAX) && !defined(REDUCE_ARGMIN) && !defined(REDUCE_ARGMAX)
+#define REDUCE_SUM
+#endif
+
+#if defined(REDUCE_ARGMIN) || defined(REDUCE_ARGMAX)
+// the value and the index of the first element with this value
+typedef struct
+{
+	ELEMENT	Value;
+	uint	Index;
+} ArgValue;
+#undef ACCUMULATOR
+#define ACCUMULATOR ArgValue
+#endif
+
+#ifndef ACCUMULATOR
+#define ACCUMULATOR ELEMENT
+#endif
+
+// vector of four elements, e.g. uint4
+#define CONCAT(A, B) A##B
+#define VECTOR4(T) CONCAT(T, 4)
+#define ELEMENT4 VECTOR4(ELEMENT)
+
+// collective function of the operator, e.g. work_group_reduce_add
+#define COLLECTIVE(Scope, Op) CONCAT(Scope, Op)
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Operator: Identity() is the neutral element, Load() converts an element, Combine() is associative
+
+#if defined(REDUCE_SUM)
+
+ACCUMULATOR Identity() { return (ACCUMULATOR)0; }
+ACCUMULATOR Load(ELEMENT Value, uint Index) { return (ACCUMULATOR)Value; }
+ACCUMULATOR Combine(ACCUMULATOR A, ACCUMULATOR B) { return A + B; }
+
+#elif defined(REDUCE_KAHAN)
+
+// .x is the sum, .y the compensation of its rounding error
+ACCUMULATOR Identity() { return (ACCUMULATOR)(0, 0); }
+ACCUMULATOR Load(ELEMENT Value, uint Index) { return (ACCUMULATOR)(Value, 0); }
+ACCUMULATOR Combine(ACCUMULATOR A, ACCUMULATOR B)
+{
+	// TwoSum: err is the exact rounding error of A.x + B.x
+	ELEMENT sum = A.x + B.x;
+	ELEMENT b = sum - A.x;
+	ELEMENT err = (A.x - (sum - b)) + (B.x - b);
+	return (ACCUMULATOR)(sum, A.y + B.y + err);
+}
+
+#elif defined(REDUCE_MIN)
+
+ACCUMULATOR Identity() { return IDENTITY_VALUE; }
+ACCUMULATOR Load(ELEMENT Value, uint Index) { return Value; }
+ACCUMULATOR Combine(ACCUMULATOR A, ACCUMULATOR B) { return min(A, B); }
+
+#elif defined(REDUCE_MAX)
+
+ACCUMULATOR Identity() { return IDENTITY_VALUE; }
+ACCUMULATOR Load(ELEMENT Value, uint Index) { return Value; }
+ACCUMULATOR Combine(ACCUMULATOR A, ACCUMULATOR B) { return max(A, B); }
+
+#else // REDUCE_ARGMIN, REDUCE_ARGMAX
+
+ACCUMULATOR Identity() { ArgValue a; a.Value = IDENTITY_VALUE; a.Index = UINT_MAX; return a; }
+ACCUMULATOR Load(ELEMENT Value, uint Index) { ArgValue a; a.Value = Value; a.Index = Index; return a; }
+ACCUMULATOR Combine(ACCUMULATOR A, ACCUMULATOR B)
+{
+	// ties go to the lower index, so the result does not depend on the order of the passes
+#ifdef REDUCE_ARGMIN
+	bool takeB = B.Value < A.Value;
+#else
+	bool takeB = B.Value > A.Value;
+#endif
+	return (takeB || (B.Value == A.Value && B.Index < A.Index)) ? B : A;
+}
+
+#endif
+
+// Element Index of an array with Size accumulators, the identity beyond its end (so the arrays need no padding)
+ACCUMULATOR LoadGuarded(const __global ACCUMULATOR* Array, uint Index, uint Size)
+{
+	return Index < Size ? Array[Index] : Identity();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+__kernel void Reduction_Load(const __global ELEMENT* inArray, __global ACCUMULATOR* outArray, uint N)
+{
+	// convert the elements to accumulators, the index is kept for argmin / argmax
+	unsigned int id = get_global_id(0);
+	if (id < N)
+		outArray[id] = Load(inArray[id], id);
+}
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-__kernel void Reduction_InterleavedAddressing(__global uint* array, uint stride)
+__kernel void Reduction_InterleavedAddressing(__global ACCUMULATOR* array, uint stride, uint N)
 {
 	// calculate position of worker
 	unsigned int pos = get_global_id(0) * stride * 2;
 
-	// increment array at position with position plus stride
-	array[pos] = array[pos] + array[pos + stride];
+	// combine array at position with position plus stride, an element without partner stays in place
+	if (pos + stride < N)
+		array[pos] = Combine(array[pos], array[pos + stride]);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-__kernel void Reduction_SequentialAddressing(__global uint* array, uint stride)
+__kernel void Reduction_SequentialAddressing(__global ACCUMULATOR* array, uint stride, uint N)
 {
 	// get global id
 	unsigned int id = get_global_id(0);
 
-	// increment array at global id with global id plus stride
-	array[id] = array[id] + array[id + stride];
+	// combine array at global id with global id plus stride, for odd N the element at stride - 1 stays in place
+	if (id + stride < N)
+		array[id] = Combine(array[id], array[id + stride]);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-__kernel void Reduction_Decomp(const __global uint* inArray, __global uint* outArray, uint N, __local uint* localBlock)
+// The decomposition kernels: N is the local size, each group combines 2 * N of the Size elements of inArray
+__kernel void Reduction_Decomp(const __global ACCUMULATOR* inArray, __global ACCUMULATOR* outArray, uint N, uint Size, __local ACCUMULATOR* localBlock)
 {
 	// get group and local id
 	unsigned int id = get_local_id(0);
 	unsigned int group_id = get_group_id(0);
 
 	// first reduction step with sequential adressing
-	localBlock[id] = inArray[group_id * N * 2 + id] + inArray[group_id * N * 2 + N + id];
+	localBlock[id] = Combine(LoadGuarded(inArray, group_id * N * 2 + id, Size), LoadGuarded(inArray, group_id * N * 2 + N + id, Size));
 
 	// further reduction on local memory using interleaved adressing
 	for (unsigned int stride = 1; stride < N; stride = stride * 2)
@@ -37,7 +167,7 @@ __kernel void Reduction_Decomp(const __global uint* inArray, __global uint* outA
 		barrier(CLK_LOCAL_MEM_FENCE);
 		if (id * stride * 2 + stride < N)
 		{
-			int sum = localBlock[id * stride * 2] + localBlock[id * stride * 2 + stride];
+			ACCUMULATOR sum = Combine(localBlock[id * stride * 2], localBlock[id * stride * 2 + stride]);
 			localBlock[id * stride * 2] = sum;
 		}
 	}
@@ -49,35 +179,226 @@ __kernel void Reduction_Decomp(const __global uint* inArray, __global uint* outA
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-__kernel void Reduction_DecompUnroll(const __global uint* inArray, __global uint* outArray, uint N, __local uint* localBlock)
+// One stage of the unrolled tree, the condition is the same for the whole group
+#define REDUCE_STAGE(S) if (N > S) { barrier(CLK_LOCAL_MEM_FENCE); if (id < S) localBlock[id] = Combine(localBlock[id], localBlock[id + S]); }
+
+__kernel void Reduction_DecompUnroll(const __global ACCUMULATOR* inArray, __global ACCUMULATOR* outArray, uint N, uint Size, __local ACCUMULATOR* localBlock)
 {
-	// not needed in GPGPU
+	// get group and local id
+	unsigned int id = get_local_id(0);
+	unsigned int group_id = get_group_id(0);
+
+	// first reduction step with sequential adressing
+	localBlock[id] = Combine(LoadGuarded(inArray, group_id * N * 2 + id, Size), LoadGuarded(inArray, group_id * N * 2 + N + id, Size));
+
+	// sequential addressing, groups beyond 1024 work-items loop over their first stages
+	unsigned int stride = N / 2;
+	for (; stride > 512; stride = stride / 2)
+	{
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (id < stride)
+			localBlock[id] = Combine(localBlock[id], localBlock[id + stride]);
+	}
+
+	// the last stages are unrolled. They keep their barriers: without them the stages of the last
+	// 32 work-items would rely on the lock-step execution of a SIMD unit, which OpenCL does not guarantee.
+	REDUCE_STAGE(512)
+	REDUCE_STAGE(256)
+	REDUCE_STAGE(128)
+	REDUCE_STAGE(64)
+	REDUCE_STAGE(32)
+	REDUCE_STAGE(16)
+	REDUCE_STAGE(8)
+	REDUCE_STAGE(4)
+	REDUCE_STAGE(2)
+	REDUCE_STAGE(1)
+
+	// write result back to global memory
+	if (id == 0) {
+		outArray[group_id] = localBlock[0];
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Combines the values of all work-items in localBlock[0], the local size has to be a power of two
+void ReduceLocalBlock(__local ACCUMULATOR* localBlock)
+{
+	unsigned int id = get_local_id(0);
+	for (unsigned int stride = get_local_size(0) / 2; stride > 0; stride = stride / 2)
+	{
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (id < stride)
+			localBlock[id] = Combine(localBlock[id], localBlock[id + stride]);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Combines the values of all work-items and returns the result to each of them. localBlock holds one value per work-item,
+// the collective functions need less of it (or none) and replace most of the barriers of the local memory tree.
+ACCUMULATOR ReduceGroup(ACCUMULATOR Value, __local ACCUMULATOR* localBlock)
+{
+#if defined(REDUCE_WORK_GROUP)
+	return COLLECTIVE(work_group_reduce_, REDUCTION_COLLECTIVE)(Value);
+#elif defined(REDUCE_SUB_GROUP)
+	// one value per sub-group, the first sub-group combines them
+	Value = COLLECTIVE(sub_group_reduce_, REDUCTION_COLLECTIVE)(Value);
+	if (get_sub_group_local_id() == 0)
+		localBlock[get_sub_group_id()] = Value;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (get_sub_group_id() == 0)
+	{
+		Value = Identity();
+		for (unsigned int i = get_sub_group_local_id(); i < get_num_sub_groups(); i += get_sub_group_size())
+			Value = Combine(Value, localBlock[i]);
+		Value = COLLECTIVE(sub_group_reduce_, REDUCTION_COLLECTIVE)(Value);
+		if (get_sub_group_local_id() == 0)
+			localBlock[0] = Value;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	return localBlock[0];
+#else
+	localBlock[get_local_id(0)] = Value;
+	ReduceLocalBlock(localBlock);
+	return localBlock[0];
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reduction_Decomp with the collective functions, or the local memory tree on devices without them
+__kernel void Reduction_DecompCollective(const __global ACCUMULATOR* inArray, __global ACCUMULATOR* outArray, uint N, uint Size, __local ACCUMULATOR* localBlock)
+{
+	unsigned int id = get_local_id(0);
+	unsigned int group_id = get_group_id(0);
+
+	// first reduction step with sequential adressing
+	ACCUMULATOR value = Combine(LoadGuarded(inArray, group_id * N * 2 + id, Size), LoadGuarded(inArray, group_id * N * 2 + N + id, Size));
+
+	value = ReduceGroup(value, localBlock);
+
+	if (id == 0)
+		outArray[group_id] = value;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// One launch: each group writes its partial result, the last group to finish combines the partial results.
+// groupsDone has to be zero before the launch, the last group resets it for the next one.
+__kernel void Reduction_SinglePass(__global ACCUMULATOR* array, __global ACCUMULATOR* partials, volatile __global uint* groupsDone,
+	uint N, __local ACCUMULATOR* localBlock)
+{
+	__local int isLastGroup;
+
+	unsigned int id = get_local_id(0);
+	unsigned int group_id = get_group_id(0);
+	unsigned int nGroups = get_num_groups(0);
+
+	// each work-item combines a grid-stride range of the array
+	ACCUMULATOR acc = Identity();
+	for (unsigned int i = get_global_id(0); i < N; i += get_global_size(0))
+		acc = Combine(acc, array[i]);
+	acc = ReduceGroup(acc, localBlock);
+
+	if (id == 0)
+	{
+		partials[group_id] = acc;
+
+		// the partial result has to be visible to the other groups before the counter is incremented
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		isLastGroup = (atomic_inc(groupsDone) == nGroups - 1);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if (!isLastGroup)
+		return;
+
+	// the last group reads the partial results of all groups (volatile, so they are not taken from a cache)
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	acc = Identity();
+	for (unsigned int i = id; i < nGroups; i += get_local_size(0))
+		acc = Combine(acc, ((volatile __global ACCUMULATOR*)partials)[i]);
+	acc = ReduceGroup(acc, localBlock);
+
+	if (id == 0)
+	{
+		array[0] = acc;
+		*groupsDone = 0;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// A fixed number of groups loops over the input elements, four per load, and writes one partial result per group
+__kernel void Reduction_GridStride(const __global ELEMENT* inArray, __global ACCUMULATOR* outArray, uint N, __local ACCUMULATOR* localBlock)
+{
+	unsigned int id = get_local_id(0);
+	unsigned int gid = get_global_id(0);
+	unsigned int stride = get_global_size(0);
+
+	// consecutive work-items load consecutive vectors, the values are accumulated in registers
+	ACCUMULATOR acc = Identity();
+	unsigned int nVectors = N / 4;
+	for (unsigned int v = gid; v < nVectors; v += stride)
+	{
+		ELEMENT4 x = vload4(v, inArray);
+		acc = Combine(acc, Load(x.s0, v * 4));
+		acc = Combine(acc, Load(x.s1, v * 4 + 1));
+		acc = Combine(acc, Load(x.s2, v * 4 + 2));
+		acc = Combine(acc, Load(x.s3, v * 4 + 3));
+	}
+
+	// the last N % 4 elements
+	for (unsigned int i = nVectors * 4 + gid; i < N; i += stride)
+		acc = Combine(acc, Load(inArray[i], i));
+
+	acc = ReduceGroup(acc, localBlock);
+
+	if (id == 0)
+		outArray[get_group_id(0)] = acc;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// One group combines the partial results of Reduction_GridStride
+__kernel void Reduction_GridStrideFinal(const __global ACCUMULATOR* inArray, __global ACCUMULATOR* outArray, uint N, __local ACCUMULATOR* localBlock)
+{
+	unsigned int id = get_local_id(0);
+
+	ACCUMULATOR acc = Identity();
+	for (unsigned int i = id; i < N; i += get_local_size(0))
+		acc = Combine(acc, inArray[i]);
+
+	acc = ReduceGroup(acc, localBlock);
+
+	if (id == 0)
+		outArray[0] = acc;
 }
 
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-__kernel void Reduction_DecompAtomics(const __global uint* inArray, __global uint* outArray, uint N, __local uint* localSum)
+__kernel void Reduction_DecompAtomics(const __global ACCUMULATOR* inArray, __global ACCUMULATOR* outArray, uint N, uint Size, __local ACCUMULATOR* localSum)
 {
+#ifdef REDUCTION_ATOMIC
 	// get group and local id
 	unsigned int id = get_local_id(0);
 	unsigned int group_id = get_group_id(0);
 
 	// calculate first reduce step in sequential way because we need to read from global memory
-	unsigned int sum = inArray[group_id * N * 2 + id] + inArray[group_id * N * 2 + N + id];
+	ACCUMULATOR sum = Combine(LoadGuarded(inArray, group_id * N * 2 + id, Size), LoadGuarded(inArray, group_id * N * 2 + N + id, Size));
 
-	// set localSum[0] to zero because it is not initialised
+	// set localSum[0] to the identity because it is not initialised
 	if (id == 0)
 	{
-		localSum[0] = 0;
+		localSum[0] = Identity();
 	}
 
-	// wait that all workers have localSum[0] equals zero
+	// wait that all workers have the initialised localSum[0]
 	barrier(CLK_LOCAL_MEM_FENCE);
 
-	// perform next reduce steps with atomic_add
-	atomic_add(localSum, sum);
+	// perform next reduce steps with the atomic operator
+	REDUCTION_ATOMIC((volatile __local ACCUMULATOR*)localSum, sum);
 
-	// wait for all atomic_add
+	// wait for all atomic operations
 	barrier(CLK_LOCAL_MEM_FENCE);
 
 	// write result back to global memory
@@ -85,4 +406,5 @@ __kernel void Reduction_DecompAtomics(const __global uint* inArray, __global uin
 	{
 		outArray[group_id] = localSum[0];
 	}
+#endif
 }
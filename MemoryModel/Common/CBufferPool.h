@@ -0,0 +1,112 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CBUFFER_POOL_H
+#define _CBUFFER_POOL_H
+
+#include "CLUtil.h"
+
+#include <map>
+#include <vector>
+#include <mutex>
+
+//! Pool of device buffers shared by all tasks of a context
+/*!
+	Tasks request device buffers with Acquire() instead of clCreateBuffer() and give them
+	back with Release() (or SAFE_RELEASE_POOLED). Requests are rounded up to power-of-two
+	size classes and released buffers are kept in a free list per context, flags and class,
+	so the next task or sweep configuration with the same sizes reuses them without an
+	allocation or first touch by the driver.
+
+	Small classes (up to 1 MB) are carved with clCreateSubBuffer() from slabs of 16 blocks,
+	aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN. Larger classes are separate buffers.
+
+	Only buffers without host pointer flags can be pooled, the contents of a recycled buffer
+	are undefined. All buffers of a context are freed by Clear(), which CAssignmentBase calls
+	before it releases the context.
+*/
+class CBufferPool
+{
+public:
+	static CBufferPool& GetSingleton();
+
+	//! Returns a buffer of at least Size bytes, Error receives the OpenCL error code (can be NULL)
+	cl_mem Acquire(cl_context Context, cl_mem_flags Flags, size_t Size, cl_int* Error = NULL);
+
+	//! Returns a buffer to the pool. Buffers that were not acquired from the pool are released.
+	void Release(cl_mem Buffer);
+
+	//! Frees all pooled buffers of the context, buffers still in use are freed when they are released
+	void Clear(cl_context Context);
+
+	//! Bytes of the buffers currently handed out, and the maximum since the start
+	size_t GetCurrentBytes() const { return m_CurrentBytes; }
+	size_t GetPeakBytes() const { return m_PeakBytes; }
+
+	//! Bytes allocated on the devices (handed out or pooled)
+	size_t GetDeviceBytes() const { return m_DeviceBytes; }
+
+	void PrintStats() const;
+
+protected:
+	CBufferPool();
+	~CBufferPool();
+
+	struct SPoolKey
+	{
+		cl_context		Context;
+		cl_mem_flags	Flags;
+		size_t			ClassSize;
+
+		bool operator<(const SPoolKey& Other) const;
+	};
+
+	struct SContextInfo
+	{
+		size_t				Alignment;
+		//bytes allocated in the context
+		size_t				DeviceBytes;
+		//slabs of the small classes, released in Clear()
+		std::vector<cl_mem>	Slabs;
+	};
+
+	size_t GetClassSize(size_t Size) const;
+
+	SContextInfo& GetContextInfo(cl_context Context);
+
+	//! Allocates a new block of the class, for small classes a slab whose other blocks are put into the free list
+	cl_mem AllocateBlock(const SPoolKey& Key, cl_int* Error);
+
+	std::map<SPoolKey, std::vector<cl_mem> >	m_FreeBlocks;
+	std::map<cl_mem, SPoolKey>					m_UsedBlocks;
+	std::map<cl_context, SContextInfo>			m_Contexts;
+
+	size_t					m_CurrentBytes;
+	size_t					m_PeakBytes;
+	size_t					m_DeviceBytes;
+	size_t					m_Hits;
+	size_t					m_Misses;
+
+	mutable std::mutex		m_Mutex;
+};
+
+//! Returns a buffer to CBufferPool and clears the handle
+#define SAFE_RELEASE_POOLED(ptr)	do {if(ptr){ CBufferPool::GetSingleton().Release(ptr); ptr = NULL; }} while(0)
+
+#endif // _CBUFFER_POOL_H
@@ -0,0 +1,168 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CHOST_BUFFER_H
+#define _CHOST_BUFFER_H
+
+#include "CLUtil.h"
+
+#include <string>
+
+//! Kind of host memory behind a CHostBuffer
+enum EHostMemoryMode
+{
+	HOST_MEMORY_PAGEABLE,	//!< plain heap memory, the driver stages every transfer through its own pinned buffer
+	HOST_MEMORY_PINNED,		//!< CL_MEM_ALLOC_HOST_PTR buffer that stays mapped, transfers can use DMA directly
+	HOST_MEMORY_ZERO_COPY,	//!< page aligned memory wrapped with CL_MEM_USE_HOST_PTR, kernels may access it in place
+	HOST_MEMORY_MODE_COUNT
+};
+
+//! Host memory for the input and output arrays of a task, allocated in one of the EHostMemoryMode modes
+/*!
+	Host code accesses the memory between Map() and Unmap(). For pageable and pinned
+	memory the pointer is always valid and Map() / Unmap() do nothing, zero-copy
+	memory has to be unmapped before the device uses it.
+
+	EnqueueWrite() / EnqueueRead() copy between the host memory and a device buffer.
+	For zero-copy memory the copy is done by the device from the wrapping memory object
+	(GetMemObject()); kernels can also use that memory object directly instead.
+
+	Allocate() needs a command queue to map the memory, the queue has to stay
+	valid until the buffer is released. Without a queue the default one is used
+	(the queue of the assignment, see CAssignmentBase).
+*/
+class CHostBuffer
+{
+public:
+	CHostBuffer();
+	~CHostBuffer();
+
+	//! Zero-copy memory is aligned to the base address alignment of the device, but at least to a page
+	bool Allocate(cl_context Context, cl_command_queue CommandQueue, size_t Size, EHostMemoryMode Mode);
+
+	void Release();
+
+	//! Makes the memory accessible by the host and returns the host pointer (blocking)
+	void* Map(cl_map_flags Flags = CL_MAP_READ | CL_MAP_WRITE, cl_command_queue CommandQueue = NULL);
+
+	//! Makes zero-copy memory accessible by the device again
+	cl_int Unmap(cl_command_queue CommandQueue = NULL);
+
+	//! Host pointer while the memory is mapped (always for pageable and pinned memory), NULL otherwise
+	void* GetHostPtr() const { return m_pMapped; }
+
+	template<typename T>
+	T* Get() const { return static_cast<T*>(m_pMapped); }
+
+	size_t GetSize() const { return m_Size; }
+
+	EHostMemoryMode GetMode() const { return m_Mode; }
+
+	//! Memory object of pinned and zero-copy memory, NULL for pageable memory
+	cl_mem GetMemObject() const { return m_MemObject; }
+
+	//! Copies Size bytes at Offset from the host memory to the same offset in DeviceBuffer
+	cl_int EnqueueWrite(cl_command_queue CommandQueue, cl_mem DeviceBuffer, size_t Offset, size_t Size,
+		cl_bool Blocking, cl_event* Event = NULL);
+
+	//! Copies Size bytes at Offset from DeviceBuffer to the same offset in the host memory
+	cl_int EnqueueRead(cl_command_queue CommandQueue, cl_mem DeviceBuffer, size_t Offset, size_t Size,
+		cl_bool Blocking, cl_event* Event = NULL);
+
+	static const char* GetModeName(EHostMemoryMode Mode);
+
+	//! Accepts the names returned by GetModeName() ("pageable", "pinned", "zerocopy")
+	static bool ParseMode(const std::string& Name, EHostMemoryMode& Mode);
+
+	//! Mode of the task arrays (see CMirroredBuffer), selected with --buffer-mode
+	static void SetDefaultMode(EHostMemoryMode Mode);
+	static EHostMemoryMode GetDefaultMode();
+
+	//! Queue used by Allocate() if none is given
+	static void SetDefaultCommandQueue(cl_command_queue CommandQueue);
+
+protected:
+	// the buffer owns memory objects and mappings, so it can not be copied
+	CHostBuffer(const CHostBuffer&);
+	CHostBuffer& operator=(const CHostBuffer&);
+
+	EHostMemoryMode		m_Mode;
+	size_t				m_Size;
+
+	cl_command_queue	m_CommandQueue;
+	cl_mem				m_MemObject;
+
+	//! Heap memory of pageable and zero-copy buffers
+	void*				m_pAllocation;
+	void*				m_pMapped;
+};
+
+//! Host array of a task together with the device buffer the kernels work on
+/*!
+	In the pageable and pinned modes the device buffer is a separate allocation and
+	Upload() / Download() copy the whole array. In zero-copy mode the kernels work on
+	the host memory directly (useful for CPU devices and devices with unified memory),
+	then Upload() only unmaps the memory and Download() maps it again.
+
+	After Allocate() the memory is mapped, so the task can fill in its input (except for
+	CL_MEM_WRITE_ONLY buffers, these belong to the device). Host code must not use the
+	array between Upload() / Unmap() and Download().
+*/
+class CMirroredBuffer
+{
+public:
+	CMirroredBuffer();
+	~CMirroredBuffer();
+
+	//! Uses the default mode of CHostBuffer (--buffer-mode). Flags are the access flags of the device buffer.
+	bool Allocate(cl_context Context, size_t Size, cl_mem_flags Flags = CL_MEM_READ_WRITE);
+
+	bool Allocate(cl_context Context, size_t Size, cl_mem_flags Flags, EHostMemoryMode Mode);
+
+	void Release();
+
+	//! Host pointer, only valid while the memory is accessible by the host
+	template<typename T>
+	T* Get() const { return m_Host.Get<T>(); }
+
+	//! Buffer for the kernel arguments
+	const cl_mem& GetDeviceBuffer() const { return m_DeviceBuffer; }
+
+	size_t GetSize() const { return m_Host.GetSize(); }
+
+	EHostMemoryMode GetMode() const { return m_Host.GetMode(); }
+
+	//! Makes the host data available to the device
+	cl_int Upload(cl_command_queue CommandQueue, cl_bool Blocking = CL_FALSE);
+
+	//! Makes the device data available to the host
+	cl_int Download(cl_command_queue CommandQueue, cl_bool Blocking = CL_TRUE);
+
+	//! Hands the memory back to the device without transferring the host data, e.g. before an output is written again
+	cl_int Unmap(cl_command_queue CommandQueue) { return m_Host.Unmap(CommandQueue); }
+
+protected:
+	CMirroredBuffer(const CMirroredBuffer&);
+	CMirroredBuffer& operator=(const CMirroredBuffer&);
+
+	CHostBuffer			m_Host;
+	cl_mem				m_DeviceBuffer;
+};
+
+#endif // _CHOST_BUFFER_H
@@ -0,0 +1,107 @@
+// Work-efficient parallel prefix sum (Blelloch) shared by the assignments.
+// Include it with #include "PrefixSum.cl", the kernel library resolves it from Common/CL.
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Work-efficient exclusive sweep of two elements per work-item, turned into an inclusive
+// prefix sum of the block. inArray and outArray may be the same array of N elements, the
+// local size has to be a power of two. Elements beyond N count as zero, so N is arbitrary.
+void PrefixSum_Block(const __global uint* inArray, __global uint* outArray, __global uint* higherLevelArray, uint N, __local uint* localBlock)
+{
+	// get local id, size and position
+	unsigned int id = get_local_id(0);
+	unsigned int size = get_local_size(0);
+	unsigned int pos = get_group_id(0) * size * 2 + id;
+
+	// load data into local memory sequential for better performance
+	unsigned int first = pos < N ? inArray[pos] : 0;
+	unsigned int second = pos + size < N ? inArray[pos + size] : 0;
+	localBlock[id] = first;
+	localBlock[id + size] = second;
+
+	// wait for local writes are done
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// perfom up sweep on local array
+	for (unsigned int step = 2; step <= size * 2; step = step * 2)
+	{
+		// check whether worker has something to do
+		if (id < (size * 2) / step)
+		{
+			// perform up sweep step
+			unsigned int index = (id + 1) * step - 1;
+			localBlock[index] += localBlock[index - step / 2];
+
+		}
+
+		// wait for sweep step completed
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	// set last element to zero for exclusive prefix sum
+	if (id == 0)
+	{
+		localBlock[size * 2 - 1] = 0;
+	}
+
+	// wait for write of last element done
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// perform down sweep
+	for (unsigned int step = size * 2; step > 1; step = step / 2)
+	{
+			// check whether worker has something to do
+			if (id < (size * 2) / step)
+			{
+				// perform single down sweep step
+				unsigned int index = (id + 1) * step - 1;
+				unsigned int left_value = localBlock[index - step / 2];
+				unsigned int right_value = localBlock[index];
+				// left child
+				localBlock[index - step / 2] = right_value;
+				// right child
+				localBlock[index] = left_value + right_value;
+			}
+
+			// wait for sweep step completed;
+			barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	// add the loaded elements to local array for inclusive prefix sum
+	localBlock[id] += first;
+	localBlock[id + size] += second;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// write result back sequential
+	if (pos < N)
+		outArray[pos] = localBlock[id];
+	if (pos + size < N)
+		outArray[pos + size] = localBlock[id + size];
+
+	// write group sum in higher level array for later composition of result
+	if (id == 0) {
+		higherLevelArray[get_group_id(0)] = localBlock[size * 2 - 1];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Adds the scanned group sums of the higher level to the blocks of the lower level (array has N elements)
+void PrefixSum_AddGroupSums(const __global uint* higherLevelArray, __global uint* array, uint N, __local uint* localBlock)
+{
+	// set local and group id and calculate position to read and write from
+	unsigned int id = get_local_id(0);
+	unsigned int group = get_group_id(0);
+	unsigned int pos = id + (group + 2) * get_local_size(0);
+
+	// the last block may be incomplete
+	if (pos >= N)
+		return;
+
+	// load group part of global array into local memory
+	localBlock[id] = array[pos];
+
+	// add group sum to local array
+	localBlock[id] += higherLevelArray[group/2];
+
+	// write result to global array
+	array[pos] = localBlock[id];
+}
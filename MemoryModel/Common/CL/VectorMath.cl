@@ -0,0 +1,14 @@
+// Vector helpers on float4 that ignore the w component
+
+float4 cross3(float4 a, float4 b) {
+	float4 c;
+	c.x = a.y * b.z - b.y * a.z;
+	c.y = a.z * b.x - b.z * a.x;
+	c.z = a.x * b.y - b.x * a.y;
+	c.w = 0.f;
+	return c;
+}
+
+float dot3(float4 a, float4 b) {
+	return a.x*b.x + a.y*b.y + a.z*b.z;
+}
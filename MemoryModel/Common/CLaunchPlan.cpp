@@ -0,0 +1,311 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CLaunchPlan.h"
+
+#include <map>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// cl_khr_command_buffer entry points
+
+// The extension is provisional and not declared by all OpenCL headers, so the entry
+// points are queried at run time. The property lists are arrays of cl_ulong.
+typedef _cl_command_buffer_khr* cl_command_buffer_handle;
+typedef cl_uint cl_sync_point;
+
+typedef cl_command_buffer_handle (CL_API_CALL *PFN_clCreateCommandBufferKHR)(cl_uint, const cl_command_queue*, const cl_ulong*, cl_int*);
+typedef cl_int (CL_API_CALL *PFN_clCommandNDRangeKernelKHR)(cl_command_buffer_handle, cl_command_queue, const cl_ulong*, cl_kernel, cl_uint,
+	const size_t*, const size_t*, const size_t*, cl_uint, const cl_sync_point*, cl_sync_point*, void**);
+typedef cl_int (CL_API_CALL *PFN_clFinalizeCommandBufferKHR)(cl_command_buffer_handle);
+typedef cl_int (CL_API_CALL *PFN_clEnqueueCommandBufferKHR)(cl_uint, cl_command_queue*, cl_command_buffer_handle, cl_uint, const cl_event*, cl_event*);
+typedef cl_int (CL_API_CALL *PFN_clReleaseCommandBufferKHR)(cl_command_buffer_handle);
+
+struct SCommandBufferAPI
+{
+	PFN_clCreateCommandBufferKHR	Create;
+	PFN_clCommandNDRangeKernelKHR	NDRangeKernel;
+	PFN_clFinalizeCommandBufferKHR	Finalize;
+	PFN_clEnqueueCommandBufferKHR	Enqueue;
+	PFN_clReleaseCommandBufferKHR	Release;
+};
+
+static bool LoadCommandBufferAPI(cl_device_id Device, SCommandBufferAPI& API)
+{
+	memset(&API, 0, sizeof(API));
+
+	if(!CLUtil::HasDeviceExtension(Device, "cl_khr_command_buffer"))
+		return false;
+
+	cl_platform_id platform = NULL;
+	if(clGetDeviceInfo(Device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL) != CL_SUCCESS)
+		return false;
+
+	API.Create = (PFN_clCreateCommandBufferKHR)clGetExtensionFunctionAddressForPlatform(platform, "clCreateCommandBufferKHR");
+	API.NDRangeKernel = (PFN_clCommandNDRangeKernelKHR)clGetExtensionFunctionAddressForPlatform(platform, "clCommandNDRangeKernelKHR");
+	API.Finalize = (PFN_clFinalizeCommandBufferKHR)clGetExtensionFunctionAddressForPlatform(platform, "clFinalizeCommandBufferKHR");
+	API.Enqueue = (PFN_clEnqueueCommandBufferKHR)clGetExtensionFunctionAddressForPlatform(platform, "clEnqueueCommandBufferKHR");
+	API.Release = (PFN_clReleaseCommandBufferKHR)clGetExtensionFunctionAddressForPlatform(platform, "clReleaseCommandBufferKHR");
+
+	return API.Create && API.NDRangeKernel && API.Finalize && API.Enqueue && API.Release;
+}
+
+static bool LoadCommandBufferAPI(cl_command_queue CommandQueue, SCommandBufferAPI& API)
+{
+	cl_device_id device = NULL;
+	if(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL) != CL_SUCCESS)
+		return false;
+	return LoadCommandBufferAPI(device, API);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CLaunchPlan
+
+bool CLaunchPlan::s_CommandBuffersEnabled = true;
+
+void CLaunchPlan::SetCommandBuffersEnabled(bool Enabled)
+{
+	s_CommandBuffersEnabled = Enabled;
+}
+
+bool CLaunchPlan::GetCommandBuffersEnabled()
+{
+	return s_CommandBuffersEnabled;
+}
+
+bool CLaunchPlan::IsCommandBufferSupported(cl_device_id Device)
+{
+	SCommandBufferAPI api;
+	return LoadCommandBufferAPI(Device, api);
+}
+
+bool CLaunchPlan::SArg::operator==(const SArg& Other) const
+{
+	return Index == Other.Index && Size == Other.Size && Local == Other.Local && Value == Other.Value;
+}
+
+CLaunchPlan::CLaunchPlan()
+	: m_Finalized(false), m_CommandBuffer(nullptr), m_CommandBufferAPI(nullptr), m_RecordedQueue(nullptr)
+{
+}
+
+CLaunchPlan::~CLaunchPlan()
+{
+	Clear();
+}
+
+void CLaunchPlan::Clear()
+{
+	if(m_CommandBuffer != nullptr)
+		m_CommandBufferAPI->Release(m_CommandBuffer);
+	m_CommandBuffer = nullptr;
+	SAFE_DELETE(m_CommandBufferAPI);
+	m_RecordedQueue = nullptr;
+
+	m_Launches.clear();
+	m_Swaps.clear();
+	m_Finalized = false;
+}
+
+CLaunchPlan& CLaunchPlan::Launch(cl_kernel Kernel, cl_uint WorkDim, const size_t* Global, const size_t* Local)
+{
+	SLaunch launch;
+	launch.Kernel = Kernel;
+	launch.WorkDim = min<cl_uint>(WorkDim, 3);
+	launch.HasLocal = Local != NULL;
+	for(cl_uint i = 0; i < 3; i++)
+	{
+		launch.Global[i] = i < launch.WorkDim ? Global[i] : 1;
+		launch.Local[i] = (Local && i < launch.WorkDim) ? Local[i] : 1;
+	}
+	m_Launches.push_back(launch);
+	return *this;
+}
+
+CLaunchPlan& CLaunchPlan::Arg(cl_uint Index, size_t Size, const void* Value)
+{
+	if(m_Launches.empty())
+		return *this;
+
+	SArg arg;
+	arg.Index = Index;
+	arg.Size = Size;
+	arg.Local = false;
+	arg.Value.assign((const unsigned char*)Value, (const unsigned char*)Value + Size);
+	m_Launches.back().Args.push_back(arg);
+	return *this;
+}
+
+CLaunchPlan& CLaunchPlan::LocalArg(cl_uint Index, size_t Size)
+{
+	if(m_Launches.empty())
+		return *this;
+
+	SArg arg;
+	arg.Index = Index;
+	arg.Size = Size;
+	arg.Local = true;
+	m_Launches.back().Args.push_back(arg);
+	return *this;
+}
+
+CLaunchPlan& CLaunchPlan::Swap(cl_mem& A, cl_mem& B)
+{
+	swap(A, B);
+	m_Swaps.push_back(make_pair(&A, &B));
+	return *this;
+}
+
+void CLaunchPlan::ApplySwaps(bool Reverse)
+{
+	if(Reverse)
+	{
+		for(size_t i = m_Swaps.size(); i > 0; i--)
+			swap(*m_Swaps[i - 1].first, *m_Swaps[i - 1].second);
+	}
+	else
+	{
+		for(size_t i = 0; i < m_Swaps.size(); i++)
+			swap(*m_Swaps[i].first, *m_Swaps[i].second);
+	}
+}
+
+cl_int CLaunchPlan::SetArgs(const SLaunch& Launch, bool All) const
+{
+	size_t nArgs = All ? Launch.Args.size() : Launch.Changed.size();
+	for(size_t i = 0; i < nArgs; i++)
+	{
+		const SArg& arg = Launch.Args[All ? i : Launch.Changed[i]];
+		cl_int clError = clSetKernelArg(Launch.Kernel, arg.Index, arg.Size, arg.Local ? NULL : &arg.Value[0]);
+		if(clError != CL_SUCCESS)
+			return clError;
+	}
+	return CL_SUCCESS;
+}
+
+cl_int CLaunchPlan::Finalize(cl_command_queue CommandQueue)
+{
+	if(m_Finalized)
+		return CL_SUCCESS;
+
+	// the handles go back to the state the arguments were recorded for
+	ApplySwaps(true);
+
+	// the enqueue loop only sets an argument if an earlier launch of the kernel in this plan set another value
+	map<cl_kernel, map<cl_uint, const SArg*> > current;
+	for(size_t i = 0; i < m_Launches.size(); i++)
+	{
+		SLaunch& launch = m_Launches[i];
+		map<cl_uint, const SArg*>& kernelArgs = current[launch.Kernel];
+
+		launch.Changed.clear();
+		for(size_t j = 0; j < launch.Args.size(); j++)
+		{
+			const SArg*& previous = kernelArgs[launch.Args[j].Index];
+			if(previous == nullptr || !(*previous == launch.Args[j]))
+				launch.Changed.push_back(j);
+			previous = &launch.Args[j];
+		}
+	}
+	m_Finalized = true;
+
+	if(s_CommandBuffersEnabled && !m_Launches.empty())
+		return Record(CommandQueue);
+	return CL_SUCCESS;
+}
+
+cl_int CLaunchPlan::Record(cl_command_queue CommandQueue)
+{
+	SCommandBufferAPI api;
+	if(!LoadCommandBufferAPI(CommandQueue, api))
+		return CL_SUCCESS;
+
+	cl_int clError = CL_SUCCESS;
+	cl_command_buffer_handle commandBuffer = api.Create(1, &CommandQueue, NULL, &clError);
+	// e.g. the queue lacks properties the device requires for command buffers, the enqueue loop works anyway
+	if(commandBuffer == nullptr || clError != CL_SUCCESS)
+		return CL_SUCCESS;
+
+	// each launch depends on the previous one, like on an in-order queue
+	cl_sync_point previous = 0;
+	for(size_t i = 0; i < m_Launches.size(); i++)
+	{
+		const SLaunch& launch = m_Launches[i];
+
+		// the command captures the argument values set at this point
+		clError = SetArgs(launch, true);
+		if(clError != CL_SUCCESS)
+			break;
+
+		cl_sync_point syncPoint = 0;
+		clError = api.NDRangeKernel(commandBuffer, NULL, NULL, launch.Kernel, launch.WorkDim, NULL, launch.Global,
+			launch.HasLocal ? launch.Local : NULL, i > 0 ? 1 : 0, i > 0 ? &previous : NULL, &syncPoint, NULL);
+		if(clError != CL_SUCCESS)
+			break;
+		previous = syncPoint;
+	}
+
+	if(clError == CL_SUCCESS)
+		clError = api.Finalize(commandBuffer);
+
+	if(clError != CL_SUCCESS)
+	{
+		// invalid arguments show up in the enqueue loop as well, anything else is a limitation of the extension
+		api.Release(commandBuffer);
+		return CL_SUCCESS;
+	}
+
+	m_CommandBuffer = commandBuffer;
+	m_CommandBufferAPI = new SCommandBufferAPI(api);
+	m_RecordedQueue = CommandQueue;
+	return CL_SUCCESS;
+}
+
+cl_int CLaunchPlan::Enqueue(cl_command_queue CommandQueue)
+{
+	// the first launch of each kernel sets all of its arguments, other code may have changed them since the last replay
+	vector<cl_kernel> seen;
+	for(size_t i = 0; i < m_Launches.size(); i++)
+	{
+		const SLaunch& launch = m_Launches[i];
+
+		bool first = find(seen.begin(), seen.end(), launch.Kernel) == seen.end();
+		if(first)
+			seen.push_back(launch.Kernel);
+
+		cl_int clError = SetArgs(launch, first);
+		if(clError != CL_SUCCESS)
+			return clError;
+
+		clError = clEnqueueNDRangeKernel(CommandQueue, launch.Kernel, launch.WorkDim, NULL, launch.Global,
+			launch.HasLocal ? launch.Local : NULL, 0, NULL, NULL);
+		if(clError != CL_SUCCESS)
+			return clError;
+	}
+	return CL_SUCCESS;
+}
+
+cl_int CLaunchPlan::Replay(cl_command_queue CommandQueue)
+{
+	cl_int clError = Finalize(CommandQueue);
+	if(clError != CL_SUCCESS)
+		return clError;
+
+	clError = CL_INVALID_OPERATION;
+	if(m_CommandBuffer != nullptr && CommandQueue == m_RecordedQueue)
+		clError = m_CommandBufferAPI->Enqueue(0, NULL, m_CommandBuffer, 0, NULL, NULL);
+	// another queue, or the command buffer is still pending and does not support simultaneous use
+	if(clError == CL_INVALID_OPERATION)
+		clError = Enqueue(CommandQueue);
+
+	if(clError == CL_SUCCESS)
+		ApplySwaps(false);
+	return clError;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,137 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CLAUNCH_PLAN_H
+#define _CLAUNCH_PLAN_H
+
+#include "CLUtil.h"
+
+#include <vector>
+
+struct _cl_command_buffer_khr;
+struct SCommandBufferAPI;
+
+//! A precomputed sequence of kernel launches that is replayed with little host work
+/*!
+	Multi-pass algorithms (reductions, scans, constraint relaxation) launch short kernels
+	many times, and setting the arguments and computing the launch geometry for each
+	pass is a measurable part of their run time. A plan is built once for a problem size:
+
+		plan.Launch(kernel, 1, &global, &local).Arg(0, buffer).Arg(1, stride);
+		plan.Swap(ping, pong);
+		...
+		plan.Replay(queue);
+
+	If the device supports cl_khr_command_buffer, Finalize() records the launches into
+	a command buffer and Replay() enqueues it with a single call. Otherwise Replay() is a
+	tight enqueue loop that only sets the arguments that differ from the previous launch
+	of the same kernel in the plan.
+
+	Arguments that are not part of the plan keep the value the kernel had when the plan
+	was recorded (command buffer) or has at replay time (enqueue loop), so they should
+	not change while the plan is in use.
+
+	Swap() exchanges two buffer handles of the caller. The handles are swapped while the
+	plan is built (so the following arguments see the swapped buffers), restored by
+	Finalize() and swapped again by each Replay(). After a replay the handles are thus in
+	the same state as after running the passes directly. As the recorded arguments are the
+	buffers of the initial state, a plan with swaps is only valid for that state.
+*/
+class CLaunchPlan
+{
+public:
+	CLaunchPlan();
+	~CLaunchPlan();
+
+	//! Allows or forbids command buffers for the plans finalized afterwards (--cl-command-buffers)
+	static void SetCommandBuffersEnabled(bool Enabled);
+	static bool GetCommandBuffersEnabled();
+
+	//! Returns true if the plans can be recorded into command buffers on the device
+	static bool IsCommandBufferSupported(cl_device_id Device);
+
+	//! Drops all launches and the recorded command buffer
+	void Clear();
+
+	bool IsEmpty() const { return m_Launches.empty(); }
+	size_t GetLaunchCount() const { return m_Launches.size(); }
+	//! True if the plan is replayed from a command buffer
+	bool IsRecorded() const { return m_CommandBuffer != nullptr; }
+
+	//! Appends a launch, the following Arg() calls belong to it. Local may be NULL.
+	CLaunchPlan& Launch(cl_kernel Kernel, cl_uint WorkDim, const size_t* Global, const size_t* Local);
+
+	CLaunchPlan& Arg(cl_uint Index, size_t Size, const void* Value);
+	template<typename T> CLaunchPlan& Arg(cl_uint Index, const T& Value) { return Arg(Index, sizeof(T), &Value); }
+	//! __local argument of Size bytes
+	CLaunchPlan& LocalArg(cl_uint Index, size_t Size);
+
+	//! Swaps two buffer handles of the caller at this point of the sequence (see above)
+	CLaunchPlan& Swap(cl_mem& A, cl_mem& B);
+
+	//! Completes the plan, records the command buffer if possible. Replay() calls it on first use.
+	cl_int Finalize(cl_command_queue CommandQueue);
+
+	//! Enqueues all launches of the plan
+	cl_int Replay(cl_command_queue CommandQueue);
+
+protected:
+	CLaunchPlan(const CLaunchPlan&);
+	CLaunchPlan& operator=(const CLaunchPlan&);
+
+	struct SArg
+	{
+		cl_uint						Index;
+		size_t						Size;
+		bool						Local;
+		std::vector<unsigned char>	Value;
+
+		bool operator==(const SArg& Other) const;
+	};
+
+	struct SLaunch
+	{
+		cl_kernel			Kernel;
+		cl_uint				WorkDim;
+		size_t				Global[3];
+		size_t				Local[3];
+		bool				HasLocal;
+		std::vector<SArg>	Args;
+		//! Arguments the enqueue loop has to set (indices into Args)
+		std::vector<size_t>	Changed;
+	};
+
+	cl_int SetArgs(const SLaunch& Launch, bool All) const;
+	cl_int Enqueue(cl_command_queue CommandQueue);
+	cl_int Record(cl_command_queue CommandQueue);
+	void ApplySwaps(bool Reverse);
+
+	std::vector<SLaunch>						m_Launches;
+	std::vector<std::pair<cl_mem*, cl_mem*> >	m_Swaps;
+
+	bool										m_Finalized;
+	_cl_command_buffer_khr*						m_CommandBuffer;
+	//! Entry points of the extension, loaded when the command buffer is recorded
+	SCommandBufferAPI*							m_CommandBufferAPI;
+	cl_command_queue							m_RecordedQueue;
+
+	static bool									s_CommandBuffersEnabled;
+};
+
+#endif // _CLAUNCH_PLAN_H
@@ -0,0 +1,86 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CREGRESSION_GATE_H
+#define _CREGRESSION_GATE_H
+
+#include "CStatistics.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+
+struct SBenchmarkResult;
+
+//! Compares the benchmark results of a run against a baseline results file
+/*!
+	The baseline is a file written by CResultsSink (JSON Lines or CSV). Only the valid
+	results of the current device are used, so the results of several devices can share
+	one file. As the file is appended to, a baseline recorded with --repetitions n contains
+	n samples of every result.
+
+	Each result is identified by task, variant, problem size and local work size, its mean
+	time is one sample.
+	A result counts as a regression if it is slower than the baseline by more than the
+	threshold and the slowdown is significant in a one-sided Welch t-test. If only one side
+	has several samples, its variance is used for both, with single samples on both sides
+	only the threshold is applied. Results without a baseline are reported, but do not
+	fail the check. A task that fails its validation always fails it.
+*/
+class CRegressionGate
+{
+public:
+	static CRegressionGate& GetSingleton();
+
+	//! Loads the valid results of the device from a results file, fails if there are none
+	bool LoadBaseline(const std::string& Path, const std::string& DeviceName);
+
+	bool IsEnabled() const { return m_Enabled; }
+
+	//! Minimum slowdown in percent and significance level of the t-test
+	void SetThreshold(double Percent, double Alpha);
+
+	//! Adds the results of a finished task, one sample per result
+	void AddResults(const std::string& TaskName, const std::vector<SBenchmarkResult>& Results, bool Valid);
+
+	//! Prints the comparison of all results, returns false if there is a regression or an invalid task
+	bool Evaluate() const;
+
+protected:
+	CRegressionGate();
+
+	//! Task, variant, problem size and local work size (e.g. "256x1x1")
+	typedef std::tuple<std::string, std::string, size_t, std::string> ResultKey;
+
+	//! Adds one line of the results file given as column name -> value, returns false if it was skipped
+	bool AddBaselineSample(const std::map<std::string, std::string>& Fields, const std::string& DeviceName);
+
+	bool								m_Enabled;
+	std::string							m_Path;
+	double								m_ThresholdPercent;
+	double								m_Alpha;
+
+	std::map<ResultKey, CStatistics>	m_Baseline;
+	std::map<ResultKey, CStatistics>	m_Current;
+	std::set<std::string>				m_InvalidTasks;
+};
+
+#endif // _CREGRESSION_GATE_H
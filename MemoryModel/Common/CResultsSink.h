@@ -0,0 +1,132 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CRESULTS_SINK_H
+#define _CRESULTS_SINK_H
+
+#include "CLUtil.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <mutex>
+
+class CStatistics;
+
+//! One timing measurement of a kernel variant, reported by a compute task
+/*!
+	Times are per iteration in milliseconds. Statistics that a task does not
+	measure (e.g. percentiles when only the mean is known) are negative.
+	A local work size of zero is replaced by the one passed to RunComputeTask().
+*/
+struct SBenchmarkResult
+{
+	SBenchmarkResult();
+
+	SBenchmarkResult(const std::string& Variant, size_t ProblemSize, int Iterations, double MeanMs, double BytesMoved = 0.0, double Flops = 0.0);
+
+	//! Takes the statistics of the kernel execution time (START->END) of an event-based profile
+	SBenchmarkResult(const std::string& Variant, size_t ProblemSize, const SKernelProfile& Profile, double BytesMoved = 0.0, double Flops = 0.0);
+
+	//! Takes the statistics of host-timed iterations, the mean is the robust mean (see CStatistics)
+	SBenchmarkResult(const std::string& Variant, size_t ProblemSize, const CStatistics& Statistics, double BytesMoved = 0.0, double Flops = 0.0);
+
+	std::string		Variant;
+	size_t			ProblemSize;
+	size_t			LocalWorkSize[3];
+	int				Iterations;
+
+	double			MeanMs;
+	double			MinMs;
+	double			MedianMs;
+	double			P95Ms;
+	double			MaxMs;
+
+	//! Bytes read and written by one iteration, used to compute the bandwidth
+	double			BytesMoved;
+	//! Arithmetic operations of one iteration, used to compute the GFLOP/s
+	double			Flops;
+	//! Achieved fraction of the roofline in percent, negative if unknown (see CRoofline)
+	double			RooflinePercent;
+};
+
+//! Collects the benchmark results of all tasks and writes them as JSON Lines or CSV
+/*!
+	RunComputeTask() brackets each task with BeginTask() / EndTask(), the tasks report
+	their measurements with Add(). The results are written in EndTask(), as only then
+	the validation status is known. Files are opened for appending, so results of
+	several runs can be collected in the same file.
+
+	If no file is open, the results are simply dropped.
+
+	Several tasks can be open at the same time (see CTaskGraph). BeginTask() binds the new
+	task to the calling thread, a phase of the task running on another thread binds it
+	with BindTask() before reporting. The last task results are also kept per thread.
+*/
+class CResultsSink
+{
+public:
+	static CResultsSink& GetSingleton();
+
+	//! Opens the results file. Format is "jsonl" or "csv", if empty it is derived from the file extension.
+	bool Open(const std::string& Path, const std::string& Format = "");
+
+	void Close();
+
+	bool IsOpen() const { return m_File.is_open(); }
+
+	//! Opens a task and binds it to the calling thread, returns the id for BindTask()
+	unsigned int BeginTask(const std::string& TaskName, const std::string& DeviceName, const size_t LocalWorkSize[3]);
+
+	//! Binds an open task to the calling thread, Add() and EndTask() act on the bound task
+	void BindTask(unsigned int TaskId);
+
+	void Add(const SBenchmarkResult& Result);
+
+	void EndTask(bool Valid);
+
+	//! Results and validation status of the last task finished by the calling thread, e.g. to find the best configuration of a sweep
+	const std::vector<SBenchmarkResult>& GetLastTaskResults() const;
+	bool WasLastTaskValid() const;
+
+protected:
+	CResultsSink();
+	~CResultsSink();
+
+	struct STask
+	{
+		std::string						TaskName;
+		std::string						DeviceName;
+		size_t							LocalWorkSize[3];
+		std::vector<SBenchmarkResult>	Pending;
+	};
+
+	void WriteJSON(const STask& Task, const SBenchmarkResult& Result, bool Valid);
+	void WriteCSV(const STask& Task, const SBenchmarkResult& Result, bool Valid);
+
+	std::ofstream					m_File;
+	bool							m_CSV;
+
+	std::mutex						m_Mutex;
+	std::map<unsigned int, STask>	m_Tasks;
+	unsigned int					m_NextTaskId;
+};
+
+#endif // _CRESULTS_SINK_H
@@ -0,0 +1,111 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CSIMD_H
+#define _CSIMD_H
+
+#include <string>
+#include <cstddef>
+
+//! Instruction sets of the vectorized CPU baselines, ordered by capability
+enum ESimdLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_AVX512,
+	SIMD_LEVEL_COUNT
+};
+
+//! Vectorized building blocks of the CPU baselines, one table per instruction set
+/*!
+	All functions work on one row (or one range of rows) so the callers can distribute
+	the rows over CThreadPool. Images are zero outside of [0, Width), as in the
+	reference implementations. Floating point results may differ from the scalar
+	references in the last bits if the compiler contracts multiply-adds.
+*/
+struct SSimdKernels
+{
+	ESimdLevel		Level;
+
+	//! Sum of N values (modulo 2^32)
+	unsigned int	(*SumU32)(const unsigned int* Data, size_t N);
+
+	//! Sum of N values, accumulated with 64 bit (exact up to 2^32 values)
+	unsigned long long	(*SumU64)(const unsigned int* Data, size_t N);
+
+	//! Inclusive prefix sum of N values starting with Carry, returns the last sum
+	unsigned int	(*InclusiveScanU32)(const unsigned int* In, unsigned int* Out, size_t N, unsigned int Carry);
+
+	//! Dst[x] += sum over k in [-Radius, Radius] of Src[x + k] * Kernel[Radius - k]
+	void			(*ConvolveRowAdd)(const float* Src, float* Dst, int Width, const float* Kernel, int Radius);
+
+	//! Dst[x] += Src[x] * Weight
+	void			(*AxpyRow)(const float* Src, float* Dst, int Width, float Weight);
+
+	//! Dst[x] = Dst[x] * Scale + Offset
+	void			(*ScaleOffsetRow)(float* Dst, int Width, float Scale, float Offset);
+
+	//! Increments Bins[min(NBins - 1, max(0, int(Src[x] * NBins)))] for all pixels of the row
+	void			(*HistogramRow)(const float* Src, int Width, int NBins, unsigned int* Bins);
+
+	//! Rotates the columns [XBegin, XEnd) of the SizeX x SizeY matrix M clockwise into MR (SizeY x SizeX)
+	void			(*RotateClockwise)(const float* M, float* MR, size_t SizeX, size_t SizeY, size_t XBegin, size_t XEnd);
+};
+
+//! Detects the instruction sets of the host (CPUID) and selects the matching kernel table
+/*!
+	The best supported level is used by default, SetLevel() can restrict it
+	(--cpu-simd scalar|sse2|avx2|avx512, see CAssignmentBase). Levels that the
+	host or the compiler does not support fall back to the next lower one.
+*/
+class CSimd
+{
+public:
+	static CSimd& GetSingleton();
+
+	//! Selects the level by name, returns false if the name is unknown
+	bool SetLevel(const std::string& Name);
+
+	ESimdLevel GetLevel() const { return m_Level; }
+	ESimdLevel GetDetectedLevel() const { return m_DetectedLevel; }
+
+	const SSimdKernels& GetKernels() const { return *m_Kernels; }
+
+	static const char* GetLevelName(ESimdLevel Level);
+
+protected:
+	CSimd();
+
+	static ESimdLevel DetectLevel();
+	void SelectKernels(ESimdLevel Level);
+
+	ESimdLevel			m_DetectedLevel;
+	ESimdLevel			m_Level;
+	const SSimdKernels*	m_Kernels;
+};
+
+// Kernel tables of the instruction sets, defined in CSimd<Level>.cpp.
+// They return NULL if the compiler was not able to build the instruction set.
+const SSimdKernels* GetSimdKernelsScalar();
+const SSimdKernels* GetSimdKernelsSSE2();
+const SSimdKernels* GetSimdKernelsAVX2();
+const SSimdKernels* GetSimdKernelsAVX512();
+
+#endif // _CSIMD_H
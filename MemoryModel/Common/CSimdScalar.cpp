@@ -0,0 +1,16 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+// Kernel table the scalar fallback, always available
+
+#include "CSimdKernels.h"
+
+const SSimdKernels* GetSimdKernelsScalar()
+{
+	static const SSimdKernels s_Kernels = MakeSimdKernels<SScalarTraits>(SIMD_SCALAR);
+	return &s_Kernels;
+}
+
+///////////////////////////////////////////////////////////////////////////////
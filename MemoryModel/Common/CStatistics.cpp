@@ -0,0 +1,212 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CStatistics.h"
+
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CStatistics
+
+CStatistics::CStatistics(unsigned int WarmUp, size_t ReservoirSize)
+	: m_WarmUp(WarmUp), m_ReservoirSize(max<size_t>(ReservoirSize, 1))
+{
+	Reset();
+}
+
+void CStatistics::Reset()
+{
+	m_Skipped = 0;
+	m_Count = 0;
+	m_Mean = 0.0;
+	m_M2 = 0.0;
+	m_Min = 0.0;
+	m_Max = 0.0;
+	m_Reservoir.clear();
+	// fixed seed, so repeated runs select the same samples
+	m_Random.seed(5489u);
+	m_SortedValid = false;
+}
+
+void CStatistics::Add(double Value)
+{
+	if(m_Skipped < m_WarmUp)
+	{
+		m_Skipped++;
+		return;
+	}
+
+	m_Count++;
+	double delta = Value - m_Mean;
+	m_Mean += delta / double(m_Count);
+	m_M2 += delta * (Value - m_Mean);
+
+	m_Min = m_Count == 1 ? Value : min(m_Min, Value);
+	m_Max = m_Count == 1 ? Value : max(m_Max, Value);
+
+	// reservoir sampling: the k-th sample replaces a random entry with probability size / k
+	if(m_Reservoir.size() < m_ReservoirSize)
+		m_Reservoir.push_back(Value);
+	else
+	{
+		size_t slot = uniform_int_distribution<size_t>(0, m_Count - 1)(m_Random);
+		if(slot < m_ReservoirSize)
+			m_Reservoir[slot] = Value;
+	}
+	m_SortedValid = false;
+}
+
+double CStatistics::GetVariance() const
+{
+	return m_Count > 1 ? m_M2 / double(m_Count - 1) : 0.0;
+}
+
+double CStatistics::GetStdDev() const
+{
+	return sqrt(GetVariance());
+}
+
+const std::vector<double>& CStatistics::GetSortedSamples() const
+{
+	if(!m_SortedValid)
+	{
+		m_Sorted = m_Reservoir;
+		sort(m_Sorted.begin(), m_Sorted.end());
+		m_SortedValid = true;
+	}
+	return m_Sorted;
+}
+
+double CStatistics::GetPercentile(double P) const
+{
+	const vector<double>& samples = GetSortedSamples();
+	if(samples.empty())
+		return 0.0;
+
+	double position = max(0.0, min(1.0, P)) * double(samples.size() - 1);
+	size_t lower = size_t(position);
+	size_t upper = min(lower + 1, samples.size() - 1);
+	return samples[lower] + (position - double(lower)) * (samples[upper] - samples[lower]);
+}
+
+double CStatistics::GetRobustMean(double Threshold, size_t* NRejected) const
+{
+	const vector<double>& samples = GetSortedSamples();
+	if(NRejected)
+		*NRejected = 0;
+	if(samples.empty())
+		return 0.0;
+
+	double median = GetMedian();
+	vector<double> deviations(samples.size());
+	for(size_t i = 0; i < samples.size(); i++)
+		deviations[i] = fabs(samples[i] - median);
+	nth_element(deviations.begin(), deviations.begin() + deviations.size() / 2, deviations.end());
+	// 1.4826 scales the MAD to the standard deviation of a normal distribution
+	double limit = Threshold * 1.4826 * deviations[deviations.size() / 2];
+
+	// with a MAD of zero (quantized timers) only the samples equal to the median are kept
+	double sum = 0.0;
+	size_t n = 0;
+	for(size_t i = 0; i < samples.size(); i++)
+	{
+		if(fabs(samples[i] - median) <= limit)
+		{
+			sum += samples[i];
+			n++;
+		}
+	}
+	if(NRejected)
+		*NRejected = samples.size() - n;
+	return sum / double(n);
+}
+
+SProfileInterval CStatistics::GetProfileInterval() const
+{
+	SProfileInterval interval;
+	interval.Min = m_Min;
+	interval.Median = GetMedian();
+	interval.P95 = GetPercentile(0.95);
+	interval.P99 = GetPercentile(0.99);
+	interval.Max = m_Max;
+	interval.Mean = GetRobustMean();
+	return interval;
+}
+
+// continued fraction of the regularized incomplete beta function, evaluated with Lentz's method
+static double IncompleteBetaFraction(double A, double B, double X)
+{
+	const int maxIterations = 300;
+	const double epsilon = 1.0e-12;
+	const double tiny = 1.0e-300;
+
+	double c = 1.0;
+	double d = 1.0 - (A + B) * X / (A + 1.0);
+	d = 1.0 / (fabs(d) < tiny ? tiny : d);
+	double h = d;
+	for(int m = 1; m <= maxIterations; m++)
+	{
+		// even and odd step of the fraction
+		for(int odd = 0; odd < 2; odd++)
+		{
+			double aa = odd ? -(A + m) * (A + B + m) * X / ((A + 2 * m) * (A + 1.0 + 2 * m))
+							: m * (B - m) * X / ((A - 1.0 + 2 * m) * (A + 2 * m));
+			d = 1.0 + aa * d;
+			d = 1.0 / (fabs(d) < tiny ? tiny : d);
+			c = 1.0 + aa / c;
+			c = fabs(c) < tiny ? tiny : c;
+			h *= d * c;
+			if(odd && fabs(d * c - 1.0) < epsilon)
+				return h;
+		}
+	}
+	return h;
+}
+
+static double RegularizedIncompleteBeta(double A, double B, double X)
+{
+	if(X <= 0.0)
+		return 0.0;
+	if(X >= 1.0)
+		return 1.0;
+
+	double front = exp(lgamma(A + B) - lgamma(A) - lgamma(B) + A * log(X) + B * log(1.0 - X));
+	// the fraction converges quickly only below the mean of the beta distribution, use the symmetry otherwise
+	if(X < (A + 1.0) / (A + B + 2.0))
+		return front * IncompleteBetaFraction(A, B, X) / A;
+	return 1.0 - front * IncompleteBetaFraction(B, A, 1.0 - X) / B;
+}
+
+double CStatistics::GetStudentTCDF(double T, double DegreesOfFreedom)
+{
+	double tail = 0.5 * RegularizedIncompleteBeta(0.5 * DegreesOfFreedom, 0.5, DegreesOfFreedom / (DegreesOfFreedom + T * T));
+	return T > 0.0 ? 1.0 - tail : tail;
+}
+
+double CStatistics::GetStudentTQuantile(double P, double DegreesOfFreedom)
+{
+	if(P <= 0.0 || P >= 1.0)
+		return P <= 0.0 ? -HUGE_VAL : HUGE_VAL;
+
+	// the distribution is symmetric, bisect in the upper half
+	double p = max(P, 1.0 - P);
+	double lo = 0.0, hi = 1.0;
+	while(GetStudentTCDF(hi, DegreesOfFreedom) < p && hi < 1.0e12)
+		hi *= 2.0;
+	for(int i = 0; i < 100; i++)
+	{
+		double mid = 0.5 * (lo + hi);
+		if(GetStudentTCDF(mid, DegreesOfFreedom) < p)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return P < 0.5 ? -0.5 * (lo + hi) : 0.5 * (lo + hi);
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -1,18 +1,19 @@
 /******************************************************************************
-                         .88888.   888888ba  dP     dP
-                        d8'   `88  88    `8b 88     88
-                        88        a88aaaa8P' 88     88
-                        88   YP88  88        88     88
-                        Y8.   .88  88        Y8.   .8P
-                         `88888'   dP        `Y88888P'
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
 
-
-   a88888b.                                         dP   oo
-  d8'   `88                                         88
-  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b.
-  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88
-  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88
-   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88
-                                88                                        .88
-                                dP                                    d8888P
-******************************************************************************/
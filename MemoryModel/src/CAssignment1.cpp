@@ -7,130 +7,44 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CSimpleArraysTask.h"
 #include "CMatrixRotateTask.h"
+#include "../Common/CTransferBandwidthTask.h"
 
 #include <iostream>
 
 using namespace std;
 
-#define NUM_TASKS 1048576
-
 ///////////////////////////////////////////////////////////////////////////////
 // CAssignment1
 
 bool CAssignment1::DoCompute()
 {
+	bool success = true;
+
 	// Task 1: simple array addition.
+	// By default we sweep the local work size from 64 to 1024 (see CBenchmarkSweep for the command line options).
 	cout << endl << endl << "Running vector addition example..." << endl << endl;
-	{
-		size_t localWorkSize[3] = {64, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {128, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {192, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {256, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {320, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {384, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {448, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {512, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {576, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {640, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {704, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {768, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {832, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {896, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {960, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {1024, 1, 1};
-		CSimpleArraysTask task(NUM_TASKS);
-		RunComputeTask(task, localWorkSize);
-	}
+	CBenchmarkSweep vectorAdd("vecadd", "1048576", "64:1024:64", "", "1000");
+	success &= RunSweep(vectorAdd, [](const SSweepConfig& Config) -> IComputeTask* {
+		return new CSimpleArraysTask(Config.ProblemSize[0], Config.Iterations);
+	});
 
 	// Task 2: matrix rotation.
+	// The odd sizes check that the kernels handle matrices that are not a multiple of the work-group size.
 	cout << endl << endl << "Running matrix rotation example..." << endl << endl;
-	{
-		size_t localWorkSize[3] = {32, 16, 1};
-		CMatrixRotateTask task(33, 17);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {32, 16, 1};
-		CMatrixRotateTask task(2048, 1024);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {32, 16, 1};
-		CMatrixRotateTask task(2048, 1025);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {32, 16, 1};
-		CMatrixRotateTask task(2049, 1024);
-		RunComputeTask(task, localWorkSize);
-	}
-	{
-		size_t localWorkSize[3] = {32, 16, 1};
-		CMatrixRotateTask task(2049, 1025);
-		RunComputeTask(task, localWorkSize);
-	}
-
-	return true;
+	CBenchmarkSweep matrixRotate("rotate", "33x17,2048x1024,2048x1025,2049x1024,2049x1025", "32x16", "", "1000");
+	success &= RunSweep(matrixRotate, [](const SSweepConfig& Config) -> IComputeTask* {
+		return new CMatrixRotateTask(Config.ProblemSize[0], Config.ProblemSize[1], Config.Iterations);
+	});
+
+	// Task 3: transfer bandwidth and latency for each kind of host memory.
+	// The sizes are given in bytes, the variants are the host memory modes (pageable, pinned, zerocopy).
+	cout << endl << endl << "Running transfer bandwidth benchmark..." << endl << endl;
+	CBenchmarkSweep transfer("transfer", "4096:67108864:*4", "1", "", "100");
+	success &= RunSweep(transfer, [](const SSweepConfig& Config) -> IComputeTask* {
+		return new CTransferBandwidthTask(Config.ProblemSize[0], Config.Variant, Config.Iterations);
+	});
+
+	return success;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
@@ -6,17 +6,25 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CMatrixRotateTask.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CKernelLibrary.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CAutoTuner.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CSimd.h"
+#include "../Common/CTimer.h"
 
 #include <string.h>
+#include <vector>
 
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////////
 // CMatrixRotateTask
 
-CMatrixRotateTask::CMatrixRotateTask(size_t SizeX, size_t SizeY)
-	:m_SizeX(static_cast<unsigned>(SizeX)), m_SizeY(static_cast<unsigned>(SizeY)), m_hM(NULL), m_hMR(NULL), m_dM(NULL),
-	m_dMR(NULL), m_hGPUResultNaive(NULL), m_hGPUResultOpt(NULL), m_Program(NULL),
+CMatrixRotateTask::CMatrixRotateTask(size_t SizeX, size_t SizeY, unsigned int NIterations)
+	:m_SizeX(static_cast<unsigned>(SizeX)), m_SizeY(static_cast<unsigned>(SizeY)), m_NIterations(NIterations), m_hM(NULL), m_hMR(NULL),
+	m_hGPUResultNaive(NULL), m_Program(NULL),
 	m_NaiveKernel(NULL), m_OptimizedKernel(NULL)
 {
 }
@@ -28,11 +36,15 @@ CMatrixRotateTask::~CMatrixRotateTask()
 
 bool CMatrixRotateTask::InitResources(cl_device_id Device, cl_context Context)
 {
+	// Input and output arrays, in zero-copy mode the kernels work on the host memory directly
+	if(!m_M.Allocate(Context, sizeof(float) * m_SizeX * m_SizeY, CL_MEM_READ_ONLY) ||
+		!m_MR.Allocate(Context, sizeof(float) * m_SizeX * m_SizeY, CL_MEM_WRITE_ONLY))
+		return false;
+
 	// CPU resources
-	m_hM = new float[m_SizeX * m_SizeY];
+	m_hM = m_M.Get<float>();
 	m_hMR = new float[m_SizeX * m_SizeY];
 	m_hGPUResultNaive = new float[m_SizeX * m_SizeY];
-	m_hGPUResultOpt = new float[m_SizeX * m_SizeY];
 
 	// Fill the matrix with random floats
 	for(unsigned int i = 0; i < m_SizeX * m_SizeY; i++)
@@ -41,25 +53,13 @@ bool CMatrixRotateTask::InitResources(cl_device_id Device, cl_context Context)
 		m_hM[i] = float(rand()) / float(RAND_MAX) * 1000;
 	}
 
-	// Allocate device buffer for input and output array
 	cl_int clError;
-    m_dM = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(float) * m_SizeX * m_SizeY, NULL, &clError);
-    V_RETURN_FALSE_CL(clError, CLUtil::GetCLErrorString(clError));
-    m_dMR = clCreateBuffer(Context, CL_MEM_WRITE_ONLY, sizeof(float) * m_SizeX * m_SizeY, NULL, &clError);
-    V_RETURN_FALSE_CL(clError, CLUtil::GetCLErrorString(clError));
 
 	// Load and compile kernels
-	string programCode;
-	if (!CLUtil::LoadProgramSourceToMemory("MatrixRot.cl", programCode))
-	{
-		cout << "Loading source to memory failed." << endl;
-		return false;
-	}
-
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_Program = CKernelLibrary::GetSingleton().Build(Device, Context, "MatrixRot.cl");
 	if (m_Program == nullptr)
 	{
-		cout << "Build program from memory failed." << endl;
+		cout << "Loading or building the program failed." << endl;
 		return false;
 	}
 
@@ -70,14 +70,14 @@ bool CMatrixRotateTask::InitResources(cl_device_id Device, cl_context Context)
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: MatrixRotNaive");
 
 	// Bind kernel arguments
-	clError = clSetKernelArg(m_NaiveKernel, 0, sizeof(cl_mem), (void*) &m_dM);
-	clError |= clSetKernelArg(m_NaiveKernel, 1, sizeof(cl_mem), (void*) &m_dMR);
+	clError = clSetKernelArg(m_NaiveKernel, 0, sizeof(cl_mem), (void*) &m_M.GetDeviceBuffer());
+	clError |= clSetKernelArg(m_NaiveKernel, 1, sizeof(cl_mem), (void*) &m_MR.GetDeviceBuffer());
 	clError |= clSetKernelArg(m_NaiveKernel, 2, sizeof(cl_int), (void*) &m_SizeX);
 	clError |= clSetKernelArg(m_NaiveKernel, 3, sizeof(cl_int), (void*) &m_SizeY);
 	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: MatrixRotNaive");
 
-	clError = clSetKernelArg(m_OptimizedKernel, 0, sizeof(cl_mem), (void*) &m_dM);
-	clError |= clSetKernelArg(m_OptimizedKernel, 1, sizeof(cl_mem), (void*) &m_dMR);
+	clError = clSetKernelArg(m_OptimizedKernel, 0, sizeof(cl_mem), (void*) &m_M.GetDeviceBuffer());
+	clError |= clSetKernelArg(m_OptimizedKernel, 1, sizeof(cl_mem), (void*) &m_MR.GetDeviceBuffer());
 	clError |= clSetKernelArg(m_OptimizedKernel, 2, sizeof(cl_int), (void*) &m_SizeX);
 	clError |= clSetKernelArg(m_OptimizedKernel, 3, sizeof(cl_int), (void*) &m_SizeY);
 	V_RETURN_FALSE_CL(clError, "Failed to set kernel args: MatrixRotNaive");
@@ -88,71 +88,137 @@ bool CMatrixRotateTask::InitResources(cl_device_id Device, cl_context Context)
 void CMatrixRotateTask::ReleaseResources()
 {
 	// CPU resources
-	SAFE_DELETE_ARRAY(m_hM);
+	m_hM = NULL;
 	SAFE_DELETE_ARRAY(m_hMR);
 	SAFE_DELETE_ARRAY(m_hGPUResultNaive);
-	SAFE_DELETE_ARRAY(m_hGPUResultOpt);
 
 	// Release device resources
-	SAFE_RELEASE_MEMOBJECT(m_dM);
-	SAFE_RELEASE_MEMOBJECT(m_dMR);
+	m_M.Release();
+	m_MR.Release();
 
 }
 
 void CMatrixRotateTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	// Write input data to the GPU
+	// Write input data to the GPU (in zero-copy mode the matrix is only unmapped)
     cl_int clError;
-    clError = clEnqueueWriteBuffer(CommandQueue, m_dM, CL_FALSE, 0, sizeof(float) * m_SizeX * m_SizeY, m_hM, 0, NULL, NULL);
+    clError = m_M.Upload(CommandQueue);
     V_RETURN_CL(clError, "Error copying data from host to device!");
 
-	// Detemine the necessary number of global work items
-	size_t globalWorkSize[2];
-	size_t nGroups[2];
-
-	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_SizeX, LocalWorkSize[0]);
-	globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_SizeY, LocalWorkSize[1]);
-	
-	nGroups[0] = globalWorkSize[0] / LocalWorkSize[0];
-	nGroups[1] = globalWorkSize[1] / LocalWorkSize[1];
-
-	cout << "Executing (" << globalWorkSize[0] << "x" << globalWorkSize[1] 
-		<< ") threads in (" << nGroups[0] << "x" << nGroups[1] << ") groups of size (" 
-		<< LocalWorkSize[0] << "x" << LocalWorkSize[1] << ")." << endl;
+	// Each kernel uses the tuned local work size, if there is an entry in the tuning database
+	CAutoTuner& tuner = CAutoTuner::GetSingleton();
+	STuningSpace space(2, m_SizeX, m_SizeY);
 
 	// Launch and profile naive kernel
-	unsigned int numberOfRuns = 1000;
-	double ms = CLUtil::ProfileKernel(CommandQueue, m_NaiveKernel, 2, globalWorkSize, LocalWorkSize, numberOfRuns);
-    cout << "Executed naive kernel in " << ms << " ms (within " << numberOfRuns << " runs)." << endl;
+	unsigned int numberOfRuns = m_NIterations;
+	size_t localWorkSize[3] = {LocalWorkSize[0], LocalWorkSize[1], 1};
+	tuner.Tune(CommandQueue, m_NaiveKernel, "MatrixRotNaive", space, localWorkSize);
+	ProfileKernel(CommandQueue, m_NaiveKernel, "MatrixRotNaive", localWorkSize, numberOfRuns);
 
 	// Read back the results from naive kernel synchronously.
 	// This command has to be blocking, since we want to check the valid data
-	clError = clEnqueueReadBuffer(CommandQueue, m_dMR, CL_TRUE, 0, sizeof(float) * m_SizeX * m_SizeY, m_hGPUResultNaive, 0, NULL, NULL);
+	clError = m_MR.Download(CommandQueue);
 	V_RETURN_CL(clError, "Error reading data from device memory!");
+	memcpy(m_hGPUResultNaive, m_MR.Get<float>(), sizeof(float) * m_SizeX * m_SizeY);
+	V_RETURN_CL(m_MR.Unmap(CommandQueue), "Error unmapping the result!");
+
+	// Optimized kernel, the tuner resizes the local memory block for each candidate
+	space.LocalMemPerWorkItem = sizeof(float);
+	space.LocalMemArgument = 4;
+	localWorkSize[0] = LocalWorkSize[0];
+	localWorkSize[1] = LocalWorkSize[1];
+	tuner.Tune(CommandQueue, m_OptimizedKernel, "MatrixRotOptimized", space, localWorkSize);
 
-	// Optimized kernel
 	// Allocate shared (local) memory for the kernel
-	clError = clSetKernelArg(m_OptimizedKernel, 4, LocalWorkSize[0] * LocalWorkSize[1] * sizeof(float), NULL);
+	clError = clSetKernelArg(m_OptimizedKernel, 4, localWorkSize[0] * localWorkSize[1] * sizeof(float), NULL);
 	V_RETURN_CL(clError, "Error allocating shared memory!");
 
 	// Run and profile optimized kernel
-	ms = CLUtil::ProfileKernel(CommandQueue, m_OptimizedKernel, 2, globalWorkSize, LocalWorkSize, numberOfRuns);
-	cout << "Executed optimized kernel in " << ms << " ms (within " << numberOfRuns << " runs)." << endl;
+	ProfileKernel(CommandQueue, m_OptimizedKernel, "MatrixRotOptimized", localWorkSize, numberOfRuns);
 
 	// Read back the data to the host
-	clError = clEnqueueReadBuffer(CommandQueue, m_dMR, CL_TRUE, 0, sizeof(float) * m_SizeX * m_SizeY, m_hGPUResultOpt, 0, NULL, NULL);
+	clError = m_MR.Download(CommandQueue);
 	V_RETURN_CL(clError, "Error reading data from device memory!");
 }
 
-void CMatrixRotateTask::ComputeCPU()
+void CMatrixRotateTask::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+	const size_t LocalWorkSize[2], unsigned int NIterations)
 {
-	for(unsigned int x = 0; x < m_SizeX; x++)
+	// Detemine the necessary number of global work items
+	size_t globalWorkSize[2];
+	size_t nGroups[2];
+
+	globalWorkSize[0] = CLUtil::GetGlobalWorkSize(m_SizeX, LocalWorkSize[0]);
+	globalWorkSize[1] = CLUtil::GetGlobalWorkSize(m_SizeY, LocalWorkSize[1]);
+
+	nGroups[0] = globalWorkSize[0] / LocalWorkSize[0];
+	nGroups[1] = globalWorkSize[1] / LocalWorkSize[1];
+
+	cout << "Executing " << KernelName << " with (" << globalWorkSize[0] << "x" << globalWorkSize[1]
+		<< ") threads in (" << nGroups[0] << "x" << nGroups[1] << ") groups of size ("
+		<< LocalWorkSize[0] << "x" << LocalWorkSize[1] << ")." << endl;
+
+	// The matrix is read and written once, there is no arithmetic.
+	size_t problemSize = size_t(m_SizeX) * m_SizeY;
+	double bytesMoved = 2.0 * sizeof(float) * problemSize;
+
+	// Prefer the device timestamps, fall back to host timing if the queue has no profiling support
+	SKernelProfile profile;
+	if (CLUtil::ProfileKernelEvents(CommandQueue, Kernel, 2, globalWorkSize, LocalWorkSize, NIterations, profile))
 	{
-		for(unsigned int y = 0; y < m_SizeY; y++)
+		cout << "Executed " << KernelName << " in " << profile.StartToEnd.Median << " ms (median of " << NIterations << " runs)." << endl;
+		CLUtil::PrintKernelProfile(KernelName, profile);
+		SBenchmarkResult result(KernelName, problemSize, profile, bytesMoved);
+		result.LocalWorkSize[0] = LocalWorkSize[0];
+		result.LocalWorkSize[1] = LocalWorkSize[1];
+		result.LocalWorkSize[2] = 1;
+		CRoofline::GetSingleton().Report(result);
+		CResultsSink::GetSingleton().Add(result);
+	}
+	else
+	{
+		double ms = CLUtil::ProfileKernel(CommandQueue, Kernel, 2, globalWorkSize, LocalWorkSize, NIterations);
+		cout << "Executed " << KernelName << " in " << ms << " ms (within " << NIterations << " runs)." << endl;
+		SBenchmarkResult result(KernelName, problemSize, NIterations, ms, bytesMoved);
+		result.LocalWorkSize[0] = LocalWorkSize[0];
+		result.LocalWorkSize[1] = LocalWorkSize[1];
+		result.LocalWorkSize[2] = 1;
+		CRoofline::GetSingleton().Report(result);
+		CResultsSink::GetSingleton().Add(result);
+	}
+}
+
+void CMatrixRotateTask::ComputeCPU()
+{
+	// each thread writes a band of rows of the rotated matrix
+	CThreadPool::GetSingleton().ParallelFor(0, m_SizeX, [this](size_t Begin, size_t End) {
+		for(unsigned int x = (unsigned int)Begin; x < (unsigned int)End; x++)
 		{
-			m_hMR[ x * m_SizeY + (m_SizeY - y - 1) ] = m_hM[ y * m_SizeX + x ];
+			for(unsigned int y = 0; y < m_SizeY; y++)
+			{
+				m_hMR[ x * m_SizeY + (m_SizeY - y - 1) ] = m_hM[ y * m_SizeX + x ];
+			}
 		}
+	});
+
+	// vectorized CPU baseline (block transposes in registers), checked against the reference above
+	const SSimdKernels& simd = CSimd::GetSingleton().GetKernels();
+	vector<float> resultSIMD(m_SizeX * m_SizeY);
+	CTimer timer;
+	timer.Start();
+	for(unsigned int i = 0; i < m_NIterations; i++) {
+		CThreadPool::GetSingleton().ParallelFor(0, m_SizeX, [&](size_t Begin, size_t End) {
+			simd.RotateClockwise(m_hM, &resultSIMD[0], m_SizeX, m_SizeY, Begin, End);
+		});
 	}
+	timer.Stop();
+
+	bool valid = memcmp(&resultSIMD[0], m_hMR, m_SizeX * m_SizeY * sizeof(float)) == 0;
+	double ms = timer.GetElapsedMilliseconds() / double(m_NIterations);
+	cout << "  CPU-SIMD (" << CSimd::GetLevelName(simd.Level) << ") average time: " << ms << " ms"
+		<< (valid ? "" : ", RESULT DIFFERS") << endl;
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("CPU-SIMD", m_SizeX * m_SizeY, m_NIterations, ms,
+		2.0 * m_SizeX * m_SizeY * sizeof(float)));
 }
 
 bool CMatrixRotateTask::ValidateResults()
@@ -162,7 +228,7 @@ bool CMatrixRotateTask::ValidateResults()
 		cout << "Results of the naive kernel are incorrect!" << endl;
 		return false;
 	}
-	if(!(memcmp(m_hMR, m_hGPUResultOpt, m_SizeX * m_SizeY * sizeof(float)) == 0))
+	if(m_MR.Get<float>() == NULL || !(memcmp(m_hMR, m_MR.Get<float>(), m_SizeX * m_SizeY * sizeof(float)) == 0))
 	{
 		cout << "Results of the optimized kernel are incorrect!" << endl;
 		return false;
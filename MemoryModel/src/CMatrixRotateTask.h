@@ -21,12 +21,15 @@
 #define _CMATRIX_ROTATE_TASK_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CHostBuffer.h"
+
+#include <string>
 
 //! A1/T2: Matrix rotation
 class CMatrixRotateTask : public IComputeTask
 {
 public:
-	CMatrixRotateTask(size_t SizeX, size_t SizeY);
+	CMatrixRotateTask(size_t SizeX, size_t SizeY, unsigned int NIterations = 1000);
 	virtual ~CMatrixRotateTask();
 
 	// IComputeTask
@@ -40,22 +43,30 @@ public:
 
 	virtual bool ValidateResults();
 
+	virtual std::string GetName() const { return "MatrixRotate"; }
+
 protected:
+	//! Profiles one of the kernels and prints the timing
+	void ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+		const size_t LocalWorkSize[2], unsigned int NIterations);
+
 	//NOTE: we have two memory address spaces, so we mark pointers with a prefix
 	//to avoid confusions: 'h' - host, 'd' - device
 
 	unsigned int		m_SizeX;
 	unsigned int		m_SizeY;
 
+	//number of kernel launches for profiling
+	unsigned int		m_NIterations;
+
 	//float data on the CPU
-	//M: original matrix, MR: rotated matrix
+	//M: original matrix (host side of m_M, valid until it is uploaded), MR: rotated matrix
 	float				*m_hM, *m_hMR;
 
-	//pointers on the GPU
-	//(result buffers for both kernels)
-	cl_mem				m_dM, m_dMR;
-	//(..and a pointer to read back the result)
-	float				*m_hGPUResultNaive, *m_hGPUResultOpt;
+	//input and output arrays of the kernels, copied or mapped depending on the buffer mode
+	CMirroredBuffer		m_M, m_MR;
+	//(..and a copy of the result of the naive kernel, m_MR holds the one of the optimized kernel)
+	float				*m_hGPUResultNaive;
 
 	//OpenCL program and kernels
 	cl_program			m_Program;
@@ -6,16 +6,23 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CSimpleArraysTask.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CKernelLibrary.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CTimer.h"
+#include "../Common/CBufferPool.h"
 
 #include <string.h>
+#include <algorithm>
 
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////////
 // CSimpleArraysTask
 
-CSimpleArraysTask::CSimpleArraysTask(size_t ArraySize)
-	: m_ArraySize(ArraySize)
+CSimpleArraysTask::CSimpleArraysTask(size_t ArraySize, unsigned int NIterations)
+	: m_ArraySize(ArraySize), m_NIterations(NIterations)
 {
 }
 
@@ -26,11 +33,21 @@ CSimpleArraysTask::~CSimpleArraysTask()
 
 bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context)
 {
+	/////////////////////////////////////////
+	// Sect. 4.5
+	// The input and output arrays, in zero-copy mode the kernel works on the host memory directly
+	if (!m_A.Allocate(Context, sizeof(cl_int) * m_ArraySize, CL_MEM_READ_ONLY) ||
+		!m_B.Allocate(Context, sizeof(cl_int) * m_ArraySize, CL_MEM_READ_ONLY) ||
+		!m_C.Allocate(Context, sizeof(cl_int) * m_ArraySize, CL_MEM_WRITE_ONLY))
+	{
+		cout << "Allocating the arrays failed." << endl;
+		return false;
+	}
+
 	// CPU resources
-	m_hA = new int[m_ArraySize];
-	m_hB = new int[m_ArraySize];
+	m_hA = m_A.Get<int>();
+	m_hB = m_B.Get<int>();
 	m_hC = new int[m_ArraySize];
-	m_hGPUResult = new int[m_ArraySize];
 
 	// Fill A and B with random integers
 	for(unsigned int i = 0; i < m_ArraySize; i++)
@@ -39,35 +56,16 @@ bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context)
 		m_hB[i] = rand() % 1024;
 	}
 
-	// Device resources
-
-	/////////////////////////////////////////
-	// Sect. 4.5
 	cl_int clError;
-    m_dA = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_int) * m_ArraySize, NULL, &clError);
-    V_RETURN_FALSE_CL(clError, CLUtil::GetCLErrorString(clError));
-
-    m_dB = clCreateBuffer(Context, CL_MEM_READ_ONLY, sizeof(cl_int) * m_ArraySize, NULL, &clError);
-    V_RETURN_FALSE_CL(clError, CLUtil::GetCLErrorString(clError));
-
-    m_dC = clCreateBuffer(Context, CL_MEM_WRITE_ONLY, sizeof(cl_int) * m_ArraySize, NULL, &clError);
-    V_RETURN_FALSE_CL(clError, CLUtil::GetCLErrorString(clError));
 
 	/////////////////////////////////////////
 	// Sect. 4.6.
 
 	// Load and compile kernels
-	string programCode;
-	if (!CLUtil::LoadProgramSourceToMemory("VectorAdd.cl", programCode))
-	{
-        cout << "Loading source to memory failed." << endl;
-        return false;
-	}
-
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_Program = CKernelLibrary::GetSingleton().Build(Device, Context, "VectorAdd.cl");
 	if (m_Program == nullptr)
 	{
-        cout << "Build program from memory failed." << endl;
+        cout << "Loading or building the program failed." << endl;
         return false;
 	}
 
@@ -75,9 +73,9 @@ bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context)
 	V_RETURN_FALSE_CL(clError, "Failed to create kernel: VecAdd");
 
 	// Bind kernel arguments
-	clError = clSetKernelArg(m_Kernel, 0, sizeof(cl_mem), (void*) &m_dA);
-	clError |= clSetKernelArg(m_Kernel, 1, sizeof(cl_mem), (void*) &m_dB);
-	clError |= clSetKernelArg(m_Kernel, 2, sizeof(cl_mem), (void*) &m_dC);
+	clError = clSetKernelArg(m_Kernel, 0, sizeof(cl_mem), (void*) &m_A.GetDeviceBuffer());
+	clError |= clSetKernelArg(m_Kernel, 1, sizeof(cl_mem), (void*) &m_B.GetDeviceBuffer());
+	clError |= clSetKernelArg(m_Kernel, 2, sizeof(cl_mem), (void*) &m_C.GetDeviceBuffer());
 	clError |= clSetKernelArg(m_Kernel, 3, sizeof(cl_int), (void*) &m_ArraySize);
     V_RETURN_FALSE_CL(clError, "Failed to set kernel args: VecAdd");
 
@@ -87,58 +85,167 @@ bool CSimpleArraysTask::InitResources(cl_device_id Device, cl_context Context)
 void CSimpleArraysTask::ReleaseResources()
 {
 	// CPU resources
-	SAFE_DELETE_ARRAY(m_hA);
-	SAFE_DELETE_ARRAY(m_hB);
+	m_hA = nullptr;
+	m_hB = nullptr;
 	SAFE_DELETE_ARRAY(m_hC);
-	SAFE_DELETE_ARRAY(m_hGPUResult);
+	SAFE_DELETE_ARRAY(m_hPipelineResult);
 
 	/////////////////////////////////////////////////
 	// Sect. 4.5., 4.6.
-	SAFE_RELEASE_MEMOBJECT(m_dA);
-	SAFE_RELEASE_MEMOBJECT(m_dB);
-	SAFE_RELEASE_MEMOBJECT(m_dC);
+	m_A.Release();
+	m_B.Release();
+	m_C.Release();
+	for(size_t i = 0; i < m_dPipelineBuffers.size(); i++)
+		SAFE_RELEASE_POOLED(m_dPipelineBuffers[i]);
+	m_dPipelineBuffers.clear();
 
 	// TO DO: free resources on the GPU
 }
 
 void CSimpleArraysTask::ComputeCPU()
 {
-	for(unsigned int i = 0; i < m_ArraySize; i++)
+	CThreadPool::GetSingleton().ParallelFor(0, m_ArraySize, [this](size_t Begin, size_t End) {
+		for(size_t i = Begin; i < End; i++)
+		{
+			m_hC[i] = m_hA[i] + m_hB[m_ArraySize - i - 1];
+		}
+	});
+}
+
+void CSimpleArraysTask::ComputeGPUPipelined(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	// Eight slices, triple buffered: A[b, e) and the mirrored range B[N-e, N-b) are uploaded, the kernel
+	// then reverses B inside the slice just as it does for the whole array
+	CStreamPipeline pipeline(3);
+	size_t sliceSize = max<size_t>((m_ArraySize + 7) / 8, 1);
+	size_t sliceBytes = sizeof(cl_int) * sliceSize;
+
+	cl_int clError;
+	m_dPipelineBuffers.assign(3 * pipeline.GetSlotCount(), (cl_mem)NULL);
+	for(size_t i = 0; i < m_dPipelineBuffers.size(); i++)
+	{
+		m_dPipelineBuffers[i] = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, sliceBytes, &clError);
+		V_RETURN_CL(clError, "Error allocating the pipeline slices!");
+	}
+	m_hPipelineResult = new int[m_ArraySize];
+
+	cl_kernel kernel = clCreateKernel(m_Program, "VecAdd", &clError);
+	V_RETURN_CL(clError, "Failed to create kernel: VecAdd");
+
+	pipeline.SetStages(
+		[&](cl_command_queue Queue, const SPipelineSlice& Slice, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+			size_t n = Slice.End - Slice.Begin;
+			cl_mem* slot = &m_dPipelineBuffers[3 * Slice.Slot];
+			cl_event writtenA;
+			cl_int e = clEnqueueWriteBuffer(Queue, slot[0], CL_FALSE, 0, n * sizeof(cl_int), m_hA + Slice.Begin, NWait, WaitList, &writtenA);
+			if(e != CL_SUCCESS)
+				return e;
+			e = clEnqueueWriteBuffer(Queue, slot[1], CL_FALSE, 0, n * sizeof(cl_int), m_hB + m_ArraySize - Slice.End, 1, &writtenA, Done);
+			clReleaseEvent(writtenA);
+			return e;
+		},
+		[&](cl_command_queue Queue, const SPipelineSlice& Slice, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+			cl_int n = cl_int(Slice.End - Slice.Begin);
+			cl_mem* slot = &m_dPipelineBuffers[3 * Slice.Slot];
+			cl_int e = clSetKernelArg(kernel, 0, sizeof(cl_mem), &slot[0]);
+			e |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &slot[1]);
+			e |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &slot[2]);
+			e |= clSetKernelArg(kernel, 3, sizeof(cl_int), &n);
+			size_t globalWorkSize = CLUtil::GetGlobalWorkSize(n, LocalWorkSize[0]);
+			if(e == CL_SUCCESS)
+				e = clEnqueueNDRangeKernel(Queue, kernel, 1, NULL, &globalWorkSize, LocalWorkSize, NWait, WaitList, Done);
+			return e;
+		},
+		[&](cl_command_queue Queue, const SPipelineSlice& Slice, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+			size_t n = Slice.End - Slice.Begin;
+			return clEnqueueReadBuffer(Queue, m_dPipelineBuffers[3 * Slice.Slot + 2], CL_FALSE, 0, n * sizeof(cl_int),
+				m_hPipelineResult + Slice.Begin, NWait, WaitList, Done);
+		});
+
+	// Best of three runs, the first one also serves as warm-up
+	vector<cl_command_queue> queues = CStreamPipeline::GetCommandQueues(CommandQueue);
+	double serialMs = -1.0, pipelinedMs = -1.0;
+	for(int run = 0; run < 3; run++)
 	{
-		m_hC[i] = m_hA[i] + m_hB[m_ArraySize - i - 1];
+		double ms = pipeline.Run(vector<cl_command_queue>(1, CommandQueue), m_ArraySize, sliceSize);
+		if(ms >= 0.0 && (serialMs < 0.0 || ms < serialMs))
+			serialMs = ms;
+		ms = pipeline.Run(queues, m_ArraySize, sliceSize);
+		if(ms >= 0.0 && (pipelinedMs < 0.0 || ms < pipelinedMs))
+			pipelinedMs = ms;
 	}
+	clReleaseKernel(kernel);
+
+	if(serialMs < 0.0 || pipelinedMs < 0.0)
+	{
+		m_PipelineValid = false;
+		return;
+	}
+
+	// Two arrays are uploaded, one is downloaded
+	double bytesMoved = 3.0 * sizeof(cl_int) * m_ArraySize;
+	cout << "Pipeline (" << queues.size() << " queues, " << (m_ArraySize + sliceSize - 1) / sliceSize << " slices): "
+		<< pipelinedMs << " ms, serialized: " << serialMs << " ms, speedup " << serialMs / pipelinedMs << "x" << endl;
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("VecAdd-pipeline-serial", m_ArraySize, 1, serialMs, bytesMoved));
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("VecAdd-pipeline", m_ArraySize, 1, pipelinedMs, bytesMoved));
 }
 
 void CSimpleArraysTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
 	/////////////////////////////////////////////////
-	// Write input data to the GPU
+	// Stream the arrays through the pipeline first, in zero-copy mode the host arrays are not accessible after the upload
+	ComputeGPUPipelined(Context, CommandQueue, LocalWorkSize);
+
+	/////////////////////////////////////////////////
+	// Write input data to the GPU (in zero-copy mode the arrays are only unmapped)
     cl_int clError;
-    clError = clEnqueueWriteBuffer(CommandQueue, m_dA, CL_FALSE, 0, sizeof(int) * m_ArraySize, m_hA, 0, NULL, NULL);
-    clError |= clEnqueueWriteBuffer(CommandQueue, m_dB, CL_FALSE, 0, sizeof(int) * m_ArraySize, m_hB, 0, NULL, NULL);
+    clError = m_A.Upload(CommandQueue);
+    clError |= m_B.Upload(CommandQueue);
     V_RETURN_CL(clError, "Error copying data from host to device!");
 
 	/////////////////////////////////////////
 	// Determine number of thread groups and launch kernel
     size_t globalWorkSize = CLUtil::GetGlobalWorkSize(m_ArraySize, LocalWorkSize[0]);
-    unsigned int numberOfRuns= 1000;
+    unsigned int numberOfRuns = m_NIterations;
     size_t nGroups = globalWorkSize / LocalWorkSize[0];
     cout << "Executing " << globalWorkSize << " threads in " << nGroups
         << " groups of size " << LocalWorkSize[0] << "." << endl;
 
-    // Profile and execute kernel with help of CUtil
-    double ms = CLUtil::ProfileKernel(CommandQueue, m_Kernel, 1, &globalWorkSize, LocalWorkSize, numberOfRuns);
-    cout << "Executed kernel in " << ms << " ms (within " << numberOfRuns << " runs)." << endl;
+    // Profile and execute kernel with help of CUtil.
+    // Use the device timestamps if available, these do not contain the launch overhead.
+    // Two arrays are read and one is written, one addition per element.
+    double bytesMoved = 3.0 * sizeof(cl_int) * m_ArraySize;
+    double flops = double(m_ArraySize);
+    SKernelProfile profile;
+    SBenchmarkResult result;
+    if (CLUtil::ProfileKernelEvents(CommandQueue, m_Kernel, 1, &globalWorkSize, LocalWorkSize, numberOfRuns, profile))
+    {
+        cout << "Executed kernel in " << profile.StartToEnd.Median << " ms (median of " << numberOfRuns << " runs)." << endl;
+        CLUtil::PrintKernelProfile("VecAdd", profile);
+        result = SBenchmarkResult("VecAdd", m_ArraySize, profile, bytesMoved, flops);
+    }
+    else
+    {
+        double ms = CLUtil::ProfileKernel(CommandQueue, m_Kernel, 1, &globalWorkSize, LocalWorkSize, numberOfRuns);
+        cout << "Executed kernel in " << ms << " ms (within " << numberOfRuns << " runs)." << endl;
+        result = SBenchmarkResult("VecAdd", m_ArraySize, numberOfRuns, ms, bytesMoved, flops);
+    }
+    CRoofline::GetSingleton().Report(result);
+    CResultsSink::GetSingleton().Add(result);
 
 	// Read back results synchronously.
 	// This command has to be blocking, since we need the data
-    clError = clEnqueueReadBuffer(CommandQueue, m_dC, CL_TRUE, 0, sizeof(int) * m_ArraySize, m_hGPUResult, 0, NULL, NULL);
+    clError = m_C.Download(CommandQueue);
     V_RETURN_CL(clError, "Error reading data from device memory!");
 }
 
 bool CSimpleArraysTask::ValidateResults()
 {
-	return (memcmp(m_hC, m_hGPUResult, m_ArraySize * sizeof(float)) == 0);
+	bool pipelineValid = m_PipelineValid && m_hPipelineResult != NULL && (memcmp(m_hC, m_hPipelineResult, m_ArraySize * sizeof(int)) == 0);
+	if(!pipelineValid)
+		cout << "Pipeline result does not match." << endl;
+
+	return pipelineValid && m_C.Get<int>() != NULL && (memcmp(m_hC, m_C.Get<int>(), m_ArraySize * sizeof(float)) == 0);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
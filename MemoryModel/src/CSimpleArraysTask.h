@@ -21,12 +21,14 @@
 #define _CSIMPLE_ARRAYS_TASK_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CHostBuffer.h"
+#include "../Common/CStreamPipeline.h"
 
 //! A1/T1: Simple vector addition
 class CSimpleArraysTask : public IComputeTask
 {
 public:
-	CSimpleArraysTask(size_t ArraySize);
+	CSimpleArraysTask(size_t ArraySize, unsigned int NIterations = 1000);
 	virtual ~CSimpleArraysTask();
 
 	// IComputeTask
@@ -41,23 +43,35 @@ public:
 
 	virtual bool ValidateResults();
 
+	virtual std::string GetName() const { return "VectorAdd"; }
+
 protected:
+	//! Computes the sum in slices with CStreamPipeline, compares the overlapped with the serialized execution
+	void ComputeGPUPipelined(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
+
 	//NOTE: we have two memory address spaces, so we mark pointers with a prefix
 	//to avoid confusions: 'h' - host, 'd' - device
 	
 	//number of array elements
 	size_t				m_ArraySize = 0;
 
-	//integer arrays on the CPU
+	//number of kernel launches for profiling
+	unsigned int		m_NIterations = 1000;
+
+	//integer arrays on the CPU (A and B are the host side of m_A and m_B, valid until they are uploaded)
 	int					*m_hA = nullptr, *m_hB = nullptr, *m_hC = nullptr;
 
-	//integer arrays on the GPU (and a buffer to read the result back to the host)
-	cl_mem				m_dA = nullptr, m_dB = nullptr, m_dC = nullptr;
-	int					*m_hGPUResult = nullptr;
+	//integer arrays on the GPU, copied or mapped depending on the buffer mode (m_C receives the result)
+	CMirroredBuffer		m_A, m_B, m_C;
 
 	//OpenCL program and kernels
 	cl_program			m_Program = nullptr;
 	cl_kernel			m_Kernel = nullptr;
+
+	//slice buffers of the pipeline (A, B and C per slot) and its result on the CPU
+	std::vector<cl_mem>	m_dPipelineBuffers;
+	int					*m_hPipelineResult = nullptr;
+	bool				m_PipelineValid = true;
 };
 
 #endif // _CSIMPLE_ARRAYS_TASK_H
@@ -7,9 +7,24 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CLUtil.h"
 #include "CTimer.h"
+#include "CResultsSink.h"
+#include "CThreadPool.h"
+#include "CSimd.h"
+#include "CStreamPipeline.h"
+#include "CBufferPool.h"
+#include "CTracer.h"
+#include "CKernelLibrary.h"
+#include "CLaunchPlan.h"
+#include "CRoofline.h"
+#include "CRegressionGate.h"
+#include "CTaskGraph.h"
 
 #include <vector>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
 
 using namespace std;
 
@@ -32,11 +47,21 @@ using namespace std;
     #endif
 #endif
 
+///////////////////////////////////////////////////////////////////////////////
+// SComputeTaskRun
+
+SComputeTaskRun::SComputeTaskRun()
+	: pTask(nullptr), Valid(false)
+{
+	LocalWorkSize[0] = LocalWorkSize[1] = LocalWorkSize[2] = 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // CAssignmentBase
 
 CAssignmentBase::CAssignmentBase()
-	: m_CLPlatform(nullptr), m_CLDevice(nullptr), m_CLContext(nullptr), m_CLCommandQueue(nullptr)
+	: m_CLPlatform(nullptr), m_CLDevice(nullptr), m_CLContext(nullptr), m_CLCommandQueue(nullptr),
+	m_TaskGraph(false), m_TaskGraphWindow(2)
 {
 }
 
@@ -45,95 +70,341 @@ CAssignmentBase::~CAssignmentBase()
 	ReleaseCLContext();
 }
 
-bool CAssignmentBase::EnterMainLoop(int, char**)
+bool CAssignmentBase::EnterMainLoop(int argc, char** argv)
 {
+	m_CommandLine.Parse(argc, argv);
+	OpenResultsSink();
+	OpenTrace();
+	OpenAutoTuner();
+	ConfigureCPUBaseline();
+
 	if(!InitCLContext())
 		return false;
+	ConfigureBufferMode();
+	CreatePipelineQueues();
+	ConfigureTaskGraph();
+	ConfigureLaunchPlans();
+	MeasureRoofline();
 
-	bool success = DoCompute();
+	bool success = OpenRegressionGate();
+
+	CRegressionGate& gate = CRegressionGate::GetSingleton();
+	int nRepetitions = max(m_CommandLine.GetInt("repetitions", gate.IsEnabled() ? 5 : 1, "GPU_REPETITIONS"), 1);
+	for(int i = 0; i < nRepetitions && success; i++)
+	{
+		if(nRepetitions > 1)
+			cout << endl << "Repetition " << i + 1 << " of " << nRepetitions << endl;
+		success = DoCompute();
+	}
+	if(success)
+		success = gate.Evaluate();
 
 	ReleaseCLContext();
+	CTracer::GetSingleton().Close();
 
 	return success;
 }
 
 #define PRINT_INFO(title, buffer, bufferSize, maxBufferSize, expr) { expr; buffer[bufferSize] = '\0'; std::cout << title << ": " << buffer << std::endl; }
 
-bool CAssignmentBase::InitCLContext()
+// Everything we need to know about a device to select it and to print the capability table
+struct SCLDeviceEntry
 {
-	//////////////////////////////////////////////////////
-	//(Sect 4.3)
+	cl_platform_id	Platform;
+	cl_device_id	Device;
+	std::string		PlatformName;
+	std::string		DeviceName;
+	cl_device_type	Type;
+	cl_uint			ComputeUnits;
+	size_t			MaxWorkGroupSize;
+	cl_ulong		LocalMemSize;
+	cl_ulong		GlobalMemSize;
+	cl_bool			UnifiedMemory;
+	// preferred vector widths: char, short, int, long, float, double
+	cl_uint			VectorWidth[6];
+};
+
+static std::string ToLower(std::string Str)
+{
+	std::transform(Str.begin(), Str.end(), Str.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+	return Str;
+}
 
-	// 1. get all platform IDs
+static bool ContainsNoCase(const std::string& Haystack, const std::string& Needle)
+{
+	return ToLower(Haystack).find(ToLower(Needle)) != std::string::npos;
+}
+
+static std::string TrimInfoString(std::string Str)
+{
+	// info strings are zero-terminated and sometimes padded with spaces
+	Str = Str.c_str();
+	size_t first = Str.find_first_not_of(' ');
+	size_t last = Str.find_last_not_of(' ');
+	return first == std::string::npos ? std::string() : Str.substr(first, last - first + 1);
+}
+
+static const char* GetDeviceTypeName(cl_device_type Type)
+{
+	if(Type & CL_DEVICE_TYPE_GPU) return "GPU";
+	if(Type & CL_DEVICE_TYPE_CPU) return "CPU";
+	if(Type & CL_DEVICE_TYPE_ACCELERATOR) return "ACC";
+	return "other";
+}
 
-	std::vector<cl_platform_id> platformIds;
+// Enumerates all devices of all types on all platforms
+static void EnumerateCLDevices(std::vector<SCLDeviceEntry>& Devices)
+{
 	const cl_uint c_MaxPlatforms = 16;
-	platformIds.resize(c_MaxPlatforms);
-	
-	cl_uint countPlatforms;
-	V_RETURN_FALSE_CL(clGetPlatformIDs(c_MaxPlatforms, &platformIds[0], &countPlatforms), "Failed to get CL platform ID");
-	platformIds.resize(countPlatforms);
+	cl_platform_id platformIds[c_MaxPlatforms];
+	cl_uint countPlatforms = 0;
+	if(clGetPlatformIDs(c_MaxPlatforms, platformIds, &countPlatforms) != CL_SUCCESS)
+		return;
+	countPlatforms = std::min(countPlatforms, c_MaxPlatforms);
 
-	// 2. find all available GPU devices
-	std::vector<cl_device_id> deviceIds;
-	const int maxDevices = 16;
-	deviceIds.resize(maxDevices);
-	int countAllDevices = 0;
+	for(cl_uint i = 0; i < countPlatforms; i++)
+	{
+		char buffer[1024] = {0};
+		clGetPlatformInfo(platformIds[i], CL_PLATFORM_NAME, sizeof(buffer) - 1, buffer, nullptr);
 
-	// Searching for the graphics device with the most dedicated video memory.
+		cl_uint countDevices = 0;
+		auto res = clGetDeviceIDs(platformIds[i], CL_DEVICE_TYPE_ALL, 0, NULL, &countDevices);
+		if(res != CL_SUCCESS || countDevices == 0) // Some poor implementations don't set count devices to zero and return CL_DEVICE_NOT_FOUND.
+		{
+			printf("[WARNING]: clGetDeviceIDs() failed. Error type: %s, Platform name: %s!\n",
+				CLUtil::GetCLErrorString(res), buffer);
+			continue;
+		}
 
-	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+		std::vector<cl_device_id> deviceIds(countDevices);
+		if(clGetDeviceIDs(platformIds[i], CL_DEVICE_TYPE_ALL, countDevices, &deviceIds[0], NULL) != CL_SUCCESS)
+			continue;
 
-	cl_ulong maxGlobalMemorySize = 0;
-	cl_device_id bestDeviceId = NULL;
+		for(cl_uint j = 0; j < countDevices; j++)
+		{
+			SCLDeviceEntry entry;
+			entry.Platform = platformIds[i];
+			entry.Device = deviceIds[j];
+			entry.PlatformName = TrimInfoString(buffer);
+
+			char name[1024] = {0};
+			clGetDeviceInfo(entry.Device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+			entry.DeviceName = TrimInfoString(name);
+
+			clGetDeviceInfo(entry.Device, CL_DEVICE_TYPE, sizeof(cl_device_type), &entry.Type, NULL);
+			clGetDeviceInfo(entry.Device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &entry.ComputeUnits, NULL);
+			clGetDeviceInfo(entry.Device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &entry.MaxWorkGroupSize, NULL);
+			clGetDeviceInfo(entry.Device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &entry.LocalMemSize, NULL);
+			clGetDeviceInfo(entry.Device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &entry.GlobalMemSize, NULL);
+			clGetDeviceInfo(entry.Device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &entry.UnifiedMemory, NULL);
+
+			const cl_device_info vectorWidthParams[6] = {
+				CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR, CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT,
+				CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE
+			};
+			for(int k = 0; k < 6; k++)
+				clGetDeviceInfo(entry.Device, vectorWidthParams[k], sizeof(cl_uint), &entry.VectorWidth[k], NULL);
+
+			Devices.push_back(entry);
+		}
+	}
+}
 
-	for (size_t i = 0; i < platformIds.size(); i++)
+static void PrintCLDeviceTable(const std::vector<SCLDeviceEntry>& Devices, int SelectedIndex)
+{
+	std::cout << "OpenCL devices:" << std::endl << std::endl;
+	std::cout << "   # Type  CUs  MaxWG  LocalKB  GlobalMB  Vec c/s/i/l/f/d  Platform / Device" << std::endl;
+	for(size_t i = 0; i < Devices.size(); i++)
 	{
-		// Getting the available devices.
-		cl_uint countDevices;
-        auto res = clGetDeviceIDs(platformIds[i], deviceType, 1, &deviceIds[countAllDevices], &countDevices);
-        if(res != CL_SUCCESS) // Maybe there are no GPU devices and some poor implementation doesn't set count devices to zero and return CL_DEVICE_NOT_FOUND.
-        {
-            char buffer[1024];
-            clGetPlatformInfo(platformIds[i], CL_PLATFORM_NAME, 1024, buffer, nullptr);
-            printf("[WARNING]: clGetDeviceIDs() failed. Error type: %s, Platform name: %s!\n",
-				CLUtil::GetCLErrorString(res), buffer);
-            continue;
-        }
-		for (size_t j = 0; j < countDevices; j++)
+		const SCLDeviceEntry& d = Devices[i];
+		std::stringstream vectorWidths;
+		for(int k = 0; k < 6; k++)
+			vectorWidths << (k > 0 ? "/" : "") << d.VectorWidth[k];
+
+		std::cout << (int(i) == SelectedIndex ? " * " : "   ") << i << " "
+			<< std::left << std::setw(5) << GetDeviceTypeName(d.Type) << std::right
+			<< std::setw(4) << d.ComputeUnits
+			<< std::setw(7) << d.MaxWorkGroupSize
+			<< std::setw(9) << d.LocalMemSize / 1024
+			<< std::setw(10) << d.GlobalMemSize / (1024 * 1024)
+			<< "  " << std::left << std::setw(15) << vectorWidths.str() << std::right
+			<< "  " << d.PlatformName << " / " << d.DeviceName << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+// Runs a short ALU-bound kernel on the device and returns the best time of a few runs in ms (or a negative value on failure)
+static double CalibrateCLDevice(const SCLDeviceEntry& Entry)
+{
+	static const char* s_CalibrationSource =
+		"__kernel void Calibrate(__global float* Out, int N)\n"
+		"{\n"
+		"	float a = get_global_id(0) * 1.0e-6f, b = 0.999f;\n"
+		"	for(int i = 0; i < N; i++) { a = mad(a, b, 0.001f); b = mad(b, a, -0.0005f); }\n"
+		"	Out[get_global_id(0)] = a + b;\n"
+		"}\n";
+	const size_t globalWorkSize = 1 << 18;
+	const int nIterations = 512;
+
+	double bestTime = -1.0;
+	cl_int clError;
+	cl_context context = clCreateContext(NULL, 1, &Entry.Device, NULL, NULL, &clError);
+	if(clError != CL_SUCCESS)
+		return bestTime;
+
+	cl_command_queue queue = clCreateCommandQueue(context, Entry.Device, 0, &clError);
+	cl_mem out = clCreateBuffer(context, CL_MEM_WRITE_ONLY, globalWorkSize * sizeof(cl_float), NULL, &clError);
+	cl_program program = CLUtil::BuildCLProgramFromMemory(Entry.Device, context, s_CalibrationSource);
+	cl_kernel kernel = program ? clCreateKernel(program, "Calibrate", &clError) : nullptr;
+
+	if(queue && out && kernel)
+	{
+		clError  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &out);
+		clError |= clSetKernelArg(kernel, 1, sizeof(int), &nIterations);
+
+		// the first run includes the warm-up, ignore it
+		for(int run = 0; run < 4 && clError == CL_SUCCESS; run++)
 		{
-			cl_device_id currentDeviceId = deviceIds[countAllDevices + j];
-			cl_ulong globalMemorySize;
-			cl_bool isUsingUnifiedMemory;
-			clGetDeviceInfo(currentDeviceId, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemorySize, NULL);
-			clGetDeviceInfo(currentDeviceId, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &isUsingUnifiedMemory, NULL);
+			CTimer timer;
+			clFinish(queue);
+			timer.Start();
+			clError = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &globalWorkSize, NULL, 0, NULL, NULL);
+			clError |= clFinish(queue);
+			timer.Stop();
+
+			double ms = timer.GetElapsedMilliseconds();
+			if(clError == CL_SUCCESS && run > 0 && (bestTime < 0.0 || ms < bestTime))
+				bestTime = ms;
+		}
+	}
+
+	SAFE_RELEASE_KERNEL(kernel);
+	SAFE_RELEASE_PROGRAM(program);
+	SAFE_RELEASE_MEMOBJECT(out);
+	if(queue)
+		clReleaseCommandQueue(queue);
+	clReleaseContext(context);
+
+	return bestTime;
+}
+
+bool CAssignmentBase::SelectCLDevice()
+{
+	//////////////////////////////////////////////////////
+	//(Sect 4.3)
+
+	// 1. get all devices of all platforms
 
-			if (!isUsingUnifiedMemory && globalMemorySize > maxGlobalMemorySize)
+	std::vector<SCLDeviceEntry> devices;
+	EnumerateCLDevices(devices);
+
+	if (devices.empty())
+	{
+		std::cout << "No device with OpenCL support was found." << std::endl;
+		return false;
+	}
+
+	// 2. filter the candidates according to the selection policy
+
+	std::string typeName = ToLower(m_CommandLine.GetString("cl-device-type", "", "GPU_CL_DEVICE_TYPE"));
+	std::string platformFilter = m_CommandLine.GetString("cl-platform", "", "GPU_CL_PLATFORM");
+	std::string deviceFilter = m_CommandLine.GetString("cl-device", "", "GPU_CL_DEVICE");
+	int deviceIndex = m_CommandLine.GetInt("cl-device-index", -1, "GPU_CL_DEVICE_INDEX");
+	std::string policy = ToLower(m_CommandLine.GetString("cl-select", "memory", "GPU_CL_SELECT"));
+
+	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+	if (typeName == "cpu")
+		deviceType = CL_DEVICE_TYPE_CPU;
+	else if (typeName == "accelerator")
+		deviceType = CL_DEVICE_TYPE_ACCELERATOR;
+	else if (typeName == "all")
+		deviceType = CL_DEVICE_TYPE_ALL;
+	else if (!typeName.empty() && typeName != "gpu")
+		std::cerr << "Warning: unknown device type '" << typeName << "', using GPU." << std::endl;
+
+	std::vector<int> candidates;
+	if (deviceIndex >= 0)
+	{
+		if (deviceIndex >= int(devices.size()))
+		{
+			PrintCLDeviceTable(devices, -1);
+			std::cerr << "Error: there is no OpenCL device with index " << deviceIndex << "." << std::endl;
+			return false;
+		}
+		candidates.push_back(deviceIndex);
+	}
+	else
+	{
+		auto filterDevices = [&](cl_device_type Type) {
+			for (size_t i = 0; i < devices.size(); i++)
 			{
-				bestDeviceId = currentDeviceId;
-				maxGlobalMemorySize = globalMemorySize;
+				if ((devices[i].Type & Type) == 0)
+					continue;
+				if (!platformFilter.empty() && !ContainsNoCase(devices[i].PlatformName, platformFilter))
+					continue;
+				if (!deviceFilter.empty() && !ContainsNoCase(devices[i].DeviceName, deviceFilter))
+					continue;
+				candidates.push_back(int(i));
 			}
-		}
+		};
+
+		filterDevices(deviceType);
 
-		countAllDevices += countDevices;
+		// No GPU on this machine (e.g. build nodes with a CPU runtime): use whatever is available, unless the type was requested explicitly.
+		if (candidates.empty() && typeName.empty())
+		{
+			std::cout << "No GPU device with OpenCL support was found, falling back to any device type." << std::endl;
+			filterDevices(CL_DEVICE_TYPE_ALL);
+		}
 	}
-	deviceIds.resize(countAllDevices);
 
-	if (countAllDevices == 0)
+	if (candidates.empty())
 	{
-		std::cout << "No device of the selected type with OpenCL support was found.";
+		PrintCLDeviceTable(devices, -1);
+		std::cout << "No device of the selected type with OpenCL support was found." << std::endl;
 		return false;
 	}
 
-	// No discrete graphics device was found: falling back to the first found device.
-	if (bestDeviceId == NULL)
+	// 3. choose one of the candidates
+
+	int selected = candidates[0];
+	if (policy == "fastest" && candidates.size() > 1)
+	{
+		double bestTime = -1.0;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			double ms = CalibrateCLDevice(devices[candidates[i]]);
+			std::cout << "Calibration of device " << candidates[i] << " (" << devices[candidates[i]].DeviceName << "): " << ms << " ms" << std::endl;
+			if (ms >= 0.0 && (bestTime < 0.0 || ms < bestTime))
+			{
+				bestTime = ms;
+				selected = candidates[i];
+			}
+		}
+	}
+	else if (policy == "memory")
+	{
+		// Searching for the device with the most dedicated memory, devices using unified memory are only used as a fallback.
+		cl_ulong maxGlobalMemorySize = 0;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			const SCLDeviceEntry& d = devices[candidates[i]];
+			if (!d.UnifiedMemory && d.GlobalMemSize > maxGlobalMemorySize)
+			{
+				selected = candidates[i];
+				maxGlobalMemorySize = d.GlobalMemSize;
+			}
+		}
+	}
+	else if (policy != "first" && policy != "fastest")
 	{
-		bestDeviceId = deviceIds[0];
+		std::cerr << "Warning: unknown selection policy '" << policy << "', using the first device." << std::endl;
 	}
 
-	// Choosing the first available device.
-	m_CLDevice = bestDeviceId;
-	clGetDeviceInfo(m_CLDevice, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &m_CLPlatform, NULL);
+	PrintCLDeviceTable(devices, selected);
+
+	m_CLDevice = devices[selected].Device;
+	m_CLPlatform = devices[selected].Platform;
 
 	// Printing platform and device data.
 	const int maxBufferSize = 1024;
@@ -153,7 +424,14 @@ bool CAssignmentBase::InitCLContext()
 	std::cout << "Local memory size: " << localMemorySize << " Byte" << std::endl;
 	std::cout << std::endl << "******************************" << std::endl << std::endl;
 
-        
+	return true;
+}
+
+bool CAssignmentBase::InitCLContext()
+{
+	if(!SelectCLDevice())
+		return false;
+
 	cl_int clError;
 
 	m_CLContext = clCreateContext(NULL, 1, &m_CLDevice, NULL, NULL, &clError);
@@ -163,15 +441,143 @@ bool CAssignmentBase::InitCLContext()
 	// Finally, create a command queue. All the asynchronous commands to the device will be issued
 	// from the CPU into this queue. This way the host program can continue the execution until some results
 	// from that device are needed.
+	// Profiling is enabled so the device timestamps of individual launches can be queried (CLUtil::ProfileKernelEvents).
 
-	m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, 0, &clError);
+	m_CLCommandQueue = clCreateCommandQueue(m_CLContext, m_CLDevice, CL_QUEUE_PROFILING_ENABLE, &clError);
 	V_RETURN_FALSE_CL(clError, "Failed to create the command queue in the context");
 
 	return true;
 }
 
+void CAssignmentBase::ConfigureBufferMode()
+{
+	std::string name = ToLower(m_CommandLine.GetString("buffer-mode", "auto", "GPU_BUFFER_MODE"));
+
+	EHostMemoryMode mode = HOST_MEMORY_PAGEABLE;
+	if (name == "auto")
+	{
+		// CPU devices and devices with unified memory work on host memory anyway, copies are pure overhead there
+		cl_device_type type = 0;
+		cl_bool unifiedMemory = CL_FALSE;
+		clGetDeviceInfo(m_CLDevice, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+		clGetDeviceInfo(m_CLDevice, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unifiedMemory), &unifiedMemory, NULL);
+		if ((type & CL_DEVICE_TYPE_CPU) || unifiedMemory)
+			mode = HOST_MEMORY_ZERO_COPY;
+	}
+	else if (!CHostBuffer::ParseMode(name, mode))
+	{
+		std::cerr << "Warning: unknown buffer mode '" << name << "', using pageable memory." << std::endl;
+	}
+
+	CHostBuffer::SetDefaultMode(mode);
+	CHostBuffer::SetDefaultCommandQueue(m_CLCommandQueue);
+	cout << "Task buffers: " << CHostBuffer::GetModeName(mode) << endl << endl;
+}
+
+void CAssignmentBase::ConfigureLaunchPlans()
+{
+	bool enabled = m_CommandLine.GetInt("cl-command-buffers", 1, "GPU_CL_COMMAND_BUFFERS") != 0;
+	bool supported = CLaunchPlan::IsCommandBufferSupported(m_CLDevice);
+	CLaunchPlan::SetCommandBuffersEnabled(enabled && supported);
+
+	cout << "Launch plans: " << (enabled && supported ? "command buffers (cl_khr_command_buffer)" : "enqueue loop")
+		<< (enabled && !supported ? ", command buffers are not supported by the device" : "") << endl << endl;
+}
+
+void CAssignmentBase::MeasureRoofline()
+{
+	if(m_CommandLine.GetInt("roofline", 1, "GPU_ROOFLINE") == 0)
+	{
+		CRoofline::GetSingleton().SetDevice(NULL);
+		return;
+	}
+
+	CTraceZone zone("Roofline");
+	CRoofline::GetSingleton().Measure(m_CLDevice, m_CLContext, m_CLCommandQueue);
+}
+
+bool CAssignmentBase::OpenRegressionGate()
+{
+	std::string path = m_CommandLine.GetString("baseline", "", "GPU_BASELINE");
+	if(path.empty())
+		return true;
+
+	CRegressionGate& gate = CRegressionGate::GetSingleton();
+	gate.SetThreshold(m_CommandLine.GetDouble("regression-threshold", 5.0, "GPU_REGRESSION_THRESHOLD"),
+		m_CommandLine.GetDouble("regression-alpha", 0.01, "GPU_REGRESSION_ALPHA"));
+
+	char deviceName[256] = {0};
+	clGetDeviceInfo(m_CLDevice, CL_DEVICE_NAME, sizeof(deviceName) - 1, deviceName, NULL);
+	return gate.LoadBaseline(path, deviceName);
+}
+
+void CAssignmentBase::CreatePipelineQueues()
+{
+	int nQueues = max(m_CommandLine.GetInt("cl-queues", 3, "GPU_CL_QUEUES"), 1);
+
+	// the main queue is the first pipeline queue, so a single queue serializes the pipeline
+	std::vector<cl_command_queue> queues(1, m_CLCommandQueue);
+	for (int i = 1; i < nQueues; i++)
+	{
+		cl_int clError;
+		cl_command_queue queue = clCreateCommandQueue(m_CLContext, m_CLDevice, CL_QUEUE_PROFILING_ENABLE, &clError);
+		if (clError != CL_SUCCESS)
+		{
+			std::cerr << "Warning: failed to create pipeline command queue " << i << " [" << CLUtil::GetCLErrorString(clError) << "]" << std::endl;
+			break;
+		}
+		m_CLPipelineQueues.push_back(queue);
+		queues.push_back(queue);
+	}
+
+	CStreamPipeline::SetCommandQueues(queues);
+}
+
+void CAssignmentBase::ConfigureTaskGraph()
+{
+	m_TaskGraph = m_CommandLine.GetInt("task-graph", 0, "GPU_TASK_GRAPH") != 0;
+	m_TaskGraphWindow = max(m_CommandLine.GetInt("task-graph-window", 2, "GPU_TASK_GRAPH_WINDOW"), 1);
+	if(!m_TaskGraph)
+		return;
+
+	int nQueues = max(m_CommandLine.GetInt("task-graph-queues", 1, "GPU_TASK_GRAPH_QUEUES"), 1);
+	// the tuner measures the candidates on an otherwise idle device
+	if(nQueues > 1 && CAutoTuner::GetSingleton().IsTuningEnabled())
+	{
+		std::cerr << "Warning: --autotune runs the GPU phases of the task graph on a single queue." << std::endl;
+		nQueues = 1;
+	}
+
+	m_CLTaskGraphQueues.push_back(m_CLCommandQueue);
+	for (int i = 1; i < nQueues; i++)
+	{
+		cl_int clError;
+		cl_command_queue queue = clCreateCommandQueue(m_CLContext, m_CLDevice, CL_QUEUE_PROFILING_ENABLE, &clError);
+		if (clError != CL_SUCCESS)
+		{
+			std::cerr << "Warning: failed to create task graph command queue " << i << " [" << CLUtil::GetCLErrorString(clError) << "]" << std::endl;
+			break;
+		}
+		m_CLTaskGraphQueues.push_back(queue);
+	}
+
+	cout << "Task graph: " << m_CLTaskGraphQueues.size() << " GPU queue(s), " << m_TaskGraphWindow << " task(s) in flight" << endl;
+}
+
 void CAssignmentBase::ReleaseCLContext()
 {
+	CHostBuffer::SetDefaultCommandQueue(NULL);
+	CStreamPipeline::SetCommandQueues(std::vector<cl_command_queue>());
+
+	for (size_t i = 0; i < m_CLPipelineQueues.size(); i++)
+		clReleaseCommandQueue(m_CLPipelineQueues[i]);
+	m_CLPipelineQueues.clear();
+
+	// the first task graph queue is the main queue
+	for (size_t i = 1; i < m_CLTaskGraphQueues.size(); i++)
+		clReleaseCommandQueue(m_CLTaskGraphQueues[i]);
+	m_CLTaskGraphQueues.clear();
+
 	if (m_CLCommandQueue != nullptr)
 	{
 		clReleaseCommandQueue(m_CLCommandQueue);
@@ -180,11 +586,55 @@ void CAssignmentBase::ReleaseCLContext()
 
 	if (m_CLContext != nullptr)
 	{
+		CLUtil::PrintProgramCacheStats();
+		CKernelLibrary::GetSingleton().PrintStats();
+		CKernelLibrary::GetSingleton().ReleasePrograms(m_CLContext);
+		CBufferPool::GetSingleton().PrintStats();
+		CBufferPool::GetSingleton().Clear(m_CLContext);
+
 		clReleaseContext(m_CLContext);
 		m_CLContext = nullptr;
 	}
 }
 
+void CAssignmentBase::OpenResultsSink()
+{
+	std::string path = m_CommandLine.GetString("results", "", "GPU_RESULTS");
+	if(!path.empty())
+		CResultsSink::GetSingleton().Open(path, m_CommandLine.GetString("results-format", "", "GPU_RESULTS_FORMAT"));
+}
+
+void CAssignmentBase::OpenTrace()
+{
+	std::string path = m_CommandLine.GetString("trace", "", "GPU_TRACE");
+	if(!path.empty())
+		CTracer::GetSingleton().Open(path);
+}
+
+void CAssignmentBase::ConfigureCPUBaseline()
+{
+	CThreadPool& pool = CThreadPool::GetSingleton();
+	pool.SetThreadCount((unsigned int)std::max(m_CommandLine.GetInt("cpu-threads", 0, "GPU_CPU_THREADS"), 0));
+	pool.SetDeterministic(m_CommandLine.GetInt("cpu-deterministic", 1, "GPU_CPU_DETERMINISTIC") != 0);
+
+	CSimd& simd = CSimd::GetSingleton();
+	std::string simdLevel = m_CommandLine.GetString("cpu-simd", "auto", "GPU_CPU_SIMD");
+	if(!simd.SetLevel(simdLevel))
+		std::cerr << "Warning: unknown instruction set '" << simdLevel << "', using " << CSimd::GetLevelName(simd.GetLevel()) << "." << endl;
+
+	cout << "CPU reference: " << pool.GetThreadCount() << " thread(s)" << (pool.IsDeterministic() ? ", deterministic" : "")
+		<< ", SIMD: " << CSimd::GetLevelName(simd.GetLevel()) << " (host supports " << CSimd::GetLevelName(simd.GetDetectedLevel()) << ")" << endl;
+}
+
+void CAssignmentBase::OpenAutoTuner()
+{
+	std::string mode = ToLower(m_CommandLine.GetString("autotune", "", "GPU_AUTOTUNE"));
+	bool enabled = m_CommandLine.HasOption("autotune", "GPU_AUTOTUNE") && mode != "0" && mode != "off";
+
+	CAutoTuner::GetSingleton().Open(m_CommandLine.GetString("autotune-db", "autotune.db", "GPU_AUTOTUNE_DB"),
+		enabled, enabled && mode == "retune", m_CommandLine.GetInt("autotune-iterations", 10, "GPU_AUTOTUNE_ITERATIONS"));
+}
+
 bool CAssignmentBase::RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3])
 {
 	if(m_CLContext == nullptr)
@@ -192,27 +642,79 @@ bool CAssignmentBase::RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3]
 		std::cerr<<"Error: RunComputeTask() cannot execute because the OpenCL context has not been created first."<<endl;
 	}
 	
-	if(!Task.InitResources(m_CLDevice, m_CLContext))
+	CTraceZone taskZone(Task.GetName());
+
+	unsigned int resultsId;
+	if(!InitComputeTask(Task, LocalWorkSize, resultsId))
+		return false;
+
+	ComputeTaskCPU(Task);
+	ComputeTaskGPU(Task, m_CLCommandQueue, LocalWorkSize);
+	FinishComputeTask(Task, resultsId);
+
+	return true;
+}
+
+bool CAssignmentBase::InitComputeTask(IComputeTask& Task, size_t LocalWorkSize[3], unsigned int& ResultsId)
+{
+	char deviceName[256] = {0};
+	clGetDeviceInfo(m_CLDevice, CL_DEVICE_NAME, sizeof(deviceName) - 1, deviceName, NULL);
+	CResultsSink& results = CResultsSink::GetSingleton();
+	ResultsId = results.BeginTask(Task.GetName(), deviceName, LocalWorkSize);
+
+	bool initialized;
+	{
+		CTraceZone zone("InitResources");
+		initialized = Task.InitResources(m_CLDevice, m_CLContext);
+	}
+	if(!initialized)
 	{
 		std::cerr << "Error during resource allocation. Aborting execution." <<endl;
 		Task.ReleaseResources();
+		results.EndTask(false);
+		CRegressionGate::GetSingleton().AddResults(Task.GetName(), results.GetLastTaskResults(), false);
 		return false;
 	}
 
+	return true;
+}
+
+void CAssignmentBase::ComputeTaskCPU(IComputeTask& Task)
+{
 	// Compute the golden result.
 	cout << "Computing CPU reference result...";
-	Task.ComputeCPU();
+	{
+		CTraceZone zone("ComputeCPU");
+		Task.ComputeCPU();
+	}
 	cout << "DONE" << endl;
+}
 
+void CAssignmentBase::ComputeTaskGPU(IComputeTask& Task, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
 	// Running the same task on the GPU.
 	cout << "Computing GPU result...";
 
 	// Runing the kernel N times. This make the measurement of the execution time more accurate.
-	Task.ComputeGPU(m_CLContext, m_CLCommandQueue, LocalWorkSize);
+	{
+		CTraceZone zone("ComputeGPU");
+		Task.ComputeGPU(m_CLContext, CommandQueue, LocalWorkSize);
+	}
 	cout << "DONE" << endl;
+}
+
+bool CAssignmentBase::FinishComputeTask(IComputeTask& Task, unsigned int ResultsId)
+{
+	CResultsSink& results = CResultsSink::GetSingleton();
+	results.BindTask(ResultsId);
 
 	// Validating results.
-	if (Task.ValidateResults())
+	bool valid;
+	{
+		CTraceZone zone("ValidateResults");
+		valid = Task.ValidateResults();
+	}
+	if (valid)
 	{
 		cout << "GOLD TEST PASSED!" << endl;
 	}
@@ -220,11 +722,153 @@ bool CAssignmentBase::RunComputeTask(IComputeTask& Task, size_t LocalWorkSize[3]
 	{
 		cout << "INVALID RESULTS!" << endl;
 	}
+	results.EndTask(valid);
+	CRegressionGate::GetSingleton().AddResults(Task.GetName(), results.GetLastTaskResults(), valid);
 	
 	// Cleaning up.
+	CTraceZone zone("ReleaseResources");
 	Task.ReleaseResources();
 
-	return true;
+	return valid;
+}
+
+bool CAssignmentBase::RunComputeTasks(std::vector<SComputeTaskRun>& Runs)
+{
+	CResultsSink& results = CResultsSink::GetSingleton();
+
+	if(!m_TaskGraph)
+	{
+		bool success = true;
+		for(size_t i = 0; i < Runs.size(); i++)
+		{
+			SComputeTaskRun& run = Runs[i];
+			if(!run.Label.empty())
+				cout << endl << run.Label << endl;
+			success &= RunComputeTask(*run.pTask, run.LocalWorkSize);
+			run.Valid = results.WasLastTaskValid();
+			run.Results = results.GetLastTaskResults();
+		}
+		return success;
+	}
+
+	// Per task: Init -> CPU -> GPU -> Finish. The host nodes of all tasks run in order on this
+	// thread, so the CPU reference of a task overlaps with the GPU phases of the previous ones.
+	// The window limits the number of tasks whose resources are allocated at the same time.
+	std::vector<char> initialized(Runs.size(), 0);
+	std::vector<unsigned int> resultsIds(Runs.size(), 0);
+	std::vector<CTaskGraph::NodeId> finished(Runs.size());
+
+	CTaskGraph graph;
+	for(size_t i = 0; i < Runs.size(); i++)
+	{
+		SComputeTaskRun& run = Runs[i];
+		std::string name = run.pTask->GetName();
+
+		std::vector<CTaskGraph::NodeId> window;
+		if(i >= size_t(m_TaskGraphWindow))
+			window.push_back(finished[i - m_TaskGraphWindow]);
+
+		CTaskGraph::NodeId init = graph.AddHostNode(name + " Init", [&, i]() {
+			SComputeTaskRun& task = Runs[i];
+			if(!task.Label.empty())
+				cout << endl << task.Label << endl;
+			initialized[i] = InitComputeTask(*task.pTask, task.LocalWorkSize, resultsIds[i]);
+			if(!initialized[i])
+			{
+				task.Valid = false;
+				task.Results = CResultsSink::GetSingleton().GetLastTaskResults();
+			}
+		}, window);
+
+		CTaskGraph::NodeId cpu = graph.AddHostNode(name + " CPU", [&, i]() {
+			if(initialized[i])
+				ComputeTaskCPU(*Runs[i].pTask);
+		}, std::vector<CTaskGraph::NodeId>(1, init));
+
+		CTaskGraph::NodeId gpu = graph.AddDeviceNode(name + " GPU", [&, i](cl_command_queue CommandQueue) {
+			if(!initialized[i])
+				return;
+			CResultsSink::GetSingleton().BindTask(resultsIds[i]);
+			ComputeTaskGPU(*Runs[i].pTask, CommandQueue, Runs[i].LocalWorkSize);
+		}, std::vector<CTaskGraph::NodeId>(1, cpu));
+
+		finished[i] = graph.AddHostNode(name + " Finish", [&, i]() {
+			if(!initialized[i])
+				return;
+			Runs[i].Valid = FinishComputeTask(*Runs[i].pTask, resultsIds[i]);
+			Runs[i].Results = CResultsSink::GetSingleton().GetLastTaskResults();
+		}, std::vector<CTaskGraph::NodeId>(1, gpu));
+	}
+
+	if(!graph.Run(m_CLTaskGraphQueues))
+		return false;
+
+	bool success = true;
+	for(size_t i = 0; i < Runs.size(); i++)
+		success &= initialized[i] != 0;
+	return success;
+}
+
+bool CAssignmentBase::RunSweep(CBenchmarkSweep& Sweep, const CBenchmarkSweep::TaskFactory& Factory)
+{
+	if(!Sweep.IsSelected(m_CommandLine))
+		return true;
+
+	if(!Sweep.ParseCommandLine(m_CommandLine))
+	{
+		std::cerr << "Error: invalid options for sweep '" << Sweep.GetName() << "'." << endl;
+		return false;
+	}
+
+	// explicitly swept local sizes must not be replaced by the tuned ones
+	CAutoTuner::GetSingleton().SetSuspended(!Sweep.IsLocalSizeTunable());
+	bool success;
+	if(!m_TaskGraph)
+	{
+		success = Sweep.Run(Factory, [this](IComputeTask& Task, size_t LocalWorkSize[3]) {
+			return RunComputeTask(Task, LocalWorkSize);
+		});
+	}
+	else
+	{
+		// all configurations are scheduled at once, so the tasks overlap
+		std::vector<SSweepConfig> configs, scheduled;
+		Sweep.GetConfigurations(configs);
+
+		std::vector<SComputeTaskRun> runs;
+		for(size_t i = 0; i < configs.size(); i++)
+		{
+			IComputeTask* pTask = Factory(configs[i]);
+			if(!pTask)
+			{
+				success = false;
+				continue;
+			}
+
+			SComputeTaskRun run;
+			run.pTask = pTask;
+			for(int d = 0; d < 3; d++)
+				run.LocalWorkSize[d] = configs[i].LocalWorkSize[d];
+			run.Label = Sweep.DescribeConfiguration(configs[i]);
+			runs.push_back(run);
+			scheduled.push_back(configs[i]);
+		}
+
+		success = RunComputeTasks(runs);
+
+		Sweep.ResetBest();
+		for(size_t i = 0; i < runs.size(); i++)
+		{
+			for(int d = 0; d < 3; d++)
+				scheduled[i].LocalWorkSize[d] = runs[i].LocalWorkSize[d];
+			Sweep.UpdateBest(scheduled[i], runs[i].Results, runs[i].Valid);
+			SAFE_DELETE(runs[i].pTask);
+		}
+	}
+	CAutoTuner::GetSingleton().SetSuspended(false);
+	Sweep.PrintBestConfigurations();
+
+	return success;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,126 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CAUTO_TUNER_H
+#define _CAUTO_TUNER_H
+
+#include "CLUtil.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <mutex>
+
+//! Search space of the local work size of one kernel launch
+struct STuningSpace
+{
+	STuningSpace(cl_uint Dimensions, size_t SizeX, size_t SizeY = 1, size_t SizeZ = 1);
+
+	cl_uint		Dimensions;
+	size_t		ProblemSize[3];
+	//! Bytes of dynamic local memory (__local kernel arguments) needed per work-item
+	size_t		LocalMemPerWorkItem;
+	//! Index of the __local argument that is resized with the local work size, -1 if there is none
+	int			LocalMemArgument;
+	//! Only consider powers of two in each dimension (e.g. for tree reductions)
+	bool		PowerOfTwo;
+};
+
+//! A local work size and its measured time per launch (negative if not measured)
+struct STuningResult
+{
+	size_t		LocalWorkSize[3];
+	double		TimeMs;
+};
+
+//! Finds the fastest local work size of a kernel and remembers it in a tuning database
+/*!
+	The database is a text file with one entry per (device, kernel, problem size bucket),
+	a bucket is the problem size rounded up to the next power of two in each dimension.
+	Tune() returns the stored local work size if there is an entry, so the measurements
+	of a previous run replace the constants in the code. Only if tuning is enabled and
+	no entry exists (or retuning is requested) the candidates are measured.
+
+	The candidates are restricted by CL_KERNEL_WORK_GROUP_SIZE, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+	the available local memory and CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE.
+*/
+class CAutoTuner
+{
+public:
+	//! Returns the time of one launch in ms for the given local work size, negative if the launch failed
+	typedef std::function<double(const size_t LocalWorkSize[3])> MeasureFunc;
+
+	static CAutoTuner& GetSingleton();
+
+	//! Loads the database. Without TuningEnabled only the stored entries are applied.
+	bool Open(const std::string& Path, bool TuningEnabled, bool Retune = false, int NIterations = 10);
+
+	bool IsTuningEnabled() const { return m_TuningEnabled; }
+
+	//! While suspended, Tune() neither looks up nor measures (e.g. if the local sizes were given explicitly)
+	void SetSuspended(bool Suspended) { m_Suspended = Suspended; }
+
+	//! Number of launches per candidate, for tasks that provide their own MeasureFunc
+	int GetIterations() const { return m_NIterations; }
+
+	//! Looks up the stored local work size, returns false if there is no entry
+	bool Lookup(cl_device_id Device, const std::string& KernelName, const STuningSpace& Space, size_t LocalWorkSize[3]) const;
+
+	//! Returns the valid local work sizes of the kernel on the device of the command queue
+	bool GetCandidates(cl_device_id Device, cl_kernel Kernel, const STuningSpace& Space, std::vector<STuningResult>& Candidates) const;
+
+	//! Replaces LocalWorkSize with the stored or tuned value. Returns false if LocalWorkSize was left unchanged.
+	/*!
+		Measure is called for each candidate, it must set any __local arguments that depend on the
+		local work size. If a task launches a sequence of kernels, Measure should time the whole sequence.
+	*/
+	bool Tune(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+		const STuningSpace& Space, const MeasureFunc& Measure, size_t LocalWorkSize[3]);
+
+	//! Tune() for kernels that can be launched as they are, with the global work size rounded up to the local work size
+	/*!
+		If Space.LocalMemArgument is set, that argument is resized for each candidate
+		and has to be set again by the caller afterwards.
+	*/
+	bool Tune(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+		const STuningSpace& Space, size_t LocalWorkSize[3]);
+
+protected:
+	CAutoTuner();
+
+	static std::string GetDeviceName(cl_device_id Device);
+	static std::string GetKey(const std::string& DeviceName, const std::string& KernelName, const STuningSpace& Space);
+
+	bool Load();
+	//! Writes m_Entries to m_Path, the caller has to hold m_Mutex
+	bool Save() const;
+
+	std::string						m_Path;
+	bool							m_TuningEnabled;
+	bool							m_Retune;
+	bool							m_Suspended;
+	int								m_NIterations;
+
+	std::map<std::string, STuningResult>	m_Entries;
+	//! Guards m_Entries and the database file, tasks on different devices tune from their own threads
+	mutable std::mutex				m_Mutex;
+};
+
+#endif // _CAUTO_TUNER_H
@@ -0,0 +1,124 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CBENCHMARK_SWEEP_H
+#define _CBENCHMARK_SWEEP_H
+
+#include "IComputeTask.h"
+#include "CCommandLine.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+struct SBenchmarkResult;
+
+//! One point of a benchmark sweep, passed to the task factory
+struct SSweepConfig
+{
+	size_t			ProblemSize[3];
+	size_t			LocalWorkSize[3];
+	//! Empty if the task should run all of its variants
+	std::string		Variant;
+	int				Iterations;
+};
+
+//! Runs a compute task for the cartesian product of problem sizes, local sizes, variants and iteration counts
+/*!
+	The lists are given with the same syntax in the code (as defaults) and on the command line:
+		--<name>-sizes		e.g. "1048576,4194304", "2048x1024,2049x1025", "1024:16777216:*2" or "1:1048576:?16"
+		--<name>-local		e.g. "64:1024:64" or "32x16,16x16"
+		--<name>-variants	e.g. "sequentialAddressing,kernelDecomposition" (empty: all variants)
+		--<name>-iterations	e.g. "100"
+	Ranges are "lo:hi:step" (additive) or "lo:hi:*factor" (multiplicative), both including hi.
+	"lo:hi:?count" draws count random values of [lo, hi], the same spec always gives the same values.
+	With --sweeps <name>[,<name>...] only the listed sweeps are executed.
+	If the code gives a single local size and --<name>-local is not used, the tasks may
+	replace it with the entry of the tuning database (see CAutoTuner).
+
+	After the sweep the fastest valid configuration for each problem size is reported,
+	based on the results the task reported to CResultsSink.
+*/
+class CBenchmarkSweep
+{
+public:
+	typedef std::function<IComputeTask*(const SSweepConfig& Config)> TaskFactory;
+	typedef std::function<bool(IComputeTask& Task, size_t LocalWorkSize[3])> TaskRunner;
+
+	CBenchmarkSweep(const std::string& Name, const std::string& Sizes, const std::string& LocalSizes,
+		const std::string& Variants = "", const std::string& Iterations = "100");
+
+	//! Overrides the defaults with the options on the command line. Returns false on syntax errors.
+	bool ParseCommandLine(const CCommandLine& CommandLine);
+
+	//! True if a single local size is given in the code, then the tuning database may replace it
+	bool IsLocalSizeTunable() const;
+
+	//! Returns false if --sweeps is given and does not contain this sweep
+	bool IsSelected(const CCommandLine& CommandLine) const;
+
+	//! Creates, runs and deletes one task per configuration, a factory returning NULL fails the sweep
+	bool Run(const TaskFactory& Factory, const TaskRunner& Runner);
+
+	//! Expands the lists into all configurations, e.g. to run them out of order. Returns false on syntax errors.
+	bool GetConfigurations(std::vector<SSweepConfig>& Configs) const;
+
+	//! Header line of a configuration, e.g. "[reduction] size 1048576, local 256x1x1, 100 iterations"
+	std::string DescribeConfiguration(const SSweepConfig& Config) const;
+
+	//! Takes the results of a finished configuration into account for PrintBestConfigurations()
+	void UpdateBest(const SSweepConfig& Config, const std::vector<SBenchmarkResult>& Results, bool Valid);
+
+	//! Forgets the best configurations of a previous run
+	void ResetBest() { m_Best.clear(); }
+
+	void PrintBestConfigurations() const;
+
+	const std::string& GetName() const { return m_Name; }
+
+protected:
+	struct SExtent
+	{
+		size_t Value[3];
+	};
+
+	struct SBestConfig
+	{
+		SExtent			ProblemSize;
+		SSweepConfig	Config;
+		std::string		Variant;
+		double			TimeMs;
+		double			BytesMoved;
+	};
+
+	//! Parses a comma separated list of extents ("N", "NxM[xK]", "lo:hi:step", "lo:hi:*factor", "lo:hi:?count")
+	static bool ParseExtents(const std::string& Spec, std::vector<SExtent>& Extents);
+	static void ParseStrings(const std::string& Spec, std::vector<std::string>& Strings);
+
+	std::string					m_Name;
+	std::string					m_SizesSpec;
+	std::string					m_LocalSizesSpec;
+	std::string					m_VariantsSpec;
+	std::string					m_IterationsSpec;
+	bool						m_LocalSizesOverridden;
+
+	std::vector<SBestConfig>	m_Best;
+};
+
+#endif // _CBENCHMARK_SWEEP_H
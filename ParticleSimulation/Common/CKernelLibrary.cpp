@@ -0,0 +1,279 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CKernelLibrary.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CKernelDefines
+
+CKernelDefines& CKernelDefines::Set(const std::string& Name, int Value)
+{
+	m_Values[Name] = to_string(Value);
+	return *this;
+}
+
+CKernelDefines& CKernelDefines::Set(const std::string& Name, unsigned int Value)
+{
+	m_Values[Name] = to_string(Value) + "u";
+	return *this;
+}
+
+CKernelDefines& CKernelDefines::Set(const std::string& Name, size_t Value)
+{
+	// sizes are mostly used for array dimensions and loop bounds, plain literals fit there
+	m_Values[Name] = to_string(Value);
+	return *this;
+}
+
+CKernelDefines& CKernelDefines::Set(const std::string& Name, float Value)
+{
+	// nine digits restore the exact float, showpoint keeps the literal a floating point one
+	stringstream value;
+	value << setprecision(9) << showpoint << Value << "f";
+	m_Values[Name] = value.str();
+	return *this;
+}
+
+CKernelDefines& CKernelDefines::Set(const std::string& Name, bool Value)
+{
+	m_Values[Name] = Value ? "1" : "0";
+	return *this;
+}
+
+CKernelDefines& CKernelDefines::SetToken(const std::string& Name, const std::string& Token)
+{
+	m_Values[Name] = Token;
+	return *this;
+}
+
+CKernelDefines& CKernelDefines::Set(const std::string& Name)
+{
+	m_Values[Name] = "";
+	return *this;
+}
+
+std::string CKernelDefines::GetOptions() const
+{
+	stringstream options;
+	for(map<string, string>::const_iterator it = m_Values.begin(); it != m_Values.end(); ++it)
+	{
+		if(it != m_Values.begin())
+			options << " ";
+		options << "-D " << it->first;
+		if(!it->second.empty())
+			options << "=" << it->second;
+	}
+	return options.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CKernelLibrary
+
+static string GetDirectory(const string& Path)
+{
+	size_t pos = Path.find_last_of("/\\");
+	return pos == string::npos ? string() : Path.substr(0, pos + 1);
+}
+
+static bool FileExists(const string& Path)
+{
+	ifstream file(Path.c_str());
+	return file.is_open();
+}
+
+CKernelLibrary& CKernelLibrary::GetSingleton()
+{
+	static CKernelLibrary s_Instance;
+	return s_Instance;
+}
+
+CKernelLibrary::CKernelLibrary()
+	: m_Hits(0), m_Misses(0)
+{
+	// the assignments run in their source directory, the shared kernels are in the Common module
+	m_SearchPaths.push_back("");
+	m_SearchPaths.push_back("../Common/CL/");
+}
+
+bool CKernelLibrary::SProgramKey::operator<(const SProgramKey& Other) const
+{
+	if(Context != Other.Context)
+		return Context < Other.Context;
+	if(Device != Other.Device)
+		return Device < Other.Device;
+	if(CompileOptions != Other.CompileOptions)
+		return CompileOptions < Other.CompileOptions;
+	return SourceCode < Other.SourceCode;
+}
+
+void CKernelLibrary::AddSearchPath(const std::string& Path)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	string path = Path;
+	if(!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+		path += "/";
+	m_SearchPaths.push_back(path);
+}
+
+std::string CKernelLibrary::ResolveInclude(const std::string& Name, const std::string& IncludingPath) const
+{
+	string local = GetDirectory(IncludingPath) + Name;
+	if(FileExists(local))
+		return local;
+
+	for(size_t i = 0; i < m_SearchPaths.size(); i++)
+	{
+		string path = m_SearchPaths[i] + Name;
+		if(FileExists(path))
+			return path;
+	}
+	return string();
+}
+
+bool CKernelLibrary::Preprocess(const std::string& Path, std::set<std::string>& Included, std::vector<std::string>& Stack, std::string& Output)
+{
+	if(find(Stack.begin(), Stack.end(), Path) != Stack.end())
+	{
+		cerr << "Error: recursive #include of '" << Path << "'." << endl;
+		return false;
+	}
+	// every file once per program
+	if(!Included.insert(Path).second)
+		return true;
+
+	string source;
+	if(!CLUtil::LoadProgramSourceToMemory(Path, source))
+		return false;
+
+	Stack.push_back(Path);
+
+	istringstream lines(source);
+	string line;
+	while(getline(lines, line))
+	{
+		// #include "File" or #include <File>, whitespace is allowed around the '#'
+		size_t first = line.find_first_not_of(" \t");
+		if(first != string::npos && line[first] == '#')
+		{
+			size_t directive = line.find_first_not_of(" \t", first + 1);
+			if(directive != string::npos && line.compare(directive, 7, "include") == 0)
+			{
+				size_t open = line.find_first_of("\"<", directive + 7);
+				size_t close = open == string::npos ? string::npos : line.find_first_of("\">", open + 1);
+				if(close == string::npos)
+				{
+					cerr << "Error: malformed #include in '" << Path << "': " << line << endl;
+					Stack.pop_back();
+					return false;
+				}
+
+				string name = line.substr(open + 1, close - open - 1);
+				string includePath = ResolveInclude(name, Path);
+				if(includePath.empty())
+				{
+					cerr << "Error: cannot find '" << name << "' included from '" << Path << "'." << endl;
+					Stack.pop_back();
+					return false;
+				}
+
+				Output += "// begin of " + name + "\n";
+				if(!Preprocess(includePath, Included, Stack, Output))
+				{
+					Stack.pop_back();
+					return false;
+				}
+				Output += "// end of " + name + "\n";
+				continue;
+			}
+		}
+
+		Output += line;
+		Output += "\n";
+	}
+
+	Stack.pop_back();
+	return true;
+}
+
+bool CKernelLibrary::LoadSource(const std::string& FileName, std::string& SourceCode)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	set<string> included;
+	vector<string> stack;
+	SourceCode.clear();
+	return Preprocess(FileName, included, stack, SourceCode);
+}
+
+cl_program CKernelLibrary::Build(cl_device_id Device, cl_context Context, const std::string& FileName,
+	const CKernelDefines& Defines, const std::string& CompileOptions)
+{
+	SProgramKey key;
+	if(!LoadSource(FileName, key.SourceCode))
+		return nullptr;
+
+	key.Context = Context;
+	key.Device = Device;
+	key.CompileOptions = CompileOptions;
+	string defines = Defines.GetOptions();
+	if(!defines.empty())
+		key.CompileOptions += (CompileOptions.empty() ? "" : " ") + defines;
+
+	lock_guard<mutex> lock(m_Mutex);
+
+	map<SProgramKey, cl_program>::iterator it = m_Programs.find(key);
+	if(it != m_Programs.end())
+	{
+		m_Hits++;
+		clRetainProgram(it->second);
+		return it->second;
+	}
+
+	cl_program program = CLUtil::BuildCLProgramFromMemory(Device, Context, key.SourceCode, key.CompileOptions);
+	if(program == nullptr)
+		return nullptr;
+
+	// one reference for the library, one for the caller
+	m_Misses++;
+	m_Programs[key] = program;
+	clRetainProgram(program);
+	return program;
+}
+
+void CKernelLibrary::ReleasePrograms(cl_context Context)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	for(map<SProgramKey, cl_program>::iterator it = m_Programs.begin(); it != m_Programs.end(); )
+	{
+		if(it->first.Context == Context)
+		{
+			clReleaseProgram(it->second);
+			m_Programs.erase(it++);
+		}
+		else
+			++it;
+	}
+}
+
+void CKernelLibrary::PrintStats() const
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	if(m_Hits + m_Misses == 0)
+		return;
+
+	cout << "Kernel library: " << m_Misses << " programs built, " << m_Hits << " reused" << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
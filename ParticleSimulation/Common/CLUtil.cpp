@@ -5,9 +5,30 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "CLUtil.h"
 #include "CTimer.h"
+#include "CTracer.h"
+#include "CStatistics.h"
 
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <atomic>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdio>
+
+#ifdef _WIN32
+	#include <direct.h>
+	#include <process.h>
+	#define MAKE_DIRECTORY(path) _mkdir(path)
+	#define GET_PROCESS_ID() _getpid()
+#else
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define MAKE_DIRECTORY(path) mkdir(path, 0755)
+	#define GET_PROCESS_ID() getpid()
+#endif
 
 using namespace std;
 
@@ -23,10 +44,43 @@ size_t CLUtil::GetGlobalWorkSize(size_t DataElemCount, size_t LocalWorkSize)
 		return DataElemCount + LocalWorkSize - r;
 }
 
+size_t CLUtil::GetNextPowerOfTwo(size_t Value)
+{
+	size_t p = 1;
+	while(p < Value)
+		p *= 2;
+	return p;
+}
+
+bool CLUtil::HasDeviceExtension(cl_device_id Device, const std::string& Extension)
+{
+	size_t size = 0;
+	if(clGetDeviceInfo(Device, CL_DEVICE_EXTENSIONS, 0, NULL, &size) != CL_SUCCESS || size == 0)
+		return false;
+	string extensions(size, '\0');
+	if(clGetDeviceInfo(Device, CL_DEVICE_EXTENSIONS, size, &extensions[0], NULL) != CL_SUCCESS)
+		return false;
+	// the name followed by a separator, so extensions of the extension do not match
+	extensions = " " + string(extensions.c_str()) + " ";
+	return extensions.find(" " + Extension + " ") != string::npos;
+}
+
+unsigned int CLUtil::GetDeviceCVersion(cl_device_id Device)
+{
+	// the version string is "OpenCL C <major>.<minor> <vendor-specific information>"
+	char version[256] = {0};
+	if(clGetDeviceInfo(Device, CL_DEVICE_OPENCL_C_VERSION, sizeof(version) - 1, version, NULL) != CL_SUCCESS)
+		return 0;
+	unsigned int major = 0, minor = 0;
+	if(sscanf(version, "OpenCL C %u.%u", &major, &minor) != 2)
+		return 0;
+	return major * 100 + minor * 10;
+}
+
 bool CLUtil::LoadProgramSourceToMemory(const std::string& Path, std::string& SourceCode)
 {
 	ifstream sourceFile;
-	
+
 	sourceFile.open(Path.c_str());
 	if (!sourceFile.is_open())
 	{
@@ -46,12 +100,194 @@ bool CLUtil::LoadProgramSourceToMemory(const std::string& Path, std::string& Sou
 	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Program binary cache
+
+static bool s_ProgramCacheInitialized = false;
+static bool s_ProgramCacheEnabled = true;
+static string s_ProgramCacheDirectory = "clcache";
+static unsigned int s_ProgramCacheHits = 0;
+static unsigned int s_ProgramCacheMisses = 0;
+
+// The environment only provides the defaults, explicit calls to the setters take precedence
+static void InitProgramCache()
+{
+	if(s_ProgramCacheInitialized)
+		return;
+	s_ProgramCacheInitialized = true;
+
+	const char* enabled = getenv("GPU_CL_CACHE");
+	if(enabled && (string(enabled) == "0" || string(enabled) == "off"))
+		s_ProgramCacheEnabled = false;
+
+	const char* directory = getenv("GPU_CL_CACHE_DIR");
+	if(directory && directory[0] != '\0')
+		s_ProgramCacheDirectory = directory;
+}
+
+// 64 bit FNV-1a, good enough to tell program variants apart
+static unsigned long long HashFNV1a(const string& Data, unsigned long long Hash = 14695981039346656037ULL)
+{
+	for(size_t i = 0; i < Data.size(); i++)
+	{
+		Hash ^= (unsigned char)Data[i];
+		Hash *= 1099511628211ULL;
+	}
+	// separator, so that ("ab", "c") and ("a", "bc") do not collide
+	Hash ^= 0xff;
+	Hash *= 1099511628211ULL;
+	return Hash;
+}
+
+static string GetDeviceInfoString(cl_device_id Device, cl_device_info Param)
+{
+	size_t size = 0;
+	if(clGetDeviceInfo(Device, Param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+		return string();
+	string value(size, '\0');
+	clGetDeviceInfo(Device, Param, size, &value[0], NULL);
+	return value;
+}
+
+static string GetProgramCachePath(cl_device_id Device, const string& SourceCode, const string& CompileOptions)
+{
+	cl_platform_id platform = NULL;
+	clGetDeviceInfo(Device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL);
+
+	string platformName;
+	size_t size = 0;
+	if(clGetPlatformInfo(platform, CL_PLATFORM_NAME, 0, NULL, &size) == CL_SUCCESS && size > 0)
+	{
+		platformName.resize(size);
+		clGetPlatformInfo(platform, CL_PLATFORM_NAME, size, &platformName[0], NULL);
+	}
+
+	unsigned long long hash = HashFNV1a(SourceCode);
+	hash = HashFNV1a(CompileOptions, hash);
+	hash = HashFNV1a(platformName, hash);
+	hash = HashFNV1a(GetDeviceInfoString(Device, CL_DEVICE_NAME), hash);
+	hash = HashFNV1a(GetDeviceInfoString(Device, CL_DRIVER_VERSION), hash);
+
+	stringstream path;
+	path << s_ProgramCacheDirectory << "/" << hex << setw(16) << setfill('0') << hash << ".clbin";
+	return path.str();
+}
+
+static cl_program LoadProgramBinary(cl_device_id Device, cl_context Context, const string& Path, const char* pCompileOptions)
+{
+	ifstream file(Path.c_str(), ios::in | ios::binary);
+	if(!file.is_open())
+		return nullptr;
+
+	vector<unsigned char> binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	if(binary.empty())
+		return nullptr;
+
+	const unsigned char* pBinary = &binary[0];
+	size_t length = binary.size();
+	cl_int binaryStatus, clError;
+	cl_program prog = clCreateProgramWithBinary(Context, 1, &Device, &length, &pBinary, &binaryStatus, &clError);
+	if(CL_SUCCESS != clError || CL_SUCCESS != binaryStatus)
+	{
+		SAFE_RELEASE_PROGRAM(prog);
+		return nullptr;
+	}
+
+	// a binary still has to be built, but this only links the already compiled code
+	if(CL_SUCCESS != clBuildProgram(prog, 1, &Device, pCompileOptions, NULL, NULL))
+	{
+		SAFE_RELEASE_PROGRAM(prog);
+		return nullptr;
+	}
+
+	return prog;
+}
+
+static void SaveProgramBinary(cl_program Program, const string& Path)
+{
+	size_t length = 0;
+	if(clGetProgramInfo(Program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &length, NULL) != CL_SUCCESS || length == 0)
+		return;
+
+	vector<unsigned char> binary(length);
+	unsigned char* pBinary = &binary[0];
+	if(clGetProgramInfo(Program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &pBinary, NULL) != CL_SUCCESS)
+		return;
+
+	// fails if the directory already exists, which is fine
+	MAKE_DIRECTORY(s_ProgramCacheDirectory.c_str());
+
+	// write to a temporary file first, so concurrent runs never read a partially written binary
+	stringstream tmpPath;
+	tmpPath << Path << "." << GET_PROCESS_ID() << ".tmp";
+	{
+		ofstream file(tmpPath.str().c_str(), ios::out | ios::binary | ios::trunc);
+		if(!file.is_open())
+		{
+			cerr << "Warning: cannot write to the program cache '" << s_ProgramCacheDirectory << "'." << endl;
+			return;
+		}
+		file.write((const char*)pBinary, length);
+	}
+
+	remove(Path.c_str());
+	if(rename(tmpPath.str().c_str(), Path.c_str()) != 0)
+		remove(tmpPath.str().c_str());
+}
+
+void CLUtil::SetProgramCacheEnabled(bool Enabled)
+{
+	InitProgramCache();
+	s_ProgramCacheEnabled = Enabled;
+}
+
+void CLUtil::SetProgramCacheDirectory(const std::string& Directory)
+{
+	InitProgramCache();
+	s_ProgramCacheDirectory = Directory;
+}
+
+unsigned int CLUtil::GetProgramCacheHits()
+{
+	return s_ProgramCacheHits;
+}
+
+unsigned int CLUtil::GetProgramCacheMisses()
+{
+	return s_ProgramCacheMisses;
+}
+
+void CLUtil::PrintProgramCacheStats()
+{
+	if(s_ProgramCacheHits + s_ProgramCacheMisses == 0)
+		return;
+
+	cout << "Program cache (" << s_ProgramCacheDirectory << "): " << s_ProgramCacheHits << " hits, "
+		<< s_ProgramCacheMisses << " misses" << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 cl_program CLUtil::BuildCLProgramFromMemory(cl_device_id Device, cl_context Context, const std::string& SourceCode, const std::string& CompileOptions)
 {
-	
-	// Ignore the last parameter CompileOptions in assignment 1
-	// This may be used later to pass flags and macro definitions to the OpenCL compiler
+	const char* pCompileOptions = CompileOptions.size() > 0 ? CompileOptions.c_str() : nullptr;
 
+	// try the binary cache first
+	InitProgramCache();
+	string cachePath;
+	if(s_ProgramCacheEnabled)
+	{
+		cachePath = GetProgramCachePath(Device, SourceCode, CompileOptions);
+		cl_program cached = LoadProgramBinary(Device, Context, cachePath, pCompileOptions);
+		if(cached != nullptr)
+		{
+			s_ProgramCacheHits++;
+			return cached;
+		}
+		s_ProgramCacheMisses++;
+	}
+
+	// no usable binary, compile from source
 	cl_program prog = nullptr;
 
 
@@ -69,7 +305,6 @@ cl_program CLUtil::BuildCLProgramFromMemory(cl_device_id Device, cl_context Cont
 	}
 
 	// program created, now build it:
-	const char* pCompileOptions = CompileOptions.size() > 0 ? CompileOptions.c_str() : nullptr;
 	clError = clBuildProgram(prog, 1, &Device, pCompileOptions, NULL, NULL);
 	PrintBuildLog(prog, Device);
 	if(CL_SUCCESS != clError)
@@ -79,6 +314,8 @@ cl_program CLUtil::BuildCLProgramFromMemory(cl_device_id Device, cl_context Cont
 		return nullptr;
 	}
 
+	if(!cachePath.empty())
+		SaveProgramBinary(prog, cachePath);
 
 	return prog;
 }
@@ -106,7 +343,7 @@ void CLUtil::PrintBuildLog(cl_program Program, cl_device_id Device)
 	cout<<buildLog<<endl;
 }
 
-double CLUtil::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions, 
+double CLUtil::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions,
 		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations)
 {
 	CTimer timer;
@@ -116,6 +353,10 @@ double CLUtil::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl
 	// Should not be used in production code, but this synchronizes HOST and DEVICE
 	clErr = clFinish(CommandQueue);
 
+	// warm-up launch, it pays for the kernel upload and cold caches
+	clErr |= clEnqueueNDRangeKernel(CommandQueue, Kernel, Dimensions, NULL, pGlobalWorkSize, pLocalWorkSize, 0, NULL, NULL);
+	clErr |= clFinish(CommandQueue);
+
 	timer.Start();
 
 	// run the kernel N times for better average accuracy
@@ -137,6 +378,144 @@ double CLUtil::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, cl
 	return timer.GetElapsedMilliseconds() / double(NIterations);
 }
 
+// Sorts the samples (given in ns) and fills in the order statistics in ms
+static void ComputeProfileInterval(const vector<cl_ulong>& Samples, SProfileInterval& Interval)
+{
+	// the reservoir holds all samples, so the percentiles are exact
+	CStatistics statistics(0, Samples.size());
+	for(size_t i = 0; i < Samples.size(); i++)
+		statistics.Add(1.0e-6 * double(Samples[i]));
+
+	Interval = statistics.GetProfileInterval();
+}
+
+bool CLUtil::IsProfilingEnabled(cl_command_queue CommandQueue)
+{
+	cl_command_queue_properties properties = 0;
+	if(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL) != CL_SUCCESS)
+		return false;
+	return (properties & CL_QUEUE_PROFILING_ENABLE) != 0;
+}
+
+bool CLUtil::ProfileKernelEvents(cl_command_queue CommandQueue, cl_kernel Kernel, cl_uint Dimensions,
+		const size_t* pGlobalWorkSize, const size_t* pLocalWorkSize, int NIterations, SKernelProfile& Profile)
+{
+	// the kernels appear with their function names in the trace
+	string name = "Kernel";
+	if(CTracer::GetSingleton().IsEnabled())
+	{
+		char functionName[256] = {0};
+		if(clGetKernelInfo(Kernel, CL_KERNEL_FUNCTION_NAME, sizeof(functionName) - 1, functionName, NULL) == CL_SUCCESS)
+			name = functionName;
+	}
+
+	return ProfileCommandEvents(CommandQueue, [&](cl_event* Event) {
+		return clEnqueueNDRangeKernel(CommandQueue, Kernel, Dimensions, NULL, pGlobalWorkSize, pLocalWorkSize, 0, NULL, Event);
+	}, NIterations, Profile, name);
+}
+
+bool CLUtil::ProfileCommandEvents(cl_command_queue CommandQueue, const std::function<cl_int(cl_event* Event)>& Enqueue,
+		int NIterations, SKernelProfile& Profile, const std::string& TraceName)
+{
+	if(NIterations <= 0)
+		return false;
+
+	// without device timestamps the batch is timed on the host, the same queue is profiled every run
+	bool deviceTimed = IsProfilingEnabled(CommandQueue);
+	if(!deviceTimed)
+	{
+		static atomic<bool> warned(false);
+		if(!warned.exchange(true))
+			cerr<<"Warning: the command queue has no CL_QUEUE_PROFILING_ENABLE, commands are timed on the host."<<endl;
+	}
+
+	vector<cl_event> events(NIterations, (cl_event)NULL);
+	cl_int clErr = clFinish(CommandQueue);
+
+	CTracer& tracer = CTracer::GetSingleton();
+	CTraceZone zone("Profile " + TraceName);
+	double enqueueUs = tracer.Now();
+
+	CTimer timer;
+	timer.Start();
+
+	// one event per command, so each command gets its own set of device timestamps
+	for(int i = 0; i < NIterations; i++)
+	{
+		clErr |= Enqueue(deviceTimed ? &events[i] : NULL);
+	}
+	clErr |= clFinish(CommandQueue);
+
+	timer.Stop();
+
+	// the first command was enqueued right after enqueueUs
+	if(deviceTimed)
+		tracer.Calibrate(events[0], enqueueUs);
+
+	vector<cl_ulong> queuedToSubmit(NIterations), submitToStart(NIterations), startToEnd(NIterations);
+	for(int i = 0; i < NIterations; i++)
+	{
+		cl_ulong tQueued = 0, tSubmit = 0, tStart = 0, tEnd = 0;
+		if(events[i] != NULL)
+		{
+			clErr |= clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &tQueued, NULL);
+			clErr |= clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &tSubmit, NULL);
+			clErr |= clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &tStart, NULL);
+			clErr |= clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &tEnd, NULL);
+			tracer.AddDeviceCommand(TraceName, CommandQueue, events[i]);
+			clReleaseEvent(events[i]);
+		}
+
+		// some drivers report non-monotonic timestamps for the host-side states, clamp these to zero
+		queuedToSubmit[i] = tSubmit > tQueued ? tSubmit - tQueued : 0;
+		submitToStart[i] = tStart > tSubmit ? tStart - tSubmit : 0;
+		startToEnd[i] = tEnd > tStart ? tEnd - tStart : 0;
+	}
+
+	if(clErr != CL_SUCCESS)
+	{
+		cerr<<"Command execution failure: "<<GetCLErrorString(clErr)<<endl;
+		return false;
+	}
+
+	ComputeProfileInterval(queuedToSubmit, Profile.QueuedToSubmit);
+	ComputeProfileInterval(submitToStart, Profile.SubmitToStart);
+	ComputeProfileInterval(startToEnd, Profile.StartToEnd);
+	Profile.NIterations = NIterations;
+	Profile.HostTimed = !deviceTimed;
+
+	if(!deviceTimed)
+	{
+		double ms = timer.GetElapsedMilliseconds() / double(NIterations);
+		SProfileInterval& interval = Profile.StartToEnd;
+		interval.Min = interval.Median = interval.P95 = interval.P99 = interval.Max = interval.Mean = ms;
+	}
+
+	return true;
+}
+
+void CLUtil::PrintKernelProfile(const std::string& KernelName, const SKernelProfile& Profile)
+{
+	auto printInterval = [](const char* Name, const SProfileInterval& I) {
+		cout<<"    "<<setw(16)<<left<<Name<<right<<fixed<<setprecision(4)
+			<<" min "<<I.Min<<" | median "<<I.Median<<" | p95 "<<I.P95
+			<<" | p99 "<<I.P99<<" | max "<<I.Max<<" ms"<<endl;
+		cout.unsetf(ios::floatfield);
+		cout<<setprecision(6);
+	};
+
+	if(Profile.HostTimed)
+	{
+		cout<<"  Host timing of "<<KernelName<<" ("<<Profile.NIterations<<" launches): "<<Profile.StartToEnd.Mean<<" ms on average"<<endl;
+		return;
+	}
+
+	cout<<"  Device timing of "<<KernelName<<" ("<<Profile.NIterations<<" launches):"<<endl;
+	printInterval("queued->submit", Profile.QueuedToSubmit);
+	printInterval("submit->start", Profile.SubmitToStart);
+	printInterval("start->end", Profile.StartToEnd);
+}
+
 #define CL_ERROR(x) case (x): return #x;
 
 const char* CLUtil::GetCLErrorString(cl_int CLErrorCode)
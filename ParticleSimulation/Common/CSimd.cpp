@@ -0,0 +1,152 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CSimd.h"
+
+#include <algorithm>
+#include <cctype>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SIMD_X86
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CPU feature detection
+
+#ifdef SIMD_X86
+
+static void QueryCPUID(unsigned int Leaf, unsigned int SubLeaf, unsigned int Regs[4])
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuidex(regs, int(Leaf), int(SubLeaf));
+	for(int i = 0; i < 4; i++)
+		Regs[i] = (unsigned int)regs[i];
+#else
+	__cpuid_count(Leaf, SubLeaf, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+}
+
+// register state the operating system saves on context switches (XCR0)
+static unsigned long long QueryXCR0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+#endif // SIMD_X86
+
+ESimdLevel CSimd::DetectLevel()
+{
+#ifdef SIMD_X86
+	unsigned int regs[4]; // EAX, EBX, ECX, EDX
+	QueryCPUID(0, 0, regs);
+	unsigned int maxLeaf = regs[0];
+
+	QueryCPUID(1, 0, regs);
+	bool sse2 = (regs[3] & (1u << 26)) != 0;
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool avx = (regs[2] & (1u << 28)) != 0;
+	if(!sse2)
+		return SIMD_SCALAR;
+
+	// the YMM / ZMM registers are only usable if the operating system saves them
+	unsigned long long xcr0 = osxsave ? QueryXCR0() : 0;
+	bool osAVX = avx && (xcr0 & 0x6) == 0x6;
+	bool osAVX512 = osAVX && (xcr0 & 0xE0) == 0xE0;
+
+	bool avx2 = false, avx512f = false;
+	if(maxLeaf >= 7)
+	{
+		QueryCPUID(7, 0, regs);
+		avx2 = (regs[1] & (1u << 5)) != 0;
+		avx512f = (regs[1] & (1u << 16)) != 0;
+	}
+
+	if(osAVX512 && avx512f && avx2)
+		return SIMD_AVX512;
+	if(osAVX && avx2)
+		return SIMD_AVX2;
+	return SIMD_SSE2;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CSimd
+
+CSimd& CSimd::GetSingleton()
+{
+	static CSimd s_Instance;
+	return s_Instance;
+}
+
+CSimd::CSimd()
+	: m_DetectedLevel(DetectLevel()), m_Level(SIMD_SCALAR), m_Kernels(NULL)
+{
+	SelectKernels(m_DetectedLevel);
+}
+
+const char* CSimd::GetLevelName(ESimdLevel Level)
+{
+	switch(Level)
+	{
+	case SIMD_SCALAR: return "scalar";
+	case SIMD_SSE2: return "sse2";
+	case SIMD_AVX2: return "avx2";
+	case SIMD_AVX512: return "avx512";
+	default: return "unknown";
+	}
+}
+
+bool CSimd::SetLevel(const std::string& Name)
+{
+	string name = Name;
+	transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+	ESimdLevel level = SIMD_LEVEL_COUNT;
+	if(name.empty() || name == "auto")
+		level = m_DetectedLevel;
+	for(int i = 0; i < SIMD_LEVEL_COUNT; i++)
+		if(name == GetLevelName(ESimdLevel(i)))
+			level = ESimdLevel(i);
+
+	if(level == SIMD_LEVEL_COUNT)
+		return false;
+
+	SelectKernels(min(level, m_DetectedLevel));
+	return true;
+}
+
+void CSimd::SelectKernels(ESimdLevel Level)
+{
+	// the compiler may not support every instruction set, then the next lower one is used
+	const SSimdKernels* (*getKernels[SIMD_LEVEL_COUNT])() = {
+		GetSimdKernelsScalar, GetSimdKernelsSSE2, GetSimdKernelsAVX2, GetSimdKernelsAVX512
+	};
+
+	for(int i = int(Level); i >= 0; i--)
+	{
+		m_Kernels = getKernels[i]();
+		if(m_Kernels != NULL)
+			break;
+	}
+	m_Level = m_Kernels->Level;
+}
+
+///////////////////////////////////////////////////////////////////////////////
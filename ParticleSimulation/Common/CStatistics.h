@@ -0,0 +1,92 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CSTATISTICS_H
+#define _CSTATISTICS_H
+
+#include "CLUtil.h"
+
+#include <vector>
+#include <random>
+
+//! Running statistics of a series of timings
+/*!
+	Mean and variance are accumulated with Welford's algorithm, so they are exact for any
+	number of samples. Percentiles are computed from a uniform reservoir sample (exact as
+	long as the reservoir is not full). The first WarmUp samples are discarded, they contain
+	the first-launch costs (kernel upload, cache misses, clock ramp-up).
+
+	The robust mean ignores outliers, i.e. samples that are more than Threshold scaled
+	median absolute deviations away from the median (interrupts, preemption, other processes).
+*/
+class CStatistics
+{
+public:
+	CStatistics(unsigned int WarmUp = 0, size_t ReservoirSize = 4096);
+
+	void Reset();
+
+	void Add(double Value);
+
+	//! Number of samples after the warm-up
+	size_t GetCount() const { return m_Count; }
+
+	double GetMean() const { return m_Mean; }
+	double GetVariance() const;
+	double GetStdDev() const;
+	double GetMin() const { return m_Min; }
+	double GetMax() const { return m_Max; }
+
+	//! Percentile interpolated linearly between the two closest ranks, P in [0, 1]
+	double GetPercentile(double P) const;
+	double GetMedian() const { return GetPercentile(0.5); }
+
+	//! Mean without the outliers, NRejected receives the number of rejected samples of the reservoir
+	double GetRobustMean(double Threshold = 3.0, size_t* NRejected = NULL) const;
+
+	//! Summary in the form of the event-based profiles, the mean is the robust mean
+	SProfileInterval GetProfileInterval() const;
+
+	//! Cumulative distribution function of Student's t-distribution
+	static double GetStudentTCDF(double T, double DegreesOfFreedom);
+
+	//! Inverse of GetStudentTCDF(), P in (0, 1)
+	static double GetStudentTQuantile(double P, double DegreesOfFreedom);
+
+protected:
+	const std::vector<double>& GetSortedSamples() const;
+
+	unsigned int		m_WarmUp;
+	unsigned int		m_Skipped;
+
+	size_t				m_Count;
+	double				m_Mean;
+	double				m_M2;
+	double				m_Min;
+	double				m_Max;
+
+	size_t				m_ReservoirSize;
+	std::vector<double>	m_Reservoir;
+	std::mt19937		m_Random;
+
+	mutable std::vector<double>	m_Sorted;
+	mutable bool				m_SortedValid;
+};
+
+#endif // _CSTATISTICS_H
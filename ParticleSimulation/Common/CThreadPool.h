@@ -0,0 +1,113 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CTHREAD_POOL_H
+#define _CTHREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+//! Small work-stealing thread pool for the CPU reference implementations
+/*!
+	ParallelFor() splits a range into chunks, distributes them over the queues of
+	the worker threads and lets the calling thread help until all chunks are done.
+	Idle workers steal chunks from the front of the other queues.
+
+	In deterministic mode the chunk boundaries only depend on the range and the grain
+	size, not on the number of threads, and ParallelReduce() combines the partial
+	results in chunk order. So floating point results are bit-exact between runs
+	and thread counts. With one thread everything is executed on the calling thread.
+*/
+class CThreadPool
+{
+public:
+	typedef std::function<void(size_t Begin, size_t End)> RangeFunc;
+
+	static CThreadPool& GetSingleton();
+
+	//! Number of threads including the calling thread, 0 uses all hardware threads
+	void SetThreadCount(unsigned int NThreads);
+	unsigned int GetThreadCount() const { return m_NThreads; }
+
+	void SetDeterministic(bool Deterministic) { m_Deterministic = Deterministic; }
+	bool IsDeterministic() const { return m_Deterministic; }
+
+	//! Splits [Begin, End) into chunks of at least Grain elements, Bounds receives the chunk boundaries
+	void GetChunks(size_t Begin, size_t End, size_t Grain, std::vector<size_t>& Bounds) const;
+
+	//! Calls Body(ChunkBegin, ChunkEnd) in parallel for all chunks of [Begin, End)
+	void ParallelFor(size_t Begin, size_t End, const RangeFunc& Body, size_t Grain = 1);
+
+	//! Body(ChunkBegin, ChunkEnd) returns the partial result of a chunk, the partial results are combined in chunk order
+	template<typename T, typename BodyFunc, typename CombineFunc>
+	T ParallelReduce(size_t Begin, size_t End, const T& Identity, BodyFunc Body, CombineFunc Combine, size_t Grain = 1)
+	{
+		std::vector<size_t> bounds;
+		GetChunks(Begin, End, Grain, bounds);
+
+		std::vector<T> partial(bounds.size() - 1, Identity);
+		ParallelFor(0, partial.size(), [&](size_t First, size_t Last) {
+			for(size_t i = First; i < Last; i++)
+				partial[i] = Body(bounds[i], bounds[i + 1]);
+		});
+
+		T result = Identity;
+		for(size_t i = 0; i < partial.size(); i++)
+			result = Combine(result, partial[i]);
+		return result;
+	}
+
+protected:
+	CThreadPool();
+	~CThreadPool();
+
+	struct SWorkerQueue
+	{
+		std::mutex							Mutex;
+		std::deque<std::function<void()> >	Tasks;
+	};
+
+	void Start();
+	void Stop();
+	void WorkerLoop(unsigned int Index);
+
+	//! Runs one task from the own queue (back) or steals one from another queue (front)
+	bool RunOneTask(int OwnQueue);
+
+	std::vector<std::thread>					m_Threads;
+	std::vector<std::unique_ptr<SWorkerQueue> >	m_Queues;
+
+	//! ParallelFor() may be called from several threads (see CTaskGraph), the first one starts the workers
+	std::mutex									m_StartMutex;
+	std::mutex									m_WakeMutex;
+	std::condition_variable						m_Wake;
+	std::atomic<size_t>							m_Pending;
+	bool										m_Stop;
+
+	unsigned int								m_NThreads;
+	bool										m_Deterministic;
+};
+
+#endif // _CTHREAD_POOL_H
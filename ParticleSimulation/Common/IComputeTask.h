@@ -31,6 +31,8 @@
 
 #include "CommonDefs.h"
 
+#include <string>
+
 //! Common interface for the tasks within the assignment.
 /*!
 	Inherit a new class for each computing task.
@@ -56,6 +58,9 @@ public:
 
 	//! Compare the GPU solution to the "golden" solution
 	virtual bool ValidateResults() = 0;
+
+	//! Name of the task in the benchmark results (see CResultsSink)
+	virtual std::string GetName() const { return "ComputeTask"; }
 };
 
 #endif // _ICOMPUTE_TASK_H
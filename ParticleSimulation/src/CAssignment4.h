@@ -27,6 +27,15 @@
 #include "GLCommon.h"
 
 //! Assignment4
+/*!
+	Without a display the simulation can run headless, e.g. on a CPU device of a server node:
+		--headless 0|1								(GPU_HEADLESS, default: 0, plain OpenCL buffers instead of OpenGL interop)
+		--frames <n>								(GPU_FRAMES, default: 1000 simulated frames)
+		--time-step <seconds>						(GPU_TIME_STEP, default: 0.003, fixed time step of each frame)
+
+	The steps per second and the kernel times are reported like the other assignments (see CResultsSink),
+	the run fails if the simulation state is no longer finite in the end.
+*/
 class CAssignment4 : public CAssignmentBase
 {
 public:
@@ -69,6 +78,9 @@ protected:
 
 	virtual void OnIdle();
 
+	//! Steps the simulation with a fixed time step without OpenGL
+	bool RunHeadless();
+
 	virtual void OnWindowResized(GLFWwindow* pWindow, int Width, int Height);
 
 protected:
@@ -21,6 +21,7 @@
 #define _CCLOTH_SIMULATION_TASK_H
 
 #include "../Common/IGUIEnabledComputeTask.h"
+#include "../Common/CLaunchPlan.h"
 
 #include "CTriMesh.h"
 #include "CGLTexture.h"
@@ -49,6 +50,8 @@ public:
 	virtual void ComputeCPU() {};
 	virtual bool ValidateResults() {return false;};
 
+	virtual std::string GetName() const { return "ClothSimulation"; }
+
 	// IGUIEnabledComputeTask
 	virtual void Render();
 
@@ -62,7 +65,16 @@ public:
 
 	virtual void OnWindowResized(int Width, int Height);
 
+	virtual void ProfileKernels(cl_command_queue CommandQueue, size_t LocalWorkSize[3], int NIterations);
+
+	virtual bool ValidateState(cl_command_queue CommandQueue);
+
+	virtual size_t GetProblemSize() const { return size_t(m_ClothResX) * m_ClothResY; }
+
 protected:
+	//! Mesh, texture and shader resources for the rendering, not used in headless mode
+	bool InitGLResources();
+
 	unsigned int			m_ClothResX = 0;
 	unsigned int			m_ClothResY = 0;
 	unsigned int			m_FrameCounter = 0;
@@ -97,6 +109,9 @@ protected:
 	cl_kernel				m_ConstraintKernel = nullptr;
 	cl_kernel				m_CollisionsKernel = nullptr;
 
+	// constraint relaxation, collision and normal passes of a frame
+	CLaunchPlan				m_RelaxationPlan;
+
 	float					m_ElapsedTime = 0.0f;
 	float					m_PrevElapsedTime = 0.0f;
 	float					m_simulationTime = 0.0f;
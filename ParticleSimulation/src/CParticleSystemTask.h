@@ -54,6 +54,8 @@ public:
 	virtual void ComputeCPU() {};
 	virtual bool ValidateResults() {return false;};
 
+	virtual std::string GetName() const { return "ParticleSystem"; }
+
 	// IGUIEnabledComputeTask
 	virtual void Render();
 
@@ -67,7 +69,15 @@ public:
 
 	virtual void OnWindowResized(int Width, int Height);
 
+	virtual void ProfileKernels(cl_command_queue CommandQueue, size_t LocalWorkSize[3], int NIterations);
+
+	virtual bool ValidateState(cl_command_queue CommandQueue);
+
+	virtual size_t GetProblemSize() const { return m_nParticles; }
+
 protected:
+	//! Particle buffers, textures and shaders for the rendering, not used in headless mode
+	bool InitGLResources(const cl_float4* pPosLife, const cl_float4* pVelMass);
 
 	void Scan(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3]);
 	void Integrate(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3], float dT);
@@ -79,6 +89,9 @@ protected:
 	unsigned int		m_nTriangles = 0;
 	unsigned int		m_volumeRes[3];
 
+	// time step of the integration
+	float				m_TimeStep = 0.003f;
+
 	size_t				m_LocalWorkSize[3];
 
 	std::string			m_CollisionMeshPath;
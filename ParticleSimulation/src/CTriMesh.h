@@ -81,6 +81,9 @@ public:
 
 	GLuint GetNormalBuffer() const;
 
+	//returns the positions (w = 1) and normals (w = 0) of the vertices, as they are stored in the vertex and normal buffer
+	void GetVertexData(std::vector<hlsl::float4>& Positions, std::vector<hlsl::float4>& Normals) const;
+
 	//void SetTransform(const float4x4& Matrix);
 
 	//const float4x4* GetTransform() const;
@@ -0,0 +1,59 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CCOMMAND_LINE_H
+#define _CCOMMAND_LINE_H
+
+#include <string>
+#include <map>
+
+//! Minimal parser for the command line options of the assignments
+/*!
+	Accepts options in the forms "--name value", "--name=value" and "--flag".
+	An option is only followed by a separate value if the next argument does not start with "--".
+
+	All getters can fall back to an environment variable, so batch jobs can configure
+	the assignments without touching the command line.
+*/
+class CCommandLine
+{
+public:
+	CCommandLine() {};
+
+	~CCommandLine() {};
+
+	void Parse(int argc, char** argv);
+
+	//! Returns true if the option was given on the command line or the environment variable EnvName is set
+	bool HasOption(const std::string& Name, const char* EnvName = nullptr) const;
+
+	//! Returns the value of the option, falling back to the environment variable EnvName and then to Default
+	std::string GetString(const std::string& Name, const std::string& Default = "", const char* EnvName = nullptr) const;
+
+	int GetInt(const std::string& Name, int Default, const char* EnvName = nullptr) const;
+
+	double GetDouble(const std::string& Name, double Default, const char* EnvName = nullptr) const;
+
+protected:
+	bool Lookup(const std::string& Name, const char* EnvName, std::string& Value) const;
+
+	std::map<std::string, std::string>	m_Options;
+};
+
+#endif // _CCOMMAND_LINE_H
@@ -0,0 +1,309 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CHostBuffer.h"
+#include "CBufferPool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+// CL_MEM_USE_HOST_PTR memory can only be used in place if it is page aligned and its size a multiple of a cache line
+static const size_t ZERO_COPY_ALIGNMENT = 4096;
+static const size_t ZERO_COPY_SIZE_GRANULARITY = 64;
+
+static EHostMemoryMode s_DefaultMode = HOST_MEMORY_PAGEABLE;
+static cl_command_queue s_DefaultCommandQueue = NULL;
+
+// CL_DEVICE_MEM_BASE_ADDR_ALIGN of the device of the queue in bytes, at least a page
+static size_t GetZeroCopyAlignment(cl_command_queue CommandQueue)
+{
+	cl_device_id device = NULL;
+	cl_uint alignBits = 0;
+	if(clGetCommandQueueInfo(CommandQueue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL) == CL_SUCCESS)
+		clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(alignBits), &alignBits, NULL);
+	return max(ZERO_COPY_ALIGNMENT, size_t(alignBits / 8));
+}
+
+static void* AllocateAligned(size_t Size, size_t Alignment)
+{
+#ifdef _WIN32
+	return _aligned_malloc(Size, Alignment);
+#else
+	void* p = NULL;
+	if(posix_memalign(&p, Alignment, Size) != 0)
+		return NULL;
+	return p;
+#endif
+}
+
+static void FreeAligned(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CHostBuffer
+
+CHostBuffer::CHostBuffer()
+	: m_Mode(HOST_MEMORY_PAGEABLE), m_Size(0), m_CommandQueue(NULL), m_MemObject(NULL),
+	m_pAllocation(NULL), m_pMapped(NULL)
+{
+}
+
+CHostBuffer::~CHostBuffer()
+{
+	Release();
+}
+
+bool CHostBuffer::Allocate(cl_context Context, cl_command_queue CommandQueue, size_t Size, EHostMemoryMode Mode)
+{
+	Release();
+
+	if(CommandQueue == NULL)
+		CommandQueue = s_DefaultCommandQueue;
+	if(CommandQueue == NULL && Mode != HOST_MEMORY_PAGEABLE)
+	{
+		cerr<<"Error: mapped host memory requires a command queue."<<endl;
+		return false;
+	}
+
+	m_Mode = Mode;
+	m_Size = Size;
+	m_CommandQueue = CommandQueue;
+
+	// allocations are never empty, so the pointers are valid for Size == 0 as well
+	size_t allocSize = max<size_t>(Size, 1);
+	cl_int clError = CL_SUCCESS;
+
+	switch(Mode)
+	{
+	case HOST_MEMORY_PAGEABLE:
+		m_pAllocation = AllocateAligned(allocSize, 64);
+		m_pMapped = m_pAllocation;
+		break;
+
+	case HOST_MEMORY_PINNED:
+		m_MemObject = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, allocSize, NULL, &clError);
+		V_RETURN_FALSE_CL(clError, "Error allocating pinned host memory");
+		m_pMapped = clEnqueueMapBuffer(CommandQueue, m_MemObject, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, allocSize, 0, NULL, NULL, &clError);
+		V_RETURN_FALSE_CL(clError, "Error mapping pinned host memory");
+		break;
+
+	case HOST_MEMORY_ZERO_COPY:
+		allocSize = (allocSize + ZERO_COPY_SIZE_GRANULARITY - 1) / ZERO_COPY_SIZE_GRANULARITY * ZERO_COPY_SIZE_GRANULARITY;
+		m_pAllocation = AllocateAligned(allocSize, GetZeroCopyAlignment(CommandQueue));
+		if(m_pAllocation == NULL)
+			break;
+		m_MemObject = clCreateBuffer(Context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, allocSize, m_pAllocation, &clError);
+		V_RETURN_FALSE_CL(clError, "Error wrapping zero-copy host memory");
+		break;
+
+	default:
+		cerr<<"Error: invalid host memory mode."<<endl;
+		return false;
+	}
+
+	if(m_pAllocation == NULL && m_MemObject == NULL)
+	{
+		cerr<<"Error: could not allocate "<<Size<<" bytes of host memory."<<endl;
+		return false;
+	}
+
+	return true;
+}
+
+void CHostBuffer::Release()
+{
+	if(m_MemObject != NULL && m_pMapped != NULL)
+	{
+		clEnqueueUnmapMemObject(m_CommandQueue, m_MemObject, m_pMapped, 0, NULL, NULL);
+		clFinish(m_CommandQueue);
+	}
+	m_pMapped = NULL;
+
+	SAFE_RELEASE_MEMOBJECT(m_MemObject);
+
+	if(m_pAllocation != NULL)
+	{
+		FreeAligned(m_pAllocation);
+		m_pAllocation = NULL;
+	}
+
+	m_Size = 0;
+	m_CommandQueue = NULL;
+}
+
+void* CHostBuffer::Map(cl_map_flags Flags, cl_command_queue CommandQueue)
+{
+	if(m_Mode != HOST_MEMORY_ZERO_COPY || m_pMapped != NULL || m_MemObject == NULL)
+		return m_pMapped;
+
+	cl_int clError;
+	m_pMapped = clEnqueueMapBuffer(CommandQueue ? CommandQueue : m_CommandQueue, m_MemObject, CL_TRUE, Flags, 0, max<size_t>(m_Size, 1), 0, NULL, NULL, &clError);
+	if(clError != CL_SUCCESS)
+	{
+		cerr<<"Error mapping zero-copy host memory ["<<CLUtil::GetCLErrorString(clError)<<"]"<<endl;
+		m_pMapped = NULL;
+	}
+	return m_pMapped;
+}
+
+cl_int CHostBuffer::Unmap(cl_command_queue CommandQueue)
+{
+	if(m_Mode != HOST_MEMORY_ZERO_COPY || m_pMapped == NULL)
+		return CL_SUCCESS;
+
+	cl_int clError = clEnqueueUnmapMemObject(CommandQueue ? CommandQueue : m_CommandQueue, m_MemObject, m_pMapped, 0, NULL, NULL);
+	m_pMapped = NULL;
+	return clError;
+}
+
+cl_int CHostBuffer::EnqueueWrite(cl_command_queue CommandQueue, cl_mem DeviceBuffer, size_t Offset, size_t Size,
+	cl_bool Blocking, cl_event* Event)
+{
+	if(m_Mode == HOST_MEMORY_ZERO_COPY)
+	{
+		cl_int clError = clEnqueueCopyBuffer(CommandQueue, m_MemObject, DeviceBuffer, Offset, Offset, Size, 0, NULL, Event);
+		if(clError == CL_SUCCESS && Blocking)
+			clError = clFinish(CommandQueue);
+		return clError;
+	}
+
+	return clEnqueueWriteBuffer(CommandQueue, DeviceBuffer, Blocking, Offset, Size, static_cast<char*>(m_pMapped) + Offset, 0, NULL, Event);
+}
+
+cl_int CHostBuffer::EnqueueRead(cl_command_queue CommandQueue, cl_mem DeviceBuffer, size_t Offset, size_t Size,
+	cl_bool Blocking, cl_event* Event)
+{
+	if(m_Mode == HOST_MEMORY_ZERO_COPY)
+	{
+		cl_int clError = clEnqueueCopyBuffer(CommandQueue, DeviceBuffer, m_MemObject, Offset, Offset, Size, 0, NULL, Event);
+		if(clError == CL_SUCCESS && Blocking)
+			clError = clFinish(CommandQueue);
+		return clError;
+	}
+
+	return clEnqueueReadBuffer(CommandQueue, DeviceBuffer, Blocking, Offset, Size, static_cast<char*>(m_pMapped) + Offset, 0, NULL, Event);
+}
+
+const char* CHostBuffer::GetModeName(EHostMemoryMode Mode)
+{
+	switch(Mode)
+	{
+	case HOST_MEMORY_PAGEABLE:	return "pageable";
+	case HOST_MEMORY_PINNED:	return "pinned";
+	case HOST_MEMORY_ZERO_COPY:	return "zerocopy";
+	default:					return "unknown";
+	}
+}
+
+bool CHostBuffer::ParseMode(const std::string& Name, EHostMemoryMode& Mode)
+{
+	for(int i = 0; i < HOST_MEMORY_MODE_COUNT; i++)
+	{
+		if(Name == GetModeName(EHostMemoryMode(i)))
+		{
+			Mode = EHostMemoryMode(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void CHostBuffer::SetDefaultMode(EHostMemoryMode Mode)
+{
+	s_DefaultMode = Mode;
+}
+
+EHostMemoryMode CHostBuffer::GetDefaultMode()
+{
+	return s_DefaultMode;
+}
+
+void CHostBuffer::SetDefaultCommandQueue(cl_command_queue CommandQueue)
+{
+	s_DefaultCommandQueue = CommandQueue;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CMirroredBuffer
+
+CMirroredBuffer::CMirroredBuffer()
+	: m_DeviceBuffer(NULL)
+{
+}
+
+CMirroredBuffer::~CMirroredBuffer()
+{
+	Release();
+}
+
+bool CMirroredBuffer::Allocate(cl_context Context, size_t Size, cl_mem_flags Flags)
+{
+	return Allocate(Context, Size, Flags, CHostBuffer::GetDefaultMode());
+}
+
+bool CMirroredBuffer::Allocate(cl_context Context, size_t Size, cl_mem_flags Flags, EHostMemoryMode Mode)
+{
+	Release();
+
+	if(!m_Host.Allocate(Context, NULL, Size, Mode))
+		return false;
+
+	if(Mode == HOST_MEMORY_ZERO_COPY)
+	{
+		// the kernels use the host memory directly
+		m_DeviceBuffer = m_Host.GetMemObject();
+		clRetainMemObject(m_DeviceBuffer);
+	}
+	else
+	{
+		cl_int clError;
+		m_DeviceBuffer = CBufferPool::GetSingleton().Acquire(Context, Flags, Size, &clError);
+		V_RETURN_FALSE_CL(clError, "Error allocating device buffer");
+	}
+
+	// the task fills in its input first, outputs stay with the device
+	if(Flags & CL_MEM_WRITE_ONLY)
+		return m_Host.Unmap() == CL_SUCCESS;
+	return m_Host.Map() != NULL;
+}
+
+void CMirroredBuffer::Release()
+{
+	m_Host.Release();
+	// the zero-copy buffer is not pooled, the pool simply releases it
+	SAFE_RELEASE_POOLED(m_DeviceBuffer);
+}
+
+cl_int CMirroredBuffer::Upload(cl_command_queue CommandQueue, cl_bool Blocking)
+{
+	if(m_Host.GetMode() == HOST_MEMORY_ZERO_COPY)
+	{
+		cl_int clError = m_Host.Unmap(CommandQueue);
+		if(clError == CL_SUCCESS && Blocking)
+			clError = clFinish(CommandQueue);
+		return clError;
+	}
+
+	return m_Host.EnqueueWrite(CommandQueue, m_DeviceBuffer, 0, m_Host.GetSize(), Blocking);
+}
+
+cl_int CMirroredBuffer::Download(cl_command_queue CommandQueue, cl_bool Blocking)
+{
+	// mapping is always blocking
+	if(m_Host.GetMode() == HOST_MEMORY_ZERO_COPY)
+		return m_Host.Map(CL_MAP_READ | CL_MAP_WRITE, CommandQueue) != NULL ? CL_SUCCESS : CL_MAP_FAILURE;
+
+	return m_Host.EnqueueRead(CommandQueue, m_DeviceBuffer, 0, m_Host.GetSize(), Blocking);
+}
+
+///////////////////////////////////////////////////////////////////////////////
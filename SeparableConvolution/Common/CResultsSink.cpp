@@ -0,0 +1,266 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CResultsSink.h"
+#include "CStatistics.h"
+
+#include <iostream>
+#include <sstream>
+#include <ctime>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// SBenchmarkResult
+
+SBenchmarkResult::SBenchmarkResult()
+	: ProblemSize(0), Iterations(0), MeanMs(-1.0), MinMs(-1.0), MedianMs(-1.0), P95Ms(-1.0), MaxMs(-1.0), BytesMoved(0.0),
+	Flops(0.0), RooflinePercent(-1.0)
+{
+	LocalWorkSize[0] = LocalWorkSize[1] = LocalWorkSize[2] = 0;
+}
+
+SBenchmarkResult::SBenchmarkResult(const std::string& Variant, size_t ProblemSize, int Iterations, double MeanMs, double BytesMoved, double Flops)
+	: Variant(Variant), ProblemSize(ProblemSize), Iterations(Iterations), MeanMs(MeanMs),
+	MinMs(-1.0), MedianMs(-1.0), P95Ms(-1.0), MaxMs(-1.0), BytesMoved(BytesMoved), Flops(Flops), RooflinePercent(-1.0)
+{
+	LocalWorkSize[0] = LocalWorkSize[1] = LocalWorkSize[2] = 0;
+}
+
+SBenchmarkResult::SBenchmarkResult(const std::string& Variant, size_t ProblemSize, const SKernelProfile& Profile, double BytesMoved, double Flops)
+	: Variant(Variant), ProblemSize(ProblemSize), Iterations(Profile.NIterations), MeanMs(Profile.StartToEnd.Mean),
+	MinMs(Profile.StartToEnd.Min), MedianMs(Profile.StartToEnd.Median), P95Ms(Profile.StartToEnd.P95), MaxMs(Profile.StartToEnd.Max),
+	BytesMoved(BytesMoved), Flops(Flops), RooflinePercent(-1.0)
+{
+	LocalWorkSize[0] = LocalWorkSize[1] = LocalWorkSize[2] = 0;
+
+	// a host-timed batch only has an average
+	if(Profile.HostTimed)
+		MinMs = MedianMs = P95Ms = MaxMs = -1.0;
+}
+
+SBenchmarkResult::SBenchmarkResult(const std::string& Variant, size_t ProblemSize, const CStatistics& Statistics, double BytesMoved, double Flops)
+	: Variant(Variant), ProblemSize(ProblemSize), Iterations(int(Statistics.GetCount())), MeanMs(Statistics.GetRobustMean()),
+	MinMs(Statistics.GetMin()), MedianMs(Statistics.GetMedian()), P95Ms(Statistics.GetPercentile(0.95)), MaxMs(Statistics.GetMax()),
+	BytesMoved(BytesMoved), Flops(Flops), RooflinePercent(-1.0)
+{
+	LocalWorkSize[0] = LocalWorkSize[1] = LocalWorkSize[2] = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CResultsSink
+
+static string EscapeJSON(const string& Str)
+{
+	stringstream out;
+	for(size_t i = 0; i < Str.size(); i++)
+	{
+		char c = Str[i];
+		if(c == '"' || c == '\\')
+			out << '\\' << c;
+		else if((unsigned char)c < 0x20)
+			out << ' ';
+		else
+			out << c;
+	}
+	return out.str();
+}
+
+static string EscapeCSV(const string& Str)
+{
+	if(Str.find_first_of(",\"\n") == string::npos)
+		return Str;
+
+	string escaped = "\"";
+	for(size_t i = 0; i < Str.size(); i++)
+	{
+		if(Str[i] == '"')
+			escaped += '"';
+		escaped += Str[i];
+	}
+	return escaped + "\"";
+}
+
+// the task bound to the thread and the last task it finished
+static thread_local unsigned int s_BoundTask = 0;
+static thread_local vector<SBenchmarkResult> s_LastResults;
+static thread_local bool s_LastValid = false;
+
+CResultsSink& CResultsSink::GetSingleton()
+{
+	static CResultsSink s_Instance;
+	return s_Instance;
+}
+
+CResultsSink::CResultsSink()
+	: m_CSV(false), m_NextTaskId(1)
+{
+}
+
+CResultsSink::~CResultsSink()
+{
+	Close();
+}
+
+bool CResultsSink::Open(const std::string& Path, const std::string& Format)
+{
+	Close();
+
+	if(Format.empty())
+		m_CSV = Path.size() >= 4 && Path.compare(Path.size() - 4, 4, ".csv") == 0;
+	else
+		m_CSV = (Format == "csv");
+
+	// only write the CSV header into new files
+	bool writeHeader = false;
+	if(m_CSV)
+	{
+		ifstream existing(Path.c_str());
+		writeHeader = !existing.good() || existing.peek() == ifstream::traits_type::eof();
+	}
+
+	m_File.open(Path.c_str(), ios::out | ios::app);
+	if(!m_File.is_open())
+	{
+		cerr << "Error: cannot open the results file '" << Path << "'." << endl;
+		return false;
+	}
+
+	if(writeHeader)
+	{
+		m_File << "timestamp,task,variant,device,problem_size,lws_x,lws_y,lws_z,iterations,"
+			<< "mean_ms,min_ms,median_ms,p95_ms,max_ms,bytes,gbytes_per_s,flops,gflops_per_s,roofline_pct,valid" << endl;
+	}
+
+	return true;
+}
+
+void CResultsSink::Close()
+{
+	if(m_File.is_open())
+		m_File.close();
+}
+
+unsigned int CResultsSink::BeginTask(const std::string& TaskName, const std::string& DeviceName, const size_t LocalWorkSize[3])
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	s_BoundTask = m_NextTaskId++;
+	STask& task = m_Tasks[s_BoundTask];
+	task.TaskName = TaskName;
+	task.DeviceName = DeviceName;
+	for(int i = 0; i < 3; i++)
+		task.LocalWorkSize[i] = LocalWorkSize ? LocalWorkSize[i] : 0;
+
+	return s_BoundTask;
+}
+
+void CResultsSink::BindTask(unsigned int TaskId)
+{
+	s_BoundTask = TaskId;
+}
+
+void CResultsSink::Add(const SBenchmarkResult& Result)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	map<unsigned int, STask>::iterator it = m_Tasks.find(s_BoundTask);
+	if(it == m_Tasks.end())
+		return;
+	STask& task = it->second;
+	task.Pending.push_back(Result);
+
+	SBenchmarkResult& added = task.Pending.back();
+	if(added.LocalWorkSize[0] == 0)
+	{
+		for(int i = 0; i < 3; i++)
+			added.LocalWorkSize[i] = task.LocalWorkSize[i];
+	}
+}
+
+void CResultsSink::EndTask(bool Valid)
+{
+	lock_guard<mutex> lock(m_Mutex);
+
+	s_LastResults.clear();
+	s_LastValid = Valid;
+
+	map<unsigned int, STask>::iterator it = m_Tasks.find(s_BoundTask);
+	s_BoundTask = 0;
+	if(it == m_Tasks.end())
+		return;
+	STask& task = it->second;
+
+	if(m_File.is_open())
+	{
+		for(size_t i = 0; i < task.Pending.size(); i++)
+		{
+			if(m_CSV)
+				WriteCSV(task, task.Pending[i], Valid);
+			else
+				WriteJSON(task, task.Pending[i], Valid);
+		}
+		m_File.flush();
+	}
+
+	s_LastResults.swap(task.Pending);
+	m_Tasks.erase(it);
+}
+
+const std::vector<SBenchmarkResult>& CResultsSink::GetLastTaskResults() const
+{
+	return s_LastResults;
+}
+
+bool CResultsSink::WasLastTaskValid() const
+{
+	return s_LastValid;
+}
+
+void CResultsSink::WriteJSON(const STask& Task, const SBenchmarkResult& Result, bool Valid)
+{
+	double bandwidth = Result.MeanMs > 0.0 ? 1.0e-6 * Result.BytesMoved / Result.MeanMs : 0.0;
+	double gflops = Result.MeanMs > 0.0 ? 1.0e-6 * Result.Flops / Result.MeanMs : 0.0;
+
+	m_File << "{\"timestamp\":" << (long long)time(NULL)
+		<< ",\"task\":\"" << EscapeJSON(Task.TaskName) << "\""
+		<< ",\"variant\":\"" << EscapeJSON(Result.Variant) << "\""
+		<< ",\"device\":\"" << EscapeJSON(Task.DeviceName) << "\""
+		<< ",\"problem_size\":" << Result.ProblemSize
+		<< ",\"local_work_size\":[" << Result.LocalWorkSize[0] << "," << Result.LocalWorkSize[1] << "," << Result.LocalWorkSize[2] << "]"
+		<< ",\"iterations\":" << Result.Iterations
+		<< ",\"mean_ms\":" << Result.MeanMs
+		<< ",\"min_ms\":" << Result.MinMs
+		<< ",\"median_ms\":" << Result.MedianMs
+		<< ",\"p95_ms\":" << Result.P95Ms
+		<< ",\"max_ms\":" << Result.MaxMs
+		<< ",\"bytes\":" << Result.BytesMoved
+		<< ",\"gbytes_per_s\":" << bandwidth
+		<< ",\"flops\":" << Result.Flops
+		<< ",\"gflops_per_s\":" << gflops
+		<< ",\"roofline_pct\":" << Result.RooflinePercent
+		<< ",\"valid\":" << (Valid ? "true" : "false")
+		<< "}" << endl;
+}
+
+void CResultsSink::WriteCSV(const STask& Task, const SBenchmarkResult& Result, bool Valid)
+{
+	double bandwidth = Result.MeanMs > 0.0 ? 1.0e-6 * Result.BytesMoved / Result.MeanMs : 0.0;
+	double gflops = Result.MeanMs > 0.0 ? 1.0e-6 * Result.Flops / Result.MeanMs : 0.0;
+
+	m_File << (long long)time(NULL) << ","
+		<< EscapeCSV(Task.TaskName) << ","
+		<< EscapeCSV(Result.Variant) << ","
+		<< EscapeCSV(Task.DeviceName) << ","
+		<< Result.ProblemSize << ","
+		<< Result.LocalWorkSize[0] << "," << Result.LocalWorkSize[1] << "," << Result.LocalWorkSize[2] << ","
+		<< Result.Iterations << ","
+		<< Result.MeanMs << "," << Result.MinMs << "," << Result.MedianMs << "," << Result.P95Ms << "," << Result.MaxMs << ","
+		<< Result.BytesMoved << "," << bandwidth << ","
+		<< Result.Flops << "," << gflops << "," << Result.RooflinePercent << ","
+		<< (Valid ? 1 : 0) << endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
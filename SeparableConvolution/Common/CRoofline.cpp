@@ -0,0 +1,185 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CRoofline.h"
+#include "CKernelLibrary.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+
+CRoofline& CRoofline::GetSingleton()
+{
+	static CRoofline s_Instance;
+	return s_Instance;
+}
+
+CRoofline::CRoofline()
+	: m_Current(nullptr)
+{
+}
+
+// Median kernel time in ms, from the device timestamps if the queue supports them
+static double TimeKernel(cl_command_queue CommandQueue, cl_kernel Kernel, const size_t* Global, const size_t* Local, int NIterations)
+{
+	SKernelProfile profile;
+	if(CLUtil::ProfileKernelEvents(CommandQueue, Kernel, 1, Global, Local, NIterations, profile))
+		return profile.StartToEnd.Median;
+	return CLUtil::ProfileKernel(CommandQueue, Kernel, 1, Global, Local, NIterations);
+}
+
+bool CRoofline::Measure(cl_device_id Device, cl_context Context, cl_command_queue CommandQueue)
+{
+	map<cl_device_id, SRooflinePeaks>::iterator it = m_Peaks.find(Device);
+	if(it != m_Peaks.end())
+	{
+		m_Current = &it->second;
+		return true;
+	}
+	m_Current = nullptr;
+
+	SRooflinePeaks peaks;
+	peaks.BandwidthGBs = 0.0;
+	peaks.GFlops = 0.0;
+
+	char name[256] = {0};
+	clGetDeviceInfo(Device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+	peaks.DeviceName = name;
+
+	size_t maxGroupSize = 256;
+	cl_ulong maxAlloc = 0;
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxGroupSize), &maxGroupSize, NULL);
+	clGetDeviceInfo(Device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, NULL);
+
+	cl_program program = CKernelLibrary::GetSingleton().Build(Device, Context, "Roofline.cl");
+	if(program == nullptr)
+		return false;
+
+	cl_int clError = CL_SUCCESS, clError2 = CL_SUCCESS;
+	cl_kernel copyKernel = clCreateKernel(program, "Roofline_Copy", &clError);
+	cl_kernel fmaKernel = clCreateKernel(program, "Roofline_FMA", &clError2);
+	clError = clError != CL_SUCCESS ? clError : clError2;
+	clReleaseProgram(program);
+
+	// large enough to leave the caches, small enough for any device
+	size_t bufferSize = size_t(min<cl_ulong>(64 << 20, maxAlloc / 2)) & ~size_t(15);
+	cl_uint n = cl_uint(bufferSize / (4 * sizeof(float)));
+	size_t local = min<size_t>(256, maxGroupSize);
+	size_t nFMA = size_t(1) << 19;
+	size_t globalCopy = CLUtil::GetGlobalWorkSize(n, local);
+	size_t globalFMA = CLUtil::GetGlobalWorkSize(nFMA, local);
+
+	cl_mem in = nullptr, out = nullptr, fmaOut = nullptr;
+	if(clError == CL_SUCCESS && copyKernel && fmaKernel)
+	{
+		in = clCreateBuffer(Context, CL_MEM_READ_WRITE, bufferSize, NULL, &clError);
+		out = clCreateBuffer(Context, CL_MEM_READ_WRITE, bufferSize, NULL, &clError2);
+		clError = clError != CL_SUCCESS ? clError : clError2;
+		fmaOut = clCreateBuffer(Context, CL_MEM_WRITE_ONLY, globalFMA * sizeof(float), NULL, &clError2);
+		clError = clError != CL_SUCCESS ? clError : clError2;
+	}
+
+	if(clError == CL_SUCCESS && copyKernel && fmaKernel)
+	{
+		// values close to a fixed point of x = a*x + b, so the chains neither overflow nor become denormal
+		cl_float a = 0.999f, b = 0.001f;
+		clError = clSetKernelArg(copyKernel, 0, sizeof(cl_mem), &in);
+		clError |= clSetKernelArg(copyKernel, 1, sizeof(cl_mem), &out);
+		clError |= clSetKernelArg(copyKernel, 2, sizeof(cl_uint), &n);
+		clError |= clSetKernelArg(fmaKernel, 0, sizeof(cl_mem), &fmaOut);
+		clError |= clSetKernelArg(fmaKernel, 1, sizeof(cl_float), &a);
+		clError |= clSetKernelArg(fmaKernel, 2, sizeof(cl_float), &b);
+	}
+
+	if(clError == CL_SUCCESS && copyKernel && fmaKernel)
+	{
+		// the buffer is read and written once
+		double copyMs = TimeKernel(CommandQueue, copyKernel, &globalCopy, &local, 20);
+		double fmaMs = TimeKernel(CommandQueue, fmaKernel, &globalFMA, &local, 20);
+
+		if(copyMs > 0.0)
+			peaks.BandwidthGBs = 1.0e-6 * 2.0 * double(n) * 4 * sizeof(float) / copyMs;
+		if(fmaMs > 0.0)
+			peaks.GFlops = 1.0e-6 * 8192.0 * double(globalFMA) / fmaMs;
+	}
+
+	SAFE_RELEASE_MEMOBJECT(in);
+	SAFE_RELEASE_MEMOBJECT(out);
+	SAFE_RELEASE_MEMOBJECT(fmaOut);
+	SAFE_RELEASE_KERNEL(copyKernel);
+	SAFE_RELEASE_KERNEL(fmaKernel);
+
+	if(peaks.BandwidthGBs <= 0.0 || peaks.GFlops <= 0.0)
+	{
+		cerr << "Warning: could not measure the roofline peaks of the device";
+		if(clError != CL_SUCCESS)
+			cerr << " [" << CLUtil::GetCLErrorString(clError) << "]";
+		cerr << "." << endl;
+		return false;
+	}
+
+	m_Current = &(m_Peaks[Device] = peaks);
+
+	ios::fmtflags flags = cout.flags();
+	streamsize precision = cout.precision();
+	cout << "Roofline of " << peaks.DeviceName << ": copy bandwidth " << fixed << setprecision(1) << peaks.BandwidthGBs
+		<< " GB/s, FMA rate " << peaks.GFlops << " GFLOP/s, ridge point " << setprecision(2) << peaks.GetRidgePoint()
+		<< " FLOP/byte" << endl << endl;
+	cout.flags(flags);
+	cout.precision(precision);
+	return true;
+}
+
+void CRoofline::SetDevice(cl_device_id Device)
+{
+	map<cl_device_id, SRooflinePeaks>::const_iterator it = m_Peaks.find(Device);
+	m_Current = it != m_Peaks.end() ? &it->second : nullptr;
+}
+
+void CRoofline::Report(SBenchmarkResult& Result) const
+{
+	if(m_Current == nullptr || Result.MeanMs <= 0.0 || (Result.BytesMoved <= 0.0 && Result.Flops <= 0.0))
+		return;
+
+	double achievedGBs = 1.0e-6 * Result.BytesMoved / Result.MeanMs;
+	double achievedGFlops = 1.0e-6 * Result.Flops / Result.MeanMs;
+
+	// the attainable rate at the arithmetic intensity of the kernel
+	double percent;
+	bool memoryBound = true;
+	if(Result.Flops > 0.0 && Result.BytesMoved > 0.0)
+	{
+		double intensity = Result.Flops / Result.BytesMoved;
+		memoryBound = intensity < m_Current->GetRidgePoint();
+		double attainable = min(m_Current->GFlops, intensity * m_Current->BandwidthGBs);
+		percent = 100.0 * achievedGFlops / attainable;
+	}
+	else if(Result.Flops > 0.0)
+	{
+		memoryBound = false;
+		percent = 100.0 * achievedGFlops / m_Current->GFlops;
+	}
+	else
+		percent = 100.0 * achievedGBs / m_Current->BandwidthGBs;
+
+	Result.RooflinePercent = percent;
+
+	ios::fmtflags flags = cout.flags();
+	streamsize precision = cout.precision();
+	cout << "  roofline (" << Result.Variant << "): " << fixed << setprecision(1) << achievedGBs << " GB/s ("
+		<< 100.0 * achievedGBs / m_Current->BandwidthGBs << "% of copy)";
+	if(Result.Flops > 0.0)
+		cout << ", " << achievedGFlops << " GFLOP/s";
+	if(Result.Flops > 0.0 && Result.BytesMoved > 0.0)
+		cout << ", " << setprecision(3) << Result.Flops / Result.BytesMoved << " FLOP/byte" << setprecision(1);
+	cout << ", " << percent << "% of roofline (" << (memoryBound ? "memory" : "compute") << " bound)"
+		<< endl;
+	cout.flags(flags);
+	cout.precision(precision);
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,128 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CStreamPipeline.h"
+#include "CTimer.h"
+#include "CTracer.h"
+
+using namespace std;
+
+static vector<cl_command_queue> s_CommandQueues;
+
+///////////////////////////////////////////////////////////////////////////////
+// CStreamPipeline
+
+void CStreamPipeline::SetCommandQueues(const std::vector<cl_command_queue>& CommandQueues)
+{
+	s_CommandQueues = CommandQueues;
+}
+
+std::vector<cl_command_queue> CStreamPipeline::GetCommandQueues(cl_command_queue DefaultQueue)
+{
+	if(s_CommandQueues.empty())
+		return vector<cl_command_queue>(1, DefaultQueue);
+	return s_CommandQueues;
+}
+
+CStreamPipeline::CStreamPipeline(unsigned int NSlots)
+	: m_NSlots(max(NSlots, 1u))
+{
+}
+
+void CStreamPipeline::SetStages(const StageFunc& Upload, const StageFunc& Compute, const StageFunc& Download)
+{
+	m_Upload = Upload;
+	m_Compute = Compute;
+	m_Download = Download;
+}
+
+double CStreamPipeline::Run(const std::vector<cl_command_queue>& CommandQueues, size_t Size, size_t SliceSize)
+{
+	if(CommandQueues.empty() || SliceSize == 0)
+		return -1.0;
+
+	// stage s runs on queue s % n: upload, compute and download queue for three queues
+	size_t nQueues = CommandQueues.size();
+	cl_command_queue uploadQueue = CommandQueues[0];
+	cl_command_queue computeQueue = CommandQueues[1 % nQueues];
+	cl_command_queue downloadQueue = CommandQueues[2 % nQueues];
+
+	size_t nSlices = (Size + SliceSize - 1) / SliceSize;
+	vector<cl_event> uploaded(nSlices, (cl_event)NULL), computed(nSlices, (cl_event)NULL), downloaded(nSlices, (cl_event)NULL);
+
+	cl_int clError = CL_SUCCESS;
+	for(size_t i = 0; i < nQueues && clError == CL_SUCCESS; i++)
+		clError = clFinish(CommandQueues[i]);
+
+	CTracer& tracer = CTracer::GetSingleton();
+	CTraceZone zone("Pipeline");
+	double enqueueUs = tracer.Now();
+
+	CTimer timer;
+	timer.Start();
+
+	for(size_t k = 0; k < nSlices && clError == CL_SUCCESS; k++)
+	{
+		SPipelineSlice slice;
+		slice.Index = k;
+		slice.Begin = k * SliceSize;
+		slice.End = min(Size, slice.Begin + SliceSize);
+		slice.Slot = (unsigned int)(k % m_NSlots);
+
+		// the slot is free once its previous slice was downloaded
+		bool slotBusy = k >= m_NSlots;
+		clError = m_Upload(uploadQueue, slice, slotBusy ? 1 : 0, slotBusy ? &downloaded[k - m_NSlots] : NULL, &uploaded[k]);
+		if(clError == CL_SUCCESS)
+			clError = m_Compute(computeQueue, slice, 1, &uploaded[k], &computed[k]);
+		if(clError == CL_SUCCESS)
+			clError = m_Download(downloadQueue, slice, 1, &computed[k], &downloaded[k]);
+
+		// the commands wait on events of the other queues, which have to be flushed (this also starts the first slices early)
+		for(size_t i = 0; i < nQueues && clError == CL_SUCCESS; i++)
+			clError = clFlush(CommandQueues[i]);
+	}
+
+	// all queues are flushed before the first one is finished, so no queue waits on commands that were never submitted
+	for(size_t i = 0; i < nQueues; i++)
+	{
+		cl_int flushError = clFlush(CommandQueues[i]);
+		if(clError == CL_SUCCESS)
+			clError = flushError;
+	}
+	for(size_t i = 0; i < nQueues; i++)
+	{
+		cl_int finishError = clFinish(CommandQueues[i]);
+		if(clError == CL_SUCCESS)
+			clError = finishError;
+	}
+
+	timer.Stop();
+
+	// the slices show up on the tracks of the three queues
+	if(nSlices > 0)
+		tracer.Calibrate(uploaded[0], enqueueUs);
+	for(size_t k = 0; k < nSlices && clError == CL_SUCCESS; k++)
+	{
+		tracer.AddDeviceCommand("Upload", uploadQueue, uploaded[k]);
+		tracer.AddDeviceCommand("Compute", computeQueue, computed[k]);
+		tracer.AddDeviceCommand("Download", downloadQueue, downloaded[k]);
+	}
+
+	for(size_t k = 0; k < nSlices; k++)
+	{
+		if(uploaded[k]) clReleaseEvent(uploaded[k]);
+		if(computed[k]) clReleaseEvent(computed[k]);
+		if(downloaded[k]) clReleaseEvent(downloaded[k]);
+	}
+
+	if(clError != CL_SUCCESS)
+	{
+		cerr<<"Error executing the pipeline ["<<CLUtil::GetCLErrorString(clError)<<"]"<<endl;
+		return -1.0;
+	}
+	return timer.GetElapsedMilliseconds();
+}
+
+///////////////////////////////////////////////////////////////////////////////
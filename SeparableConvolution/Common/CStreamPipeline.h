@@ -0,0 +1,85 @@
+/******************************************************************************
+                         .88888.   888888ba  dP     dP 
+                        d8'   `88  88    `8b 88     88 
+                        88        a88aaaa8P' 88     88 
+                        88   YP88  88        88     88 
+                        Y8.   .88  88        Y8.   .8P 
+                         `88888'   dP        `Y88888P' 
+                                                       
+                                                       
+   a88888b.                                         dP   oo                   
+  d8'   `88                                         88                        
+  88        .d8888b. 88d8b.d8b. 88d888b. dP    dP d8888P dP 88d888b. .d8888b. 
+  88        88'  `88 88'`88'`88 88'  `88 88    88   88   88 88'  `88 88'  `88 
+  Y8.   .88 88.  .88 88  88  88 88.  .88 88.  .88   88   88 88    88 88.  .88 
+   Y88888P' `88888P' dP  dP  dP 88Y888P' `88888P'   dP   dP dP    dP `8888P88 
+                                88                                        .88 
+                                dP                                    d8888P  
+******************************************************************************/
+
+#ifndef _CSTREAM_PIPELINE_H
+#define _CSTREAM_PIPELINE_H
+
+#include "CLUtil.h"
+
+#include <vector>
+#include <functional>
+
+//! One slice of the input of a CStreamPipeline
+struct SPipelineSlice
+{
+	size_t			Index;
+	//! Range of the slice in the units of the task (elements, rows, ...)
+	size_t			Begin;
+	size_t			End;
+	//! Buffer set of the slice, slices with the same slot are never in flight at the same time
+	unsigned int	Slot;
+};
+
+//! Splits a large input into slices and overlaps upload, computation and download of different slices
+/*!
+	Each slice passes three stages: Upload, Compute and Download. With several command
+	queues the stages are distributed over the queues (upload, compute and download queue
+	for three queues), so the upload of slice k+1 and the download of slice k-1 can run
+	while slice k is computed. The stages of a slice are ordered by events, and the upload
+	into a slot waits until the previous slice of the slot was downloaded (double buffering
+	with two slots, triple buffering with three).
+
+	With a single queue the same commands simply serialize, which is the reference for
+	the gain of the overlap. Transfers only overlap with kernels if the host memory is
+	pinned (--buffer-mode pinned, see CHostBuffer), most drivers copy pageable memory
+	synchronously.
+
+	The queues are created by CAssignmentBase (--cl-queues, see there) and registered
+	with SetCommandQueues().
+*/
+class CStreamPipeline
+{
+public:
+	//! Enqueues one stage of a slice after the events in WaitList, Done receives the event of the last command of the stage
+	typedef std::function<cl_int(cl_command_queue CommandQueue, const SPipelineSlice& Slice,
+		cl_uint NWait, const cl_event* WaitList, cl_event* Done)> StageFunc;
+
+	static void SetCommandQueues(const std::vector<cl_command_queue>& CommandQueues);
+
+	//! The registered queues, or only DefaultQueue if none are registered
+	static std::vector<cl_command_queue> GetCommandQueues(cl_command_queue DefaultQueue);
+
+	CStreamPipeline(unsigned int NSlots = 3);
+
+	void SetStages(const StageFunc& Upload, const StageFunc& Compute, const StageFunc& Download);
+
+	unsigned int GetSlotCount() const { return m_NSlots; }
+
+	//! Runs all slices of [0, Size) and waits for them. Returns the wall time in ms, or a negative value on errors.
+	double Run(const std::vector<cl_command_queue>& CommandQueues, size_t Size, size_t SliceSize);
+
+protected:
+	unsigned int	m_NSlots;
+
+	StageFunc		m_Upload;
+	StageFunc		m_Compute;
+	StageFunc		m_Download;
+};
+
+#endif // _CSTREAM_PIPELINE_H
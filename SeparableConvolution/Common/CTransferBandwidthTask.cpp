@@ -0,0 +1,180 @@
+/******************************************************************************
+GPU Computing / GPGPU Praktikum source code.
+
+******************************************************************************/
+
+#include "CTransferBandwidthTask.h"
+
+#include "CLUtil.h"
+#include "CTimer.h"
+#include "CResultsSink.h"
+#include "CBufferPool.h"
+
+#include <iomanip>
+#include <string.h>
+#include <stdlib.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// CTransferBandwidthTask
+
+CTransferBandwidthTask::CTransferBandwidthTask(size_t Size, const std::string& Variant, unsigned int NIterations)
+	: m_Size(Size), m_Variant(Variant), m_NIterations(NIterations)
+{
+}
+
+CTransferBandwidthTask::~CTransferBandwidthTask()
+{
+	ReleaseResources();
+}
+
+bool CTransferBandwidthTask::InitResources(cl_device_id Device, cl_context Context)
+{
+	EHostMemoryMode mode;
+	if(!m_Variant.empty() && !CHostBuffer::ParseMode(m_Variant, mode))
+	{
+		cerr<<"Error: unknown host memory mode \""<<m_Variant<<"\" (pageable, pinned or zerocopy)."<<endl;
+		return false;
+	}
+
+	m_hPattern.resize(m_Size);
+	for(size_t i = 0; i < m_Size; i++)
+		m_hPattern[i] = (unsigned char)(rand() & 0xff);
+
+	// empty buffers are not allowed
+	size_t deviceSize = max<size_t>(m_Size, 1);
+	cl_int clError;
+	m_dBuffer = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, deviceSize, &clError);
+	V_RETURN_FALSE_CL(clError, "Error allocating device buffer");
+	m_dBufferCopy = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, deviceSize, &clError);
+	V_RETURN_FALSE_CL(clError, "Error allocating device buffer");
+
+	m_Valid = true;
+	return true;
+}
+
+void CTransferBandwidthTask::ReleaseResources()
+{
+	SAFE_RELEASE_POOLED(m_dBuffer);
+	SAFE_RELEASE_POOLED(m_dBufferCopy);
+	m_hPattern.clear();
+}
+
+bool CTransferBandwidthTask::IsModeEnabled(EHostMemoryMode Mode) const
+{
+	return m_Variant.empty() || m_Variant == CHostBuffer::GetModeName(Mode);
+}
+
+void CTransferBandwidthTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
+{
+	cout<<"  Transfers of "<<m_Size<<" bytes ("<<m_NIterations<<" iterations):"<<endl;
+
+	for(int mode = 0; mode < HOST_MEMORY_MODE_COUNT; mode++)
+	{
+		if(IsModeEnabled(EHostMemoryMode(mode)))
+			m_Valid &= MeasureMode(Context, CommandQueue, EHostMemoryMode(mode));
+	}
+
+	// the device-side copy does not depend on the host memory
+	Measure(CommandQueue, "D2D", 2.0 * double(m_Size), [&](cl_event* Event) {
+		return clEnqueueCopyBuffer(CommandQueue, m_dBuffer, m_dBufferCopy, 0, 0, m_Size, 0, NULL, Event);
+	});
+}
+
+bool CTransferBandwidthTask::MeasureMode(cl_context Context, cl_command_queue CommandQueue, EHostMemoryMode Mode)
+{
+	CHostBuffer host;
+	if(!host.Allocate(Context, CommandQueue, m_Size, Mode))
+		return false;
+
+	string modeName = CHostBuffer::GetModeName(Mode);
+
+	void* hostPtr = host.Map(CL_MAP_WRITE);
+	if(hostPtr == NULL)
+		return false;
+	memcpy(hostPtr, m_hPattern.data(), m_Size);
+	V_RETURN_FALSE_CL(host.Unmap(), "Error unmapping host memory");
+
+	bool success = Measure(CommandQueue, "H2D-" + modeName, double(m_Size), [&](cl_event* Event) {
+		return host.EnqueueWrite(CommandQueue, m_dBuffer, 0, m_Size, CL_FALSE, Event);
+	});
+
+	// round trip: m_dBuffer holds the pattern now, copy it and read the copy back into the cleared host memory
+	V_RETURN_FALSE_CL(clEnqueueCopyBuffer(CommandQueue, m_dBuffer, m_dBufferCopy, 0, 0, m_Size, 0, NULL, NULL),
+		"Error copying device buffer");
+	if((hostPtr = host.Map(CL_MAP_WRITE)) == NULL)
+		return false;
+	memset(hostPtr, 0, m_Size);
+	V_RETURN_FALSE_CL(host.Unmap(), "Error unmapping host memory");
+
+	success &= Measure(CommandQueue, "D2H-" + modeName, double(m_Size), [&](cl_event* Event) {
+		return host.EnqueueRead(CommandQueue, m_dBufferCopy, 0, m_Size, CL_FALSE, Event);
+	});
+
+	if((hostPtr = host.Map(CL_MAP_READ)) == NULL)
+		return false;
+	bool valid = memcmp(hostPtr, m_hPattern.data(), m_Size) == 0;
+	host.Unmap();
+	if(!valid)
+		cout<<"  Round trip through "<<modeName<<" host memory corrupted the data!"<<endl;
+
+	return success && valid;
+}
+
+bool CTransferBandwidthTask::Measure(cl_command_queue CommandQueue, const std::string& Variant, double BytesMoved,
+	const EnqueueFunc& Enqueue)
+{
+	SBenchmarkResult result;
+	SKernelProfile profile;
+
+	// use the device timestamps if possible, these do not contain the enqueue overhead
+	if(CLUtil::IsProfilingEnabled(CommandQueue))
+	{
+		if(!CLUtil::ProfileCommandEvents(CommandQueue, Enqueue, m_NIterations, profile, Variant))
+			return false;
+		result = SBenchmarkResult(Variant, m_Size, profile, BytesMoved);
+	}
+	else
+	{
+		CTimer timer;
+		cl_int clError = clFinish(CommandQueue);
+		timer.Start();
+		for(unsigned int i = 0; i < m_NIterations; i++)
+			clError |= Enqueue(NULL);
+		clError |= clFinish(CommandQueue);
+		timer.Stop();
+		V_RETURN_FALSE_CL(clError, "Error executing transfer " << Variant);
+		result = SBenchmarkResult(Variant, m_Size, m_NIterations, timer.GetElapsedMilliseconds() / double(m_NIterations), BytesMoved);
+	}
+
+	double ms = result.MedianMs >= 0.0 ? result.MedianMs : result.MeanMs;
+	cout<<"    "<<setw(14)<<left<<Variant<<right<<" latency "<<setw(10)<<1000.0 * ms<<" us, bandwidth "
+		<<1.0e-6 * BytesMoved / ms<<" GB/s"<<endl;
+	CResultsSink::GetSingleton().Add(result);
+
+	return true;
+}
+
+void CTransferBandwidthTask::ComputeCPU()
+{
+	vector<unsigned char> copy(m_Size);
+	unsigned int nIterations = max(m_NIterations, 1u);
+
+	CTimer timer;
+	timer.Start();
+	for(unsigned int i = 0; i < nIterations; i++)
+		memcpy(copy.data(), m_hPattern.data(), m_Size);
+	timer.Stop();
+
+	double ms = timer.GetElapsedMilliseconds() / double(nIterations);
+	cout<<"  memcpy: "<<1000.0 * ms<<" us, bandwidth "<<2.0e-6 * double(m_Size) / ms<<" GB/s"<<endl;
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("memcpy", m_Size, nIterations, ms, 2.0 * double(m_Size)));
+}
+
+bool CTransferBandwidthTask::ValidateResults()
+{
+	return m_Valid;
+}
+
+///////////////////////////////////////////////////////////////////////////////
@@ -26,12 +26,29 @@
 /*!
 	Currently we only use this interface in Assignment4
 	to perform GL rendering and respond to user input with keyboard and mouse.
+
+	In headless mode the task allocates plain OpenCL buffers instead of sharing
+	them with OpenGL and makes no OpenGL calls at all, so it runs on any device
+	without a display. Render() and the input callbacks are not called then.
 */
 class IGUIEnabledComputeTask : public IComputeTask
 {
 public:
 	virtual ~IGUIEnabledComputeTask() {};
 
+	//! Has to be set before InitResources()
+	void SetHeadless(bool Headless) { m_Headless = Headless; }
+	bool IsHeadless() const { return m_Headless; }
+
+	//! Profiles each simulation kernel with the arguments of the last frame and adds the times to CResultsSink
+	virtual void ProfileKernels(cl_command_queue , size_t [3], int ) {};
+
+	//! Reads back the simulation state, returns false if it is no longer finite (the simulation blew up)
+	virtual bool ValidateState(cl_command_queue ) { return true; };
+
+	//! Number of simulated elements (particles, cloth vertices), the problem size of the reported results
+	virtual size_t GetProblemSize() const { return 0; };
+
 	// OpenGL render callback
 	virtual void Render() = 0;
 
@@ -43,6 +60,9 @@ public:
 	virtual void OnIdle(double Time, float ElapsedTime) = 0;
 
 	virtual void OnWindowResized(int Width, int Height) = 0;
+
+protected:
+	bool m_Headless = false;
 };
 
 
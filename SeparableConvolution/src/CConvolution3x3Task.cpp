@@ -7,6 +7,13 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "../Common/CLUtil.h"
 #include "../Common/CTimer.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CSimd.h"
+#include "../Common/CKernelLibrary.h"
+
+#include <vector>
 
 using namespace std;
 
@@ -68,10 +75,7 @@ bool CConvolution3x3Task::InitResources(cl_device_id Device, cl_context Context)
 		kernelConstants, &clError);
 	V_RETURN_FALSE_CL(clError, "Error allocating device kernel constants.");
 
-	string programCode;
-
-	CLUtil::LoadProgramSourceToMemory("Convolution3x3.cl", programCode);
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode);
+	m_Program = CKernelLibrary::GetSingleton().Build(Device, Context, "Convolution3x3.cl");
 	if(m_Program == nullptr) return false;
 
 	//create kernel(s)
@@ -107,7 +111,32 @@ void CConvolution3x3Task::ComputeGPU(cl_context Context, cl_command_queue Comman
 	//do 1 or 3 convolution steps, based on the number of color channels to process
 	unsigned int numChannels = m_Monochrome ? 1 : 3;
 
-	size_t dataSize = m_Pitch * m_Height * sizeof(cl_float);
+	//stream the first channel in bands through the pipeline while the source channels are still on the host
+	cl_int clError;
+	cl_kernel bandKernel = clCreateKernel(m_Program, "Convolution", &clError);
+	V_RETURN_CL(clError, "Failed to create kernel: Convolution");
+	clError  = clSetKernelArg(bandKernel, 2, sizeof(cl_mem), (void*)&m_dKernelConstants);
+	clError |= clSetKernelArg(bandKernel, 3, sizeof(cl_uint), (void*)&m_Width);
+	clError |= clSetKernelArg(bandKernel, 5, sizeof(cl_uint), (void*)&m_Pitch);
+	V_RETURN_CL(clError, "Error setting the band kernel arguments");
+
+	RunPipelined(Context, CommandQueue, 0, 1, (unsigned int)m_TileSize[1],
+		[&](cl_command_queue Queue, cl_mem Dst, cl_mem Src, cl_mem, unsigned int Rows, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+			cl_int e  = clSetKernelArg(bandKernel, 0, sizeof(cl_mem), (void*)&Dst);
+			e |= clSetKernelArg(bandKernel, 1, sizeof(cl_mem), (void*)&Src);
+			e |= clSetKernelArg(bandKernel, 4, sizeof(cl_uint), (void*)&Rows);
+			size_t globalWorkSize[2] = {
+				CLUtil::GetGlobalWorkSize(m_Width, m_TileSize[0]),
+				CLUtil::GetGlobalWorkSize(Rows, m_TileSize[1])
+			};
+			if(e == CL_SUCCESS)
+				e = clEnqueueNDRangeKernel(Queue, bandKernel, 2, NULL, globalWorkSize, m_TileSize, NWait, WaitList, Done);
+			return e;
+		});
+	clReleaseKernel(bandKernel);
+
+	if(!UploadSources(CommandQueue))
+		return;
 
 	//perform the convolution and measure the performance
 	double runTime = 0.0f;
@@ -117,13 +146,16 @@ void CConvolution3x3Task::ComputeGPU(cl_context Context, cl_command_queue Comman
 
 	cout<<"  Average GPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s" <<endl;
 
-	for(unsigned int iChannel = 0; iChannel < numChannels; iChannel++)
-	{
-		//copy the results back to the CPU
-		V_RETURN_CL( clEnqueueReadBuffer(CommandQueue, m_dResultChannels[iChannel], CL_TRUE, 0, dataSize,
-									m_hGPUResultChannels[iChannel], 0, NULL, NULL), "Error reading back results from the device!" );
-	}
+	// each channel is read and written once (ignoring the overlap of the tiles),
+	// each pixel takes 9 multiply-adds plus scale and offset
+	SBenchmarkResult result("Convolution", size_t(m_Width) * m_Height, nIterations, runTime,
+		2.0 * sizeof(float) * m_Width * m_Height * numChannels, 20.0 * m_Width * m_Height * numChannels);
+	CRoofline::GetSingleton().Report(result);
+	CResultsSink::GetSingleton().Add(result);
 
+	//copy the results back to the CPU (or map them)
+	if(!DownloadResults(CommandQueue, numChannels))
+		return;
 
 	SaveImage("Images/GPUResult3x3.pfm", m_hGPUResultChannels);
 }
@@ -140,13 +172,27 @@ void CConvolution3x3Task::ComputeCPU()
 		runTime += ConvolutionChannelCPU(iChannel);
 	}
 
-	cout<<"  CPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s" <<endl;
+	cout<<"  CPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s ("
+		<< CThreadPool::GetSingleton().GetThreadCount() << " threads)" <<endl;
+
+	// vectorized CPU baseline, computed into a separate buffer so the reference stays untouched
+	vector<float> resultSIMD(m_Pitch * m_Height);
+	double runTimeSIMD = 0.0;
+	float maxError = 0;
+	for(unsigned int iChannel = 0; iChannel < numChannels; iChannel++)
+	{
+		runTimeSIMD += ConvolutionChannelCPUSIMD(iChannel, &resultSIMD[0]);
+		maxError = max(maxError, MaxErrorToCPUResult(iChannel, &resultSIMD[0]));
+	}
+	ReportCPUSIMD(runTimeSIMD / 10.0, maxError, 10, 2.0 * sizeof(float) * m_Width * m_Height * numChannels);
 
 	SaveImage("Images/CPUResult3x3.pfm", m_hCPUResultChannels);
 }
 
 double CConvolution3x3Task::ConvolutionChannelCPU(unsigned int Channel)
 {
+	CThreadPool& pool = CThreadPool::GetSingleton();
+
 	//also measure the time for the first channel
 	CTimer timer;
 
@@ -157,27 +203,71 @@ double CConvolution3x3Task::ConvolutionChannelCPU(unsigned int Channel)
 	for(int iter = 0; iter < nIterations; iter++)
 	{
 
-		for(unsigned int y = 0; y < m_Height; y++)
-		{
-			for(unsigned int x = 0; x < m_Width; x++)
+		// the rows are independent, so each thread computes a band of rows
+		pool.ParallelFor(0, m_Height, [&](size_t First, size_t Last) {
+			for(unsigned int y = (unsigned int)First; y < (unsigned int)Last; y++)
 			{
-				float value = 0;
-				//apply convolution kernel
-				for(int offsetY = -1; offsetY < 2; offsetY ++)
+				for(unsigned int x = 0; x < m_Width; x++)
+				{
+					float value = 0;
+					//apply convolution kernel
+					for(int offsetY = -1; offsetY < 2; offsetY ++)
+					{
+						int sy = y + offsetY;
+						if(sy >= 0 && sy < int(m_Height))
+							for(int offsetX = -1; offsetX < 2; offsetX++)
+							{
+								int sx = x + offsetX;
+								if(sx >= 0 && sx < int(m_Width))
+									value += m_hSourceChannels[Channel][sy * m_Pitch + sx] * m_hConvolutionKernel[1 + offsetY][1 + offsetX];
+							}
+					}
+					m_hCPUResultChannels[Channel][y * m_Pitch + x] = value * m_KernelWeight + m_Offset;		
+				}
+			}
+		});
+
+	}
+
+	timer.Stop();
+
+	return timer.GetElapsedMilliseconds();
+}
+
+double CConvolution3x3Task::ConvolutionChannelCPUSIMD(unsigned int Channel, float* Result)
+{
+	CThreadPool& pool = CThreadPool::GetSingleton();
+	const SSimdKernels& simd = CSimd::GetSingleton().GetKernels();
+
+	// ConvolveRowAdd() mirrors the kernel (Kernel[Radius - k] is applied to Src[x + k])
+	float mirrored[3][3];
+	for(int i = 0; i < 3; i++)
+		for(int j = 0; j < 3; j++)
+			mirrored[i][j] = m_hConvolutionKernel[i][2 - j];
+
+	CTimer timer;
+
+	const int nIterations = 10;
+
+	timer.Start();
+
+	for(int iter = 0; iter < nIterations; iter++)
+	{
+		// each row is the sum of three row FIRs, followed by the weight and offset
+		pool.ParallelFor(0, m_Height, [&](size_t First, size_t Last) {
+			for(int y = (int)First; y < (int)Last; y++)
+			{
+				float* dst = Result + y * m_Pitch;
+				fill(dst, dst + m_Width, 0.0f);
+				for(int offsetY = -1; offsetY < 2; offsetY++)
 				{
 					int sy = y + offsetY;
 					if(sy >= 0 && sy < int(m_Height))
-						for(int offsetX = -1; offsetX < 2; offsetX++)
-						{
-							int sx = x + offsetX;
-							if(sx >= 0 && sx < int(m_Width))
-								value += m_hSourceChannels[Channel][sy * m_Pitch + sx] * m_hConvolutionKernel[1 + offsetY][1 + offsetX];
-						}
+						simd.ConvolveRowAdd(m_hSourceChannels[Channel] + sy * m_Pitch, dst, m_Width, mirrored[1 + offsetY], 1);
 				}
-				m_hCPUResultChannels[Channel][y * m_Pitch + x] = value * m_KernelWeight + m_Offset;		
+				simd.ScaleOffsetRow(dst, m_Width, m_KernelWeight, m_Offset);
 			}
-		}
-
+		});
 	}
 
 	timer.Stop();
@@ -191,11 +281,11 @@ double CConvolution3x3Task::ConvolutionChannelGPU(unsigned int Channel, cl_conte
 	size_t globalWorkSize[2] = {CLUtil::GetGlobalWorkSize(m_Width, m_TileSize[0]), CLUtil::GetGlobalWorkSize(m_Height, m_TileSize[1])};
 	
 	cl_int clErr;
-	clErr  = clSetKernelArg(m_ConvolutionKernel, 0, sizeof(cl_mem), (void*)&m_dResultChannels[Channel]);
-	clErr |= clSetKernelArg(m_ConvolutionKernel, 1, sizeof(cl_mem), (void*)&m_dSourceChannels[Channel]);
+	clErr  = clSetKernelArg(m_ConvolutionKernel, 0, sizeof(cl_mem), (void*)&m_ResultChannels[Channel].GetDeviceBuffer());
+	clErr |= clSetKernelArg(m_ConvolutionKernel, 1, sizeof(cl_mem), (void*)&m_SourceChannels[Channel].GetDeviceBuffer());
 	V_RETURN_0_CL(clErr, "Error setting kernel arguments!");
 
-	return CLUtil::ProfileKernel(CommandQueue, m_ConvolutionKernel, 2, globalWorkSize, m_TileSize, NIterations);
+	return ProfileKernel(CommandQueue, m_ConvolutionKernel, "Convolution", globalWorkSize, m_TileSize, NIterations, Channel == 0);
 }
 
 
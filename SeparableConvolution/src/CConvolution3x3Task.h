@@ -47,10 +47,14 @@ public:
 
 	virtual void ComputeCPU();
 
+	virtual std::string GetName() const { return "Convolution3x3"; }
+
 protected:
 	
 	// the return value is the run time in milliseconds
 	double ConvolutionChannelCPU(unsigned int Channel);
+	// same as ConvolutionChannelCPU() with the vectorized row kernels of CSimd, the return value is the run time in milliseconds
+	double ConvolutionChannelCPUSIMD(unsigned int Channel, float* Result);
 	//the last parameter is for timing, and the returned value is the average run time in milliseconds
 	double ConvolutionChannelGPU(unsigned int Channel, cl_context Context, cl_command_queue CommandQueue, int NIterations);
 
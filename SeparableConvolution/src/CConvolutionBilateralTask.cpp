@@ -7,6 +7,10 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "../Common/CLUtil.h"
 #include "../Common/CTimer.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CBufferPool.h"
+#include "../Common/CRoofline.h"
 #include "Pfm.h"
 
 #include <sstream>
@@ -89,7 +93,7 @@ bool CConvolutionBilateralTask::InitResources(cl_device_id Device, cl_context Co
 	cl_int clError = 0;
 	cl_int clErr;
 
-	m_dDiscBuffer = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_int),  NULL, &clErr);
+	m_dDiscBuffer = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_int), &clErr);
 	clError = clErr;
 	m_dNormDepthBuffer = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, m_Pitch * m_Height * sizeof(cl_float4),  m_hNormDepthBuffer, &clErr);
 	clError |= clErr;
@@ -153,7 +157,7 @@ void CConvolutionBilateralTask::ReleaseResources()
 	SAFE_DELETE_ARRAY( m_hGPUDiscBuffer );
 	SAFE_DELETE_ARRAY( m_hNormDepthBuffer );
 
-	SAFE_RELEASE_MEMOBJECT( m_dDiscBuffer );
+	SAFE_RELEASE_POOLED(m_dDiscBuffer);
 	SAFE_RELEASE_MEMOBJECT( m_dNormDepthBuffer );
 
 	SAFE_RELEASE_KERNEL( m_HorizontalDiscKernel );
@@ -164,19 +168,21 @@ void CConvolutionBilateralTask::ReleaseResources()
 
 void CConvolutionBilateralTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	size_t dataSize = m_Pitch * m_Height * sizeof(cl_float);
 	int nIterations = 100;
 
 	unsigned int numChannels = 3;
 
+	if(!UploadSources(CommandQueue))
+		return;
+
 	double runTime = 0.0f;
 
 	// detect discontinuities
 	size_t globalWorkSizeH[2] = {CLUtil::GetGlobalWorkSize(m_Width / m_StepsHorizontal, m_LocalSizeHorizontal[0]), CLUtil::GetGlobalWorkSize(m_Height, m_LocalSizeHorizontal[1])};	
-	runTime += CLUtil::ProfileKernel(CommandQueue, m_HorizontalDiscKernel, 2, globalWorkSizeH, LocalWorkSize, nIterations);
+	runTime += ProfileKernel(CommandQueue, m_HorizontalDiscKernel, "DiscontinuityHorizontal", globalWorkSizeH, LocalWorkSize, nIterations, true);
 
 	size_t globalWorkSizeV[2] = {CLUtil::GetGlobalWorkSize(m_Width, m_LocalSizeVertical[0]), CLUtil::GetGlobalWorkSize(m_Height / m_StepsVertical, m_LocalSizeVertical[1])};
-	runTime += CLUtil::ProfileKernel(CommandQueue, m_VerticalDiscKernel, 2, globalWorkSizeV, LocalWorkSize, nIterations);
+	runTime += ProfileKernel(CommandQueue, m_VerticalDiscKernel, "DiscontinuityVertical", globalWorkSizeV, LocalWorkSize, nIterations, true);
 
 
 	for(unsigned int iChannel = 0; iChannel < numChannels; iChannel++)
@@ -186,14 +192,19 @@ void CConvolutionBilateralTask::ComputeGPU(cl_context Context, cl_command_queue
 
 	cout<<"  Average GPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s" <<endl;
 
-	for(unsigned int iChannel = 0; iChannel < numChannels; iChannel++)
-	{
-		//copy the results back to the CPU
-		//(this time the data is in the same buffer as the input was, because of the 2 convolution passes)
-		V_RETURN_CL( clEnqueueReadBuffer(CommandQueue, m_dResultChannels[iChannel], CL_TRUE, 0, dataSize,
-									m_hGPUResultChannels[iChannel], 0, NULL, NULL), "Error reading back results from the device!" );
-
-	}
+	// the discontinuity passes read the normal and depth (float4) and write the flags per pixel, the two
+	// convolution passes read the channel and the flags and write the channel, with a multiply-add and
+	// the weight sum for each of the 2 * KERNEL_RADIUS + 1 taps
+	double pixels = double(m_Width) * m_Height;
+	SBenchmarkResult result("Bilateral", size_t(m_Width) * m_Height, nIterations, runTime,
+		2.0 * (sizeof(cl_float4) + sizeof(cl_int)) * pixels + 2.0 * (2 * sizeof(float) + sizeof(cl_int)) * pixels * numChannels,
+		2.0 * 3.0 * (2 * m_KernelRadius + 1) * pixels * numChannels);
+	CRoofline::GetSingleton().Report(result);
+	CResultsSink::GetSingleton().Add(result);
+
+	//copy the results back to the CPU (or map them)
+	if(!DownloadResults(CommandQueue, numChannels))
+		return;
 	V_RETURN_CL( clEnqueueReadBuffer(CommandQueue, m_dDiscBuffer, CL_TRUE, 0, m_Width * m_Height * sizeof(int), 
 		m_hGPUDiscBuffer, 0, NULL, NULL), "Error reading back results from the device!" );
 	
@@ -205,50 +216,55 @@ void CConvolutionBilateralTask::ComputeCPU()
 {
 	double runTime = 0.0;
 
+	// Each thread works on a band of rows (columns in the vertical pass)
+	CThreadPool& pool = CThreadPool::GetSingleton();
+
 	CTimer timer;
 	timer.Start();
 	
 	// Detect discontinuities
-	for(unsigned int y = 0; y < m_Height; y++)
-		for(unsigned int x = 0; x < m_Width; x++)
-		{
-			cl_float4 myNormDepth = m_hNormDepthBuffer[y*m_Pitch + x];
-			int flag = 0;
-
-			// Left neighbor
-			if (x > 0) {
-				cl_float4 normDepth = m_hNormDepthBuffer[y*m_Pitch + x - 1];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+	pool.ParallelFor(0, m_Height, [&](size_t First, size_t Last) {
+		for(unsigned int y = (unsigned int)First; y < (unsigned int)Last; y++)
+			for(unsigned int x = 0; x < m_Width; x++)
+			{
+				cl_float4 myNormDepth = m_hNormDepthBuffer[y*m_Pitch + x];
+				int flag = 0;
+
+				// Left neighbor
+				if (x > 0) {
+					cl_float4 normDepth = m_hNormDepthBuffer[y*m_Pitch + x - 1];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 1;
+				} else
 					flag |= 1;
-			} else
-				flag |= 1;
 
-			// Right neighbor
-			if (x < m_Width - 1) {
-				cl_float4 normDepth  = m_hNormDepthBuffer[y*m_Pitch + x + 1];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+				// Right neighbor
+				if (x < m_Width - 1) {
+					cl_float4 normDepth  = m_hNormDepthBuffer[y*m_Pitch + x + 1];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 2;
+				} else
 					flag |= 2;
-			} else
-				flag |= 2;
 
-			// Upper neighbor
-			if (y > 0) {
-				cl_float4 normDepth = m_hNormDepthBuffer[(y-1)*m_Pitch + x];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+				// Upper neighbor
+				if (y > 0) {
+					cl_float4 normDepth = m_hNormDepthBuffer[(y-1)*m_Pitch + x];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 4;
+				} else
 					flag |= 4;
-			} else
-				flag |= 4;
 
-			// Lower neighbor
-			if (y < m_Height - 1) {
-				cl_float4 normDepth  = m_hNormDepthBuffer[(y+1)*m_Pitch + x];
-				if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+				// Lower neighbor
+				if (y < m_Height - 1) {
+					cl_float4 normDepth  = m_hNormDepthBuffer[(y+1)*m_Pitch + x];
+					if (IsNormalDiscontinuity(myNormDepth, normDepth) || IsDepthDiscontinuity(myNormDepth.s[3], normDepth.s[3]))
+						flag |= 8;
+				} else
 					flag |= 8;
-			} else
-				flag |= 8;
 
-			m_hCPUDiscBuffer[y * m_Pitch + x] = flag;
-		}
+				m_hCPUDiscBuffer[y * m_Pitch + x] = flag;
+			}
+	});
 
 	timer.Stop();
 
@@ -258,7 +274,8 @@ void CConvolutionBilateralTask::ComputeCPU()
 	for(unsigned int iChannel = 0; iChannel < 3; iChannel++)
 		runTime += ConvolutionChannelCPU(iChannel);
 
-	cout<<"  CPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s" <<endl;
+	cout<<"  CPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s ("
+		<< CThreadPool::GetSingleton().GetThreadCount() << " threads)" <<endl;
 
 	// Store CPU results
 	SaveImage("Images/CPUResultBilateral.pfm", m_hCPUResultChannels);
@@ -267,112 +284,118 @@ void CConvolutionBilateralTask::ComputeCPU()
 
 double CConvolutionBilateralTask::ConvolutionChannelCPU(unsigned int Channel)
 {
+	CThreadPool& pool = CThreadPool::GetSingleton();
+
 	CTimer timer;
 	timer.Start();
 
 	// HORIZONTAL PASS
-	for(unsigned int y = 0; y < m_Height; y++) 
-	{
-		for(unsigned int x = 0; x < m_Width; x++)
+	pool.ParallelFor(0, m_Height, [&](size_t First, size_t Last) {
+		for(unsigned int y = (unsigned int)First; y < (unsigned int)Last; y++)
 		{
-			float sum = 0.f;
-			float weight = 0.f;
+			for(unsigned int x = 0; x < m_Width; x++)
+			{
+				float sum = 0.f;
+				float weight = 0.f;
 
-			// Middle pixel
-			weight	= m_hKernelHorizontal[m_KernelRadius];
-			sum		= m_hSourceChannels[Channel][y * m_Pitch + x] * weight;
+				// Middle pixel
+				weight	= m_hKernelHorizontal[m_KernelRadius];
+				sum		= m_hSourceChannels[Channel][y * m_Pitch + x] * weight;
 
-			// Left neighborhood
-			for(int k = 0; k > -m_KernelRadius; ) {
+				// Left neighborhood
+				for(int k = 0; k > -m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
-				// If discontinuity on the left detected, bail out
-				if (flag & 1 ||  (int)x+k <= 0)
-					break;
+					int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
+					// If discontinuity on the left detected, bail out
+					if (flag & 1 ||  (int)x+k <= 0)
+						break;
 
-				k--; 
+					k--; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
+					weight += w;
+				}
 
-			// Right neighborhood
-			for(int k = 0; k < m_KernelRadius; ) {
+				// Right neighborhood
+				for(int k = 0; k < m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
-				// If discontinuity on the right is detected, bail out
-				if (flag & 2 || (int)x+k >= (int)m_Width-1)
-					break;
+					int flag = m_hCPUDiscBuffer[y * m_Pitch + x + k];
+					// If discontinuity on the right is detected, bail out
+					if (flag & 2 || (int)x+k >= (int)m_Width-1)
+						break;
 
-				k++; 
+					k++; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hSourceChannels[Channel][y * m_Pitch + x + k] * w;
+					weight += w;
+				}
 
-			// Re-normalize
-			if (weight != 0.f)
-				sum /= weight;
-			else
-				sum = 0.f;
+				// Re-normalize
+				if (weight != 0.f)
+					sum /= weight;
+				else
+					sum = 0.f;
 
-			m_hCPUWorkingBuffer[y * m_Pitch + x] = sum;
+				m_hCPUWorkingBuffer[y * m_Pitch + x] = sum;
+			}
 		}
-	}
+	});
 
 	//VERTICAL PASS
-	for(unsigned int x = 0; x < m_Width; x++)
-	{
-		for(unsigned int y = 0; y < m_Height; y++)
+	pool.ParallelFor(0, m_Width, [&](size_t First, size_t Last) {
+		for(unsigned int x = (unsigned int)First; x < (unsigned int)Last; x++)
 		{
-			float sum = 0.f;
-			float weight = 0.f;
+			for(unsigned int y = 0; y < m_Height; y++)
+			{
+				float sum = 0.f;
+				float weight = 0.f;
 
-			// Middle pixel
-			weight	= m_hKernelHorizontal[m_KernelRadius];
-			sum		= m_hCPUWorkingBuffer[y * m_Pitch + x] * weight;
+				// Middle pixel
+				weight	= m_hKernelHorizontal[m_KernelRadius];
+				sum		= m_hCPUWorkingBuffer[y * m_Pitch + x] * weight;
 
-			// Upper neighborhood
-			for(int k = 0; k > -m_KernelRadius; ) {
+				// Upper neighborhood
+				for(int k = 0; k > -m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
-				// If discontinuity on the left detected, bail out
-				if (flag & 4 || y+k <= 0)
-					break;
+					int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
+					// If discontinuity on the left detected, bail out
+					if (flag & 4 || y+k <= 0)
+						break;
 
-				k--; 
+					k--; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
+					weight += w;
+				}
 
-			// Lower neighborhood
-			for(int k = 0; k < m_KernelRadius; ) {
+				// Lower neighborhood
+				for(int k = 0; k < m_KernelRadius; ) {
 
-				int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
-				// If discontinuity on the right is detected, bail out
-				if (flag & 8 || (int)y+k >= (int)m_Height-1)
-					break;
+					int flag = m_hCPUDiscBuffer[(y+k) * m_Pitch + x];
+					// If discontinuity on the right is detected, bail out
+					if (flag & 8 || (int)y+k >= (int)m_Height-1)
+						break;
 
-				k++; 
+					k++; 
 
-				float w = m_hKernelHorizontal[m_KernelRadius - k];
-				sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
-				weight += w;
-			}
+					float w = m_hKernelHorizontal[m_KernelRadius - k];
+					sum += m_hCPUWorkingBuffer[(y+k) * m_Pitch + x] * w;
+					weight += w;
+				}
 
-			// Re-normalize
-			if (weight != 0.f)
-				sum /= weight;
-			else
-				sum = 0.f;
+				// Re-normalize
+				if (weight != 0.f)
+					sum /= weight;
+				else
+					sum = 0.f;
 
-			m_hCPUResultChannels[Channel][y * m_Pitch + x] = sum;
+				m_hCPUResultChannels[Channel][y * m_Pitch + x] = sum;
+			}
 		}
-	}
+	});
 	
 
 	timer.Stop();
@@ -385,19 +408,19 @@ double CConvolutionBilateralTask::ConvolutionChannelGPU(unsigned int Channel, cl
 
 	double runTime = 0;
 
-	clErr  = clSetKernelArg(m_HorizontalKernel, 1, sizeof(cl_mem), (void*)&m_dSourceChannels[Channel]);
+	clErr  = clSetKernelArg(m_HorizontalKernel, 1, sizeof(cl_mem), (void*)&m_SourceChannels[Channel].GetDeviceBuffer());
 	clErr |= clSetKernelArg(m_HorizontalKernel, 0, sizeof(cl_mem), (void*)&m_dGPUWorkingBuffer);
 	V_RETURN_0_CL(clErr, "Error setting horizontal kernel arguments");
 
 	size_t globalWorkSizeH[2] = {CLUtil::GetGlobalWorkSize(m_Width / m_StepsHorizontal, m_LocalSizeHorizontal[0]), CLUtil::GetGlobalWorkSize(m_Height, m_LocalSizeHorizontal[1])};	
-	runTime += CLUtil::ProfileKernel(CommandQueue, m_HorizontalKernel, 2, globalWorkSizeH, m_LocalSizeHorizontal, NIterations);
+	runTime += ProfileKernel(CommandQueue, m_HorizontalKernel, "BilateralHorizontal", globalWorkSizeH, m_LocalSizeHorizontal, NIterations, Channel == 0);
 
 	clErr  = clSetKernelArg(m_VerticalKernel, 1, sizeof(cl_mem), (void*)&m_dGPUWorkingBuffer);
-	clErr |= clSetKernelArg(m_VerticalKernel, 0, sizeof(cl_mem), (void*)&m_dResultChannels[Channel]);
+	clErr |= clSetKernelArg(m_VerticalKernel, 0, sizeof(cl_mem), (void*)&m_ResultChannels[Channel].GetDeviceBuffer());
 	V_RETURN_0_CL(clErr, "Error setting vertical kernel arguments");
 
 	size_t globalWorkSizeV[2] = {CLUtil::GetGlobalWorkSize(m_Width, m_LocalSizeVertical[0]), CLUtil::GetGlobalWorkSize(m_Height / m_StepsVertical, m_LocalSizeVertical[1])};
-	runTime += CLUtil::ProfileKernel(CommandQueue, m_VerticalKernel, 2, globalWorkSizeV, m_LocalSizeVertical, NIterations);
+	runTime += ProfileKernel(CommandQueue, m_VerticalKernel, "BilateralVertical", globalWorkSizeV, m_LocalSizeVertical, NIterations, Channel == 0);
 
 	return runTime;
 }
@@ -55,6 +55,8 @@ public:
 
 	virtual void ComputeCPU();
 
+	virtual std::string GetName() const { return "ConvolutionBilateral"; }
+
 protected:
 
 	// the return value is the run time in milliseconds
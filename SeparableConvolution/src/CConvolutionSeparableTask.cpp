@@ -7,9 +7,16 @@ GPU Computing / GPGPU Praktikum source code.
 
 #include "../Common/CLUtil.h"
 #include "../Common/CTimer.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CSimd.h"
+#include "../Common/CBufferPool.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CKernelLibrary.h"
 
 #include <sstream>
 #include <cstring>
+#include <vector>
 
 using namespace std;
 
@@ -79,26 +86,22 @@ bool CConvolutionSeparableTask::InitResources(cl_device_id Device, cl_context Co
 	clError |= clErr;
 	V_RETURN_FALSE_CL(clError, "Error allocating device kernel constants.");
 
-	m_dGPUWorkingBuffer = clCreateBuffer(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_float), NULL, &clError);
+	m_dGPUWorkingBuffer = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, m_Pitch * m_Height * sizeof(cl_float), &clError);
 	V_RETURN_FALSE_CL(clError, "Error allocating device working array");
 
 	m_hCPUWorkingBuffer = new float[m_Height * m_Pitch];
 
-	string programCode;
-
-	CLUtil::LoadProgramSourceToMemory(m_ProgramName, programCode);
-
 	//This time we define several kernel-specific constants that we did not know during
 	//implementing the kernel, but we need to include during compile time.
-	stringstream compileOptions;
-	compileOptions<<"-cl-fast-relaxed-math"
-	<<" -D KERNEL_RADIUS="<<m_KernelRadius
-	<<" -D H_GROUPSIZE_X="<<m_LocalSizeHorizontal[0]<<" -D H_GROUPSIZE_Y="<<m_LocalSizeHorizontal[1]
-	<<" -D H_RESULT_STEPS="<<m_StepsHorizontal
-	<<" -D V_GROUPSIZE_X="<<m_LocalSizeVertical[0]<<" -D V_GROUPSIZE_Y="<<m_LocalSizeVertical[1]
-	<<" -D V_RESULT_STEPS="<<m_StepsVertical;
-
-	m_Program = CLUtil::BuildCLProgramFromMemory(Device, Context, programCode, compileOptions.str());
+	//Tasks with the same constants share the program built first.
+	CKernelDefines defines;
+	defines.Set("KERNEL_RADIUS", m_KernelRadius)
+		.Set("H_GROUPSIZE_X", m_LocalSizeHorizontal[0]).Set("H_GROUPSIZE_Y", m_LocalSizeHorizontal[1])
+		.Set("H_RESULT_STEPS", m_StepsHorizontal)
+		.Set("V_GROUPSIZE_X", m_LocalSizeVertical[0]).Set("V_GROUPSIZE_Y", m_LocalSizeVertical[1])
+		.Set("V_RESULT_STEPS", m_StepsVertical);
+
+	m_Program = CKernelLibrary::GetSingleton().Build(Device, Context, m_ProgramName, defines, "-cl-fast-relaxed-math");
 	if(m_Program == nullptr) return false;
 
 
@@ -136,7 +139,7 @@ void CConvolutionSeparableTask::ReleaseResources()
 {
 	SAFE_DELETE_ARRAY( m_hCPUWorkingBuffer );
 
-	SAFE_RELEASE_MEMOBJECT(m_dGPUWorkingBuffer);
+	SAFE_RELEASE_POOLED(m_dGPUWorkingBuffer);
 	SAFE_RELEASE_MEMOBJECT(m_dKernelHorizontal);
 	SAFE_RELEASE_MEMOBJECT(m_dKernelVertical);
 
@@ -147,11 +150,66 @@ void CConvolutionSeparableTask::ReleaseResources()
 
 void CConvolutionSeparableTask::ComputeGPU(cl_context Context, cl_command_queue CommandQueue, size_t LocalWorkSize[3])
 {
-	size_t dataSize = m_Pitch * m_Height * sizeof(cl_float);
 	int nIterations = 100;
 
 	unsigned int numChannels = 3;
 
+	//stream the first channel in bands through the pipeline while the source channels are still on the host,
+	//the bands are multiples of the rows of both passes
+	cl_int clError;
+	cl_kernel bandKernelH = clCreateKernel(m_Program, "ConvHorizontal", &clError);
+	V_RETURN_CL(clError, "Failed to create horizontal kernel.");
+	cl_kernel bandKernelV = clCreateKernel(m_Program, "ConvVertical", &clError);
+	if(clError != CL_SUCCESS)
+		clReleaseKernel(bandKernelH);
+	V_RETURN_CL(clError, "Failed to create vertical kernel.");
+	clError  = clSetKernelArg(bandKernelH, 2, sizeof(cl_mem), (void*)&m_dKernelHorizontal);
+	clError |= clSetKernelArg(bandKernelH, 3, sizeof(cl_uint), (void*)&m_Width);
+	clError |= clSetKernelArg(bandKernelH, 4, sizeof(cl_uint), (void*)&m_Pitch);
+	clError |= clSetKernelArg(bandKernelV, 2, sizeof(cl_mem), (void*)&m_dKernelVertical);
+	clError |= clSetKernelArg(bandKernelV, 4, sizeof(cl_uint), (void*)&m_Pitch);
+
+	unsigned int rowsV = m_StepsVertical * (unsigned int)m_LocalSizeVertical[1];
+	unsigned int granularity = rowsV;
+	while(granularity % m_LocalSizeHorizontal[1] != 0)
+		granularity += rowsV;
+
+	if(clError == CL_SUCCESS)
+	{
+		RunPipelined(Context, CommandQueue, 0, m_KernelRadius, granularity,
+			[&](cl_command_queue Queue, cl_mem Dst, cl_mem Src, cl_mem Scratch, unsigned int Rows, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+				cl_int e  = clSetKernelArg(bandKernelH, 0, sizeof(cl_mem), (void*)&Scratch);
+				e |= clSetKernelArg(bandKernelH, 1, sizeof(cl_mem), (void*)&Src);
+				e |= clSetKernelArg(bandKernelV, 0, sizeof(cl_mem), (void*)&Dst);
+				e |= clSetKernelArg(bandKernelV, 1, sizeof(cl_mem), (void*)&Scratch);
+				e |= clSetKernelArg(bandKernelV, 3, sizeof(cl_uint), (void*)&Rows);
+				size_t globalWorkSizeH[2] = {
+					CLUtil::GetGlobalWorkSize(m_Width / m_StepsHorizontal, m_LocalSizeHorizontal[0]),
+					CLUtil::GetGlobalWorkSize(Rows, m_LocalSizeHorizontal[1])
+				};
+				size_t globalWorkSizeV[2] = {
+					CLUtil::GetGlobalWorkSize(m_Width, m_LocalSizeVertical[0]),
+					CLUtil::GetGlobalWorkSize(Rows / m_StepsVertical, m_LocalSizeVertical[1])
+				};
+				//both passes run on the same in-order queue, so only the first one has to wait
+				if(e == CL_SUCCESS)
+					e = clEnqueueNDRangeKernel(Queue, bandKernelH, 2, NULL, globalWorkSizeH, m_LocalSizeHorizontal, NWait, WaitList, NULL);
+				if(e == CL_SUCCESS)
+					e = clEnqueueNDRangeKernel(Queue, bandKernelV, 2, NULL, globalWorkSizeV, m_LocalSizeVertical, 0, NULL, Done);
+				return e;
+			});
+	}
+	else
+	{
+		cerr<<"Error setting the band kernel arguments ["<<CLUtil::GetCLErrorString(clError)<<"]"<<endl;
+		m_PipelineValid = false;
+	}
+	clReleaseKernel(bandKernelH);
+	clReleaseKernel(bandKernelV);
+
+	if(!UploadSources(CommandQueue))
+		return;
+
 	double runTime = 0.0f;
 	for(unsigned int iChannel = 0; iChannel < numChannels; iChannel++)
 	{
@@ -160,14 +218,18 @@ void CConvolutionSeparableTask::ComputeGPU(cl_context Context, cl_command_queue
 
 	cout<<"  Average GPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s" <<endl;
 
-	for(unsigned int iChannel = 0; iChannel < numChannels; iChannel++)
-	{
-		//copy the results back to the CPU
-		//(this time the data is in the same buffer as the input was, because of the 2 convolution passes)
-		V_RETURN_CL( clEnqueueReadBuffer(CommandQueue, m_dResultChannels[iChannel], CL_TRUE, 0, dataSize,
-									m_hGPUResultChannels[iChannel], 0, NULL, NULL), "Error reading back results from the device!" );
+	// two passes, each reads and writes every channel once and takes 2 * KERNEL_RADIUS + 1 multiply-adds per pixel
+	SBenchmarkResult result(m_OutFileName, size_t(m_Width) * m_Height, nIterations, runTime,
+		4.0 * sizeof(float) * m_Width * m_Height * numChannels, 4.0 * (2 * m_KernelRadius + 1) * m_Width * m_Height * numChannels);
+	result.LocalWorkSize[0] = m_LocalSizeHorizontal[0];
+	result.LocalWorkSize[1] = m_LocalSizeHorizontal[1];
+	result.LocalWorkSize[2] = 1;
+	CRoofline::GetSingleton().Report(result);
+	CResultsSink::GetSingleton().Add(result);
 
-	}
+	//copy the results back to the CPU (or map them)
+	if(!DownloadResults(CommandQueue, numChannels))
+		return;
 
 	SaveImage("Images/GPUResultSeparable_" + m_OutFileName + ".pfm", m_hGPUResultChannels);
 }
@@ -180,45 +242,102 @@ void CConvolutionSeparableTask::ComputeCPU()
 		runTime += ConvolutionChannelCPU(iChannel);
 	}
 
-	cout<<"  CPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s" <<endl;
+	cout<<"  CPU time: "<<runTime<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / runTime << " Gpixels/s ("
+		<< CThreadPool::GetSingleton().GetThreadCount() << " threads)" <<endl;
+
+	// vectorized CPU baseline, computed into separate buffers so the reference stays untouched
+	vector<float> resultSIMD(m_Pitch * m_Height), workingSIMD(m_Pitch * m_Height);
+	double runTimeSIMD = 0.0;
+	float maxError = 0;
+	for(unsigned int iChannel = 0; iChannel < 3; iChannel++)
+	{
+		runTimeSIMD += ConvolutionChannelCPUSIMD(iChannel, &resultSIMD[0], &workingSIMD[0]);
+		maxError = max(maxError, MaxErrorToCPUResult(iChannel, &resultSIMD[0]));
+	}
+	ReportCPUSIMD(runTimeSIMD, maxError, 1, 4.0 * sizeof(float) * m_Width * m_Height * 3);
 
 	SaveImage("Images/CPUResultSeparable_" + m_OutFileName + ".pfm", m_hCPUResultChannels);
 }
 
 double CConvolutionSeparableTask::ConvolutionChannelCPU(unsigned int Channel)
 {
+	// the passes are split into bands of rows (columns), each pixel is computed as in the serial code
+	CThreadPool& pool = CThreadPool::GetSingleton();
+
 	CTimer timer;
 	timer.Start();
 
 	//horizontal pass
-	for(int y = 0; y < (int)m_Height; y++)
-		for(int x = 0; x < (int)m_Width; x++)
-		{
-			float value = 0;
-			//apply horizontal kernel
-			for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
+	pool.ParallelFor(0, m_Height, [&](size_t First, size_t Last) {
+		for(int y = (int)First; y < (int)Last; y++)
+			for(int x = 0; x < (int)m_Width; x++)
 			{
-				int sx = x + k;
-				if(sx >= 0 && sx < (int)m_Width)
-					value += m_hSourceChannels[Channel][y * m_Pitch + sx] * m_hKernelHorizontal[m_KernelRadius - k];
+				float value = 0;
+				//apply horizontal kernel
+				for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
+				{
+					int sx = x + k;
+					if(sx >= 0 && sx < (int)m_Width)
+						value += m_hSourceChannels[Channel][y * m_Pitch + sx] * m_hKernelHorizontal[m_KernelRadius - k];
+				}
+				m_hCPUWorkingBuffer[y * m_Pitch + x] = value;
 			}
-			m_hCPUWorkingBuffer[y * m_Pitch + x] = value;
-		}
+	});
 
 	//vertical pass
-	for(int x = 0; x < (int)m_Width; x++)
-		for(int y = 0; y < (int)m_Height; y++)
+	pool.ParallelFor(0, m_Width, [&](size_t First, size_t Last) {
+		for(int x = (int)First; x < (int)Last; x++)
+			for(int y = 0; y < (int)m_Height; y++)
+			{
+				float value = 0;
+				//apply horizontal kernel
+				for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
+				{
+					int sy = y + k;
+					if(sy >= 0 && sy < (int)m_Height)
+						value += m_hCPUWorkingBuffer[sy * m_Pitch + x] * m_hKernelVertical[m_KernelRadius - k];
+				}
+				m_hCPUResultChannels[Channel][y * m_Pitch + x] = value;
+			}
+	});
+
+	timer.Stop();
+
+	return timer.GetElapsedMilliseconds();
+}
+
+double CConvolutionSeparableTask::ConvolutionChannelCPUSIMD(unsigned int Channel, float* Result, float* WorkingBuffer)
+{
+	CThreadPool& pool = CThreadPool::GetSingleton();
+	const SSimdKernels& simd = CSimd::GetSingleton().GetKernels();
+
+	CTimer timer;
+	timer.Start();
+
+	//horizontal pass: one FIR per row
+	pool.ParallelFor(0, m_Height, [&](size_t First, size_t Last) {
+		for(int y = (int)First; y < (int)Last; y++)
+		{
+			float* dst = WorkingBuffer + y * m_Pitch;
+			fill(dst, dst + m_Width, 0.0f);
+			simd.ConvolveRowAdd(m_hSourceChannels[Channel] + y * m_Pitch, dst, m_Width, m_hKernelHorizontal, m_KernelRadius);
+		}
+	});
+
+	//vertical pass: weighted sum of whole rows, in the same order as the reference
+	pool.ParallelFor(0, m_Height, [&](size_t First, size_t Last) {
+		for(int y = (int)First; y < (int)Last; y++)
 		{
-			float value = 0;
-			//apply horizontal kernel
+			float* dst = Result + y * m_Pitch;
+			fill(dst, dst + m_Width, 0.0f);
 			for(int k = -m_KernelRadius; k <= m_KernelRadius; k++)
 			{
 				int sy = y + k;
 				if(sy >= 0 && sy < (int)m_Height)
-					value += m_hCPUWorkingBuffer[sy * m_Pitch + x] * m_hKernelVertical[m_KernelRadius - k];
+					simd.AxpyRow(WorkingBuffer + sy * m_Pitch, dst, m_Width, m_hKernelVertical[m_KernelRadius - k]);
 			}
-			m_hCPUResultChannels[Channel][y * m_Pitch + x] = value;
 		}
+	});
 
 	timer.Stop();
 
@@ -230,10 +349,10 @@ double CConvolutionSeparableTask::ConvolutionChannelGPU(unsigned int Channel, cl
 	cl_int clErr;
 
 	clErr  = clSetKernelArg(m_HorizontalKernel, 0, sizeof(cl_mem), (void*)&m_dGPUWorkingBuffer);
-	clErr |= clSetKernelArg(m_HorizontalKernel, 1, sizeof(cl_mem), (void*)&m_dSourceChannels[Channel]);
+	clErr |= clSetKernelArg(m_HorizontalKernel, 1, sizeof(cl_mem), (void*)&m_SourceChannels[Channel].GetDeviceBuffer());
 	V_RETURN_0_CL(clErr, "Error setting horizontal kernel arguments");
 
-	clErr  = clSetKernelArg(m_VerticalKernel, 0, sizeof(cl_mem), (void*)&m_dResultChannels[Channel]);
+	clErr  = clSetKernelArg(m_VerticalKernel, 0, sizeof(cl_mem), (void*)&m_ResultChannels[Channel].GetDeviceBuffer());
 	clErr |= clSetKernelArg(m_VerticalKernel, 1, sizeof(cl_mem), (void*)&m_dGPUWorkingBuffer);
 	V_RETURN_0_CL(clErr, "Error setting vertical kernel arguments");
 
@@ -244,13 +363,13 @@ double CConvolutionSeparableTask::ConvolutionChannelGPU(unsigned int Channel, cl
 		CLUtil::GetGlobalWorkSize(m_Width / m_StepsHorizontal, m_LocalSizeHorizontal[0]),
 		CLUtil::GetGlobalWorkSize(m_Height, m_LocalSizeHorizontal[1])
 	};
-	runTime = CLUtil::ProfileKernel(CommandQueue, m_HorizontalKernel, 2, globalWorkSizeH, m_LocalSizeHorizontal, NIterations);
+	runTime = ProfileKernel(CommandQueue, m_HorizontalKernel, "ConvHorizontal", globalWorkSizeH, m_LocalSizeHorizontal, NIterations, Channel == 0);
 
 	size_t globalWorkSizeV[2] = {
 		CLUtil::GetGlobalWorkSize(m_Width, m_LocalSizeVertical[0]),
 		CLUtil::GetGlobalWorkSize(m_Height / m_StepsVertical, m_LocalSizeVertical[1])
 	};
-	runTime += CLUtil::ProfileKernel(CommandQueue, m_VerticalKernel, 2, globalWorkSizeV, m_LocalSizeVertical, NIterations);
+	runTime += ProfileKernel(CommandQueue, m_VerticalKernel, "ConvVertical", globalWorkSizeV, m_LocalSizeVertical, NIterations, Channel == 0);
 
 	return runTime;
 }
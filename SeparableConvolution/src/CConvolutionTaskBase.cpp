@@ -6,15 +6,22 @@ GPU Computing / GPGPU Praktikum source code.
 #include "CConvolutionTaskBase.h"
 
 #include "../Common/CLUtil.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CSimd.h"
+#include "../Common/CStreamPipeline.h"
+#include "../Common/CBufferPool.h"
+#include "../Common/CTracer.h"
 
 #include "Pfm.h"
 
 #include <sstream>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 #include <assert.h>
 #include <cstdint>
 #include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -34,7 +41,12 @@ CConvolutionTaskBase::~CConvolutionTaskBase()
 bool CConvolutionTaskBase::InitResources(cl_device_id , cl_context Context)
 {
 	PFM inputPfm;
-	if (!inputPfm.LoadRGB(m_FileName.c_str())) {
+	bool loaded;
+	{
+		CTraceZone zone("LoadPFM");
+		loaded = inputPfm.LoadRGB(m_FileName.c_str());
+	}
+	if (!loaded) {
 		cerr<<"Error loading file: " << m_FileName.c_str() << "." << endl;
 		return false;
 	}
@@ -49,12 +61,18 @@ bool CConvolutionTaskBase::InitResources(cl_device_id , cl_context Context)
 
 	cout<<"Size of image: "<<m_Width<<" x "<<m_Height<<endl;
 
-	//allocate data for the float channels
+	unsigned int dataSize = m_Pitch * m_Height * sizeof(cl_float);
+
+	//allocate data for the float channels, the source channels are filled in place
 	for(int i = 0; i < 3; i++)
 	{
-		m_hSourceChannels[i] = new float[m_Height * m_Pitch];
+		if(!m_SourceChannels[i].Allocate(Context, dataSize, CL_MEM_READ_ONLY) ||
+			!m_ResultChannels[i].Allocate(Context, dataSize, CL_MEM_WRITE_ONLY))
+			return false;
+
+		m_hSourceChannels[i] = m_SourceChannels[i].Get<float>();
 		m_hCPUResultChannels[i] = new float[m_Height * m_Pitch];
-		m_hGPUResultChannels[i] = new float[m_Height * m_Pitch];
+		m_hGPUResultChannels[i] = NULL;
 	}
 
 	//extract R, G, B channels
@@ -87,18 +105,6 @@ bool CConvolutionTaskBase::InitResources(cl_device_id , cl_context Context)
 		pixelOffset += m_Pitch - m_Width;
 	}
 
-	unsigned int dataSize = m_Pitch * m_Height * sizeof(cl_float);
-
-	cl_int clError;
-	for(int i = 0; i < 3; i++)
-	{
-		m_dSourceChannels[i] = clCreateBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dataSize, m_hSourceChannels[i], &clError);
-		V_RETURN_FALSE_CL(clError, "Error allocating device input array");
-
-		m_dResultChannels[i] = clCreateBuffer(Context, CL_MEM_WRITE_ONLY, dataSize, NULL, &clError);
-		V_RETURN_FALSE_CL(clError, "Error allocating device output array");
-	}
-
 	return true;
 }
 
@@ -106,12 +112,12 @@ void CConvolutionTaskBase::ReleaseResources()
 {
 	for(int i = 0; i < 3; i++)
 	{
-		SAFE_DELETE_ARRAY( m_hSourceChannels[i] );
+		m_hSourceChannels[i] = NULL;
 		SAFE_DELETE_ARRAY( m_hCPUResultChannels[i] );
-		SAFE_DELETE_ARRAY( m_hGPUResultChannels[i] );
+		m_hGPUResultChannels[i] = NULL;
 
-		SAFE_RELEASE_MEMOBJECT( m_dSourceChannels[i] );
-		SAFE_RELEASE_MEMOBJECT( m_dResultChannels[i] );
+		m_SourceChannels[i].Release();
+		m_ResultChannels[i].Release();
 	}
 }
 
@@ -120,6 +126,10 @@ bool CConvolutionTaskBase::ValidateResults()
 	//number of channels to compute
 	unsigned int numChannels = m_Monochrome ? 1 : 3;
 
+	for(unsigned int i = 0; i < numChannels; i++)
+		if(m_hGPUResultChannels[i] == NULL)
+			return false;
+
 	//calculate the average squared difference
 	float avgError = 0;
 	float maxError = 0;
@@ -153,7 +163,127 @@ bool CConvolutionTaskBase::ValidateResults()
 	strm<<"Images/DifferenceImage"<<m_FileNamePostfix<<".pfm";
 	SaveImage(strm.str().c_str(), m_hCPUResultChannels);
 
-	return (avgError < 1e-10f && maxError < 1e-8);
+	return (avgError < 1e-10f && maxError < 1e-8) && m_PipelineValid;
+}
+
+bool CConvolutionTaskBase::UploadSources(cl_command_queue CommandQueue)
+{
+	CTraceZone zone("UploadSources");
+	for(int i = 0; i < 3; i++)
+	{
+		V_RETURN_FALSE_CL(m_SourceChannels[i].Upload(CommandQueue), "Error copying the source channels to the device!");
+		m_hSourceChannels[i] = NULL;
+	}
+	return true;
+}
+
+bool CConvolutionTaskBase::DownloadResults(cl_command_queue CommandQueue, unsigned int NChannels)
+{
+	CTraceZone zone("DownloadResults");
+	for(unsigned int i = 0; i < NChannels; i++)
+	{
+		V_RETURN_FALSE_CL(m_ResultChannels[i].Download(CommandQueue), "Error reading back results from the device!");
+		m_hGPUResultChannels[i] = m_ResultChannels[i].Get<float>();
+	}
+	return true;
+}
+
+float CConvolutionTaskBase::MaxErrorToCPUResult(unsigned int Channel, const float* Result)
+{
+	float maxError = 0;
+	for(unsigned int y = 0; y < m_Height; y++)
+		for(unsigned int x = 0; x < m_Width; x++)
+			maxError = max(maxError, fabsf(Result[y * m_Pitch + x] - m_hCPUResultChannels[Channel][y * m_Pitch + x]));
+	return maxError;
+}
+
+void CConvolutionTaskBase::ReportCPUSIMD(double Ms, float MaxError, int NIterations, double BytesMoved)
+{
+	ESimdLevel level = CSimd::GetSingleton().GetLevel();
+	cout<<"  CPU-SIMD ("<<CSimd::GetLevelName(level)<<") average time: "<<Ms<<" ms, throughput: "<< 1.0e-6 * m_Width * m_Height / Ms
+		<< " Gpixels/s, max. abs. error: "<<MaxError<<(MaxError < 1e-4f ? "" : " RESULT DIFFERS")<<endl;
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("CPU-SIMD", size_t(m_Width) * m_Height, NIterations, Ms, BytesMoved));
+}
+
+void CConvolutionTaskBase::RunPipelined(cl_context Context, cl_command_queue CommandQueue, unsigned int Channel,
+	unsigned int HaloRows, unsigned int RowGranularity, const BandFunc& EnqueueBand)
+{
+	// about eight bands, triple buffered
+	unsigned int granularity = max(RowGranularity, 1u);
+	unsigned int halo = (HaloRows + granularity - 1) / granularity * granularity;
+	unsigned int bandRows = ((m_Height + 7) / 8 + granularity - 1) / granularity * granularity;
+	// kernels without a check of the image height may write up to a full granule past the band
+	unsigned int capacityRows = bandRows + 2 * halo + granularity;
+	size_t rowBytes = m_Pitch * sizeof(cl_float);
+
+	CStreamPipeline pipeline(3);
+	vector<cl_mem> buffers(3 * pipeline.GetSlotCount(), (cl_mem)NULL);
+	vector<float> result(m_Pitch * m_Height, 0.0f);
+	float* source = m_hSourceChannels[Channel];
+
+	// rows of the band image of a slice: [Begin - top, End + bottom)
+	auto bandTop = [&](const SPipelineSlice& Slice) { return (unsigned int)min<size_t>(halo, Slice.Begin); };
+	auto bandBottom = [&](const SPipelineSlice& Slice) { return (unsigned int)min<size_t>(halo, m_Height - Slice.End); };
+
+	pipeline.SetStages(
+		[&](cl_command_queue Queue, const SPipelineSlice& Slice, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+			size_t first = Slice.Begin - bandTop(Slice);
+			size_t rows = Slice.End + bandBottom(Slice) - first;
+			return clEnqueueWriteBuffer(Queue, buffers[3 * Slice.Slot], CL_FALSE, 0, rows * rowBytes, source + first * m_Pitch,
+				NWait, WaitList, Done);
+		},
+		[&](cl_command_queue Queue, const SPipelineSlice& Slice, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+			unsigned int rows = bandTop(Slice) + (unsigned int)(Slice.End - Slice.Begin) + bandBottom(Slice);
+			cl_mem* slot = &buffers[3 * Slice.Slot];
+			return EnqueueBand(Queue, slot[1], slot[0], slot[2], rows, NWait, WaitList, Done);
+		},
+		[&](cl_command_queue Queue, const SPipelineSlice& Slice, cl_uint NWait, const cl_event* WaitList, cl_event* Done) -> cl_int {
+			return clEnqueueReadBuffer(Queue, buffers[3 * Slice.Slot + 1], CL_FALSE, bandTop(Slice) * rowBytes,
+				(Slice.End - Slice.Begin) * rowBytes, &result[Slice.Begin * m_Pitch], NWait, WaitList, Done);
+		});
+
+	// source, result and scratch buffer of each slot
+	cl_int clError = CL_SUCCESS;
+	for(size_t i = 0; i < buffers.size() && clError == CL_SUCCESS; i++)
+		buffers[i] = CBufferPool::GetSingleton().Acquire(Context, CL_MEM_READ_WRITE, capacityRows * rowBytes, &clError);
+
+	// best of three runs, the first one also serves as warm-up
+	vector<cl_command_queue> queues = CStreamPipeline::GetCommandQueues(CommandQueue);
+	double serialMs = -1.0, pipelinedMs = -1.0;
+	for(int run = 0; run < 3 && clError == CL_SUCCESS; run++)
+	{
+		double ms = pipeline.Run(vector<cl_command_queue>(1, CommandQueue), m_Height, bandRows);
+		if(ms >= 0.0 && (serialMs < 0.0 || ms < serialMs))
+			serialMs = ms;
+		ms = pipeline.Run(queues, m_Height, bandRows);
+		if(ms >= 0.0 && (pipelinedMs < 0.0 || ms < pipelinedMs))
+			pipelinedMs = ms;
+	}
+
+	for(size_t i = 0; i < buffers.size(); i++)
+		SAFE_RELEASE_POOLED(buffers[i]);
+
+	if(clError != CL_SUCCESS || serialMs < 0.0 || pipelinedMs < 0.0)
+	{
+		cerr<<"Error running the convolution pipeline ["<<CLUtil::GetCLErrorString(clError)<<"]"<<endl;
+		m_PipelineValid = false;
+		return;
+	}
+
+	// the last line is ignored as in ValidateResults()
+	float maxError = 0;
+	for(unsigned int y = 0; y + 1 < m_Height; y++)
+		for(unsigned int x = 0; x < m_Width; x++)
+			maxError = max(maxError, fabsf(result[y * m_Pitch + x] - m_hCPUResultChannels[Channel][y * m_Pitch + x]));
+	m_PipelineValid = maxError < 1e-4f;
+
+	// one channel is uploaded and downloaded once, plus the halo rows
+	cout<<"  Pipeline ("<<queues.size()<<" queues, "<<(m_Height + bandRows - 1) / bandRows<<" bands of "<<bandRows<<" rows): "
+		<<pipelinedMs<<" ms, serialized: "<<serialMs<<" ms, speedup "<<serialMs / pipelinedMs<<"x, max. abs. error: "<<maxError
+		<<(m_PipelineValid ? "" : " RESULT DIFFERS")<<endl;
+	double bytesMoved = 2.0 * sizeof(float) * m_Width * m_Height;
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("Pipeline-serial", size_t(m_Width) * m_Height, 1, serialMs, bytesMoved));
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("Pipeline", size_t(m_Width) * m_Height, 1, pipelinedMs, bytesMoved));
 }
 
 #ifdef HAVE_BIG_ENDIAN
@@ -220,6 +350,7 @@ save_image_bmp(const char *path, unsigned char *data, int width, int height)
 void CConvolutionTaskBase::SaveImage(const std::string& FileName, float* Channels[3])
 {
 	// Save the result back to the disk
+	CTraceZone zone("SaveImage");
 	PFM resPfm;
 	resPfm.pImg = new float[m_Width * m_Height * 3];
 	unsigned int pfmOffset = 0;
@@ -290,6 +421,19 @@ void CConvolutionTaskBase::SaveIntImage(const std::string& FileName, int* Channe
 	}
 }
 
+double CConvolutionTaskBase::ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+	const size_t GlobalWorkSize[2], const size_t LocalWorkSize[2], int NIterations, bool PrintProfile)
+{
+	SKernelProfile profile;
+	if(!CLUtil::ProfileKernelEvents(CommandQueue, Kernel, 2, GlobalWorkSize, LocalWorkSize, NIterations, profile))
+		return CLUtil::ProfileKernel(CommandQueue, Kernel, 2, GlobalWorkSize, LocalWorkSize, NIterations);
+
+	if(PrintProfile)
+		CLUtil::PrintKernelProfile(KernelName, profile);
+
+	return profile.StartToEnd.Mean;
+}
+
 float CConvolutionTaskBase::RGBToGrayScale(float R, float G, float B)
 {
 	return 0.3f * R + 0.59f * G + 0.11f * B;
@@ -21,8 +21,10 @@
 #define _CCONVOLUTION_TASK_BASE_H
 
 #include "../Common/IComputeTask.h"
+#include "../Common/CHostBuffer.h"
 
 #include <string>
+#include <functional>
 
 //! Abstract base class for all convolution tasks
 /*!
@@ -49,6 +51,45 @@ protected:
 	void SaveImage(const std::string& FileName, float* Channels[3]);
 	void SaveIntImage(const std::string& FileName, int* Channel);
 
+	//! Profiles a 2D kernel and returns its average execution time in ms
+	/*!
+		Uses the device timestamps of each launch if the queue supports profiling, so the
+		launch overhead is not included. Falls back to CLUtil::ProfileKernel() otherwise.
+		If PrintProfile is true, the distribution of the device-side intervals is printed.
+	*/
+	double ProfileKernel(cl_command_queue CommandQueue, cl_kernel Kernel, const std::string& KernelName,
+		const size_t GlobalWorkSize[2], const size_t LocalWorkSize[2], int NIterations, bool PrintProfile);
+
+	//! Makes the source channels available to the kernels (copied or unmapped, see CMirroredBuffer)
+	bool UploadSources(cl_command_queue CommandQueue);
+
+	//! Makes the first NChannels result channels of the kernels available in m_hGPUResultChannels
+	bool DownloadResults(cl_command_queue CommandQueue, unsigned int NChannels);
+
+	//! Largest absolute difference between Result and the CPU reference of the channel
+	float MaxErrorToCPUResult(unsigned int Channel, const float* Result);
+
+	//! Prints the average time of one pass of a vectorized CPU baseline and reports it to the results sink
+	/*!
+		The SIMD baselines may contract multiply-adds, so they are compared with a
+		tolerance (MaxError, see MaxErrorToCPUResult()) instead of bit-exact.
+	*/
+	void ReportCPUSIMD(double Ms, float MaxError, int NIterations, double BytesMoved);
+
+	//! Enqueues the convolution of a band of Rows rows (same width and pitch as the image) from Src to Dst, Scratch is a buffer of the same size
+	typedef std::function<cl_int(cl_command_queue CommandQueue, cl_mem Dst, cl_mem Src, cl_mem Scratch, unsigned int Rows,
+		cl_uint NWait, const cl_event* WaitList, cl_event* Done)> BandFunc;
+
+	//! Convolves a channel in bands of rows with CStreamPipeline and compares the overlapped with the serialized execution
+	/*!
+		Each band is uploaded with HaloRows extra rows above and below (clipped at the image border),
+		convolved as an image of its own, and only its inner rows are downloaded. Bands and halos are
+		multiples of RowGranularity, so the kernels see the same tiling as for the whole image.
+		Has to be called before UploadSources(), the result is checked in ValidateResults().
+	*/
+	void RunPipelined(cl_context Context, cl_command_queue CommandQueue, unsigned int Channel,
+		unsigned int HaloRows, unsigned int RowGranularity, const BandFunc& EnqueueBand);
+
 	// helper functions:
 	
 	// one grayscale floating point value out of RGB
@@ -68,13 +109,17 @@ protected:
 	unsigned int	m_Width  = 0;
 	unsigned int	m_Pitch  = 0;
 
-	float*			m_hSourceChannels[3]    /*= { nullptr, nullptr, nullptr }*/; //R, G, B channels
+	float*			m_hSourceChannels[3]    /*= { nullptr, nullptr, nullptr }*/; //R, G, B channels (host side of m_SourceChannels, valid until UploadSources())
 	float*			m_hCPUResultChannels[3] /*= { nullptr, nullptr, nullptr }*/; //the convolved image
-	float*			m_hGPUResultChannels[3] /*= { nullptr, nullptr, nullptr }*/; //the convolved image
+	float*			m_hGPUResultChannels[3] /*= { nullptr, nullptr, nullptr }*/; //the convolved image (host side of m_ResultChannels after DownloadResults())
 
 	//we process exactly one channel on the GPU in the same time
-	cl_mem			m_dSourceChannels[3] /*= { nullptr, nullptr, nullptr}*/;
-	cl_mem			m_dResultChannels[3] /*= { nullptr, nullptr, nullptr}*/;
+	//(copied or mapped depending on the buffer mode, in zero-copy mode the kernels work on the host memory)
+	CMirroredBuffer	m_SourceChannels[3];
+	CMirroredBuffer	m_ResultChannels[3];
+
+	//false if the banded result of RunPipelined() differs from the CPU reference
+	bool			m_PipelineValid = true;
 
 };
 
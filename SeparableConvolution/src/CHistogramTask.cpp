@@ -1,9 +1,17 @@
 #include "CHistogramTask.h"
 #include "../Common/CLUtil.h"
 #include "../Common/CTimer.h"
+#include "../Common/CResultsSink.h"
+#include "../Common/CRoofline.h"
+#include "../Common/CThreadPool.h"
+#include "../Common/CSimd.h"
+#include "../Common/CTracer.h"
+#include "../Common/CStatistics.h"
+#include "../Common/CKernelLibrary.h"
 #include "Pfm.h"
 #include <string.h>
 #include <cassert>
+#include <algorithm>
 
 CHistogramTask::
 CHistogramTask(float min_val, float max_val, bool use_local_memory, const std::string &img_path)
@@ -25,7 +33,12 @@ InitResources(cl_device_id dev, cl_context ctx)
 {
 	cl_int err;
 	PFM img;
-	if(!img.LoadRGB(m_img_path.c_str())) {
+	bool loaded;
+	{
+		CTraceZone zone("LoadPFM");
+		loaded = img.LoadRGB(m_img_path.c_str());
+	}
+	if(!loaded) {
 		std::cerr << "Error loading image: \"" << m_img_path << "\"!" << std::endl;
 		return false;
 	}
@@ -56,11 +69,7 @@ InitResources(cl_device_id dev, cl_context ctx)
 	V_RETURN_FALSE_CL(err, "Failed to allocate device memory");
 
 
-	std::string src;
-	if(!CLUtil::LoadProgramSourceToMemory("histogram.cl", src))
-		return false;
-
-	m_program = CLUtil::BuildCLProgramFromMemory(dev, ctx, src);
+	m_program = CKernelLibrary::GetSingleton().Build(dev, ctx, "histogram.cl");
 	if(!m_program)
 		return false;
 
@@ -147,23 +156,31 @@ ComputeGPU(cl_context ctx, cl_command_queue cmdq, size_t lws[3])
 		((m_img_height + lws[1] - 1) / lws[1]) * lws[1]
 	};
 
-	CTimer timer;
 	clFinish(cmdq);
-	timer.Start();
 
+	// every iteration is timed on its own, the first two are warm-up
 	const int num_iterations = 100;
-	for(int i = 0; i < num_iterations; i++) {
+	CStatistics stats(2);
+	for(int i = 0; i < num_iterations + 2; i++) {
+		CScopedTimer timer(stats);
 		clEnqueueNDRangeKernel(cmdq, m_kernel_set_to_val, 1, NULL, &global_size_clear, &local_size_clear, 0, NULL, NULL);
 
 		clEnqueueNDRangeKernel(cmdq, m_kernel_histogram, 2, NULL, global_size, lws, 0, NULL, NULL);
+		clFinish(cmdq);
 	}
-	clFinish(cmdq);
-	timer.Stop();
 
 	const char *prefix = m_use_local_memory
 		? "  Histogram GPU time (using local memory): "
 		: "  Histogram GPU time (no local memory): ";
-	std::cout << prefix << timer.GetElapsedMilliseconds() / float(num_iterations) << " ms\n";
+	double ms = stats.GetRobustMean();
+	std::cout << prefix << ms << " ms (median " << stats.GetMedian() << ", p95 " << stats.GetPercentile(0.95) << ")\n";
+
+	// every pixel is read once and scaled to its bin
+	SBenchmarkResult result(m_use_local_memory ? "local_memory" : "global_atomics",
+		size_t(m_img_width) * m_img_height, stats, sizeof(float) * double(m_img_width) * m_img_height,
+		double(m_img_width) * m_img_height);
+	CRoofline::GetSingleton().Report(result);
+	CResultsSink::GetSingleton().Add(result);
 
 	m_histogram_gpu.resize(NUM_HIST_BINS);
 
@@ -175,19 +192,57 @@ ComputeGPU(cl_context ctx, cl_command_queue cmdq, size_t lws[3])
 void CHistogramTask::
 ComputeCPU()
 {
-	m_histogram.assign(NUM_HIST_BINS, 0);
 	CTimer timer;
 	timer.Start();
-	for(int y = 0; y < m_img_height; y++) {
-		for(int x = 0; x < m_img_width; x++) {
-			float p = m_pixels[y * m_img_stride + x] * float(NUM_HIST_BINS);
-			int h_idx = std::min<int>(NUM_HIST_BINS - 1, std::max<int>(0, int(p)));
-			m_histogram[h_idx]++;
+	// every band of rows gets its own histogram, these are summed up afterwards
+	auto histogram_rows = [this](size_t first, size_t last) {
+		std::vector<int> histogram(NUM_HIST_BINS, 0);
+		for(int y = int(first); y < int(last); y++) {
+			for(int x = 0; x < m_img_width; x++) {
+				float p = m_pixels[y * m_img_stride + x] * float(NUM_HIST_BINS);
+				int h_idx = std::min<int>(NUM_HIST_BINS - 1, std::max<int>(0, int(p)));
+				histogram[h_idx]++;
+			}
 		}
-	}
+		return histogram;
+	};
+	auto add_histograms = [](std::vector<int> a, const std::vector<int>& b) {
+		for(size_t i = 0; i < a.size(); i++)
+			a[i] += b[i];
+		return a;
+	};
+	m_histogram = CThreadPool::GetSingleton().ParallelReduce(0, m_img_height,
+		std::vector<int>(NUM_HIST_BINS, 0), histogram_rows, add_histograms);
 	timer.Stop();
 
 	std::cout << "  Histogram CPU time: " << timer.GetElapsedMilliseconds() << " ms\n";
+
+	// vectorized baseline: the bin indices are computed in SIMD registers, the increments stay scalar
+	const SSimdKernels &simd = CSimd::GetSingleton().GetKernels();
+	CTimer timer_simd;
+	timer_simd.Start();
+	auto histogram_rows_simd = [&](size_t first, size_t last) {
+		std::vector<unsigned int> histogram(NUM_HIST_BINS, 0);
+		for(int y = int(first); y < int(last); y++)
+			simd.HistogramRow(&m_pixels[y * m_img_stride], m_img_width, NUM_HIST_BINS, histogram.data());
+		return histogram;
+	};
+	auto add_histograms_simd = [](std::vector<unsigned int> a, const std::vector<unsigned int>& b) {
+		for(size_t i = 0; i < a.size(); i++)
+			a[i] += b[i];
+		return a;
+	};
+	std::vector<unsigned int> histogram_simd = CThreadPool::GetSingleton().ParallelReduce(0, m_img_height,
+		std::vector<unsigned int>(NUM_HIST_BINS, 0), histogram_rows_simd, add_histograms_simd);
+	timer_simd.Stop();
+
+	bool is_same = std::equal(m_histogram.begin(), m_histogram.end(), histogram_simd.begin(),
+		[](int a, unsigned int b) { return unsigned(a) == b; });
+	double ms = timer_simd.GetElapsedMilliseconds();
+	std::cout << "  Histogram CPU-SIMD (" << CSimd::GetLevelName(simd.Level) << ") time: " << ms << " ms"
+		<< (is_same ? "" : ", RESULT DIFFERS") << "\n";
+	CResultsSink::GetSingleton().Add(SBenchmarkResult("CPU-SIMD", size_t(m_img_width) * m_img_height, 1, ms,
+		double(sizeof(float)) * m_img_width * m_img_height));
 }
 
 bool CHistogramTask::
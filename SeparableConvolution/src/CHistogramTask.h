@@ -17,6 +17,7 @@ public:
 	virtual void ComputeGPU(cl_context ctx, cl_command_queue cmdq, size_t lws[3]) override;
 	virtual void ComputeCPU() override;
 	virtual bool ValidateResults() override;
+	virtual std::string GetName() const override { return "Histogram"; }
 
 protected:
 	float m_min_val = 0.0f, m_max_val = 1.0f;
@@ -13,10 +13,11 @@ int main(int argc, char** argv)
 {
 	CAssignment3 myAssignment;
 
-	myAssignment.EnterMainLoop(argc, argv);
+	auto success = myAssignment.EnterMainLoop(argc, argv);
 
 #ifdef _MSC_VER
 	cout<<"Press any key..."<<endl;
 	cin.get();
 #endif
+	return success ? 0 : 1;
 }